@@ -18,12 +18,27 @@
 
 #include <algorithm>
 #include <cmath>
+#include <string>
+#include <vector>
 
+#include <pficommon/lang/bind.h>
+
+#include "../common/parallel.hpp"
 #include "../common/vector_util.hpp"
 
+using std::string;
+using std::vector;
+
 namespace jubatus {
 namespace anomaly {
 
+namespace {
+
+// smallest number of queries scored by one thread
+const size_t MIN_SCORE_CHUNK_SIZE = 8;
+
+}  // namespace
+
 const uint32_t anomaly_base::NEIGHBOR_NUM = 10;
 
 anomaly_base::anomaly_base() {
@@ -44,5 +59,43 @@ void anomaly_base::load(std::istream& is) {
   load_impl(is);
 }
 
+void anomaly_base::calc_anomaly_scores(
+    const vector<sfv_t>& queries,
+    vector<float>& scores,
+    size_t thread_num) const {
+  scores_batch<sfv_t> batch = {&queries, &scores};
+  run_calc_scores(batch, thread_num);
+}
+
+void anomaly_base::calc_anomaly_scores(
+    const vector<string>& ids,
+    vector<float>& scores,
+    size_t thread_num) const {
+  scores_batch<string> batch = {&ids, &scores};
+  run_calc_scores(batch, thread_num);
+}
+
+template <typename Query>
+void anomaly_base::calc_scores_range(
+    const scores_batch<Query>* batch,
+    size_t begin,
+    size_t end) const {
+  for (size_t i = begin; i < end; ++i) {
+    (*batch->scores)[i] = calc_anomaly_score((*batch->queries)[i]);
+  }
+}
+
+template <typename Query>
+void anomaly_base::run_calc_scores(
+    const scores_batch<Query>& batch,
+    size_t thread_num) const {
+  const size_t size = batch.queries->size();
+  batch.scores->resize(size);
+  common::run_chunks(
+      pfi::lang::bind(&anomaly_base::calc_scores_range<Query>, this, &batch,
+                      pfi::lang::_2, pfi::lang::_3),
+      size, common::get_chunk_num(size, thread_num, MIN_SCORE_CHUNK_SIZE));
+}
+
 }  // namespace anomaly
 }  // namespace jubatus
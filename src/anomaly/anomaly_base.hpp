@@ -39,6 +39,16 @@ class anomaly_base {
   // return anomaly score of query
   virtual float calc_anomaly_score(const sfv_t& query) const = 0;
   virtual float calc_anomaly_score(const std::string& id) const = 0;
+  // Batch versions of calc_anomaly_score. Queries are split into at most
+  // thread_num chunks calculated concurrently.
+  void calc_anomaly_scores(
+      const std::vector<sfv_t>& queries,
+      std::vector<float>& scores,
+      size_t thread_num) const;
+  void calc_anomaly_scores(
+      const std::vector<std::string>& ids,
+      std::vector<float>& scores,
+      size_t thread_num) const;
   virtual void clear() = 0;
   virtual void clear_row(const std::string& id) = 0;
   virtual void update_row(const std::string& id, const sfv_diff_t& diff) = 0;
@@ -61,6 +71,23 @@ class anomaly_base {
   virtual bool load_impl(std::istream&) = 0;
 
   storage::sparse_matrix_storage orig_;
+
+ private:
+  template <typename Query>
+  struct scores_batch {
+    const std::vector<Query>* queries;
+    std::vector<float>* scores;
+  };
+
+  template <typename Query>
+  void calc_scores_range(
+      const scores_batch<Query>* batch,
+      size_t begin,
+      size_t end) const;
+  template <typename Query>
+  void run_calc_scores(
+      const scores_batch<Query>& batch,
+      size_t thread_num) const;
 };
 
 }  // namespace anomaly
@@ -22,7 +22,6 @@
 #include <vector>
 
 #include <glog/logging.h>
-#include <pficommon/data/serialization.h>
 #include <pficommon/lang/cast.h>
 #include <pficommon/math/random.h>
 
@@ -122,15 +121,11 @@ const storage::anomaly_storage_base* lof::get_const_storage() const {
 }
 
 bool lof::save_impl(ostream& os) {
-  pfi::data::serialization::binary_oarchive oa(os);
-  oa << lof_index_;
-  return true;
+  return lof_index_.save(os);
 }
 
 bool lof::load_impl(istream& is) {
-  pfi::data::serialization::binary_iarchive ia(is);
-  ia >> lof_index_;
-  return true;
+  return lof_index_.load(is);
 }
 
 }  // namespace anomaly
@@ -24,9 +24,13 @@
 #include <utility>
 #include <vector>
 
+#include <pficommon/lang/bind.h>
+#include <pficommon/lang/cast.h>
+
 #include "anomaly_type.hpp"
 #include "../common/exception.hpp"
 #include "../common/jsonconfig.hpp"
+#include "../common/parallel.hpp"
 #include "../recommender/euclid_lsh.hpp"
 #include "../recommender/recommender_factory.hpp"
 
@@ -52,6 +56,19 @@ namespace storage {
 const uint32_t lof_storage::DEFAULT_NEIGHBOR_NUM = 10;
 const uint32_t lof_storage::DEFAULT_REVERSE_NN_NUM = 30;
 
+namespace {
+
+// smallest number of rows updated by one thread of update_entries
+const size_t MIN_UPDATE_CHUNK_SIZE = 16;
+
+// Marks models saved in the versioned format. Models saved before it begin
+// with the size of lof_table_, which is never 0xffffffff.
+const char FORMAT_MARKER[] = "\xff\xff\xff\xff";
+const size_t FORMAT_MARKER_SIZE = 4;
+const uint32_t FORMAT_VERSION = 1;
+
+}  // namespace
+
 lof_storage::config::config()
     : nearest_neighbor_num(DEFAULT_NEIGHBOR_NUM),
       reverse_nearest_neighbor_num(DEFAULT_REVERSE_NN_NUM) {
@@ -60,6 +77,8 @@ lof_storage::config::config()
 lof_storage::lof_storage()
     : neighbor_num_(DEFAULT_NEIGHBOR_NUM),
       reverse_nn_num_(DEFAULT_REVERSE_NN_NUM),
+      max_dirty_rows_(0),
+      thread_num_(1),
       nn_engine_(recommender::recommender_factory::create_recommender(
           "euclid_lsh",
           jsonconfig::config(pfi::text::json::to_json(
@@ -69,6 +88,8 @@ lof_storage::lof_storage()
 lof_storage::lof_storage(recommender::recommender_base* nn_engine)
     : neighbor_num_(DEFAULT_NEIGHBOR_NUM),
       reverse_nn_num_(DEFAULT_REVERSE_NN_NUM),
+      max_dirty_rows_(0),
+      thread_num_(1),
       nn_engine_(nn_engine) {
 }
 
@@ -77,7 +98,23 @@ lof_storage::lof_storage(
     recommender::recommender_base* nn_engine)
     : neighbor_num_(config.nearest_neighbor_num),
       reverse_nn_num_(config.reverse_nearest_neighbor_num),
+      max_dirty_rows_(0),
+      thread_num_(1),
       nn_engine_(nn_engine) {
+  if (config.max_dirty_rows) {
+    if (*config.max_dirty_rows <= 0) {
+      throw JUBATUS_EXCEPTION(exception::runtime_error(
+          "max_dirty_rows must be positive"));
+    }
+    max_dirty_rows_ = *config.max_dirty_rows;
+  }
+  if (config.thread_num) {
+    if (*config.thread_num <= 0) {
+      throw JUBATUS_EXCEPTION(exception::runtime_error(
+          "thread_num must be positive"));
+    }
+    thread_num_ = *config.thread_num;
+  }
 }
 
 lof_storage::~lof_storage() {
@@ -105,7 +142,9 @@ float lof_storage::collect_lrds(
       break;
     }
   }
-  neighbors.pop_back();
+  if (!neighbors.empty()) {
+    neighbors.pop_back();
+  }
 
   return collect_lrds_from_neighbors(neighbors, neighbor_lrd);
 }
@@ -113,11 +152,15 @@ float lof_storage::collect_lrds(
 void lof_storage::remove_row(const string& row) {
   mark_removed(lof_table_diff_[row]);
   nn_engine_->clear_row(row);
+  updated_rows_.erase(row);
+  dirty_rows_.erase(row);
 }
 
 void lof_storage::clear() {
   lof_table_t().swap(lof_table_);
   lof_table_t().swap(lof_table_diff_);
+  unordered_set<string>().swap(updated_rows_);
+  unordered_set<string>().swap(dirty_rows_);
   nn_engine_->clear();
 }
 
@@ -126,6 +169,11 @@ void lof_storage::get_all_row_ids(vector<string>& ids) const {
 }
 
 void lof_storage::update_row(const string& row, const sfv_t& diff) {
+  if (max_dirty_rows_ > 0) {
+    update_row_lazily(row, diff);
+    return;
+  }
+
   unordered_set<string> update_set;
 
   {
@@ -185,26 +233,109 @@ float lof_storage::get_lrd(const string& row) const {
 void lof_storage::update_all() {
   vector<string> ids;
   get_all_row_ids(ids);
+  update_entries(ids);
+
+  unordered_set<string>().swap(updated_rows_);
+  unordered_set<string>().swap(dirty_rows_);
+}
 
-  // NOTE: These two loops are separated, since update_lrd requires new kdist
-  // values of k-NN.
-  for (size_t i = 0; i < ids.size(); ++i) {
-    update_kdist(ids[i]);
+void lof_storage::update_dirty_rows() {
+  // neighbors shared by many updated rows are updated only once
+  unordered_set<string> update_set;
+  for (unordered_set<string>::const_iterator it = updated_rows_.begin();
+       it != updated_rows_.end(); ++it) {
+    if (has_entry(*it)) {
+      collect_neighbors(*it, update_set);
+      update_set.insert(*it);
+    }
   }
-  for (size_t i = 0; i < ids.size(); ++i) {
-    update_lrd(ids[i]);
+  // rows may be removed by mix after they are marked
+  for (unordered_set<string>::const_iterator it = dirty_rows_.begin();
+       it != dirty_rows_.end(); ++it) {
+    if (has_entry(*it)) {
+      update_set.insert(*it);
+    }
   }
+  unordered_set<string>().swap(updated_rows_);
+  unordered_set<string>().swap(dirty_rows_);
+
+  update_entries(update_set);
 }
 
 bool lof_storage::save(ostream& os) {
-  pfi::data::serialization::binary_oarchive oa(os);
-  oa << *this;
+  update_dirty_rows();
+
+  os.write(FORMAT_MARKER, FORMAT_MARKER_SIZE);
+  binary_oarchive oa(os);
+  uint32_t version = FORMAT_VERSION;
+  string name = nn_engine_->type();
+  oa << version << lof_table_ << lof_table_diff_ << neighbor_num_
+     << reverse_nn_num_ << name;
+
+  const ostream::pos_type size_pos = os.tellp();
+  uint64_t size = 0;
+  oa << size;
+  nn_engine_->save(os);
+
+  const ostream::pos_type end_pos = os.tellp();
+  if (size_pos != ostream::pos_type(-1) && end_pos != ostream::pos_type(-1)) {
+    size = end_pos - size_pos - sizeof(size);
+    os.seekp(size_pos);
+    oa << size;
+    os.seekp(end_pos);
+  }
   return true;
 }
 
 bool lof_storage::load(istream& is) {
+  const istream::pos_type pos = is.tellg();
+  char marker[FORMAT_MARKER_SIZE];
+  is.read(marker, FORMAT_MARKER_SIZE);
+  if (!is || !std::equal(marker, marker + FORMAT_MARKER_SIZE,
+                         FORMAT_MARKER)) {
+    is.clear();
+    is.seekg(pos);
+    load_legacy(is);
+    return true;
+  }
+
   binary_iarchive ia(is);
-  ia >> *this;
+  uint32_t version = 0;
+  ia >> version;
+  if (version != FORMAT_VERSION) {
+    throw JUBATUS_EXCEPTION(
+      exception::runtime_error("unsupported lof_storage format")
+      << exception::error_message(
+        "format version: " + pfi::lang::lexical_cast<string>(version)));
+  }
+
+  string name;
+  ia >> lof_table_ >> lof_table_diff_ >> neighbor_num_ >> reverse_nn_num_
+     >> name;
+  if (nn_engine_->type() != name) {
+    throw JUBATUS_EXCEPTION(
+      exception::runtime_error("inconsistent nearest neighbor engine type")
+      << exception::error_message(
+        "lof's NN engine type:  " + nn_engine_->type())
+      << exception::error_message("saved NN engine type: " + name));
+  }
+
+  uint64_t size = 0;
+  ia >> size;
+  nn_engine_->clear();
+  const istream::pos_type begin_pos = is.tellg();
+  nn_engine_->load(is);
+  const istream::pos_type end_pos = is.tellg();
+  if (size != 0 && begin_pos != istream::pos_type(-1) &&
+      end_pos - begin_pos != static_cast<std::streamoff>(size)) {
+    throw JUBATUS_EXCEPTION(
+      exception::runtime_error("broken NN engine in lof_storage")
+      << exception::error_message(
+        "saved size: " + pfi::lang::lexical_cast<string>(size)));
+  }
+
+  unordered_set<string>().swap(updated_rows_);
+  unordered_set<string>().swap(dirty_rows_);
   return true;
 }
 
@@ -264,6 +395,21 @@ void lof_storage::mix(const string& lhs, string& rhs) const {
 
 // private
 
+void lof_storage::load_legacy(istream& is) {
+  // the NN engine was saved into a string
+  binary_iarchive ia(is);
+  string name, impl;
+  ia >> lof_table_ >> lof_table_diff_ >> neighbor_num_ >> reverse_nn_num_
+     >> name >> impl;
+
+  nn_engine_->clear();
+  istringstream iss(impl);
+  nn_engine_->load(iss);
+
+  unordered_set<string>().swap(updated_rows_);
+  unordered_set<string>().swap(dirty_rows_);
+}
+
 // static
 void lof_storage::mark_removed(lof_entry& entry) {
   entry.kdist = -1;
@@ -274,6 +420,14 @@ bool lof_storage::is_removed(const lof_entry& entry) {
   return entry.kdist < 0;
 }
 
+bool lof_storage::has_entry(const string& row) const {
+  lof_table_t::const_iterator it = lof_table_diff_.find(row);
+  if (it != lof_table_diff_.end()) {
+    return !is_removed(it->second);
+  }
+  return lof_table_.find(row) != lof_table_.end();
+}
+
 float lof_storage::collect_lrds_from_neighbors(
     const vector<pair<string, float> >& neighbors,
     unordered_map<string, float>& neighbor_lrd) const {
@@ -341,53 +495,89 @@ void lof_storage::collect_neighbors(
   }
 }
 
-void lof_storage::update_entries(const unordered_set<string>& rows) {
-  // NOTE: These two loops are separated, since update_lrd requires new kdist
-  // values of k-NN.
-  typedef unordered_map<string, vector<pair<string, float> > >
-    rows_to_neighbors_type;
+void lof_storage::update_row_lazily(const string& row, const sfv_t& diff) {
+  // neighbors of the row before the update are recorded now, since they
+  // cannot be found after it
+  {
+    sfv_t query;
+    nn_engine_->decode_row(row, query);
+    if (!query.empty()) {
+      collect_neighbors(row, dirty_rows_);
+    }
+  }
+
+  nn_engine_->update_row(row, diff);
+  updated_rows_.insert(row);
 
-  rows_to_neighbors_type rows_to_neighbors;
-  for (unordered_set<string>::const_iterator it = rows.begin();
-       it != rows.end(); ++it) {
-    nn_engine_->neighbor_row(*it, rows_to_neighbors[*it], neighbor_num_);
+  // values of the row itself are always fresh, so that new rows can be read
+  // as neighbors right away
+  unordered_set<string> update_set;
+  update_set.insert(row);
+  update_entries(update_set);
+
+  if (updated_rows_.size() >= max_dirty_rows_) {
+    update_dirty_rows();
   }
+}
 
-  for (rows_to_neighbors_type::const_iterator it = rows_to_neighbors.begin();
-       it != rows_to_neighbors.end(); ++it) {
-    update_kdist_with_neighbors(it->first, it->second);
+void lof_storage::update_entries(const unordered_set<string>& rows) {
+  vector<string> row_vector(rows.begin(), rows.end());
+  update_entries(row_vector);
+}
+
+void lof_storage::update_entries(vector<string>& rows) {
+  // NOTE: kdist values of all rows are stored before lrd values are
+  // calculated, since lrd requires new kdist values of k-NN. Neighbors found
+  // for kdist are reused for lrd.
+  update_batch batch;
+  batch.rows.swap(rows);
+  batch.neighbors.resize(batch.rows.size());
+  batch.values.resize(batch.rows.size());
+
+  batch.lrd = false;
+  run_update_batch(batch);
+  for (size_t i = 0; i < batch.rows.size(); ++i) {
+    if (!batch.neighbors[i].empty()) {
+      lof_table_diff_[batch.rows[i]].kdist = batch.values[i];
+    }
   }
-  for (rows_to_neighbors_type::const_iterator it = rows_to_neighbors.begin();
-       it != rows_to_neighbors.end(); ++it) {
-    update_lrd_with_neighbors(it->first, it->second);
+
+  batch.lrd = true;
+  run_update_batch(batch);
+  for (size_t i = 0; i < batch.rows.size(); ++i) {
+    lof_table_diff_[batch.rows[i]].lrd = batch.values[i];
   }
 }
 
-void lof_storage::update_kdist(const string& row) {
-  vector<pair<string, float> > neighbors;
-  nn_engine_->neighbor_row(row, neighbors, neighbor_num_);
-  update_kdist_with_neighbors(row, neighbors);
+void lof_storage::run_update_batch(update_batch& batch) const {
+  const size_t size = batch.rows.size();
+  common::run_chunks(
+      pfi::lang::bind(&lof_storage::update_batch_range, this, &batch,
+                      pfi::lang::_2, pfi::lang::_3),
+      size, common::get_chunk_num(size, thread_num_, MIN_UPDATE_CHUNK_SIZE));
 }
 
-void lof_storage::update_kdist_with_neighbors(
-    const string& row,
-    const vector<pair<string, float> >& neighbors) {
-  if (!neighbors.empty()) {
-    lof_table_diff_[row].kdist = neighbors.back().second;
+void lof_storage::update_batch_range(
+    update_batch* batch,
+    size_t begin,
+    size_t end) const {
+  for (size_t i = begin; i < end; ++i) {
+    if (batch->lrd) {
+      batch->values[i] = calc_lrd(batch->neighbors[i]);
+    } else {
+      nn_engine_->neighbor_row(batch->rows[i], batch->neighbors[i],
+                               neighbor_num_);
+      if (!batch->neighbors[i].empty()) {
+        batch->values[i] = batch->neighbors[i].back().second;
+      }
+    }
   }
 }
 
-void lof_storage::update_lrd(const string& row) {
-  vector<pair<string, float> > neighbors;
-  nn_engine_->neighbor_row(row, neighbors, neighbor_num_);
-  update_lrd_with_neighbors(row, neighbors);
-}
-
-void lof_storage::update_lrd_with_neighbors(
-    const string& row, const vector<pair<string, float> >& neighbors) {
+float lof_storage::calc_lrd(
+    const vector<pair<string, float> >& neighbors) const {
   if (neighbors.empty()) {
-    lof_table_diff_[row].lrd = 1;
-    return;
+    return 1;
   }
 
   const size_t length = min(neighbors.size(), size_t(neighbor_num_));
@@ -397,11 +587,10 @@ void lof_storage::update_lrd_with_neighbors(
   }
 
   if (sum_reachability == 0) {
-    lof_table_diff_[row].lrd = numeric_limits<float>::infinity();
-    return;
+    return numeric_limits<float>::infinity();
   }
 
-  lof_table_diff_[row].lrd = length / sum_reachability;
+  return length / sum_reachability;
 }
 
 }  // namespace storage
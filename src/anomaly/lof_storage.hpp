@@ -22,6 +22,7 @@
 #include <utility>
 #include <vector>
 
+#include <pficommon/data/optional.h>
 #include <pficommon/data/serialization.h>
 #include <pficommon/data/unordered_map.h>
 #include <pficommon/data/unordered_set.h>
@@ -46,10 +47,18 @@ class lof_storage : public anomaly_storage_base {
 
     int nearest_neighbor_num;
     int reverse_nearest_neighbor_num;
+    // When given, update_row recomputes kdist and lrd of the updated row
+    // only, and those of its neighbors are recomputed together once this
+    // number of rows are updated. Until then, scores around the updated rows
+    // may be stale.
+    pfi::data::optional<int> max_dirty_rows;
+    // number of threads to update kdist and lrd of many rows
+    pfi::data::optional<int> thread_num;
 
     template<typename Ar>
     void serialize(Ar& ar) {
-      ar & MEMBER(nearest_neighbor_num) & MEMBER(reverse_nearest_neighbor_num);
+      ar & MEMBER(nearest_neighbor_num) & MEMBER(reverse_nearest_neighbor_num)
+        & MEMBER(max_dirty_rows) & MEMBER(thread_num);
     }
   };
 
@@ -79,6 +88,12 @@ class lof_storage : public anomaly_storage_base {
   void update_row(const std::string& row, const sfv_t& diff);
 
   void update_all();  // Update kdists and lrds
+  // Update kdists and lrds around rows updated since the last call; only
+  // needed with max_dirty_rows
+  void update_dirty_rows();
+  size_t dirty_row_num() const {
+    return updated_rows_.size();
+  }
 
   std::string name() const;
 
@@ -86,6 +101,8 @@ class lof_storage : public anomaly_storage_base {
   float get_kdist(const std::string& row) const;
   float get_lrd(const std::string& row) const;
 
+  // The NN engine is saved directly into the stream following its size,
+  // which is filled in when os is seekable.
   bool save(std::ostream& os);
   bool load(std::istream& is);
 
@@ -111,34 +128,10 @@ class lof_storage : public anomaly_storage_base {
 
   static void mark_removed(lof_entry& entry);
   static bool is_removed(const lof_entry& entry);
+  bool has_entry(const std::string& row) const;
 
-  friend class pfi::data::serialization::access;
-
-  template<class Ar>
-  void serialize(Ar& ar) {
-    ar & MEMBER(lof_table_) & MEMBER(lof_table_diff_);
-    ar & MEMBER(neighbor_num_) & MEMBER(reverse_nn_num_);
-
-    // TODO(kashihara): Make it more efficient
-    if (ar.is_read) {
-      std::string name;
-      ar & name;
-      nn_engine_->clear();
-
-      std::string impl;
-      ar & impl;
-      std::istringstream iss(impl);
-      nn_engine_->load(iss);
-    } else {
-      std::string name = nn_engine_->type();
-      ar & name;
-
-      std::ostringstream oss;
-      nn_engine_->save(oss);
-      std::string str = oss.str();
-      ar & str;
-    }
-  }
+  // loads models saved before the format was versioned
+  void load_legacy(std::istream& is);
 
   float collect_lrds_from_neighbors(
       const std::vector<std::pair<std::string, float> >& neighbors,
@@ -157,16 +150,24 @@ class lof_storage : public anomaly_storage_base {
       const std::string& row,
       pfi::data::unordered_set<std::string>& nn) const;
 
-  void update_entries(const pfi::data::unordered_set<std::string>& rows);
-  void update_kdist(const std::string& row);
-  void update_lrd(const std::string& row);
+  void update_row_lazily(const std::string& row, const sfv_t& diff);
+  // rows to update kdist and lrd, and their k-NN
+  struct update_batch {
+    std::vector<std::string> rows;
+    std::vector<std::vector<std::pair<std::string, float> > > neighbors;
+    std::vector<float> values;
+    bool lrd;  // whether values are lrd or kdist
+  };
 
-  void update_kdist_with_neighbors(
-      const std::string& row,
-      const std::vector<std::pair<std::string, float> >& neighbors);
-  void update_lrd_with_neighbors(
-      const std::string& row,
-      const std::vector<std::pair<std::string, float> >& neighbors);
+  void update_entries(const pfi::data::unordered_set<std::string>& rows);
+  void update_entries(std::vector<std::string>& rows);
+  void run_update_batch(update_batch& batch) const;
+  void update_batch_range(
+      update_batch* batch,
+      size_t begin,
+      size_t end) const;
+  float calc_lrd(
+      const std::vector<std::pair<std::string, float> >& neighbors) const;
 
   lof_table_t lof_table_;  // table for storing k-dist and lrd values
   lof_table_t lof_table_diff_;
@@ -174,6 +175,13 @@ class lof_storage : public anomaly_storage_base {
   uint32_t neighbor_num_;  // k of k-nn
   uint32_t reverse_nn_num_;  // ck of ck-nn as an approx. of k-reverse-nn
 
+  size_t max_dirty_rows_;  // 0 unless updates are lazy
+  size_t thread_num_;
+  // rows updated since the last update_dirty_rows
+  pfi::data::unordered_set<std::string> updated_rows_;
+  // neighbors of updated rows before the updates
+  pfi::data::unordered_set<std::string> dirty_rows_;
+
   pfi::lang::scoped_ptr<recommender::recommender_base> nn_engine_;
 };
 
@@ -0,0 +1,114 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+
+// Benchmark of lof_storage::update_all with euclid_lsh, which recomputes
+// kdist and lrd of all rows as after a mix or a model load. Compares a
+// single thread with the given number of threads.
+//
+// usage: lof_storage_bench [row_num [thread_num [dim]]]
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <pficommon/lang/cast.h>
+#include <pficommon/math/random.h>
+#include <pficommon/system/time_util.h>
+#include "../recommender/euclid_lsh.hpp"
+#include "lof_storage.hpp"
+
+using jubatus::sfv_t;
+using jubatus::storage::lof_storage;
+using pfi::lang::lexical_cast;
+using pfi::system::time::clock_time;
+using pfi::system::time::get_clock_time;
+using std::string;
+using std::vector;
+
+namespace {
+
+const size_t CLUSTER_NUM = 100;
+
+void make_rows(size_t row_num, size_t dim, vector<sfv_t>& rows) {
+  pfi::math::random::mtrand rand(0);
+  vector<vector<float> > centers(CLUSTER_NUM, vector<float>(dim));
+  for (size_t i = 0; i < CLUSTER_NUM; ++i) {
+    for (size_t j = 0; j < dim; ++j) {
+      centers[i][j] = rand.next_gaussian() * 10;
+    }
+  }
+
+  rows.resize(row_num);
+  for (size_t i = 0; i < row_num; ++i) {
+    const vector<float>& center = centers[rand.next_int(CLUSTER_NUM)];
+    for (size_t j = 0; j < dim; ++j) {
+      rows[i].push_back(std::make_pair(
+          lexical_cast<string>(j), center[j] + rand.next_gaussian()));
+    }
+  }
+}
+
+double run(const vector<sfv_t>& rows, int thread_num, lof_storage*& s) {
+  lof_storage::config config;
+  // rows are added without updating their neighbors
+  config.max_dirty_rows = rows.size() + 1;
+  config.thread_num = thread_num;
+  s = new lof_storage(config, new jubatus::recommender::euclid_lsh);
+  for (size_t i = 0; i < rows.size(); ++i) {
+    s->update_row(lexical_cast<string>(i), rows[i]);
+  }
+
+  clock_time start = get_clock_time();
+  s->update_all();
+  clock_time end = get_clock_time();
+  return static_cast<double>(end - start);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  size_t row_num = argc > 1 ? std::atoi(argv[1]) : 100000;
+  int thread_num = argc > 2 ? std::atoi(argv[2]) : 4;
+  size_t dim = argc > 3 ? std::atoi(argv[3]) : 10;
+
+  vector<sfv_t> rows;
+  make_rows(row_num, dim, rows);
+
+  lof_storage* single = NULL;
+  lof_storage* threaded = NULL;
+  double single_sec = run(rows, 1, single);
+  double threaded_sec = run(rows, thread_num, threaded);
+
+  size_t mismatch = 0;
+  for (size_t i = 0; i < row_num; ++i) {
+    const string id = lexical_cast<string>(i);
+    if (single->get_kdist(id) != threaded->get_kdist(id) ||
+        single->get_lrd(id) != threaded->get_lrd(id)) {
+      ++mismatch;
+    }
+  }
+  delete single;
+  delete threaded;
+
+  std::cout << "rows: " << row_num << ", dim: " << dim << std::endl;
+  std::cout << "1 thread: " << single_sec << " sec" << std::endl;
+  std::cout << thread_num << " threads: " << threaded_sec << " sec"
+            << std::endl;
+  std::cout << "mismatched rows: " << mismatch << std::endl;
+  return mismatch == 0 ? 0 : 1;
+}
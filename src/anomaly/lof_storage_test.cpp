@@ -16,6 +16,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <limits>
 #include <sstream>
 #include <string>
 #include <utility>
@@ -29,6 +30,7 @@
 #include "../common/exception.hpp"
 #include "../common/hash.hpp"
 #include "../common/portable_mixer.hpp"  // TODO(kashihara): use linear_mixer
+#include "../recommender/euclid_lsh.hpp"
 #include "../recommender/recommender_mock.hpp"
 #include "../recommender/recommender_mock_util.hpp"
 #include "lof_storage.hpp"
@@ -166,6 +168,190 @@ TEST_F(lof_storage_one_dimensional_test, collect_lrds_novel_input) {
   EXPECT_FLOAT_EQ(1/2.f, lrds["0"]);
 }
 
+TEST(lof_storage, collect_lrds_unknown_row) {
+  pfi::lang::scoped_ptr<lof_storage> s(
+      make_storage(2, 2, new recommender::recommender_mock));
+  unordered_map<string, float> lrds;
+  EXPECT_EQ(std::numeric_limits<float>::infinity(),
+            s->collect_lrds("unknown", lrds));
+  EXPECT_TRUE(lrds.empty());
+}
+
+TEST(lof_storage, lazy_update) {
+  recommender::recommender_mock* rmock = new recommender::recommender_mock;
+  lof_storage::config config;
+  config.nearest_neighbor_num = 2;
+  config.reverse_nearest_neighbor_num = 2;
+  config.max_dirty_rows = 100;
+  lof_storage s(config, rmock);
+
+  s.update_row("-1", make_sfv("1:-1"));
+  s.update_row("0", make_sfv("1:0"));
+  s.update_row("1", make_sfv("1:1"));
+  s.update_row("10", make_sfv("1:10"));
+  EXPECT_EQ(4u, s.dirty_row_num());
+
+  rmock->set_neighbor_relation(make_sfv("1:-1"), make_ids("0:1 1:2 10:11"));
+  rmock->set_neighbor_relation(make_sfv("1:0"), make_ids("-1:1 1:1 10:10"));
+  rmock->set_neighbor_relation(make_sfv("1:1"), make_ids("0:1 -1:2 10:9"));
+  rmock->set_neighbor_relation(make_sfv("1:10"), make_ids("1:9 0:10 -1:11"));
+
+  // values are stale until dirty rows are updated
+  EXPECT_FLOAT_EQ(1.f, s.get_lrd("0"));
+
+  s.update_dirty_rows();
+  EXPECT_EQ(0u, s.dirty_row_num());
+
+  // same values as lof_storage_one_dimensional_test
+  EXPECT_FLOAT_EQ(2.f, s.get_kdist("-1"));
+  EXPECT_FLOAT_EQ(1.f, s.get_kdist("0"));
+  EXPECT_FLOAT_EQ(2.f, s.get_kdist("1"));
+  EXPECT_FLOAT_EQ(10.f, s.get_kdist("10"));
+  EXPECT_FLOAT_EQ(2/3.f, s.get_lrd("-1"));
+  EXPECT_FLOAT_EQ(1/2.f, s.get_lrd("0"));
+  EXPECT_FLOAT_EQ(2/3.f, s.get_lrd("1"));
+  EXPECT_FLOAT_EQ(2/19.f, s.get_lrd("10"));
+}
+
+TEST(lof_storage, lazy_update_bounded) {
+  lof_storage::config config;
+  config.max_dirty_rows = 2;
+  lof_storage s(config, new recommender::recommender_mock);
+
+  s.update_row("r1", make_sfv("1:1"));
+  EXPECT_EQ(1u, s.dirty_row_num());
+  s.update_row("r1", make_sfv("1:2"));
+  EXPECT_EQ(1u, s.dirty_row_num());
+  s.update_row("r2", make_sfv("2:1"));
+  EXPECT_EQ(0u, s.dirty_row_num());
+
+  s.update_row("r3", make_sfv("3:1"));
+  s.remove_row("r3");
+  EXPECT_EQ(0u, s.dirty_row_num());
+}
+
+TEST(lof_storage, invalid_max_dirty_rows) {
+  lof_storage::config config;
+  config.max_dirty_rows = 0;
+  EXPECT_THROW(lof_storage(config, new recommender::recommender_mock),
+               exception::runtime_error);
+}
+
+TEST(lof_storage, update_all_in_threads) {
+  lof_storage::config config;
+  config.max_dirty_rows = 10000;
+  lof_storage single(config, new recommender::euclid_lsh);
+  config.thread_num = 4;
+  lof_storage threaded(config, new recommender::euclid_lsh);
+
+  pfi::math::random::mtrand r(0);
+  for (size_t i = 0; i < 200; ++i) {
+    sfv_t v;
+    for (size_t j = 0; j < 3; ++j) {
+      v.push_back(make_pair(lexical_cast<string>(j), r.next_gaussian()));
+    }
+    const string id = lexical_cast<string>(i);
+    single.update_row(id, v);
+    threaded.update_row(id, v);
+  }
+  single.update_all();
+  threaded.update_all();
+
+  vector<string> ids;
+  single.get_all_row_ids(ids);
+  ASSERT_EQ(200u, ids.size());
+  for (size_t i = 0; i < ids.size(); ++i) {
+    EXPECT_EQ(single.get_kdist(ids[i]), threaded.get_kdist(ids[i]));
+    EXPECT_EQ(single.get_lrd(ids[i]), threaded.get_lrd(ids[i]));
+  }
+}
+
+TEST(lof_storage, invalid_thread_num) {
+  lof_storage::config config;
+  config.thread_num = 0;
+  EXPECT_THROW(lof_storage(config, new recommender::recommender_mock),
+               exception::runtime_error);
+}
+
+TEST(lof_storage, save_and_load) {
+  recommender::recommender_mock* rmock = new recommender::recommender_mock;
+  pfi::lang::scoped_ptr<lof_storage> s(make_storage(2, 2, rmock));
+  s->update_row("-1", make_sfv("1:-1"));
+  s->update_row("0", make_sfv("1:0"));
+  s->update_row("1", make_sfv("1:1"));
+  rmock->set_neighbor_relation(make_sfv("1:-1"), make_ids("0:1 1:2"));
+  rmock->set_neighbor_relation(make_sfv("1:0"), make_ids("-1:1 1:1"));
+  rmock->set_neighbor_relation(make_sfv("1:1"), make_ids("0:1 -1:2"));
+  s->update_all();
+
+  std::stringstream ss;
+  s->save(ss);
+  ss << "tail";
+
+  lof_storage loaded(new recommender::recommender_mock);
+  loaded.load(ss);
+  string tail;
+  ss >> tail;
+  EXPECT_EQ("tail", tail);
+
+  vector<string> ids;
+  loaded.get_all_row_ids(ids);
+  EXPECT_EQ(3u, ids.size());
+  EXPECT_FLOAT_EQ(2.f, loaded.get_kdist("-1"));
+  EXPECT_FLOAT_EQ(1.f, loaded.get_kdist("0"));
+  EXPECT_FLOAT_EQ(2/3.f, loaded.get_lrd("-1"));
+  EXPECT_FLOAT_EQ(1/2.f, loaded.get_lrd("0"));
+}
+
+namespace {
+
+// lof_storage::lof_entry
+struct legacy_entry {
+  float kdist;
+  float lrd;
+
+  template<typename Ar>
+  void serialize(Ar& ar) {
+    ar & MEMBER(kdist) & MEMBER(lrd);
+  }
+};
+
+}  // namespace
+
+TEST(lof_storage, load_legacy_format) {
+  recommender::recommender_mock nn_engine;
+  nn_engine.update_row("r1", make_sfv("1:1"));
+  nn_engine.update_row("r2", make_sfv("1:2"));
+  std::ostringstream nn_engine_os;
+  nn_engine.save(nn_engine_os);
+
+  unordered_map<string, legacy_entry> table, diff;
+  table["r1"].kdist = 1;
+  table["r1"].lrd = 0.5;
+  diff["r2"].kdist = 2;
+  diff["r2"].lrd = 0.25;
+  uint32_t neighbor_num = 2;
+  uint32_t reverse_nn_num = 3;
+  string name = nn_engine.type();
+  string impl = nn_engine_os.str();
+
+  // the NN engine was saved into a string
+  std::stringstream ss;
+  pfi::data::serialization::binary_oarchive oa(ss);
+  oa << table << diff << neighbor_num << reverse_nn_num << name << impl;
+
+  lof_storage s(new recommender::recommender_mock);
+  s.load(ss);
+
+  vector<string> ids;
+  s.get_all_row_ids(ids);
+  EXPECT_EQ(2u, ids.size());
+  EXPECT_FLOAT_EQ(1.f, s.get_kdist("r1"));
+  EXPECT_FLOAT_EQ(0.5f, s.get_lrd("r1"));
+  EXPECT_FLOAT_EQ(2.f, s.get_kdist("r2"));
+  EXPECT_FLOAT_EQ(0.25f, s.get_lrd("r2"));
+}
+
 class lof_storage_mix_test : public ::testing::TestWithParam<
     std::pair<int, lof_storage::config> > {
  protected:
@@ -149,5 +149,26 @@ TEST(lof, calc_anomaly_score2) {
   EXPECT_EQ(2.0, anomaly_score);
 }
 
+TEST(lof, calc_anomaly_scores) {
+  lof_impl l;
+  vector<string> ids;
+  for (size_t i = 0; i < 100; ++i) {
+    ids.push_back(i % 2 ? "r1" : "r2");
+  }
+  vector<float> scores;
+  l.calc_anomaly_scores(ids, scores, 4);
+  ASSERT_EQ(ids.size(), scores.size());
+  for (size_t i = 0; i < ids.size(); ++i) {
+    EXPECT_EQ(l.calc_anomaly_score(ids[i]), scores[i]);
+  }
+
+  vector<sfv_t> queries(10);
+  l.calc_anomaly_scores(queries, scores, 4);
+  ASSERT_EQ(queries.size(), scores.size());
+  for (size_t i = 0; i < queries.size(); ++i) {
+    EXPECT_EQ(0.5, scores[i]);
+  }
+}
+
 }  // namespace anomaly
 }  // namespace jubatus
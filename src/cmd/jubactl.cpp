@@ -83,6 +83,8 @@ try {
   p.add<int>("interval_sec", 'S', "[start] mix interval by seconds", false, 16);
   p.add<int>("interval_count", 'I',
       "[start] mix interval by update count", false, 512);
+  p.add<int>("id_lease_size", 'U',
+      "[start] number of ids leased from zookeeper at once", false, 0);
 
   p.add("debug", 'd', "debug mode");
 
@@ -195,6 +197,7 @@ void send2supervisor(
 
     server_option.interval_sec = argv.get<int>("interval_sec");
     server_option.interval_count = argv.get<int>("interval_count");
+    server_option.id_lease_size = argv.get<int>("id_lease_size");
   }
 
   ls_->list(jubatus::common::JUBAVISOR_BASE_PATH, list);
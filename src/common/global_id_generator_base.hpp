@@ -19,6 +19,7 @@
 
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 namespace jubatus {
 namespace common {
@@ -28,6 +29,14 @@ class global_id_generator_base {
   virtual ~global_id_generator_base() {}
 
   virtual uint64_t generate() = 0;
+
+  // generates num ids, which are not always consecutive
+  virtual void generate_many(size_t num, std::vector<uint64_t>& ids) {
+    ids.clear();
+    for (size_t i = 0; i < num; ++i) {
+      ids.push_back(generate());
+    }
+  }
 };
 
 }  // namespace common
@@ -16,6 +16,7 @@
 
 #include <cassert>
 #include <string>
+#include <vector>
 
 #ifndef ATOMIC_I8_SUPPORT
 #include <pficommon/concurrent/lock.h>
@@ -54,5 +55,24 @@ uint64_t global_id_generator_standalone::generate() {
 #endif
 }
 
+void global_id_generator_standalone::generate_many(
+    size_t num,
+    std::vector<uint64_t>& ids) {
+#ifdef ATOMIC_I8_SUPPORT
+  uint64_t first = __sync_fetch_and_add(&pimpl_->counter, num);
+#else
+  uint64_t first;
+  {
+    pfi::concurrent::scoped_lock lk(pimpl_->counter_mutex);
+    first = pimpl_->counter;
+    pimpl_->counter += num;
+  }
+#endif
+  ids.resize(num);
+  for (size_t i = 0; i < num; ++i) {
+    ids[i] = first + i;
+  }
+}
+
 }  // namespace common
 }  // namespace jubatus
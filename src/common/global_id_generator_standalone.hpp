@@ -19,6 +19,7 @@
 
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 #include <pficommon/lang/scoped_ptr.h>
 
@@ -35,6 +36,7 @@ class global_id_generator_standalone: public global_id_generator_base {
   virtual ~global_id_generator_standalone();
 
   virtual uint64_t generate();
+  virtual void generate_many(size_t num, std::vector<uint64_t>& ids);
 
  private:
   pfi::lang::scoped_ptr<impl> pimpl_;
@@ -14,6 +14,7 @@
 // License along with this library; if not, write to the Free Software
 // Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
+#include <vector>
 #include <gtest/gtest.h>
 #include "global_id_generator_base.hpp"
 #include "global_id_generator_standalone.hpp"
@@ -28,7 +29,19 @@ TEST(generate, standalone) {
   EXPECT_EQ(2u, gen.generate());
 }
 
-// TODO(oda): test with idgen_zk
+TEST(generate_many, standalone) {
+  global_id_generator_standalone gen;
+  EXPECT_EQ(0u, gen.generate());
+
+  std::vector<uint64_t> ids;
+  gen.generate_many(3, ids);
+  ASSERT_EQ(3u, ids.size());
+  EXPECT_EQ(1u, ids[0]);
+  EXPECT_EQ(2u, ids[1]);
+  EXPECT_EQ(3u, ids[2]);
+
+  EXPECT_EQ(4u, gen.generate());
+}
 
 }  // namespace common
 }  // namespace jubatus
@@ -14,25 +14,59 @@
 // License along with this library; if not, write to the Free Software
 // Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
+#include <algorithm>
 #include <cassert>
 #include <string>
+#include <vector>
+
+#include <glog/logging.h>
+#include <pficommon/concurrent/lock.h>
+#include <pficommon/lang/bind.h>
 
 #include "exception.hpp"
 #include "global_id_generator_base.hpp"
 #include "global_id_generator_zk.hpp"
 
+using pfi::concurrent::scoped_lock;
+
 namespace jubatus {
 namespace common {
 
-global_id_generator_zk::global_id_generator_zk() {
+namespace {
+
+// a block is created by a multi operation of this number of sets, which
+// must fit in a request to ZooKeeper
+const size_t MAX_ID_BLOCK_SIZE = 1000;
+
+}  // namespace
+
+global_id_generator_zk::global_id_generator_zk()
+    : lease_size_(0),
+      leased_num_(0),
+      refill_requested_(false),
+      is_running_(false),
+      refiller_(pfi::lang::bind(
+          &global_id_generator_zk::refiller_loop, this)) {
+}
+
+global_id_generator_zk::global_id_generator_zk(size_t lease_size)
+    : lease_size_(lease_size),
+      leased_num_(0),
+      refill_requested_(false),
+      is_running_(false),
+      refiller_(pfi::lang::bind(
+          &global_id_generator_zk::refiller_loop, this)) {
 }
 
 global_id_generator_zk::~global_id_generator_zk() {
+  stop_refiller();
 }
 
 void global_id_generator_zk::set_ls(
     cshared_ptr<lock_service>& ls,
     const std::string& path_prefix) {
+  stop_refiller();
+
   path_ = path_prefix + "/id_generator";
   ls_ = ls;
   if (!ls_->create(path_)) {
@@ -41,9 +75,25 @@ void global_id_generator_zk::set_ls(
         << jubatus::exception::error_api_func("lock_service::create")
         << jubatus::exception::error_message(path_));
   }
+
+  if (lease_size_ > 0) {
+    scoped_lock lk(m_);
+    leased_blocks_.clear();
+    leased_num_ = 0;
+    // take the first lease before ids are requested
+    refill_requested_ = true;
+    is_running_ = true;
+    refiller_.start();
+  }
 }
 
 uint64_t global_id_generator_zk::generate() {
+  if (lease_size_ > 0) {
+    std::vector<uint64_t> ids;
+    generate_many(1, ids);
+    return ids[0];
+  }
+
   uint64_t res;
   if ( !ls_ ) {
     throw JUBATUS_EXCEPTION(
@@ -57,5 +107,116 @@ uint64_t global_id_generator_zk::generate() {
   }
 }
 
+void global_id_generator_zk::generate_many(
+    size_t num,
+    std::vector<uint64_t>& ids) {
+  if (!ls_) {
+    throw JUBATUS_EXCEPTION(
+        jubatus::exception::runtime_error("lock_service is not given"));
+  }
+  ids.clear();
+  ids.reserve(num);
+  if (lease_size_ > 0) {
+    take_leased_ids(num, ids);
+  }
+  if (ids.size() < num) {
+    // the lease ran out before it was refilled
+    create_ids(num - ids.size(), ids);
+  }
+}
+
+void global_id_generator_zk::create_ids(
+    size_t num,
+    std::vector<uint64_t>& ids) {
+  std::vector<id_block> blocks;
+  lease(num, blocks);
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    for (uint64_t id = blocks[i].first; id < blocks[i].second; ++id) {
+      ids.push_back(id);
+    }
+  }
+}
+
+void global_id_generator_zk::lease(
+    size_t num,
+    std::vector<id_block>& blocks) {
+  size_t leased = 0;
+  while (leased < num) {
+    const uint32_t size = std::min(num - leased, MAX_ID_BLOCK_SIZE);
+    uint64_t first;
+    if (!ls_->create_id_block(path_, 0, size, first)) {
+      throw JUBATUS_EXCEPTION(
+          jubatus::exception::runtime_error("Failed to create id"));
+    }
+    blocks.push_back(id_block(first, first + size));
+    leased += size;
+  }
+}
+
+void global_id_generator_zk::take_leased_ids(
+    size_t num,
+    std::vector<uint64_t>& ids) {
+  scoped_lock lk(m_);
+  while (ids.size() < num && !leased_blocks_.empty()) {
+    id_block& block = leased_blocks_.front();
+    const uint64_t size = std::min<uint64_t>(
+        num - ids.size(), block.second - block.first);
+    for (uint64_t i = 0; i < size; ++i) {
+      ids.push_back(block.first + i);
+    }
+    block.first += size;
+    leased_num_ -= size;
+    if (block.first == block.second) {
+      leased_blocks_.pop_front();
+    }
+  }
+
+  if (leased_num_ < lease_size_ && !refill_requested_) {
+    refill_requested_ = true;
+    c_.notify();
+  }
+}
+
+void global_id_generator_zk::stop_refiller() {
+  {
+    scoped_lock lk(m_);
+    if (!is_running_) {
+      return;
+    }
+    is_running_ = false;
+    c_.notify();
+  }
+  refiller_.join();
+}
+
+void global_id_generator_zk::refiller_loop() {
+  while (true) {
+    {
+      scoped_lock lk(m_);
+      while (is_running_ && !refill_requested_) {
+        c_.wait(m_);
+      }
+      if (!is_running_) {
+        break;
+      }
+    }
+
+    std::vector<id_block> blocks;
+    try {
+      lease(lease_size_, blocks);
+    } catch (const jubatus::exception::jubatus_exception& e) {
+      // ids are leased synchronously until the next request succeeds
+      LOG(ERROR) << e.diagnostic_information(true);
+    }
+
+    scoped_lock lk(m_);
+    for (size_t i = 0; i < blocks.size(); ++i) {
+      leased_blocks_.push_back(blocks[i]);
+      leased_num_ += blocks[i].second - blocks[i].first;
+    }
+    refill_requested_ = false;
+  }
+}
+
 }  // namespace common
 }  // namespace jubatus
@@ -18,7 +18,15 @@
 #define JUBATUS_COMMON_GLOBAL_ID_GENERATOR_ZK_HPP_
 
 #include <stdint.h>
+#include <deque>
 #include <string>
+#include <utility>
+#include <vector>
+
+#include <pficommon/concurrent/condition.h>
+#include <pficommon/concurrent/mutex.h>
+#include <pficommon/concurrent/thread.h>
+#include <pficommon/lang/noncopyable.h>
 
 #include "global_id_generator_base.hpp"
 #include "lock_service.hpp"
@@ -27,18 +35,44 @@
 namespace jubatus {
 namespace common {
 
-class global_id_generator_zk: public global_id_generator_base {
+// When lease_size is given, ids are leased from ZooKeeper lease_size at a
+// time and handed out locally. A new lease is taken in a thread when less
+// than lease_size ids remain, so ids are ordered only within each block
+// leased by one ZooKeeper operation.
+class global_id_generator_zk: public global_id_generator_base,
+    pfi::lang::noncopyable {
  public:
   global_id_generator_zk();
+  explicit global_id_generator_zk(size_t lease_size);
   virtual ~global_id_generator_zk();
 
   uint64_t generate();
+  // one ZooKeeper operation for each block of ids
+  void generate_many(size_t num, std::vector<uint64_t>& ids);
 
   void set_ls(cshared_ptr<lock_service>& ls, const std::string& path_prefix);
 
  private:
+  // [first, end) of leased ids
+  typedef std::pair<uint64_t, uint64_t> id_block;
+
+  void create_ids(size_t num, std::vector<uint64_t>& ids);
+  void lease(size_t num, std::vector<id_block>& blocks);
+  void take_leased_ids(size_t num, std::vector<uint64_t>& ids);
+  void stop_refiller();
+  void refiller_loop();
+
   std::string path_;
   cshared_ptr<lock_service> ls_;
+
+  const size_t lease_size_;
+  std::deque<id_block> leased_blocks_;
+  size_t leased_num_;
+  bool refill_requested_;
+  volatile bool is_running_;
+  pfi::concurrent::thread refiller_;
+  pfi::concurrent::mutex m_;
+  pfi::concurrent::condition c_;
 };
 
 }  // namespace common
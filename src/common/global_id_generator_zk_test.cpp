@@ -0,0 +1,189 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include <pficommon/concurrent/lock.h>
+#include <pficommon/concurrent/mutex.h>
+#include <pficommon/concurrent/thread.h>
+#include "global_id_generator_zk.hpp"
+#include "lock_service.hpp"
+
+using std::string;
+using std::vector;
+
+namespace jubatus {
+namespace common {
+
+namespace {
+
+// creates ids as a node of ZooKeeper does by versions
+class id_lock_service : public lock_service {
+ public:
+  id_lock_service()
+      : version_(0),
+        block_num_(0) {
+  }
+
+  void force_close() {
+  }
+  bool create(const string& path, const string& payload, bool ephemeral) {
+    return true;
+  }
+  bool set(const string& path, const string& payload) {
+    return true;
+  }
+  bool remove(const string& path) {
+    return true;
+  }
+  bool exists(const string& path) {
+    return true;
+  }
+  bool bind_watcher(
+      const string& path,
+      pfi::lang::function<void(int, int, string)>&) {
+    return true;
+  }
+  bool create_seq(const string& path, string&) {
+    return false;
+  }
+
+  bool create_id(const string& path, uint32_t prefix, uint64_t& res) {
+    pfi::concurrent::scoped_lock lk(m_);
+    res = (static_cast<uint64_t>(prefix) << 32) | ++version_;
+    return true;
+  }
+  bool create_id_block(
+      const string& path,
+      uint32_t prefix,
+      uint32_t size,
+      uint64_t& first) {
+    pfi::concurrent::scoped_lock lk(m_);
+    first = (static_cast<uint64_t>(prefix) << 32) | (version_ + 1);
+    version_ += size;
+    ++block_num_;
+    return true;
+  }
+
+  bool list(const string& path, vector<string>& out) {
+    return true;
+  }
+  bool hd_list(const string& path, string& out) {
+    return true;
+  }
+  bool read(const string& path, string& out) {
+    return false;
+  }
+  void push_cleanup(pfi::lang::function<void()>& f) {
+  }
+  void run_cleanup() {
+  }
+  const string& get_hosts() const {
+    return hosts_;
+  }
+  const string type() const {
+    return "id";
+  }
+
+  size_t block_num() {
+    pfi::concurrent::scoped_lock lk(m_);
+    return block_num_;
+  }
+
+ private:
+  pfi::concurrent::mutex m_;
+  uint64_t version_;
+  size_t block_num_;
+  string hosts_;
+};
+
+void expect_unique(vector<uint64_t> ids) {
+  std::sort(ids.begin(), ids.end());
+  EXPECT_TRUE(std::adjacent_find(ids.begin(), ids.end()) == ids.end());
+}
+
+}  // namespace
+
+TEST(global_id_generator_zk, generate) {
+  id_lock_service* ls = new id_lock_service();
+  cshared_ptr<lock_service> ls_ptr(ls);
+  global_id_generator_zk gen;
+  gen.set_ls(ls_ptr, "/test");
+
+  EXPECT_EQ(1u, gen.generate());
+  EXPECT_EQ(2u, gen.generate());
+
+  vector<uint64_t> ids;
+  gen.generate_many(2500, ids);
+  ASSERT_EQ(2500u, ids.size());
+  for (size_t i = 0; i < ids.size(); ++i) {
+    EXPECT_EQ(3u + i, ids[i]);
+  }
+  EXPECT_EQ(3u, ls->block_num());
+}
+
+TEST(global_id_generator_zk, lease) {
+  id_lock_service* ls = new id_lock_service();
+  cshared_ptr<lock_service> ls_ptr(ls);
+  global_id_generator_zk gen(100);
+  gen.set_ls(ls_ptr, "/test");
+
+  // the first lease is taken in the thread
+  for (int i = 0; i < 1000 && ls->block_num() == 0; ++i) {
+    pfi::concurrent::thread::sleep(0.01);
+  }
+  ASSERT_EQ(1u, ls->block_num());
+
+  // ids in the lease are handed out in order
+  vector<uint64_t> ids;
+  for (size_t i = 0; i < 50; ++i) {
+    ids.push_back(gen.generate());
+  }
+  for (size_t i = 0; i < ids.size(); ++i) {
+    EXPECT_EQ(1u + i, ids[i]);
+  }
+
+  // more ids than leased are taken synchronously
+  vector<uint64_t> many;
+  gen.generate_many(1000, many);
+  ASSERT_EQ(1000u, many.size());
+  ids.insert(ids.end(), many.begin(), many.end());
+  for (size_t i = 0; i < 1000; ++i) {
+    ids.push_back(gen.generate());
+  }
+  expect_unique(ids);
+}
+
+TEST(global_id_generator_zk, lease_with_others) {
+  id_lock_service* ls = new id_lock_service();
+  cshared_ptr<lock_service> ls_ptr(ls);
+  global_id_generator_zk leasing(10);
+  leasing.set_ls(ls_ptr, "/test");
+  global_id_generator_zk other;
+  other.set_ls(ls_ptr, "/test");
+
+  vector<uint64_t> ids;
+  for (size_t i = 0; i < 100; ++i) {
+    ids.push_back(leasing.generate());
+    ids.push_back(other.generate());
+  }
+  expect_unique(ids);
+}
+
+}  // namespace common
+}  // namespace jubatus
@@ -59,6 +59,12 @@ class lock_service {
       const std::string& path,
       uint32_t prefix,
       uint64_t& res) = 0;
+  // creates size consecutive ids at once, of which first is the smallest
+  virtual bool create_id_block(
+      const std::string& path,
+      uint32_t prefix,
+      uint32_t size,
+      uint64_t& first) = 0;
 
   virtual bool list(const std::string& path, std::vector<std::string>& out) = 0;
   virtual bool hd_list(const std::string& path, std::string& out) = 0;
@@ -0,0 +1,91 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <vector>
+#include <pficommon/concurrent/thread.h>
+#include <pficommon/lang/bind.h>
+#include <pficommon/lang/shared_ptr.h>
+#include "exception.hpp"
+
+using std::vector;
+using pfi::concurrent::thread;
+using pfi::lang::function;
+using pfi::lang::shared_ptr;
+
+namespace jubatus {
+namespace common {
+
+namespace {
+
+// whether the current thread was started by run_chunks
+__thread bool in_chunk_thread = false;
+
+void run_chunk(
+    const function<void(size_t, size_t, size_t)>* f,
+    size_t chunk,
+    size_t begin,
+    size_t end,
+    jubatus::exception::exception_thrower_ptr* error) {
+  in_chunk_thread = true;
+  try {
+    (*f)(chunk, begin, end);
+  } catch (...) {
+    *error = jubatus::exception::get_current_exception();
+  }
+}
+
+}  // namespace
+
+size_t get_chunk_num(size_t size, size_t thread_num, size_t min_chunk_size) {
+  if (in_chunk_thread) {
+    return 1;
+  }
+  return std::max(std::min(thread_num, size / min_chunk_size),
+                  static_cast<size_t>(1));
+}
+
+void run_chunks(
+    const function<void(size_t, size_t, size_t)>& f,
+    size_t size,
+    size_t chunk_num) {
+  if (chunk_num <= 1) {
+    f(0, 0, size);
+    return;
+  }
+
+  vector<jubatus::exception::exception_thrower_ptr> errors(chunk_num);
+  vector<shared_ptr<thread> > threads;
+  for (size_t i = 0; i < chunk_num; ++i) {
+    threads.push_back(shared_ptr<thread>(new thread(pfi::lang::bind(
+        &run_chunk, &f, i, size * i / chunk_num, size * (i + 1) / chunk_num,
+        &errors[i]))));
+    threads.back()->start();
+  }
+  for (size_t i = 0; i < chunk_num; ++i) {
+    threads[i]->join();
+  }
+  for (size_t i = 0; i < chunk_num; ++i) {
+    if (errors[i]) {
+      errors[i]->throw_exception();
+    }
+  }
+}
+
+}  // namespace common
+}  // namespace jubatus
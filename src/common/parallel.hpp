@@ -0,0 +1,43 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#ifndef JUBATUS_COMMON_PARALLEL_HPP_
+#define JUBATUS_COMMON_PARALLEL_HPP_
+
+#include <cstddef>
+#include <pficommon/lang/function.h>
+
+namespace jubatus {
+namespace common {
+
+// Returns the number of chunks to split size elements into for
+// run_chunks, which is at most thread_num and leaves at least
+// min_chunk_size elements in each chunk, and at least 1.
+// Threads started by run_chunks get 1, so that they start no more threads.
+size_t get_chunk_num(size_t size, size_t thread_num, size_t min_chunk_size);
+
+// Calls f(i, begin, end) for the i-th of chunk_num chunks [begin, end) of
+// [0, size) in its own thread, and rethrows an exception thrown by them
+// after all of them end. A single chunk runs in the calling thread.
+void run_chunks(
+    const pfi::lang::function<void(size_t, size_t, size_t)>& f,
+    size_t size,
+    size_t chunk_num);
+
+}  // namespace common
+}  // namespace jubatus
+
+#endif  // JUBATUS_COMMON_PARALLEL_HPP_
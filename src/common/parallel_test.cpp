@@ -0,0 +1,86 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include <vector>
+#include <gtest/gtest.h>
+#include <pficommon/lang/bind.h>
+#include "exception.hpp"
+#include "parallel.hpp"
+
+using std::vector;
+
+namespace jubatus {
+namespace common {
+
+namespace {
+
+void count_elements(
+    vector<int>* counts,
+    vector<size_t>* nested_chunk_nums,
+    size_t chunk,
+    size_t begin,
+    size_t end) {
+  for (size_t i = begin; i < end; ++i) {
+    ++(*counts)[i];
+  }
+  (*nested_chunk_nums)[chunk] = get_chunk_num(100, 4, 1);
+}
+
+void throw_in_last_chunk(size_t chunk_num, size_t chunk, size_t, size_t) {
+  if (chunk == chunk_num - 1) {
+    throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error("error"));
+  }
+}
+
+}  // namespace
+
+TEST(get_chunk_num, trivial) {
+  EXPECT_EQ(4u, get_chunk_num(100, 4, 10));
+  EXPECT_EQ(2u, get_chunk_num(25, 4, 10));
+  EXPECT_EQ(1u, get_chunk_num(5, 4, 10));
+  EXPECT_EQ(1u, get_chunk_num(0, 4, 10));
+  EXPECT_EQ(1u, get_chunk_num(100, 0, 10));
+}
+
+TEST(run_chunks, all_elements) {
+  for (size_t chunk_num = 1; chunk_num <= 4; ++chunk_num) {
+    vector<int> counts(10);
+    vector<size_t> nested_chunk_nums(chunk_num);
+    run_chunks(pfi::lang::bind(&count_elements, &counts, &nested_chunk_nums,
+                               pfi::lang::_1, pfi::lang::_2, pfi::lang::_3),
+               counts.size(), chunk_num);
+    EXPECT_EQ(vector<int>(10, 1), counts);
+    if (chunk_num > 1) {
+      // threads of chunks start no more threads
+      EXPECT_EQ(vector<size_t>(chunk_num, 1), nested_chunk_nums);
+    }
+  }
+  EXPECT_EQ(4u, get_chunk_num(100, 4, 1));
+}
+
+TEST(run_chunks, exception) {
+  EXPECT_THROW(run_chunks(pfi::lang::bind(&throw_in_last_chunk, 3,
+                                          pfi::lang::_1, pfi::lang::_2,
+                                          pfi::lang::_3), 10, 3),
+               jubatus::exception::runtime_error);
+  EXPECT_THROW(run_chunks(pfi::lang::bind(&throw_in_last_chunk, 1,
+                                          pfi::lang::_1, pfi::lang::_2,
+                                          pfi::lang::_3), 10, 1),
+               jubatus::exception::runtime_error);
+}
+
+}  // namespace common
+}  // namespace jubatus
@@ -156,6 +156,37 @@ bool zk::create_id(const string& path, uint32_t prefix, uint64_t& res) {
   return true;
 }
 
+bool zk::create_id_block(
+    const string& path,
+    uint32_t prefix,
+    uint32_t size,
+    uint64_t& first) {
+  if (size == 0) {
+    return false;
+  }
+
+  // versions are increased one by one by the operations done atomically
+  vector<zoo_op_t> ops(size);
+  vector<zoo_op_result_t> results(size);
+  vector<struct Stat> stats(size);
+  for (uint32_t i = 0; i < size; ++i) {
+    zoo_set_op_init(&ops[i], path.c_str(), "dummy", 6, -1, &stats[i]);
+  }
+
+  scoped_lock lk(m_);
+  int rc = zoo_multi(zh_, size, &ops[0], &results[0]);
+
+  if (rc != ZOK) {
+    LOG(ERROR) << "failed to set data: " << path << " - " << zerror(rc);
+    return false;
+  }
+
+  first = (static_cast<uint64_t>(prefix) << 32)
+      | (stats[size - 1].version - size + 1);
+  DLOG(INFO) << __func__ << " " << path << " " << size;
+  return true;
+}
+
 bool zk::remove(const string& path) {
   scoped_lock lk(m_);
   int rc = zoo_delete(zh_, path.c_str(), -1);
@@ -60,6 +60,11 @@ class zk : public lock_service {
   // ephemeral only
   bool create_seq(const std::string& path, std::string&);
   bool create_id(const std::string& path, uint32_t prefix, uint64_t& res);
+  bool create_id_block(
+      const std::string& path,
+      uint32_t prefix,
+      uint32_t size,
+      uint64_t& first);
 
   // returns unsorted list
   bool list(const std::string& path, std::vector<std::string>& out);
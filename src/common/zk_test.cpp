@@ -135,6 +135,24 @@ TEST_F(zk_trivial, create_id) {
   zk_->remove(root_path);
 }
 
+TEST_F(zk_trivial, create_id_block) {
+  zk_->create(root_path, "");
+  ASSERT_TRUE(zk_->exists(root_path));
+
+  uint64_t id = 0, first = 0;
+
+  EXPECT_TRUE(zk_->create_id(root_path, 1, id));
+  EXPECT_EQ(0x100000000llu + 1, id);
+
+  EXPECT_TRUE(zk_->create_id_block(root_path, 1, 10, first));
+  EXPECT_EQ(0x100000000llu + 2, first);
+
+  EXPECT_TRUE(zk_->create_id(root_path, 1, id));
+  EXPECT_EQ(0x100000000llu + 12, id);
+
+  zk_->remove(root_path);
+}
+
 // TODO(kashihara): test lock_service_mutex
 
 TEST_F(zk_trivial, trivial_with_membershp) {
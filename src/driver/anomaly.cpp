@@ -16,9 +16,13 @@
 
 #include "anomaly.hpp"
 
+#include <time.h>
+#include <map>
 #include <string>
 #include <utility>
 #include <vector>
+#include <pficommon/lang/bind.h>
+#include <pficommon/lang/cast.h>
 
 #include "../anomaly/anomaly_factory.hpp"
 #include "../common/global_id_generator_base.hpp"
@@ -43,13 +47,21 @@ using pfi::lang::shared_ptr;
 namespace jubatus {
 namespace driver {
 
+namespace {
+
+// expired rows evicted at a time under the write lock
+const size_t EXPIRED_ROWS_PER_EVICTION = 1024;
+
+}  // namespace
+
 anomaly::anomaly(
     jubatus::anomaly::anomaly_base* anomaly_method,
     pfi::lang::shared_ptr<framework::mixer::mixer> mixer,
     pfi::lang::shared_ptr<fv_converter::datum_to_fv_converter> converter)
     : mixer_(mixer),
       mixable_holder_(new mixable_holder),
-      converter_(converter) {
+      converter_(converter),
+      evicted_row_num_(0) {
   common::cshared_ptr<jubatus::anomaly::anomaly_base>
       anomaly_method_p(anomaly_method);
   anomaly_.set_model(anomaly_method_p);
@@ -58,15 +70,22 @@ anomaly::anomaly(
   mixer_->set_mixable_holder(mixable_holder_);
   mixable_holder_->register_mixable(&anomaly_);
   mixable_holder_->register_mixable(&wm_);
+  anomaly_.rows_changed = pfi::lang::bind(&anomaly::sync_rows, this);
 
   (*converter_).set_weight_manager(wm_.get_model());
 }
 
 anomaly::~anomaly() {
+  if (row_expirer_) {
+    row_expirer_->stop();
+  }
 }
 
 void anomaly::clear_row(const std::string& id) {
   anomaly_.get_model()->clear_row(id);
+  if (row_limiter_) {
+    row_limiter_->remove(id);
+  }
 }
 
 pair<string, float> anomaly::add(
@@ -76,16 +95,59 @@ pair<string, float> anomaly::add(
   return make_pair(id, score);
 }
 
+void anomaly::convert_for_add(const fv_converter::datum& d, sfv_t& v) {
+  converter_->convert_and_update_weight(d, v);
+}
+
+pair<string, float> anomaly::add(const string& id, const sfv_t& v) {
+  anomaly_.get_model()->update_row(id, v);
+  limit_rows(id);
+  return make_pair(id, anomaly_.get_model()->calc_anomaly_score(id));
+}
+
+void anomaly::convert_for_add(
+    const vector<fv_converter::datum>& data,
+    vector<sfv_t>& vs,
+    size_t thread_num) {
+  converter_->convert_and_update_weight_many(data, vs, thread_num);
+}
+
+vector<pair<string, float> > anomaly::add_bulk(
+    const vector<string>& ids,
+    const vector<sfv_t>& vs,
+    size_t thread_num) {
+  for (size_t i = 0; i < ids.size(); ++i) {
+    anomaly_.get_model()->update_row(ids[i], vs[i]);
+  }
+
+  // rows of the batch may be evicted by the others
+  vector<float> scores;
+  anomaly_.get_model()->calc_anomaly_scores(ids, scores, thread_num);
+  for (size_t i = 0; i < ids.size(); ++i) {
+    limit_rows(ids[i]);
+  }
+
+  vector<pair<string, float> > ret(ids.size());
+  for (size_t i = 0; i < ids.size(); ++i) {
+    ret[i] = make_pair(ids[i], scores[i]);
+  }
+  return ret;
+}
+
 float anomaly::update(const string& id, const fv_converter::datum& d) {
   sfv_t v;
   converter_->convert_and_update_weight(d, v);
 
   anomaly_.get_model()->update_row(id, v);
+  limit_rows(id);
   return anomaly_.get_model()->calc_anomaly_score(id);
 }
 
 void anomaly::clear() {
   anomaly_.get_model()->clear();
+  if (row_limiter_) {
+    row_limiter_->clear();
+  }
 }
 
 float anomaly::calc_score(const fv_converter::datum& d) const {
@@ -94,11 +156,79 @@ float anomaly::calc_score(const fv_converter::datum& d) const {
   return anomaly_.get_model()->calc_anomaly_score(v);
 }
 
+vector<float> anomaly::calc_score_bulk(
+    const vector<fv_converter::datum>& data,
+    size_t thread_num) const {
+  vector<sfv_t> vs;
+  converter_->convert_many(data, vs);
+
+  vector<float> scores;
+  anomaly_.get_model()->calc_anomaly_scores(vs, scores, thread_num);
+  return scores;
+}
+
 vector<string> anomaly::get_all_rows() const {
   vector<string> ids;
   anomaly_.get_model()->get_all_row_ids(ids);
   return ids;
 }
 
+void anomaly::get_status(std::map<string, string>& status) const {
+  converter_->get_status(status);
+  if (row_limiter_) {
+    status["row_limiter.row_num"] =
+        pfi::lang::lexical_cast<string>(row_limiter_->size());
+    status["row_limiter.evicted_row_num"] =
+        pfi::lang::lexical_cast<string>(evicted_row_num_);
+  }
+}
+
+void anomaly::set_row_limits(const row_limiter::config& config) {
+  row_limiter_.reset(new row_limiter(config));
+  if (row_limiter_->has_ttl()) {
+    row_expirer_.reset(new row_expirer(
+        mixable_holder_->rw_mutex(),
+        pfi::lang::bind(&anomaly::evict_expired_rows, this)));
+    row_expirer_->start();
+  }
+}
+
+void anomaly::limit_rows(const std::string& updated_id) {
+  if (!row_limiter_) {
+    return;
+  }
+  row_limiter_->touch(updated_id, time(NULL));
+  evict_overflowed_rows();
+}
+
+void anomaly::sync_rows() {
+  if (!row_limiter_) {
+    return;
+  }
+  vector<string> ids;
+  anomaly_.get_model()->get_all_row_ids(ids);
+  row_limiter_->sync(ids, time(NULL));
+  evict_overflowed_rows();
+}
+
+void anomaly::evict_overflowed_rows() {
+  vector<string> ids;
+  row_limiter_->take_overflowed(ids);
+  for (size_t i = 0; i < ids.size(); ++i) {
+    anomaly_.get_model()->clear_row(ids[i]);
+  }
+  evicted_row_num_ += ids.size();
+}
+
+bool anomaly::evict_expired_rows() {
+  vector<string> ids;
+  row_limiter_->take_expired(time(NULL), EXPIRED_ROWS_PER_EVICTION, ids);
+  for (size_t i = 0; i < ids.size(); ++i) {
+    anomaly_.get_model()->clear_row(ids[i]);
+  }
+  evicted_row_num_ += ids.size();
+  return ids.size() == EXPIRED_ROWS_PER_EVICTION;
+}
+
 }  // namespace driver
 }  // namespace jubatus
@@ -17,9 +17,11 @@
 #ifndef JUBATUS_DRIVER_ANOMALY_HPP_
 #define JUBATUS_DRIVER_ANOMALY_HPP_
 
+#include <map>
 #include <string>
 #include <utility>
 #include <vector>
+#include <pficommon/lang/function.h>
 #include <pficommon/lang/shared_ptr.h>
 #include "../anomaly/anomaly_base.hpp"
 #include "../common/shared_ptr.hpp"
@@ -29,6 +31,7 @@
 #include "diffv.hpp"
 #include "linear_function_mixer.hpp"
 #include "mixable_weight_manager.hpp"
+#include "row_limiter.hpp"
 
 namespace jubatus {
 namespace driver {
@@ -44,6 +47,9 @@ struct mixable_anomaly : public framework::mixable<
 
   void put_diff_impl(const std::string& v) {
     get_model()->get_storage()->set_mixed_and_clear_diff(v);
+    if (rows_changed) {
+      rows_changed();
+    }
   }
 
   void mix_impl(
@@ -54,8 +60,18 @@ struct mixable_anomaly : public framework::mixable<
     get_model()->get_const_storage()->mix(rhs, mixed);
   }
 
+  void load(std::istream& is) {
+    framework::mixable<jubatus::anomaly::anomaly_base, std::string>::load(is);
+    if (rows_changed) {
+      rows_changed();
+    }
+  }
+
   void clear() {
   }
+
+  // called after rows are added or removed by mix or load
+  pfi::lang::function<void()> rows_changed;
 };
 
 class anomaly {
@@ -83,17 +99,53 @@ class anomaly {
       const std::string& id,
       const fv_converter::datum& d);
   float update(const std::string& id, const fv_converter::datum& d);
+
+  // Two-stage add. convert_for_add only needs the model read lock; add
+  // with a converted row needs the write lock.
+  void convert_for_add(const fv_converter::datum& d, sfv_t& v);
+  std::pair<std::string, float> add(const std::string& id, const sfv_t& v);
+
+  // Batch versions of add and calc_score, which use thread_num threads.
+  // Scores of added rows are calculated after all of them are added, and
+  // rows over the limit are evicted after that.
+  void convert_for_add(
+      const std::vector<fv_converter::datum>& data,
+      std::vector<sfv_t>& vs,
+      size_t thread_num);
+  std::vector<std::pair<std::string, float> > add_bulk(
+      const std::vector<std::string>& ids,
+      const std::vector<sfv_t>& vs,
+      size_t thread_num);
+  std::vector<float> calc_score_bulk(
+      const std::vector<fv_converter::datum>& data,
+      size_t thread_num) const;
+
   void clear();
   float calc_score(const fv_converter::datum& d) const;
   std::vector<std::string> get_all_rows() const;
 
+  void get_status(std::map<std::string, std::string>& status) const;
+
+  // Evicts rows of the model by the limits, including rows added by mix or
+  // load. Expired rows are evicted in background.
+  void set_row_limits(const row_limiter::config& config);
+
  private:
+  void limit_rows(const std::string& updated_id);
+  void sync_rows();
+  void evict_overflowed_rows();
+  bool evict_expired_rows();
+
   pfi::lang::shared_ptr<framework::mixer::mixer> mixer_;
   pfi::lang::shared_ptr<framework::mixable_holder> mixable_holder_;
 
   pfi::lang::shared_ptr<fv_converter::datum_to_fv_converter> converter_;
   mixable_anomaly anomaly_;
   mixable_weight_manager wm_;
+
+  pfi::lang::shared_ptr<row_limiter> row_limiter_;
+  uint64_t evicted_row_num_;
+  pfi::lang::shared_ptr<row_expirer> row_expirer_;
 };
 
 }  // namespace driver
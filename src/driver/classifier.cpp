@@ -16,6 +16,7 @@
 
 #include "classifier.hpp"
 
+#include <map>
 #include <string>
 #include <utility>
 #include <vector>
@@ -81,5 +82,56 @@ classify_result classifier::classify(
   return scores;
 }
 
+void classifier::train(
+    const vector<pair<string, fv_converter::datum> >& data) {
+  vector<pair<string, sfv_t> > examples;
+  convert_for_train(data, examples, 1);
+  train(examples);
+}
+
+vector<classify_result> classifier::classify(
+    const vector<fv_converter::datum>& data) const {
+  vector<sfv_t> vs;
+  converter_->convert_many(data, vs);
+
+  vector<classify_result> results(vs.size());
+  for (size_t i = 0; i < vs.size(); ++i) {
+    classifier_->classify_with_scores(vs[i], results[i]);
+  }
+  return results;
+}
+
+void classifier::convert_for_train(
+    const vector<pair<string, fv_converter::datum> >& data,
+    vector<pair<string, sfv_t> >& examples,
+    size_t thread_num) {
+  vector<fv_converter::datum> datums;
+  datums.reserve(data.size());
+  for (size_t i = 0; i < data.size(); ++i) {
+    datums.push_back(data[i].second);
+  }
+
+  vector<sfv_t> vs;
+  converter_->convert_and_update_weight_many(datums, vs, thread_num);
+
+  vector<pair<string, sfv_t> > ret(vs.size());
+  for (size_t i = 0; i < vs.size(); ++i) {
+    ret[i].first = data[i].first;
+    ret[i].second.swap(vs[i]);
+    sort_and_merge(ret[i].second);
+  }
+  ret.swap(examples);
+}
+
+void classifier::train(const vector<pair<string, sfv_t> >& examples) {
+  for (size_t i = 0; i < examples.size(); ++i) {
+    classifier_->train(examples[i].second, examples[i].first);
+  }
+}
+
+void classifier::get_status(std::map<string, string>& status) const {
+  converter_->get_status(status);
+}
+
 }  // namespace driver
 }  // namespace jubatus
@@ -17,6 +17,7 @@
 #ifndef JUBATUS_DRIVER_CLASSIFIER_HPP_
 #define JUBATUS_DRIVER_CLASSIFIER_HPP_
 
+#include <map>
 #include <string>
 #include <utility>
 #include <vector>
@@ -59,6 +60,25 @@ class classifier {
   void train(const std::pair<std::string, fv_converter::datum>& data);
   classify_result classify(const fv_converter::datum& data) const;
 
+  // Batch versions. Data are converted together so that splitters can
+  // process all string values at once.
+  void train(
+      const std::vector<std::pair<std::string, fv_converter::datum> >& data);
+  std::vector<classify_result> classify(
+      const std::vector<fv_converter::datum>& data) const;
+
+  // Two-stage batch training. convert_for_train only updates document
+  // frequencies, which is thread-safe, so it can run under the model read
+  // lock with data split into thread_num chunks. train with converted
+  // examples needs the write lock.
+  void convert_for_train(
+      const std::vector<std::pair<std::string, fv_converter::datum> >& data,
+      std::vector<std::pair<std::string, sfv_t> >& examples,
+      size_t thread_num);
+  void train(const std::vector<std::pair<std::string, sfv_t> >& examples);
+
+  void get_status(std::map<std::string, std::string>& status) const;
+
  private:
   pfi::lang::shared_ptr<framework::mixer::mixer> mixer_;
   pfi::lang::shared_ptr<framework::mixable_holder> mixable_holder_;
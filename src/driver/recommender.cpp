@@ -16,9 +16,13 @@
 
 #include "recommender.hpp"
 
+#include <time.h>
+#include <map>
 #include <string>
 #include <utility>
 #include <vector>
+#include <pficommon/lang/bind.h>
+#include <pficommon/lang/cast.h>
 
 #include "../recommender/recommender_factory.hpp"
 #include "../common/util.hpp"
@@ -42,13 +46,21 @@ using pfi::lang::shared_ptr;
 namespace jubatus {
 namespace driver {
 
+namespace {
+
+// expired rows evicted at a time under the write lock
+const size_t EXPIRED_ROWS_PER_EVICTION = 1024;
+
+}  // namespace
+
 recommender::recommender(
     jubatus::recommender::recommender_base* recommender_method,
     pfi::lang::shared_ptr<framework::mixer::mixer> mixer,
     pfi::lang::shared_ptr<fv_converter::datum_to_fv_converter> converter)
     : mixer_(mixer),
       mixable_holder_(new mixable_holder),
-      converter_(converter) {
+      converter_(converter),
+      evicted_row_num_(0) {
   common::cshared_ptr<jubatus::recommender::recommender_base>
       recommender_method_p(recommender_method);
   recommender_.set_model(recommender_method_p);
@@ -57,15 +69,22 @@ recommender::recommender(
   mixer_->set_mixable_holder(mixable_holder_);
   mixable_holder_->register_mixable(&recommender_);
   mixable_holder_->register_mixable(&wm_);
+  recommender_.rows_changed = pfi::lang::bind(&recommender::sync_rows, this);
 
   (*converter_).set_weight_manager(wm_.get_model());
 }
 
 recommender::~recommender() {
+  if (row_expirer_) {
+    row_expirer_->stop();
+  }
 }
 
 void recommender::clear_row(const std::string& id) {
   recommender_.get_model()->clear_row(id);
+  if (row_limiter_) {
+    row_limiter_->remove(id);
+  }
 }
 
 void recommender::update_row(
@@ -74,15 +93,32 @@ void recommender::update_row(
   sfv_diff_t v;
   converter_->convert_and_update_weight(dat, v);
   recommender_.get_model()->update_row(id, v);
+  limit_rows(id);
+}
+
+void recommender::convert_for_update_row(
+    const fv_converter::datum& dat,
+    sfv_t& v) {
+  converter_->convert_and_update_weight(dat, v);
+}
+
+void recommender::update_row(const std::string& id, const sfv_t& v) {
+  recommender_.get_model()->update_row(id, v);
+  limit_rows(id);
 }
 
 void recommender::clear() {
   recommender_.get_model()->clear();
+  if (row_limiter_) {
+    row_limiter_->clear();
+  }
 }
 
-fv_converter::datum recommender::complete_row_from_id(const std::string& id) {
+fv_converter::datum recommender::complete_row_from_id(
+    const std::string& id,
+    size_t thread_num) {
   sfv_t v;
-  recommender_.get_model()->complete_row(id, v);
+  recommender_.get_model()->complete_row(id, v, thread_num);
 
   fv_converter::datum ret;
   fv_converter::revert_feature(v, ret);
@@ -90,10 +126,11 @@ fv_converter::datum recommender::complete_row_from_id(const std::string& id) {
 }
 
 fv_converter::datum recommender::complete_row_from_datum(
-    const fv_converter::datum& dat) {
+    const fv_converter::datum& dat,
+    size_t thread_num) {
   sfv_t u, v;
   converter_->convert(dat, u);
-  recommender_.get_model()->complete_row(u, v);
+  recommender_.get_model()->complete_row(u, v, thread_num);
 
   fv_converter::datum ret;
   fv_converter::revert_feature(v, ret);
@@ -120,6 +157,29 @@ recommender::similar_row_from_datum(
   return ret;
 }
 
+std::vector<std::vector<std::pair<std::string, float> > >
+recommender::similar_row_from_ids(
+    const std::vector<std::string>& ids,
+    size_t ret_num,
+    size_t thread_num) {
+  std::vector<std::vector<std::pair<std::string, float> > > ret;
+  recommender_.get_model()->similar_rows(ids, ret, ret_num, thread_num);
+  return ret;
+}
+
+std::vector<std::vector<std::pair<std::string, float> > >
+recommender::similar_row_from_datums(
+    const std::vector<fv_converter::datum>& data,
+    size_t size,
+    size_t thread_num) {
+  std::vector<sfv_t> vs;
+  converter_->convert_many(data, vs);
+
+  std::vector<std::vector<std::pair<std::string, float> > > ret;
+  recommender_.get_model()->similar_rows(vs, ret, size, thread_num);
+  return ret;
+}
+
 float recommender::calc_similality(
     const fv_converter::datum& l,
     const fv_converter::datum& r) {
@@ -150,5 +210,62 @@ std::vector<std::string> recommender::get_all_rows() {
   return ret;
 }
 
+void recommender::get_status(std::map<string, string>& status) const {
+  converter_->get_status(status);
+  if (row_limiter_) {
+    status["row_limiter.row_num"] =
+        pfi::lang::lexical_cast<string>(row_limiter_->size());
+    status["row_limiter.evicted_row_num"] =
+        pfi::lang::lexical_cast<string>(evicted_row_num_);
+  }
+}
+
+void recommender::set_row_limits(const row_limiter::config& config) {
+  row_limiter_.reset(new row_limiter(config));
+  if (row_limiter_->has_ttl()) {
+    row_expirer_.reset(new row_expirer(
+        mixable_holder_->rw_mutex(),
+        pfi::lang::bind(&recommender::evict_expired_rows, this)));
+    row_expirer_->start();
+  }
+}
+
+void recommender::limit_rows(const std::string& updated_id) {
+  if (!row_limiter_) {
+    return;
+  }
+  row_limiter_->touch(updated_id, time(NULL));
+  evict_overflowed_rows();
+}
+
+void recommender::sync_rows() {
+  if (!row_limiter_) {
+    return;
+  }
+  vector<string> ids;
+  recommender_.get_model()->get_all_row_ids(ids);
+  row_limiter_->sync(ids, time(NULL));
+  evict_overflowed_rows();
+}
+
+void recommender::evict_overflowed_rows() {
+  vector<string> ids;
+  row_limiter_->take_overflowed(ids);
+  for (size_t i = 0; i < ids.size(); ++i) {
+    recommender_.get_model()->clear_row(ids[i]);
+  }
+  evicted_row_num_ += ids.size();
+}
+
+bool recommender::evict_expired_rows() {
+  vector<string> ids;
+  row_limiter_->take_expired(time(NULL), EXPIRED_ROWS_PER_EVICTION, ids);
+  for (size_t i = 0; i < ids.size(); ++i) {
+    recommender_.get_model()->clear_row(ids[i]);
+  }
+  evicted_row_num_ += ids.size();
+  return ids.size() == EXPIRED_ROWS_PER_EVICTION;
+}
+
 }  // namespace driver
 }  // namespace jubatus
@@ -17,9 +17,11 @@
 #ifndef JUBATUS_DRIVER_RECOMMENDER_HPP_
 #define JUBATUS_DRIVER_RECOMMENDER_HPP_
 
+#include <map>
 #include <string>
 #include <utility>
 #include <vector>
+#include <pficommon/lang/function.h>
 #include <pficommon/lang/shared_ptr.h>
 #include "../recommender/recommender_base.hpp"
 #include "../common/shared_ptr.hpp"
@@ -29,6 +31,7 @@
 #include "diffv.hpp"
 #include "linear_function_mixer.hpp"
 #include "mixable_weight_manager.hpp"
+#include "row_limiter.hpp"
 
 namespace jubatus {
 namespace driver {
@@ -44,6 +47,9 @@ struct mixable_recommender : public framework::mixable<
 
   void put_diff_impl(const std::string& v) {
     get_model()->get_storage()->set_mixed_and_clear_diff(v);
+    if (rows_changed) {
+      rows_changed();
+    }
   }
 
   void mix_impl(
@@ -54,8 +60,19 @@ struct mixable_recommender : public framework::mixable<
     get_model()->get_const_storage()->mix(rhs, mixed);
   }
 
+  void load(std::istream& is) {
+    framework::mixable<jubatus::recommender::recommender_base,
+                       std::string>::load(is);
+    if (rows_changed) {
+      rows_changed();
+    }
+  }
+
   void clear() {
   }
+
+  // called after rows are added or removed by mix or load
+  pfi::lang::function<void()> rows_changed;
 };
 
 class recommender {
@@ -82,16 +99,36 @@ class recommender {
 
   void clear_row(const std::string& id);
   void update_row(const std::string& id, const fv_converter::datum& dat);
+
+  // Two-stage update. convert_for_update_row only needs the model read
+  // lock; update_row with a converted row needs the write lock.
+  void convert_for_update_row(const fv_converter::datum& dat, sfv_t& v);
+  void update_row(const std::string& id, const sfv_t& v);
   void clear();
 
-  fv_converter::datum complete_row_from_id(const std::string& id);
-  fv_converter::datum complete_row_from_datum(const fv_converter::datum& dat);
+  fv_converter::datum complete_row_from_id(
+      const std::string& id,
+      size_t thread_num);
+  fv_converter::datum complete_row_from_datum(
+      const fv_converter::datum& dat,
+      size_t thread_num);
   std::vector<std::pair<std::string, float> > similar_row_from_id(
       const std::string& id,
       size_t ret_num);
   std::vector<std::pair<std::string, float> > similar_row_from_datum(
       const fv_converter::datum& data,
       size_t size);
+  // Batch versions of similar_row_from_id and similar_row_from_datum
+  std::vector<std::vector<std::pair<std::string, float> > >
+  similar_row_from_ids(
+      const std::vector<std::string>& ids,
+      size_t ret_num,
+      size_t thread_num);
+  std::vector<std::vector<std::pair<std::string, float> > >
+  similar_row_from_datums(
+      const std::vector<fv_converter::datum>& data,
+      size_t size,
+      size_t thread_num);
 
   float calc_similality(
       const fv_converter::datum& l,
@@ -101,13 +138,28 @@ class recommender {
   fv_converter::datum decode_row(const std::string& id);
   std::vector<std::string> get_all_rows();
 
+  void get_status(std::map<std::string, std::string>& status) const;
+
+  // Evicts rows of the model by the limits, including rows added by mix or
+  // load. Expired rows are evicted in background.
+  void set_row_limits(const row_limiter::config& config);
+
  private:
+  void limit_rows(const std::string& updated_id);
+  void sync_rows();
+  void evict_overflowed_rows();
+  bool evict_expired_rows();
+
   pfi::lang::shared_ptr<framework::mixer::mixer> mixer_;
   pfi::lang::shared_ptr<framework::mixable_holder> mixable_holder_;
 
   pfi::lang::shared_ptr<fv_converter::datum_to_fv_converter> converter_;
   mixable_recommender recommender_;
   mixable_weight_manager wm_;
+
+  pfi::lang::shared_ptr<row_limiter> row_limiter_;
+  uint64_t evicted_row_num_;
+  pfi::lang::shared_ptr<row_expirer> row_expirer_;
 };
 
 }  // namespace driver
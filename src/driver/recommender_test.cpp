@@ -0,0 +1,103 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <pficommon/lang/cast.h>
+#include <pficommon/lang/shared_ptr.h>
+
+#include "recommender.hpp"
+#include "../framework/mixer/dummy_mixer.hpp"
+#include "../fv_converter/datum_to_fv_converter.hpp"
+#include "../recommender/inverted_index.hpp"
+
+using std::make_pair;
+using std::map;
+using std::string;
+using std::stringstream;
+using pfi::lang::lexical_cast;
+using pfi::lang::shared_ptr;
+
+namespace jubatus {
+namespace driver {
+
+namespace {
+
+shared_ptr<recommender> make_recommender(int max_rows) {
+  shared_ptr<recommender> r(new recommender(
+      new jubatus::recommender::inverted_index,
+      shared_ptr<framework::mixer::mixer>(
+          new framework::mixer::dummy_mixer),
+      shared_ptr<fv_converter::datum_to_fv_converter>(
+          new fv_converter::datum_to_fv_converter)));
+  if (max_rows) {
+    row_limiter::config config;
+    config.max_rows = max_rows;
+    r->set_row_limits(config);
+  }
+  return r;
+}
+
+mixable_recommender* get_mixable(recommender& r) {
+  return dynamic_cast<mixable_recommender*>(
+      r.get_mixable_holder()->get_mixables()[0]);
+}
+
+void add_rows(recommender& r, size_t num) {
+  for (size_t i = 0; i < num; ++i) {
+    sfv_t v;
+    v.push_back(make_pair("f" + lexical_cast<string>(i % 3), 1.0f));
+    r.update_row("r" + lexical_cast<string>(i), v);
+  }
+}
+
+}  // namespace
+
+TEST(recommender, row_limit_of_mixed_rows) {
+  shared_ptr<recommender> r1 = make_recommender(0);
+  shared_ptr<recommender> r2 = make_recommender(3);
+  add_rows(*r1, 5);
+
+  // r2 receives the rows only by mix
+  get_mixable(*r2)->put_diff_impl(get_mixable(*r1)->get_diff_impl());
+  map<string, string> status;
+  r2->get_status(status);
+  EXPECT_EQ("3", status["row_limiter.row_num"]);
+  EXPECT_EQ("2", status["row_limiter.evicted_row_num"]);
+}
+
+TEST(recommender, row_limit_of_loaded_rows) {
+  shared_ptr<recommender> r1 = make_recommender(0);
+  shared_ptr<recommender> r2 = make_recommender(3);
+  add_rows(*r1, 5);
+  get_mixable(*r1)->put_diff_impl(get_mixable(*r1)->get_diff_impl());
+
+  stringstream ss;
+  get_mixable(*r1)->save(ss);
+  get_mixable(*r2)->load(ss);
+  map<string, string> status;
+  r2->get_status(status);
+  EXPECT_EQ("3", status["row_limiter.row_num"]);
+  EXPECT_EQ("2", status["row_limiter.evicted_row_num"]);
+}
+
+}  // namespace driver
+}  // namespace jubatus
@@ -16,8 +16,10 @@
 
 #include "regression.hpp"
 
+#include <map>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "../common/util.hpp"
 #include "../framework/mixer/mixer_factory.hpp"
@@ -28,6 +30,7 @@
 
 using std::string;
 using std::pair;
+using std::vector;
 
 using jubatus::framework::mixer::create_mixer;
 using jubatus::framework::mixable_holder;
@@ -73,5 +76,36 @@ float regression::estimate(
   return value;
 }
 
+void regression::convert_for_train(
+    const vector<pair<float, fv_converter::datum> >& data,
+    vector<pair<float, sfv_t> >& examples,
+    size_t thread_num) {
+  vector<fv_converter::datum> datums;
+  datums.reserve(data.size());
+  for (size_t i = 0; i < data.size(); ++i) {
+    datums.push_back(data[i].second);
+  }
+
+  vector<sfv_t> vs;
+  converter_->convert_and_update_weight_many(datums, vs, thread_num);
+
+  vector<pair<float, sfv_t> > ret(vs.size());
+  for (size_t i = 0; i < vs.size(); ++i) {
+    ret[i].first = data[i].first;
+    ret[i].second.swap(vs[i]);
+  }
+  ret.swap(examples);
+}
+
+void regression::train(const vector<pair<float, sfv_t> >& examples) {
+  for (size_t i = 0; i < examples.size(); ++i) {
+    regression_->train(examples[i].second, examples[i].first);
+  }
+}
+
+void regression::get_status(std::map<string, string>& status) const {
+  converter_->get_status(status);
+}
+
 }  // namespace driver
 }  // namespace jubatus
@@ -17,8 +17,10 @@
 #ifndef JUBATUS_DRIVER_REGRESSION_HPP_
 #define JUBATUS_DRIVER_REGRESSION_HPP_
 
+#include <map>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include <pficommon/lang/shared_ptr.h>
 #include "../regression/regression_base.hpp"
@@ -56,6 +58,15 @@ class regression {
   void train(const std::pair<float, fv_converter::datum>& data);
   float estimate(const fv_converter::datum& data) const;
 
+  // Two-stage batch training; see driver::classifier::convert_for_train
+  void convert_for_train(
+      const std::vector<std::pair<float, fv_converter::datum> >& data,
+      std::vector<std::pair<float, sfv_t> >& examples,
+      size_t thread_num);
+  void train(const std::vector<std::pair<float, sfv_t> >& examples);
+
+  void get_status(std::map<std::string, std::string>& status) const;
+
  private:
   pfi::lang::shared_ptr<framework::mixer::mixer> mixer_;
   pfi::lang::shared_ptr<framework::mixable_holder> mixable_holder_;
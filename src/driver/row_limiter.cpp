@@ -0,0 +1,188 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+
+#include "row_limiter.hpp"
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <glog/logging.h>
+#include <pficommon/concurrent/lock.h>
+#include <pficommon/data/unordered_set.h>
+#include <pficommon/lang/bind.h>
+#include "../common/exception.hpp"
+
+using pfi::concurrent::scoped_lock;
+using std::string;
+using std::vector;
+
+namespace jubatus {
+namespace driver {
+
+row_limiter::row_limiter(const config& config)
+    : max_rows_(0),
+      ttl_(0),
+      lru_(true) {
+  if (config.max_rows) {
+    if (*config.max_rows <= 0) {
+      throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error(
+          "max_rows must be a positive integer"));
+    }
+    max_rows_ = *config.max_rows;
+  }
+  if (config.row_ttl) {
+    if (*config.row_ttl <= 0) {
+      throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error(
+          "row_ttl must be a positive integer"));
+    }
+    ttl_ = *config.row_ttl;
+  }
+  if (config.eviction) {
+    if (*config.eviction == "oldest") {
+      lru_ = false;
+    } else if (*config.eviction != "lru") {
+      throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error(
+          "unknown eviction: " + *config.eviction));
+    }
+  }
+}
+
+void row_limiter::touch(const string& id, uint64_t now) {
+  pfi::data::unordered_map<string, rows_t::iterator>::iterator it =
+      index_.find(id);
+  if (it == index_.end()) {
+    index_[id] = rows_.insert(rows_.end(), std::make_pair(id, now));
+  } else if (lru_) {
+    it->second->second = now;
+    rows_.splice(rows_.end(), rows_, it->second);
+  }
+}
+
+void row_limiter::remove(const string& id) {
+  pfi::data::unordered_map<string, rows_t::iterator>::iterator it =
+      index_.find(id);
+  if (it != index_.end()) {
+    rows_.erase(it->second);
+    index_.erase(it);
+  }
+}
+
+void row_limiter::clear() {
+  rows_.clear();
+  index_.clear();
+}
+
+void row_limiter::sync(const vector<string>& ids, uint64_t now) {
+  pfi::data::unordered_set<string> model_ids(ids.begin(), ids.end());
+  for (rows_t::iterator it = rows_.begin(); it != rows_.end();) {
+    if (model_ids.count(it->first) == 0) {
+      index_.erase(it->first);
+      it = rows_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  for (size_t i = 0; i < ids.size(); ++i) {
+    if (index_.count(ids[i]) == 0) {
+      index_[ids[i]] = rows_.insert(rows_.end(), std::make_pair(ids[i], now));
+    }
+  }
+}
+
+void row_limiter::take_overflowed(vector<string>& ids) {
+  ids.clear();
+  if (max_rows_ == 0) {
+    return;
+  }
+  while (index_.size() > max_rows_) {
+    ids.push_back(rows_.front().first);
+    index_.erase(rows_.front().first);
+    rows_.pop_front();
+  }
+}
+
+void row_limiter::take_expired(
+    uint64_t now,
+    size_t max_num,
+    vector<string>& ids) {
+  ids.clear();
+  if (ttl_ == 0) {
+    return;
+  }
+  while (!rows_.empty() && ids.size() < max_num
+         && rows_.front().second + ttl_ <= now) {
+    ids.push_back(rows_.front().first);
+    index_.erase(rows_.front().first);
+    rows_.pop_front();
+  }
+}
+
+row_expirer::row_expirer(
+    pfi::concurrent::rw_mutex& model_mutex,
+    const pfi::lang::function<bool()>& evict)
+    : model_mutex_(model_mutex),
+      evict_(evict),
+      is_running_(false),
+      t_(pfi::lang::bind(&row_expirer::expirer_loop, this)) {
+}
+
+row_expirer::~row_expirer() {
+  stop();
+}
+
+void row_expirer::start() {
+  scoped_lock lk(m_);
+  if (!is_running_) {
+    is_running_ = true;
+    t_.start();
+  }
+}
+
+void row_expirer::stop() {
+  {
+    scoped_lock lk(m_);
+    if (!is_running_) {
+      return;
+    }
+    is_running_ = false;
+    c_.notify();
+  }
+  t_.join();
+}
+
+void row_expirer::expirer_loop() {
+  bool remaining = false;
+  while (is_running_) {
+    if (!remaining) {
+      scoped_lock lk(m_);
+      if (!is_running_) {
+        break;
+      }
+      c_.wait(m_, 1);
+    }
+    try {
+      pfi::concurrent::scoped_wlock lk(model_mutex_);
+      remaining = evict_();
+    } catch (const jubatus::exception::jubatus_exception& e) {
+      LOG(ERROR) << e.diagnostic_information(true);
+      remaining = false;
+    }
+  }
+}
+
+}  // namespace driver
+}  // namespace jubatus
@@ -0,0 +1,122 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+
+#ifndef JUBATUS_DRIVER_ROW_LIMITER_HPP_
+#define JUBATUS_DRIVER_ROW_LIMITER_HPP_
+
+#include <stdint.h>
+#include <list>
+#include <string>
+#include <utility>
+#include <vector>
+#include <pficommon/concurrent/condition.h>
+#include <pficommon/concurrent/mutex.h>
+#include <pficommon/concurrent/rwmutex.h>
+#include <pficommon/concurrent/thread.h>
+#include <pficommon/data/optional.h>
+#include <pficommon/data/serialization.h>
+#include <pficommon/data/unordered_map.h>
+#include <pficommon/lang/function.h>
+#include <pficommon/lang/noncopyable.h>
+
+namespace jubatus {
+namespace driver {
+
+// Keeps track of rows of a model, and chooses rows to evict when there are
+// more than max_rows of them or they expire after row_ttl seconds. Evicted
+// rows are removed from models of other servers by mix, as rows cleared
+// with clear_row are.
+class row_limiter {
+ public:
+  struct config {
+    pfi::data::optional<int> max_rows;
+    // seconds since rows are updated ("lru") or added ("oldest")
+    pfi::data::optional<int> row_ttl;
+    // "lru" (default) or "oldest"
+    pfi::data::optional<std::string> eviction;
+
+    template<typename Ar>
+    void serialize(Ar& ar) {
+      ar & MEMBER(max_rows) & MEMBER(row_ttl) & MEMBER(eviction);
+    }
+  };
+
+  explicit row_limiter(const config& config);
+
+  // Records that the row is updated at now (seconds)
+  void touch(const std::string& id, uint64_t now);
+  void remove(const std::string& id);
+  void clear();
+  // Makes the tracked rows the same as ids, the rows of the model, after
+  // rows are added or removed by mix or load. Rows not tracked yet are
+  // recorded as updated at now.
+  void sync(const std::vector<std::string>& ids, uint64_t now);
+
+  // Takes rows out of the limiter, which are to be evicted from the model
+  void take_overflowed(std::vector<std::string>& ids);
+  void take_expired(
+      uint64_t now,
+      size_t max_num,
+      std::vector<std::string>& ids);
+
+  bool has_ttl() const {
+    return ttl_ > 0;
+  }
+  size_t size() const {
+    return index_.size();
+  }
+
+ private:
+  // rows in order of eviction
+  typedef std::list<std::pair<std::string, uint64_t> > rows_t;
+
+  size_t max_rows_;
+  uint64_t ttl_;
+  bool lru_;
+  rows_t rows_;
+  pfi::data::unordered_map<std::string, rows_t::iterator> index_;
+};
+
+// Calls evict every second in a thread under the write lock of the model.
+// evict removes a limited number of expired rows at a time, and returns true
+// if more rows remain to be removed, in which case it is called again soon
+// after the lock is released.
+class row_expirer : pfi::lang::noncopyable {
+ public:
+  row_expirer(
+      pfi::concurrent::rw_mutex& model_mutex,
+      const pfi::lang::function<bool()>& evict);
+  ~row_expirer();
+
+  void start();
+  void stop();
+
+ private:
+  void expirer_loop();
+
+  pfi::concurrent::rw_mutex& model_mutex_;
+  pfi::lang::function<bool()> evict_;
+  volatile bool is_running_;
+  pfi::concurrent::thread t_;
+  pfi::concurrent::mutex m_;
+  pfi::concurrent::condition c_;
+};
+
+}  // namespace driver
+}  // namespace jubatus
+
+#endif  // JUBATUS_DRIVER_ROW_LIMITER_HPP_
@@ -0,0 +1,149 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <pficommon/lang/cast.h>
+
+#include "row_limiter.hpp"
+#include "../common/exception.hpp"
+
+using std::string;
+using std::vector;
+
+namespace jubatus {
+namespace driver {
+
+namespace {
+
+row_limiter::config make_config(
+    int max_rows,
+    int row_ttl,
+    const string& eviction) {
+  row_limiter::config config;
+  if (max_rows) {
+    config.max_rows = max_rows;
+  }
+  if (row_ttl) {
+    config.row_ttl = row_ttl;
+  }
+  config.eviction = eviction;
+  return config;
+}
+
+}  // namespace
+
+TEST(row_limiter, invalid_config) {
+  EXPECT_THROW(row_limiter(make_config(-1, 0, "lru")),
+               jubatus::exception::runtime_error);
+  EXPECT_THROW(row_limiter(make_config(0, -1, "lru")),
+               jubatus::exception::runtime_error);
+  EXPECT_THROW(row_limiter(make_config(0, 0, "random")),
+               jubatus::exception::runtime_error);
+}
+
+TEST(row_limiter, max_rows_lru) {
+  row_limiter l(make_config(2, 0, "lru"));
+  EXPECT_FALSE(l.has_ttl());
+  vector<string> ids;
+  l.touch("r1", 0);
+  l.touch("r2", 0);
+  l.take_overflowed(ids);
+  EXPECT_TRUE(ids.empty());
+
+  // r1 is used more recently than r2
+  l.touch("r1", 1);
+  l.touch("r3", 1);
+  l.take_overflowed(ids);
+  ASSERT_EQ(1u, ids.size());
+  EXPECT_EQ("r2", ids[0]);
+  EXPECT_EQ(2u, l.size());
+
+  l.remove("r1");
+  l.touch("r4", 2);
+  l.take_overflowed(ids);
+  EXPECT_TRUE(ids.empty());
+}
+
+TEST(row_limiter, max_rows_oldest) {
+  row_limiter l(make_config(2, 0, "oldest"));
+  vector<string> ids;
+  l.touch("r1", 0);
+  l.touch("r2", 0);
+  l.touch("r1", 1);
+  l.touch("r3", 1);
+  l.take_overflowed(ids);
+  ASSERT_EQ(1u, ids.size());
+  EXPECT_EQ("r1", ids[0]);
+}
+
+TEST(row_limiter, row_ttl) {
+  row_limiter l(make_config(0, 10, "lru"));
+  EXPECT_TRUE(l.has_ttl());
+  vector<string> ids;
+  for (int i = 0; i < 5; ++i) {
+    l.touch("r" + pfi::lang::lexical_cast<string>(i), i);
+  }
+  l.touch("r0", 5);
+  l.take_overflowed(ids);
+  EXPECT_TRUE(ids.empty());
+
+  l.take_expired(12, 100, ids);
+  ASSERT_EQ(2u, ids.size());
+  EXPECT_EQ("r1", ids[0]);
+  EXPECT_EQ("r2", ids[1]);
+
+  // at most max_num rows at a time
+  l.take_expired(20, 2, ids);
+  ASSERT_EQ(2u, ids.size());
+  EXPECT_EQ("r3", ids[0]);
+  EXPECT_EQ("r4", ids[1]);
+  l.take_expired(20, 2, ids);
+  ASSERT_EQ(1u, ids.size());
+  EXPECT_EQ("r0", ids[0]);
+  EXPECT_EQ(0u, l.size());
+}
+
+TEST(row_limiter, sync) {
+  row_limiter l(make_config(3, 0, "lru"));
+  vector<string> ids;
+  l.touch("r1", 0);
+  l.touch("r2", 1);
+
+  // r1 is removed and r3 and r4 are added by mix
+  vector<string> model_ids;
+  model_ids.push_back("r2");
+  model_ids.push_back("r3");
+  model_ids.push_back("r4");
+  model_ids.push_back("r5");
+  l.sync(model_ids, 2);
+  EXPECT_EQ(4u, l.size());
+  l.take_overflowed(ids);
+  ASSERT_EQ(1u, ids.size());
+  EXPECT_EQ("r2", ids[0]);
+
+  l.touch("r3", 3);
+  l.touch("r6", 3);
+  l.take_overflowed(ids);
+  ASSERT_EQ(1u, ids.size());
+  EXPECT_EQ("r4", ids[0]);
+}
+
+}  // namespace driver
+}  // namespace jubatus
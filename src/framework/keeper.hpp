@@ -18,6 +18,7 @@
 #define JUBATUS_FRAMEWORK_KEEPER_HPP_
 
 #include <iostream>
+#include <map>
 #include <string>
 #include <utility>
 #include <vector>
@@ -150,6 +151,19 @@ class keeper : public keeper_common, jubatus::common::mprpc::rpc_server {
     add(method_name, f);
   }
 
+  // cht method taking a list of ids and returning a result for each of them.
+  // Ids are grouped by their servers, each of which is called once.
+  template<typename R, typename A0>
+  void register_cht_batch(const std::string& method_name) {
+    using mp::placeholders::_1;
+    using mp::placeholders::_2;
+    using mp::placeholders::_3;
+    mp::function<std::vector<R>(std::string, std::vector<std::string>, A0)> f =
+        mp::bind(&keeper::template cht_batch_proxy1<R, A0>,
+                 this, method_name, _1, _2, _3);
+    add(method_name, f);
+  }
+
   // async random method ( arity 0-4 )
   template<typename R>
   void register_async_random(const std::string& method_name) {
@@ -564,6 +578,67 @@ class keeper : public keeper_common, jubatus::common::mprpc::rpc_server {
     }
   }
 
+  template<typename R, typename A0>
+  std::vector<R> cht_batch_proxy1(
+      const std::string& method_name,
+      const std::string& name,
+      const std::vector<std::string>& ids,
+      const A0& arg) {
+    DLOG(INFO) << __func__ << " " << method_name << " " << name;
+    std::vector<std::pair<std::string, int> > owners;
+    get_owners_from_cht_(name, ids, owners);
+
+    // ids sent to each server and their positions in ids
+    host_list_type hosts;
+    std::vector<std::vector<std::string> > host_ids;
+    std::vector<std::vector<size_t> > positions;
+    std::map<std::pair<std::string, int>, size_t> host_index;
+    for (size_t i = 0; i < ids.size(); ++i) {
+      std::pair<std::map<std::pair<std::string, int>, size_t>::iterator, bool>
+          it = host_index.insert(std::make_pair(owners[i], hosts.size()));
+      if (it.second) {
+        hosts.push_back(owners[i]);
+        host_ids.push_back(std::vector<std::string>());
+        positions.push_back(std::vector<size_t>());
+      }
+      host_ids[it.first->second].push_back(ids[i]);
+      positions[it.first->second].push_back(i);
+    }
+
+    msgpack::rpc::session_pool* pool = get_private_session_pool();
+    std::vector<msgpack::rpc::future> futures;
+    for (size_t i = 0; i < hosts.size(); ++i) {
+      DLOG(INFO) << "request to " << hosts[i].first << ":" << hosts[i].second;
+      msgpack::rpc::session s = pool->get_session(hosts[i].first,
+                                                  hosts[i].second);
+      s.set_timeout(a_.timeout);
+      futures.push_back(s.call(method_name, name, host_ids[i], arg));
+    }
+
+    std::vector<R> ret(ids.size());
+    for (size_t i = 0; i < hosts.size(); ++i) {
+      try {
+        std::vector<R> results;
+        try {
+          results = futures[i].template get<std::vector<R> >();
+        }
+        JUBATUS_MSGPACKRPC_EXCEPTION_DEFAULT_HANDLER(method_name);
+        if (results.size() != positions[i].size()) {
+          throw JUBATUS_EXCEPTION(jubatus::common::mprpc::rpc_no_result()
+              << jubatus::common::mprpc::error_method(method_name));
+        }
+        for (size_t j = 0; j < results.size(); ++j) {
+          ret[positions[i][j]] = results[j];
+        }
+      } catch (const std::exception& e) {
+        LOG(ERROR) << e.what() << " from " << hosts[i].first << ":"
+                   << hosts[i].second;
+        throw;
+      }
+    }
+    return ret;
+  }
+
   //// async version
   template<int N, typename R, typename Tuple>
   void cht_async_vproxy(
@@ -100,5 +100,22 @@ void keeper_common::get_members_from_cht_(
   }
 }
 
+void keeper_common::get_owners_from_cht_(
+    const std::string& name,
+    const std::vector<std::string>& ids,
+    std::vector<std::pair<std::string, int> >& ret) {
+  ret.clear();
+  pfi::concurrent::scoped_lock lk(mutex_);
+  jubatus::common::cht ht(zk_, a_.type, name);
+  std::vector<std::pair<std::string, int> > hosts;
+  for (size_t i = 0; i < ids.size(); ++i) {
+    ht.find(ids[i], hosts, 1);
+    if (hosts.empty()) {
+      throw JUBATUS_EXCEPTION(no_worker(name));
+    }
+    ret.push_back(hosts[0]);
+  }
+}
+
 }  // namespace framework
 }  // namespace jubatus
@@ -58,6 +58,12 @@ class keeper_common {
       std::vector<std::pair<std::string, int> >& ret,
       size_t n);
 
+  // the first server of each id, looked up in one cht
+  void get_owners_from_cht_(
+      const std::string& name,
+      const std::vector<std::string>& ids,
+      std::vector<std::pair<std::string, int> >& ret);
+
   keeper_argv a_;
   pfi::math::random::mtrand rng_;
   pfi::concurrent::mutex mutex_;
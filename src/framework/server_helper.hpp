@@ -125,6 +125,8 @@ class server_helper {
     data["interval_sec"] = pfi::lang::lexical_cast<std::string>(a.interval_sec);
     data["interval_count"] = pfi::lang::lexical_cast<std::string>(
         a.interval_count);
+    data["id_lease_size"] = pfi::lang::lexical_cast<std::string>(
+        a.id_lease_size);
     data["is_standalone"] = pfi::lang::lexical_cast<std::string>(
         a.is_standalone());
     data["VERSION"] = JUBATUS_VERSION;
@@ -102,6 +102,8 @@ server_argv::server_argv(int args, char** argv, const std::string& type)
   p.add("join", 'j', "join to the existing cluster");
   p.add<int>("interval_sec", 's', "mix interval by seconds", false, 16);
   p.add<int>("interval_count", 'i', "mix interval by update count", false, 512);
+  p.add<int>("id_lease_size", 'u',
+      "number of ids leased from zookeeper at once (e.g. 10000)", false, 0);
 #endif
 
   // APPLY CHANGES TO JUBAVISOR WHEN ARGUMENTS MODIFIED
@@ -143,14 +145,22 @@ server_argv::server_argv(int args, char** argv, const std::string& type)
   join = p.exist("join");
   interval_sec = p.get<int>("interval_sec");
   interval_count = p.get<int>("interval_count");
+  id_lease_size = p.get<int>("id_lease_size");
 #else
   z = "";
   name = "";
   join = false;
   interval_sec = 16;
   interval_count = 512;
+  id_lease_size = 0;
 #endif
 
+  if (id_lease_size < 0) {
+    std::cerr << "id_lease_size must not be negative" << std::endl;
+    std::cerr << p.usage() << std::endl;
+    exit(1);
+  }
+
   if (!is_standalone() && name.empty()) {
     std::cerr << "can't start multinode mode without name specified"
         << std::endl;
@@ -186,7 +196,8 @@ server_argv::server_argv()
       loglevel(google::INFO),
       eth("localhost"),
       interval_sec(5),
-      interval_count(1024) {
+      interval_count(1024),
+      id_lease_size(0) {
 }
 
 void server_argv::boot_message(const std::string& progname) const {
@@ -213,6 +224,7 @@ void server_argv::boot_message(const std::string& progname) const {
   ss << "    join           : " << std::boolalpha << join << '\n';
   ss << "    interval sec   : " << interval_sec << '\n';
   ss << "    interval count : " << interval_count << '\n';
+  ss << "    id lease size  : " << id_lease_size << '\n';
 #endif
   LOG(INFO) << ss.str();
 }
@@ -81,10 +81,12 @@ struct server_argv {
   std::string eth;
   int interval_sec;
   int interval_count;
+  // number of ids leased from ZooKeeper at once (no lease when 0)
+  int id_lease_size;
 
   MSGPACK_DEFINE(join, port, bind_address, bind_if, timeout, threadnum,
       program_name, type, z, name, datadir, logdir, loglevel, eth,
-      interval_sec, interval_count);
+      interval_sec, interval_count, id_lease_size);
 
   bool is_standalone() const {
     return (z == "");
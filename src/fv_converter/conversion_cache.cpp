@@ -0,0 +1,153 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include "conversion_cache.hpp"
+
+#include <map>
+#include <string>
+#include <pficommon/concurrent/lock.h>
+#include <pficommon/lang/cast.h>
+
+using pfi::concurrent::scoped_lock;
+
+namespace jubatus {
+namespace fv_converter {
+
+namespace {
+
+const uint64_t FNV_OFFSET_BASIS = 14695981039346656037LLU;
+const uint64_t FNV_PRIME = 1099511628211LLU;
+
+void fnv_update(uint64_t& hash, const char* data, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= FNV_PRIME;
+  }
+}
+
+void fnv_update(uint64_t& hash, const std::string& s) {
+  uint64_t size = s.size();
+  fnv_update(hash, reinterpret_cast<const char*>(&size), sizeof(size));
+  fnv_update(hash, s.data(), s.size());
+}
+
+}  // namespace
+
+uint64_t calc_datum_fingerprint(const datum& d) {
+  uint64_t hash = FNV_OFFSET_BASIS;
+  for (size_t i = 0; i < d.string_values_.size(); ++i) {
+    fnv_update(hash, d.string_values_[i].first);
+    fnv_update(hash, d.string_values_[i].second);
+  }
+  // separates string values from num values
+  fnv_update(hash, "\0", 1);
+  for (size_t i = 0; i < d.num_values_.size(); ++i) {
+    fnv_update(hash, d.num_values_[i].first);
+    double v = d.num_values_[i].second;
+    fnv_update(hash, reinterpret_cast<const char*>(&v), sizeof(v));
+  }
+  return hash;
+}
+
+conversion_cache::conversion_cache(size_t max_size)
+    : max_size_(max_size),
+      hit_count_(),
+      miss_count_() {
+}
+
+bool conversion_cache::get(const datum& d, sfv_t& fv) {
+  uint64_t fp = calc_datum_fingerprint(d);
+
+  scoped_lock lk(m_);
+  index_t::iterator it = index_.find(fp);
+  if (it == index_.end()
+      || it->second->key.string_values_ != d.string_values_
+      || it->second->key.num_values_ != d.num_values_) {
+    ++miss_count_;
+    return false;
+  }
+
+  entries_.splice(entries_.begin(), entries_, it->second);
+  fv = it->second->fv;
+  ++hit_count_;
+  return true;
+}
+
+void conversion_cache::put(const datum& d, const sfv_t& fv) {
+  if (max_size_ == 0) {
+    return;
+  }
+  uint64_t fp = calc_datum_fingerprint(d);
+
+  scoped_lock lk(m_);
+  index_t::iterator it = index_.find(fp);
+  if (it != index_.end()) {
+    // overwrites the entry even on fingerprint collision
+    it->second->key = d;
+    it->second->fv = fv;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return;
+  }
+
+  entry e;
+  e.fingerprint = fp;
+  e.key = d;
+  e.fv = fv;
+  entries_.push_front(e);
+  index_[fp] = entries_.begin();
+
+  while (index_.size() > max_size_) {
+    index_.erase(entries_.back().fingerprint);
+    entries_.pop_back();
+  }
+}
+
+void conversion_cache::clear() {
+  scoped_lock lk(m_);
+  entries_.clear();
+  index_t().swap(index_);
+}
+
+size_t conversion_cache::size() const {
+  scoped_lock lk(m_);
+  return index_.size();
+}
+
+uint64_t conversion_cache::get_hit_count() const {
+  scoped_lock lk(m_);
+  return hit_count_;
+}
+
+uint64_t conversion_cache::get_miss_count() const {
+  scoped_lock lk(m_);
+  return miss_count_;
+}
+
+void conversion_cache::get_status(
+    std::map<std::string, std::string>& status) const {
+  scoped_lock lk(m_);
+  status["converter_cache_size"] =
+      pfi::lang::lexical_cast<std::string>(index_.size());
+  status["converter_cache_max_size"] =
+      pfi::lang::lexical_cast<std::string>(max_size_);
+  status["converter_cache_hit"] =
+      pfi::lang::lexical_cast<std::string>(hit_count_);
+  status["converter_cache_miss"] =
+      pfi::lang::lexical_cast<std::string>(miss_count_);
+}
+
+}  // namespace fv_converter
+}  // namespace jubatus
@@ -0,0 +1,76 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#ifndef JUBATUS_FV_CONVERTER_CONVERSION_CACHE_HPP_
+#define JUBATUS_FV_CONVERTER_CONVERSION_CACHE_HPP_
+
+#include <stdint.h>
+#include <list>
+#include <map>
+#include <string>
+#include <pficommon/concurrent/mutex.h>
+#include <pficommon/data/unordered_map.h>
+#include "../common/type.hpp"
+#include "datum.hpp"
+
+namespace jubatus {
+namespace fv_converter {
+
+uint64_t calc_datum_fingerprint(const datum& d);
+
+// LRU cache of unweighted feature vectors.
+// Global weights (e.g. IDF) change as the model learns, so the cached vectors
+// must not contain them; callers apply weights after each lookup.
+class conversion_cache {
+ public:
+  explicit conversion_cache(size_t max_size);
+
+  bool get(const datum& d, sfv_t& fv);
+  void put(const datum& d, const sfv_t& fv);
+
+  void clear();
+
+  size_t size() const;
+  size_t max_size() const {
+    return max_size_;
+  }
+
+  uint64_t get_hit_count() const;
+  uint64_t get_miss_count() const;
+
+  void get_status(std::map<std::string, std::string>& status) const;
+
+ private:
+  struct entry {
+    uint64_t fingerprint;
+    datum key;
+    sfv_t fv;
+  };
+  typedef std::list<entry> entry_list_t;
+  typedef pfi::data::unordered_map<uint64_t, entry_list_t::iterator> index_t;
+
+  size_t max_size_;
+  entry_list_t entries_;
+  index_t index_;
+  uint64_t hit_count_;
+  uint64_t miss_count_;
+  mutable pfi::concurrent::mutex m_;
+};
+
+}  // namespace fv_converter
+}  // namespace jubatus
+
+#endif  // JUBATUS_FV_CONVERTER_CONVERSION_CACHE_HPP_
@@ -0,0 +1,93 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include <string>
+#include <utility>
+#include <gtest/gtest.h>
+#include "conversion_cache.hpp"
+#include "datum.hpp"
+
+namespace jubatus {
+namespace fv_converter {
+
+namespace {
+
+datum make_datum(const std::string& value) {
+  datum d;
+  d.string_values_.push_back(std::make_pair("key", value));
+  d.num_values_.push_back(std::make_pair("num", 1.0));
+  return d;
+}
+
+sfv_t make_fv(const std::string& key) {
+  sfv_t fv;
+  fv.push_back(std::make_pair(key, 1.0));
+  return fv;
+}
+
+}  // namespace
+
+TEST(calc_datum_fingerprint, trivial) {
+  EXPECT_EQ(calc_datum_fingerprint(make_datum("a")),
+            calc_datum_fingerprint(make_datum("a")));
+  EXPECT_NE(calc_datum_fingerprint(make_datum("a")),
+            calc_datum_fingerprint(make_datum("b")));
+
+  datum d1, d2;
+  d1.string_values_.push_back(std::make_pair("ab", "c"));
+  d2.string_values_.push_back(std::make_pair("a", "bc"));
+  EXPECT_NE(calc_datum_fingerprint(d1), calc_datum_fingerprint(d2));
+}
+
+TEST(conversion_cache, get_and_put) {
+  conversion_cache cache(10);
+  sfv_t fv;
+  EXPECT_FALSE(cache.get(make_datum("a"), fv));
+
+  cache.put(make_datum("a"), make_fv("fa"));
+  ASSERT_TRUE(cache.get(make_datum("a"), fv));
+  ASSERT_EQ(1u, fv.size());
+  EXPECT_EQ("fa", fv[0].first);
+
+  EXPECT_EQ(1u, cache.get_hit_count());
+  EXPECT_EQ(1u, cache.get_miss_count());
+}
+
+TEST(conversion_cache, evict_least_recently_used) {
+  conversion_cache cache(2);
+  sfv_t fv;
+  cache.put(make_datum("a"), make_fv("fa"));
+  cache.put(make_datum("b"), make_fv("fb"));
+  ASSERT_TRUE(cache.get(make_datum("a"), fv));
+
+  cache.put(make_datum("c"), make_fv("fc"));
+  EXPECT_EQ(2u, cache.size());
+  EXPECT_TRUE(cache.get(make_datum("a"), fv));
+  EXPECT_FALSE(cache.get(make_datum("b"), fv));
+  EXPECT_TRUE(cache.get(make_datum("c"), fv));
+}
+
+TEST(conversion_cache, clear) {
+  conversion_cache cache(2);
+  sfv_t fv;
+  cache.put(make_datum("a"), make_fv("fa"));
+  cache.clear();
+  EXPECT_EQ(0u, cache.size());
+  EXPECT_FALSE(cache.get(make_datum("a"), fv));
+}
+
+}  // namespace fv_converter
+}  // namespace jubatus
@@ -254,6 +254,12 @@ void initialize_converter(
         << *config.hash_max_size.get();
     throw JUBATUS_EXCEPTION(converter_exception(msg.str()));
   }
+  if (config.cache_size.bool_test() && *config.cache_size.get() < 0) {
+    std::stringstream msg;
+    msg << "cache_size must not be negative, but is "
+        << *config.cache_size.get();
+    throw JUBATUS_EXCEPTION(converter_exception(msg.str()));
+  }
 
   std::map<std::string, string_filter_ptr> string_filters;
   init_string_filter_types(config.string_filter_types, string_filters);
@@ -273,6 +279,9 @@ void initialize_converter(
   if (config.hash_max_size.bool_test()) {
     conv.set_hash_max_size(*config.hash_max_size.get());
   }
+  if (config.cache_size.bool_test()) {
+    conv.set_cache_size(*config.cache_size.get());
+  }
 }
 
 pfi::lang::shared_ptr<datum_to_fv_converter> make_fv_converter(
@@ -90,6 +90,7 @@ struct converter_config {
   std::vector<num_rule> num_rules;
 
   pfi::data::optional<int64_t> hash_max_size;
+  pfi::data::optional<int64_t> cache_size;
 
   friend class pfi::data::serialization::access;
   template<class Archive>
@@ -97,7 +98,7 @@ struct converter_config {
     ar & MEMBER(string_filter_types) & MEMBER(string_filter_rules)
         & MEMBER(num_filter_types) & MEMBER(num_filter_rules)
         & MEMBER(string_types) & MEMBER(string_rules) & MEMBER(num_types)
-        & MEMBER(num_rules) & MEMBER(hash_max_size);
+        & MEMBER(num_rules) & MEMBER(hash_max_size) & MEMBER(cache_size);
   }
 };
 
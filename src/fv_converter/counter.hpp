@@ -73,6 +73,10 @@ class counter {
     pfi::data::unordered_map<T, unsigned>().swap(data_);
   }
 
+  void swap(counter<T>& counts) {
+    data_.swap(counts.data_);
+  }
+
   void add(const counter<T>& counts) {
     for (const_iterator it = counts.begin(); it != counts.end(); ++it) {
       (*this)[it->first] += it->second;
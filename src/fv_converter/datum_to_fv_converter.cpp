@@ -16,12 +16,17 @@
 
 #include "datum_to_fv_converter.hpp"
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <map>
 #include <string>
 #include <utility>
 #include <vector>
 #include <pficommon/data/optional.h>
+#include <pficommon/lang/bind.h>
+#include <pficommon/lang/shared_ptr.h>
+#include "conversion_cache.hpp"
 #include "counter.hpp"
 #include "datum.hpp"
 #include "exception.hpp"
@@ -29,35 +34,51 @@
 #include "match_all.hpp"
 #include "num_feature.hpp"
 #include "num_filter.hpp"
+#ifdef HAVE_RE2
+#  include "re2_filter.hpp"
+#endif
+#ifdef HAVE_RE2_SET_ERROR_INFO
+#  include "re2_filter_set.hpp"
+#endif
 #include "space_splitter.hpp"
 #include "string_filter.hpp"
 #include "weight_manager.hpp"
 #include "without_split.hpp"
+#include "../common/parallel.hpp"
 
 namespace jubatus {
 namespace fv_converter {
 
+namespace {
+
+// Smallest number of data converted by one thread in
+// convert_and_update_weight_many
+const size_t MIN_CHUNK_SIZE = 64;
+
+}  // namespace
+
 /// impl
 
 class datum_to_fv_converter_impl {
  private:
   typedef pfi::data::unordered_map<std::string, float> weight_t;
+  typedef std::vector<std::pair<size_t, size_t> > boundaries_t;
 
   struct string_filter_rule {
     pfi::lang::shared_ptr<key_matcher> matcher_;
     pfi::lang::shared_ptr<string_filter> filter_;
     std::string suffix_;
+    // id in re2_filters_, or -1 if this rule is not prescreened
+    int re2_id_;
+  };
 
-    void filter(const datum::sv_t& string_values, datum::sv_t& filtered) const {
-      for (size_t i = 0; i < string_values.size(); ++i) {
-        const std::pair<std::string, std::string>& value = string_values[i];
-        if (matcher_->match(value.first)) {
-          std::string out;
-          filter_->filter(value.second, out);
-          std::string dest = value.first + suffix_;
-          filtered.push_back(std::make_pair(dest, out));
-        }
-      }
+  // ids of regexp filters that can rewrite a string value
+  struct prescreen_result {
+    bool scanned_;
+    std::vector<int> ids_;
+
+    prescreen_result()
+        : scanned_(false) {
     }
   };
 
@@ -120,6 +141,14 @@ class datum_to_fv_converter_impl {
 
   pfi::data::optional<feature_hasher> hasher_;
 
+  pfi::lang::shared_ptr<conversion_cache> cache_;
+
+#ifdef HAVE_RE2_SET_ERROR_INFO
+  // all regexp string filters compiled into one set, which is used when
+  // there are two or more of them
+  pfi::lang::shared_ptr<re2_filter_set> re2_filters_;
+#endif
+
  public:
   datum_to_fv_converter_impl()
       : weights_() {
@@ -127,17 +156,26 @@ class datum_to_fv_converter_impl {
 
   void clear_rules() {
     string_filter_rules_.clear();
+#ifdef HAVE_RE2_SET_ERROR_INFO
+    re2_filters_.reset();
+#endif
     num_filter_rules_.clear();
     string_rules_.clear();
     num_rules_.clear();
+    if (cache_) {
+      cache_->clear();
+    }
   }
 
   void register_string_filter(
       pfi::lang::shared_ptr<key_matcher> matcher,
       pfi::lang::shared_ptr<string_filter> filter,
       const std::string& suffix) {
-    string_filter_rule rule = { matcher, filter, suffix };
+    string_filter_rule rule = { matcher, filter, suffix, -1 };
     string_filter_rules_.push_back(rule);
+#ifdef HAVE_RE2_SET_ERROR_INFO
+    update_re2_filters();
+#endif
   }
 
   void register_num_filter(
@@ -172,7 +210,7 @@ class datum_to_fv_converter_impl {
 
   void convert(const datum& datum, sfv_t& ret_fv) const {
     sfv_t fv;
-    convert_unweighted(datum, fv);
+    convert_unweighted_cached(datum, fv);
     if (weights_) {
       (*weights_).get_weight(fv);
     }
@@ -186,7 +224,7 @@ class datum_to_fv_converter_impl {
 
   void convert_and_update_weight(const datum& datum, sfv_t& ret_fv) {
     sfv_t fv;
-    convert_unweighted(datum, fv);
+    convert_unweighted_cached(datum, fv);
     if (weights_) {
       (*weights_).update_weight(fv);
       (*weights_).get_weight(fv);
@@ -199,6 +237,66 @@ class datum_to_fv_converter_impl {
     fv.swap(ret_fv);
   }
 
+  void convert_many(
+      const std::vector<datum>& data,
+      std::vector<sfv_t>& ret_fvs) const {
+    std::vector<sfv_t> fvs;
+    convert_unweighted_many_cached(data, fvs);
+    for (size_t i = 0; i < fvs.size(); ++i) {
+      if (weights_) {
+        (*weights_).get_weight(fvs[i]);
+      }
+
+      if (hasher_) {
+        hasher_->hash_feature_keys(fvs[i]);
+      }
+    }
+
+    fvs.swap(ret_fvs);
+  }
+
+  void convert_and_update_weight_many(
+      const std::vector<datum>& data,
+      std::vector<sfv_t>& ret_fvs) {
+    std::vector<sfv_t> fvs;
+    convert_unweighted_many_cached(data, fvs);
+    // weights are updated in order so that the result is the same as
+    // calling convert_and_update_weight for each datum
+    for (size_t i = 0; i < fvs.size(); ++i) {
+      if (weights_) {
+        (*weights_).update_weight(fvs[i]);
+        (*weights_).get_weight(fvs[i]);
+      }
+
+      if (hasher_) {
+        hasher_->hash_feature_keys(fvs[i]);
+      }
+    }
+
+    fvs.swap(ret_fvs);
+  }
+
+  void convert_and_update_weight_many(
+      const std::vector<datum>& data,
+      std::vector<sfv_t>& ret_fvs,
+      size_t thread_num) {
+    size_t chunk_num =
+        common::get_chunk_num(data.size(), thread_num, MIN_CHUNK_SIZE);
+    if (chunk_num <= 1) {
+      convert_and_update_weight_many(data, ret_fvs);
+      return;
+    }
+
+    std::vector<sfv_t> fvs(data.size());
+    common::run_chunks(
+        pfi::lang::bind(
+            &datum_to_fv_converter_impl::convert_and_update_weight_range,
+            this, &data, &fvs, pfi::lang::_2, pfi::lang::_3),
+        data.size(), chunk_num);
+
+    fvs.swap(ret_fvs);
+  }
+
   void convert_unweighted(const datum& datum, sfv_t& ret_fv) const {
     sfv_t fv;
 
@@ -215,6 +313,119 @@ class datum_to_fv_converter_impl {
     fv.swap(ret_fv);
   }
 
+  void convert_unweighted_cached(const datum& datum, sfv_t& ret_fv) const {
+    if (!cache_) {
+      convert_unweighted(datum, ret_fv);
+      return;
+    }
+    if (cache_->get(datum, ret_fv)) {
+      return;
+    }
+    convert_unweighted(datum, ret_fv);
+    cache_->put(datum, ret_fv);
+  }
+
+  // Converts data like convert_unweighted, but string values of all data
+  // are passed to each splitter with one split_many call.
+  void convert_unweighted_many(
+      const std::vector<const datum*>& data,
+      std::vector<sfv_t>& ret_fvs) const {
+    // string values to convert, in the order of convert_unweighted:
+    // original values and filtered values of data[0], data[1], ...
+    std::vector<datum::sv_t> filtered_strings(data.size());
+    std::vector<const datum::sv_t*> string_values;
+    for (size_t i = 0; i < data.size(); ++i) {
+      filter_strings(data[i]->string_values_, filtered_strings[i]);
+      string_values.push_back(&data[i]->string_values_);
+      string_values.push_back(&filtered_strings[i]);
+    }
+
+    std::vector<std::vector<boundaries_t> > boundaries(string_rules_.size());
+    for (size_t i = 0; i < string_rules_.size(); ++i) {
+      split_strings(string_rules_[i], string_values, boundaries[i]);
+    }
+
+    std::vector<size_t> positions(string_rules_.size());
+    std::vector<sfv_t> fvs(data.size());
+    for (size_t i = 0; i < data.size(); ++i) {
+      sfv_t& fv = fvs[i];
+      for (size_t k = 2 * i; k < 2 * i + 2; ++k) {
+        for (size_t j = 0; j < string_rules_.size(); ++j) {
+          convert_split_strings(string_rules_[j], *string_values[k],
+                                boundaries[j], positions[j], fv);
+        }
+      }
+
+      std::vector<std::pair<std::string, double> > filtered_nums;
+      filter_nums(data[i]->num_values_, filtered_nums);
+      convert_nums(data[i]->num_values_, fv);
+      convert_nums(filtered_nums, fv);
+    }
+
+    fvs.swap(ret_fvs);
+  }
+
+  void convert_unweighted_many_cached(
+      const std::vector<datum>& data,
+      std::vector<sfv_t>& ret_fvs) const {
+    std::vector<const datum*> ptrs(data.size());
+    for (size_t i = 0; i < data.size(); ++i) {
+      ptrs[i] = &data[i];
+    }
+    convert_unweighted_many_cached(ptrs, ret_fvs);
+  }
+
+  void convert_unweighted_many_cached(
+      const std::vector<const datum*>& data,
+      std::vector<sfv_t>& ret_fvs) const {
+    std::vector<sfv_t> fvs(data.size());
+    std::vector<size_t> missed_ids;
+    std::vector<const datum*> missed;
+    for (size_t i = 0; i < data.size(); ++i) {
+      if (!cache_ || !cache_->get(*data[i], fvs[i])) {
+        missed_ids.push_back(i);
+        missed.push_back(data[i]);
+      }
+    }
+
+    std::vector<sfv_t> converted;
+    convert_unweighted_many(missed, converted);
+    for (size_t i = 0; i < missed.size(); ++i) {
+      if (cache_) {
+        cache_->put(*missed[i], converted[i]);
+      }
+      fvs[missed_ids[i]].swap(converted[i]);
+    }
+
+    fvs.swap(ret_fvs);
+  }
+
+  // Converts data[begin, end) into (*fvs)[begin, end) in a worker thread
+  // of convert_and_update_weight_many
+  void convert_and_update_weight_range(
+      const std::vector<datum>* data,
+      std::vector<sfv_t>* fvs,
+      size_t begin,
+      size_t end) {
+    std::vector<const datum*> chunk;
+    for (size_t i = begin; i < end; ++i) {
+      chunk.push_back(&(*data)[i]);
+    }
+    std::vector<sfv_t> converted;
+    convert_unweighted_many_cached(chunk, converted);
+    for (size_t i = 0; i < converted.size(); ++i) {
+      if (weights_) {
+        (*weights_).update_weight(converted[i]);
+        (*weights_).get_weight(converted[i]);
+      }
+
+      if (hasher_) {
+        hasher_->hash_feature_keys(converted[i]);
+      }
+      (*fvs)[begin + i].swap(converted[i]);
+    }
+  }
+
   void revert_feature(
       const std::string& feature,
       std::pair<std::string, std::string>& expect) const {
@@ -255,17 +466,101 @@ class datum_to_fv_converter_impl {
     weights_ = wm;
   }
 
+  void set_cache_size(size_t cache_size) {
+    if (cache_size == 0) {
+      cache_.reset();
+    } else {
+      cache_.reset(new conversion_cache(cache_size));
+    }
+  }
+
+  void get_status(std::map<std::string, std::string>& status) const {
+    if (cache_) {
+      cache_->get_status(status);
+    }
+  }
+
  private:
+#ifdef HAVE_RE2_SET_ERROR_INFO
+  void update_re2_filters() {
+    std::vector<size_t> rule_ids;
+    for (size_t i = 0; i < string_filter_rules_.size(); ++i) {
+      string_filter_rules_[i].re2_id_ = -1;
+      if (dynamic_cast<re2_filter*>(string_filter_rules_[i].filter_.get())) {
+        rule_ids.push_back(i);
+      }
+    }
+    if (rule_ids.size() < 2) {
+      re2_filters_.reset();
+      return;
+    }
+
+    pfi::lang::shared_ptr<re2_filter_set> filters(new re2_filter_set);
+    for (size_t i = 0; i < rule_ids.size(); ++i) {
+      string_filter_rule& rule = string_filter_rules_[rule_ids[i]];
+      rule.re2_id_ = filters->add(
+          *dynamic_cast<re2_filter*>(rule.filter_.get()));
+    }
+    filters->compile();
+    re2_filters_ = filters;
+  }
+#endif
+
+  // Returns false only when the filter of rule surely leaves value unchanged.
+  bool may_change(
+      const string_filter_rule& rule,
+      const std::string& value,
+      prescreen_result& result) const {
+#ifdef HAVE_RE2_SET_ERROR_INFO
+    if (rule.re2_id_ < 0 || !re2_filters_) {
+      return true;
+    }
+    if (!result.scanned_) {
+      re2_filters_->match(value, result.ids_);
+      result.scanned_ = true;
+    }
+    return std::binary_search(
+        result.ids_.begin(), result.ids_.end(), rule.re2_id_);
+#else
+    return true;
+#endif
+  }
+
+  void filter_string(
+      const string_filter_rule& rule,
+      const datum::sv_t& string_values,
+      std::vector<prescreen_result>& results,
+      datum::sv_t& filtered) const {
+    for (size_t i = 0; i < string_values.size(); ++i) {
+      const std::pair<std::string, std::string>& value = string_values[i];
+      if (rule.matcher_->match(value.first)) {
+        std::string out;
+        if (may_change(rule, value.second, results[i])) {
+          rule.filter_->filter(value.second, out);
+        } else {
+          out = value.second;
+        }
+        std::string dest = value.first + rule.suffix_;
+        filtered.push_back(std::make_pair(dest, out));
+      }
+    }
+  }
+
   void filter_strings(
       const datum::sv_t& string_values,
       datum::sv_t& filtered_values) const {
+    std::vector<prescreen_result> string_results(string_values.size());
+    std::vector<prescreen_result> filtered_results(filtered_values.size());
     for (size_t i = 0; i < string_filter_rules_.size(); ++i) {
       datum::sv_t update;
-      string_filter_rules_[i].filter(string_values, update);
-      string_filter_rules_[i].filter(filtered_values, update);
+      filter_string(string_filter_rules_[i], string_values, string_results,
+                    update);
+      filter_string(string_filter_rules_[i], filtered_values,
+                    filtered_results, update);
 
       filtered_values.insert(filtered_values.end(), update.begin(),
                              update.end());
+      filtered_results.resize(filtered_values.size());
     }
   }
 
@@ -313,6 +608,43 @@ class datum_to_fv_converter_impl {
     }
   }
 
+  void split_strings(
+      const string_feature_rule& splitter,
+      const std::vector<const datum::sv_t*>& string_values,
+      std::vector<boundaries_t>& ret_boundaries) const {
+    std::vector<std::string> values;
+    for (size_t i = 0; i < string_values.size(); ++i) {
+      const datum::sv_t& sv = *string_values[i];
+      for (size_t j = 0; j < sv.size(); ++j) {
+        if (splitter.matcher_->match(sv[j].first)) {
+          values.push_back(sv[j].second);
+        }
+      }
+    }
+    splitter.splitter_->split_many(values, ret_boundaries);
+  }
+
+  void convert_split_strings(
+      const string_feature_rule& splitter,
+      const datum::sv_t& string_values,
+      const std::vector<boundaries_t>& boundaries,
+      size_t& position,
+      sfv_t& ret_fv) const {
+    for (size_t j = 0; j < string_values.size(); ++j) {
+      const std::string& key = string_values[j].first;
+      const std::string& value = string_values[j].second;
+      if (!splitter.matcher_->match(key)) {
+        continue;
+      }
+      counter<std::string> counter;
+      count_words(value, boundaries[position++], counter);
+      for (size_t i = 0; i < splitter.weights_.size(); ++i) {
+        make_string_features(
+            key, splitter.name_, splitter.weights_[i], counter, ret_fv);
+      }
+    }
+  }
+
   static std::string make_feature(
       const std::string& key,
       const std::string& value,
@@ -336,15 +668,21 @@ class datum_to_fv_converter_impl {
       const std::string& value,
       counter<std::string>& counter) const {
     if (splitter.matcher_->match(key)) {
-      std::vector<std::pair<size_t, size_t> > boundaries;
+      boundaries_t boundaries;
       splitter.splitter_->split(value, boundaries);
+      count_words(value, boundaries, counter);
+    }
+  }
 
-      for (size_t i = 0; i < boundaries.size(); i++) {
-        size_t begin = boundaries[i].first;
-        size_t len = boundaries[i].second;
-        std::string word = value.substr(begin, len);
-        ++counter[word];
-      }
+  void count_words(
+      const std::string& value,
+      const boundaries_t& boundaries,
+      counter<std::string>& counter) const {
+    for (size_t i = 0; i < boundaries.size(); i++) {
+      size_t begin = boundaries[i].first;
+      size_t len = boundaries[i].second;
+      std::string word = value.substr(begin, len);
+      ++counter[word];
     }
   }
 
@@ -442,6 +780,25 @@ void datum_to_fv_converter::convert_and_update_weight(
   pimpl_->convert_and_update_weight(datum, ret_fv);
 }
 
+void datum_to_fv_converter::convert_many(
+    const std::vector<datum>& data,
+    std::vector<sfv_t>& ret_fvs) const {
+  pimpl_->convert_many(data, ret_fvs);
+}
+
+void datum_to_fv_converter::convert_and_update_weight_many(
+    const std::vector<datum>& data,
+    std::vector<sfv_t>& ret_fvs) {
+  pimpl_->convert_and_update_weight_many(data, ret_fvs);
+}
+
+void datum_to_fv_converter::convert_and_update_weight_many(
+    const std::vector<datum>& data,
+    std::vector<sfv_t>& ret_fvs,
+    size_t thread_num) {
+  pimpl_->convert_and_update_weight_many(data, ret_fvs, thread_num);
+}
+
 void datum_to_fv_converter::clear_rules() {
   pimpl_->clear_rules();
 }
@@ -494,5 +851,14 @@ void datum_to_fv_converter::set_weight_manager(
   pimpl_->set_weight_manager(wm);
 }
 
+void datum_to_fv_converter::set_cache_size(size_t cache_size) {
+  pimpl_->set_cache_size(cache_size);
+}
+
+void datum_to_fv_converter::get_status(
+    std::map<std::string, std::string>& status) const {
+  pimpl_->get_status(status);
+}
+
 }  // namespace fv_converter
 }  // namespace jubatus
@@ -17,6 +17,7 @@
 #ifndef JUBATUS_FV_CONVERTER_DATUM_TO_FV_CONVERTER_HPP_
 #define JUBATUS_FV_CONVERTER_DATUM_TO_FV_CONVERTER_HPP_
 
+#include <map>
 #include <string>
 #include <utility>
 #include <vector>
@@ -72,6 +73,25 @@ class datum_to_fv_converter {
 
   void convert_and_update_weight(const datum& datum, sfv_t& ret_fv);
 
+  // Batch versions of convert and convert_and_update_weight.
+  // Each word_splitter is called once for all string values in the batch.
+  void convert_many(
+      const std::vector<datum>& data,
+      std::vector<sfv_t>& ret_fvs) const;
+
+  void convert_and_update_weight_many(
+      const std::vector<datum>& data,
+      std::vector<sfv_t>& ret_fvs);
+
+  // Same as above, but splits data into at most thread_num chunks that are
+  // converted concurrently. As document frequencies are updated in no
+  // particular order, weights may differ slightly from the sequential
+  // version.
+  void convert_and_update_weight_many(
+      const std::vector<datum>& data,
+      std::vector<sfv_t>& ret_fvs,
+      size_t thread_num);
+
   void clear_rules();
 
   void register_string_filter(
@@ -105,6 +125,10 @@ class datum_to_fv_converter {
 
   void set_weight_manager(common::cshared_ptr<weight_manager> wm);
 
+  void set_cache_size(size_t cache_size);
+
+  void get_status(std::map<std::string, std::string>& status) const;
+
  private:
   pfi::lang::scoped_ptr<datum_to_fv_converter_impl> pimpl_;
 };
@@ -16,10 +16,12 @@
 
 #include <algorithm>
 #include <cmath>
+#include <map>
 #include <string>
 #include <utility>
 #include <vector>
 #include <gtest/gtest.h>
+#include <pficommon/lang/cast.h>
 #include <pficommon/lang/shared_ptr.h>
 #include <pficommon/text/json.h>
 #include "character_ngram.hpp"
@@ -30,6 +32,7 @@
 #include "match_all.hpp"
 #include "num_feature_impl.hpp"
 #include "num_filter_impl.hpp"
+#include "prefix_match.hpp"
 #ifdef HAVE_RE2
 #  include "re2_filter.hpp"
 #endif
@@ -280,6 +283,63 @@ TEST(datum_to_fv_converter, register_string_filter) {
 #endif
 }
 
+#ifdef HAVE_RE2
+TEST(datum_to_fv_converter, many_regexp_filters) {
+  datum_to_fv_converter conv;
+  init_weight_manager(conv);
+
+  datum datum;
+  datum.string_values_.push_back(std::make_pair("/text", "<b>ab</b>"));
+  datum.string_values_.push_back(std::make_pair("/id", "x1"));
+
+  std::vector<splitter_weight_type> p;
+  p.push_back(splitter_weight_type(FREQ_BINARY, TERM_BINARY));
+  conv.register_string_rule("str",
+      shared_ptr<key_matcher>(new match_all()),
+      shared_ptr<word_splitter>(new without_split()),
+      p);
+  conv.register_string_filter(shared_ptr<key_matcher>(new match_all()),
+      shared_ptr<string_filter>(new re2_filter("<[^>]*>", "")),
+      "_tag");
+  conv.register_string_filter(shared_ptr<key_matcher>(new match_all()),
+      shared_ptr<string_filter>(new re2_filter("[0-9]", "N")),
+      "_num");
+  conv.register_string_filter(shared_ptr<key_matcher>(new match_all()),
+      shared_ptr<string_filter>(new re2_filter("z", "Z")),
+      "_z");
+
+  std::vector<std::pair<std::string, float> > feature;
+  conv.convert(datum, feature);
+
+  std::vector<std::string> keys;
+  for (size_t i = 0; i < feature.size(); ++i) {
+    keys.push_back(feature[i].first);
+  }
+  std::sort(keys.begin(), keys.end());
+
+  std::vector<std::string> expected;
+  expected.push_back("/id$x1@str#bin/bin");
+  expected.push_back("/id_num$xN@str#bin/bin");
+  expected.push_back("/id_num_z$xN@str#bin/bin");
+  expected.push_back("/id_tag$x1@str#bin/bin");
+  expected.push_back("/id_tag_num$xN@str#bin/bin");
+  expected.push_back("/id_tag_num_z$xN@str#bin/bin");
+  expected.push_back("/id_tag_z$x1@str#bin/bin");
+  expected.push_back("/id_z$x1@str#bin/bin");
+  expected.push_back("/text$<b>ab</b>@str#bin/bin");
+  expected.push_back("/text_num$<b>ab</b>@str#bin/bin");
+  expected.push_back("/text_num_z$<b>ab</b>@str#bin/bin");
+  expected.push_back("/text_tag$ab@str#bin/bin");
+  expected.push_back("/text_tag_num$ab@str#bin/bin");
+  expected.push_back("/text_tag_num_z$ab@str#bin/bin");
+  expected.push_back("/text_tag_z$ab@str#bin/bin");
+  expected.push_back("/text_z$<b>ab</b>@str#bin/bin");
+  std::sort(expected.begin(), expected.end());
+
+  EXPECT_EQ(expected, keys);
+}
+#endif
+
 TEST(datum_to_fv_converter, register_num_filter) {
   datum_to_fv_converter conv;
   init_weight_manager(conv);
@@ -349,5 +409,137 @@ TEST(datum_to_fv_converter, hasher) {
   EXPECT_EQ("0", feature[i].first);
 }
 
+namespace {
+
+void init_many_converter(datum_to_fv_converter& conv) {
+  init_weight_manager(conv);
+  {
+    std::vector<splitter_weight_type> p;
+    p.push_back(splitter_weight_type(TERM_FREQUENCY, IDF));
+    conv.register_string_rule("space",
+        shared_ptr<key_matcher>(new prefix_match("/title")),
+        shared_ptr<word_splitter>(new space_splitter()),
+        p);
+  }
+  {
+    std::vector<splitter_weight_type> p;
+    p.push_back(splitter_weight_type(FREQ_BINARY, TERM_BINARY));
+    conv.register_string_rule("str",
+        shared_ptr<key_matcher>(new match_all()),
+        shared_ptr<word_splitter>(new without_split()),
+        p);
+  }
+#ifdef HAVE_RE2
+  conv.register_string_filter(
+      shared_ptr<key_matcher>(new prefix_match("/title")),
+      shared_ptr<string_filter>(new re2_filter("<[^>]*>", "")),
+      "_filtered");
+#endif
+  conv.register_num_rule("num",
+      shared_ptr<key_matcher>(new match_all()),
+      shared_ptr<num_feature>(new num_value_feature()));
+}
+
+}  // namespace
+
+TEST(datum_to_fv_converter, convert_many) {
+  std::vector<datum> data(3);
+  data[0].string_values_.push_back(std::make_pair("/title", "a <b>b</b> a"));
+  data[0].string_values_.push_back(std::make_pair("/id", "x"));
+  data[0].num_values_.push_back(std::make_pair("/age", 10));
+  data[2].string_values_.push_back(std::make_pair("/id", "y"));
+  data[2].string_values_.push_back(std::make_pair("/title", "c a"));
+
+  datum_to_fv_converter conv1;
+  init_many_converter(conv1);
+  std::vector<sfv_t> expected;
+  for (size_t i = 0; i < data.size(); ++i) {
+    sfv_t fv;
+    conv1.convert_and_update_weight(data[i], fv);
+    expected.push_back(fv);
+  }
+
+  datum_to_fv_converter conv2;
+  init_many_converter(conv2);
+  std::vector<sfv_t> actual;
+  conv2.convert_and_update_weight_many(data, actual);
+  EXPECT_EQ(expected, actual);
+
+  expected.clear();
+  for (size_t i = 0; i < data.size(); ++i) {
+    sfv_t fv;
+    conv1.convert(data[i], fv);
+    expected.push_back(fv);
+  }
+  conv2.convert_many(data, actual);
+  EXPECT_EQ(expected, actual);
+}
+
+TEST(datum_to_fv_converter, convert_many_parallel) {
+  std::vector<datum> data(500);
+  for (size_t i = 0; i < data.size(); ++i) {
+    std::string n = pfi::lang::lexical_cast<std::string>(i);
+    data[i].string_values_.push_back(std::make_pair("/title", "a <b>" + n));
+    data[i].string_values_.push_back(std::make_pair("/id", n));
+    data[i].num_values_.push_back(std::make_pair("/age", i));
+  }
+
+  datum_to_fv_converter conv1;
+  init_many_converter(conv1);
+  std::vector<sfv_t> expected;
+  conv1.convert_and_update_weight_many(data, expected);
+
+  datum_to_fv_converter conv2;
+  init_many_converter(conv2);
+  std::vector<sfv_t> actual;
+  conv2.convert_and_update_weight_many(data, actual, 4);
+  ASSERT_EQ(expected.size(), actual.size());
+
+  // document frequencies are the same once all data are counted
+  conv1.convert_many(data, expected);
+  conv2.convert_many(data, actual);
+  EXPECT_EQ(expected, actual);
+}
+
+TEST(datum_to_fv_converter, cache_reapplies_idf) {
+  datum_to_fv_converter conv;
+  init_weight_manager(conv);
+  conv.set_cache_size(10);
+  {
+    shared_ptr<key_matcher> match(new match_all());
+    shared_ptr<word_splitter> s(new space_splitter());
+    std::vector<splitter_weight_type> p;
+    p.push_back(splitter_weight_type(FREQ_BINARY, IDF));
+    conv.register_string_rule("space", match, s, p);
+  }
+
+  datum d1;
+  d1.string_values_.push_back(std::make_pair("/id", "a b"));
+  datum d2;
+  d2.string_values_.push_back(std::make_pair("/id", "a"));
+
+  std::vector<std::pair<std::string, float> > feature;
+  conv.convert_and_update_weight(d1, feature);
+  conv.convert_and_update_weight(d2, feature);
+
+  // df("a") = 2, df("b") = 1, |D| = 2; "a" has zero weight
+  conv.convert(d1, feature);
+  ASSERT_EQ(1u, feature.size());
+  EXPECT_EQ("/id$b@space#bin/idf", feature[0].first);
+  EXPECT_FLOAT_EQ(std::log(3. / 2.), feature[0].second);
+
+  // df("b") = 1, |D| = 3; the cached vector must be reweighted
+  conv.convert_and_update_weight(d2, feature);
+  conv.convert(d1, feature);
+  ASSERT_EQ(1u, feature.size());
+  EXPECT_FLOAT_EQ(std::log(4. / 2.), feature[0].second);
+
+  std::map<std::string, std::string> status;
+  conv.get_status(status);
+  EXPECT_EQ("2", status["converter_cache_size"]);
+  EXPECT_EQ("3", status["converter_cache_hit"]);
+  EXPECT_EQ("2", status["converter_cache_miss"]);
+}
+
 }  // namespace fv_converter
 }  // namespace jubatus
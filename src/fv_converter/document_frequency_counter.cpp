@@ -0,0 +1,230 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include "document_frequency_counter.hpp"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+#include <pficommon/concurrent/lock.h>
+#include "../common/hash.hpp"
+
+using pfi::concurrent::scoped_lock;
+using pfi::concurrent::scoped_rlock;
+using pfi::concurrent::scoped_wlock;
+
+namespace jubatus {
+namespace fv_converter {
+
+namespace {
+
+void clear_counts(std::vector<unsigned>& counts) {
+  std::fill(counts.begin(), counts.end(), 0);
+}
+
+void add_counts(
+    const std::vector<unsigned>& counts,
+    const pfi::data::unordered_map<std::string, size_t>& ids,
+    counter<std::string>& freqs) {
+  typedef pfi::data::unordered_map<std::string, size_t>::const_iterator
+      iterator;
+  for (iterator it = ids.begin(); it != ids.end(); ++it) {
+    unsigned count = counts[it->second];
+    if (count > 0) {
+      freqs[it->first] += count;
+    }
+  }
+}
+
+}  // namespace
+
+document_frequency_counter::document_frequency_counter()
+    : diff_document_count_(0),
+      master_document_count_(0) {
+}
+
+void document_frequency_counter::add_document(const sfv_t& fv) {
+  // Count the document first so that no reader observes a document
+  // frequency larger than the document count.
+#ifdef ATOMIC_I8_SUPPORT
+  __sync_fetch_and_add(&diff_document_count_, 1);
+#else
+  {
+    scoped_lock lk(count_mutex_);
+    ++diff_document_count_;
+  }
+#endif
+
+  for (sfv_t::const_iterator it = fv.begin(); it != fv.end(); ++it) {
+    shard& s = get_shard(it->first);
+    {
+      scoped_rlock lk(s.mutex);
+      pfi::data::unordered_map<std::string, size_t>::const_iterator id =
+          s.ids.find(it->first);
+      if (id != s.ids.end()) {
+        __sync_fetch_and_add(&s.diff[id->second], 1);
+        continue;
+      }
+    }
+    scoped_wlock lk(s.mutex);
+    ++s.diff[intern(s, it->first)];
+  }
+}
+
+size_t document_frequency_counter::get_document_count() const {
+#ifndef ATOMIC_I8_SUPPORT
+  scoped_lock lk(count_mutex_);
+#endif
+  return diff_document_count_ + master_document_count_;
+}
+
+size_t document_frequency_counter::get_document_frequency(
+    const std::string& key) const {
+  const shard& s = get_shard(key);
+  scoped_rlock lk(s.mutex);
+  pfi::data::unordered_map<std::string, size_t>::const_iterator it =
+      s.ids.find(key);
+  if (it == s.ids.end()) {
+    return 0;
+  }
+  return s.diff[it->second] + s.master[it->second];
+}
+
+void document_frequency_counter::get_diff(
+    size_t& document_count,
+    counter<std::string>& freqs) const {
+  {
+#ifndef ATOMIC_I8_SUPPORT
+    scoped_lock lk(count_mutex_);
+#endif
+    document_count = diff_document_count_;
+  }
+  for (size_t i = 0; i < SHARD_NUM; ++i) {
+    scoped_rlock lk(shards_[i].mutex);
+    add_counts(shards_[i].diff, shards_[i].ids, freqs);
+  }
+}
+
+void document_frequency_counter::get_master(
+    size_t& document_count,
+    counter<std::string>& freqs) const {
+  {
+#ifndef ATOMIC_I8_SUPPORT
+    scoped_lock lk(count_mutex_);
+#endif
+    document_count = master_document_count_;
+  }
+  for (size_t i = 0; i < SHARD_NUM; ++i) {
+    scoped_rlock lk(shards_[i].mutex);
+    add_counts(shards_[i].master, shards_[i].ids, freqs);
+  }
+}
+
+void document_frequency_counter::put_diff(
+    size_t document_count,
+    const counter<std::string>& freqs) {
+  for (size_t i = 0; i < SHARD_NUM; ++i) {
+    scoped_wlock lk(shards_[i].mutex);
+    clear_counts(shards_[i].diff);
+  }
+  for (counter<std::string>::const_iterator it = freqs.begin();
+       it != freqs.end(); ++it) {
+    shard& s = get_shard(it->first);
+    scoped_wlock lk(s.mutex);
+    s.master[intern(s, it->first)] += it->second;
+  }
+
+  scoped_lock lk(count_mutex_);
+  diff_document_count_ = 0;
+  master_document_count_ += document_count;
+}
+
+void document_frequency_counter::set(
+    size_t diff_document_count,
+    const counter<std::string>& diff_freqs,
+    size_t master_document_count,
+    const counter<std::string>& master_freqs) {
+  clear();
+  for (counter<std::string>::const_iterator it = diff_freqs.begin();
+       it != diff_freqs.end(); ++it) {
+    shard& s = get_shard(it->first);
+    scoped_wlock lk(s.mutex);
+    s.diff[intern(s, it->first)] += it->second;
+  }
+  for (counter<std::string>::const_iterator it = master_freqs.begin();
+       it != master_freqs.end(); ++it) {
+    shard& s = get_shard(it->first);
+    scoped_wlock lk(s.mutex);
+    s.master[intern(s, it->first)] += it->second;
+  }
+
+  scoped_lock lk(count_mutex_);
+  diff_document_count_ = diff_document_count;
+  master_document_count_ = master_document_count;
+}
+
+void document_frequency_counter::clear() {
+  for (size_t i = 0; i < SHARD_NUM; ++i) {
+    shard& s = shards_[i];
+    scoped_wlock lk(s.mutex);
+    pfi::data::unordered_map<std::string, size_t>().swap(s.ids);
+    std::vector<unsigned>().swap(s.diff);
+    std::vector<unsigned>().swap(s.master);
+  }
+
+  scoped_lock lk(count_mutex_);
+  diff_document_count_ = 0;
+  master_document_count_ = 0;
+}
+
+size_t document_frequency_counter::size() const {
+  size_t size = 0;
+  for (size_t i = 0; i < SHARD_NUM; ++i) {
+    scoped_rlock lk(shards_[i].mutex);
+    size += shards_[i].ids.size();
+  }
+  return size;
+}
+
+document_frequency_counter::shard& document_frequency_counter::get_shard(
+    const std::string& key) {
+  return shards_[hash_util::calc_string_hash(key) % SHARD_NUM];
+}
+
+const document_frequency_counter::shard&
+document_frequency_counter::get_shard(const std::string& key) const {
+  return shards_[hash_util::calc_string_hash(key) % SHARD_NUM];
+}
+
+size_t document_frequency_counter::intern(
+    shard& s,
+    const std::string& key) {
+  // caller must hold the write lock of s
+  pfi::data::unordered_map<std::string, size_t>::const_iterator it =
+      s.ids.find(key);
+  if (it != s.ids.end()) {
+    return it->second;
+  }
+  size_t id = s.diff.size();
+  s.ids.insert(std::make_pair(key, id));
+  s.diff.push_back(0);
+  s.master.push_back(0);
+  return id;
+}
+
+}  // namespace fv_converter
+}  // namespace jubatus
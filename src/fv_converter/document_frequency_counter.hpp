@@ -0,0 +1,91 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#ifndef JUBATUS_FV_CONVERTER_DOCUMENT_FREQUENCY_COUNTER_HPP_
+#define JUBATUS_FV_CONVERTER_DOCUMENT_FREQUENCY_COUNTER_HPP_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <pficommon/concurrent/mutex.h>
+#include <pficommon/concurrent/rwmutex.h>
+#include <pficommon/data/unordered_map.h>
+#include <pficommon/lang/noncopyable.h>
+#include "../common/type.hpp"
+#include "counter.hpp"
+
+namespace jubatus {
+namespace fv_converter {
+
+// Document frequencies of the diff and the master model.
+// Each key is interned once into a shard and both counts are kept in
+// arrays indexed by the local feature ID, so a key is not duplicated
+// between diff and master. add_document only locks the shards it touches
+// and increments existing counts atomically, so it can be called
+// concurrently with itself and with the getters.
+class document_frequency_counter : pfi::lang::noncopyable {
+ public:
+  document_frequency_counter();
+
+  void add_document(const sfv_t& fv);
+
+  size_t get_document_count() const;
+  size_t get_document_frequency(const std::string& key) const;
+
+  // Counts added by add_document since the last put_diff
+  void get_diff(size_t& document_count, counter<std::string>& freqs) const;
+  void get_master(size_t& document_count, counter<std::string>& freqs) const;
+
+  // Adds mixed counts to the master and clears the diff
+  void put_diff(size_t document_count, const counter<std::string>& freqs);
+
+  // Replaces all counts, e.g. on load
+  void set(
+      size_t diff_document_count,
+      const counter<std::string>& diff_freqs,
+      size_t master_document_count,
+      const counter<std::string>& master_freqs);
+
+  void clear();
+
+  size_t size() const;
+
+ private:
+  struct shard {
+    mutable pfi::concurrent::rw_mutex mutex;
+    pfi::data::unordered_map<std::string, size_t> ids;
+    std::vector<unsigned> diff;
+    std::vector<unsigned> master;
+  };
+
+  static const size_t SHARD_NUM = 16;
+
+  shard& get_shard(const std::string& key);
+  const shard& get_shard(const std::string& key) const;
+  static size_t intern(shard& s, const std::string& key);
+
+  shard shards_[SHARD_NUM];
+
+  // only used when 64-bit atomic operations are not available
+  mutable pfi::concurrent::mutex count_mutex_;
+  uint64_t diff_document_count_;
+  uint64_t master_document_count_;
+};
+
+}  // namespace fv_converter
+}  // namespace jubatus
+
+#endif  // JUBATUS_FV_CONVERTER_DOCUMENT_FREQUENCY_COUNTER_HPP_
@@ -0,0 +1,136 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <gtest/gtest.h>
+#include <pficommon/concurrent/thread.h>
+#include <pficommon/lang/bind.h>
+#include <pficommon/lang/cast.h>
+#include <pficommon/lang/shared_ptr.h>
+#include "../common/type.hpp"
+#include "document_frequency_counter.hpp"
+
+namespace jubatus {
+namespace fv_converter {
+
+TEST(document_frequency_counter, trivial) {
+  document_frequency_counter c;
+  sfv_t fv;
+  c.add_document(fv);
+
+  fv.push_back(std::make_pair("key1", 1.0));
+  fv.push_back(std::make_pair("key2", 1.0));
+  c.add_document(fv);
+
+  EXPECT_EQ(2u, c.get_document_count());
+  EXPECT_EQ(1u, c.get_document_frequency("key1"));
+  EXPECT_EQ(0u, c.get_document_frequency("unknown"));
+  EXPECT_EQ(2u, c.size());
+
+  size_t count = 0;
+  counter<std::string> freqs;
+  c.get_diff(count, freqs);
+  EXPECT_EQ(2u, count);
+  EXPECT_EQ(1u, freqs["key1"]);
+  EXPECT_EQ(1u, freqs["key2"]);
+
+  c.clear();
+  EXPECT_EQ(0u, c.get_document_count());
+  EXPECT_EQ(0u, c.get_document_frequency("key1"));
+  EXPECT_EQ(0u, c.size());
+}
+
+TEST(document_frequency_counter, put_diff) {
+  document_frequency_counter c;
+  sfv_t fv;
+  fv.push_back(std::make_pair("key1", 1.0));
+  c.add_document(fv);
+
+  counter<std::string> mixed;
+  mixed["key1"] = 3;
+  mixed["key2"] = 1;
+  c.put_diff(4, mixed);
+
+  EXPECT_EQ(4u, c.get_document_count());
+  EXPECT_EQ(3u, c.get_document_frequency("key1"));
+  EXPECT_EQ(1u, c.get_document_frequency("key2"));
+
+  size_t count = 0;
+  counter<std::string> diff;
+  c.get_diff(count, diff);
+  EXPECT_EQ(0u, count);
+  EXPECT_FALSE(diff.contains("key1"));
+
+  counter<std::string> master;
+  c.get_master(count, master);
+  EXPECT_EQ(4u, count);
+  EXPECT_EQ(3u, master["key1"]);
+  EXPECT_EQ(1u, master["key2"]);
+}
+
+TEST(document_frequency_counter, set) {
+  counter<std::string> diff, master;
+  diff["key1"] = 1;
+  master["key1"] = 2;
+  master["key2"] = 2;
+
+  document_frequency_counter c;
+  c.set(1, diff, 3, master);
+  EXPECT_EQ(4u, c.get_document_count());
+  EXPECT_EQ(3u, c.get_document_frequency("key1"));
+  EXPECT_EQ(2u, c.get_document_frequency("key2"));
+}
+
+namespace {
+
+void add_documents(document_frequency_counter* c, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    sfv_t fv;
+    fv.push_back(std::make_pair("common", 1.0));
+    fv.push_back(std::make_pair(
+        "key" + pfi::lang::lexical_cast<std::string>(i), 1.0));
+    c->add_document(fv);
+  }
+}
+
+}  // namespace
+
+TEST(document_frequency_counter, concurrent_add) {
+  const size_t thread_num = 4;
+  const size_t doc_num = 1000;
+  document_frequency_counter c;
+
+  std::vector<pfi::lang::shared_ptr<pfi::concurrent::thread> > threads;
+  for (size_t i = 0; i < thread_num; ++i) {
+    threads.push_back(pfi::lang::shared_ptr<pfi::concurrent::thread>(
+        new pfi::concurrent::thread(
+            pfi::lang::bind(&add_documents, &c, doc_num))));
+    threads.back()->start();
+  }
+  for (size_t i = 0; i < thread_num; ++i) {
+    threads[i]->join();
+  }
+
+  EXPECT_EQ(thread_num * doc_num, c.get_document_count());
+  EXPECT_EQ(thread_num * doc_num, c.get_document_frequency("common"));
+  EXPECT_EQ(thread_num, c.get_document_frequency("key0"));
+  EXPECT_EQ(doc_num + 1, c.size());
+}
+
+}  // namespace fv_converter
+}  // namespace jubatus
@@ -67,5 +67,14 @@ void* dynamic_loader::load_symbol(const std::string& name) const {
   return func;
 }
 
+void* dynamic_loader::find_symbol(const std::string& name) const {
+  dlerror();
+  void* func = dlsym(handle_, name.c_str());
+  if (dlerror() != NULL) {
+    return NULL;
+  }
+  return func;
+}
+
 }  // namespace fv_converter
 }  // namespace jubatus
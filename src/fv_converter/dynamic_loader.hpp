@@ -29,6 +29,8 @@ class dynamic_loader {
   ~dynamic_loader();
 
   void* load_symbol(const std::string& name) const;
+  // Same as load_symbol, but returns NULL for optional symbols not found
+  void* find_symbol(const std::string& name) const;
 
  private:
   void* handle_;
@@ -40,5 +40,11 @@ TEST(dynamic_loader, unknown_function) {
   EXPECT_THROW(l.load_symbol("unknown"), converter_exception);
 }
 
+TEST(dynamic_loader, find_symbol) {
+  dynamic_loader l(LIBSPLITTER_SAMPLE);
+  EXPECT_TRUE(l.find_symbol("create") != NULL);
+  EXPECT_TRUE(l.find_symbol("unknown") == NULL);
+}
+
 }  // namespace fv_converter
 }  // namespace jubatus
@@ -29,7 +29,12 @@ dynamic_splitter::dynamic_splitter(
     const std::string& function,
     const std::map<std::string, std::string>& params)
     : loader_(path),
-      impl_(load_object<word_splitter>(loader_, function, params)) {
+      impl_(load_object<word_splitter>(loader_, function, params)),
+      has_split_many_(false) {
+  typedef int (*abi_version_func_t)();
+  abi_version_func_t abi_version = reinterpret_cast<abi_version_func_t>(
+      loader_.find_symbol("jubatus_word_splitter_abi_version"));
+  has_split_many_ = abi_version && (*abi_version)() >= 1;
 }
 
 void dynamic_splitter::split(
@@ -38,5 +43,17 @@ void dynamic_splitter::split(
   impl_->split(string, ret_boundaries);
 }
 
+void dynamic_splitter::split_many(
+    const std::vector<std::string>& strings,
+    std::vector<std::vector<std::pair<size_t, size_t> > >& ret_boundaries)
+    const {
+  if (has_split_many_) {
+    impl_->split_many(strings, ret_boundaries);
+  } else {
+    // calls split of impl_ for each string
+    word_splitter::split_many(strings, ret_boundaries);
+  }
+}
+
 }  // namespace fv_converter
 }  // namespace jubatus
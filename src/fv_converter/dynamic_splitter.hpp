@@ -39,9 +39,16 @@ class dynamic_splitter : public word_splitter {
       const std::string& string,
       std::vector<std::pair<size_t, size_t> >& ret_boundaries) const;
 
+  void split_many(
+      const std::vector<std::string>& strings,
+      std::vector<std::vector<std::pair<size_t, size_t> > >& ret_boundaries)
+      const;
+
  private:
   dynamic_loader loader_;
   pfi::lang::scoped_ptr<word_splitter> impl_;
+  // whether impl_ has split_many in its vtable
+  bool has_split_many_;
 };
 
 }  // namespace fv_converter
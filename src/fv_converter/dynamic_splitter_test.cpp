@@ -41,6 +41,29 @@ TEST(dynamic_splitter, trivial) {
   EXPECT_EQ(4u, bounds[1].second);
 }
 
+TEST(dynamic_splitter, split_many) {
+  dynamic_splitter s(LIBSPLITTER_SAMPLE,
+      "create",
+      std::map<std::string, std::string>());
+  std::vector<std::string> strings;
+  strings.push_back(" test test");
+  strings.push_back("");
+  strings.push_back("a");
+  std::vector<std::vector<std::pair<size_t, size_t> > > bounds;
+  s.split_many(strings, bounds);
+
+  ASSERT_EQ(3u, bounds.size());
+  ASSERT_EQ(2u, bounds[0].size());
+  EXPECT_EQ(1u, bounds[0][0].first);
+  EXPECT_EQ(4u, bounds[0][0].second);
+  EXPECT_EQ(6u, bounds[0][1].first);
+  EXPECT_EQ(4u, bounds[0][1].second);
+  EXPECT_EQ(0u, bounds[1].size());
+  ASSERT_EQ(1u, bounds[2].size());
+  EXPECT_EQ(0u, bounds[2][0].first);
+  EXPECT_EQ(1u, bounds[2][0].second);
+}
+
 TEST(dynamic_splitter, unknown_file) {
   EXPECT_THROW(
       dynamic_splitter s("unknown_file.so",
@@ -14,6 +14,7 @@
 // License along with this library; if not, write to the Free Software
 // Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
+#include <algorithm>
 #include <cmath>
 #include <string>
 #include <utility>
@@ -47,6 +48,13 @@ void keyword_weights::update_document_frequency(const sfv_t& fv) {
   }
 }
 
+void keyword_weights::swap_document_frequencies(
+    size_t& document_count,
+    counter<std::string>& frequencies) {
+  std::swap(document_count_, document_count);
+  document_frequencies_.swap(frequencies);
+}
+
 void keyword_weights::add_weight(const std::string& key, float weight) {
   weights_[key] = weight;
 }
@@ -63,6 +71,10 @@ float keyword_weights::get_user_weight(const std::string& key) const {
 void keyword_weights::merge(const keyword_weights& w) {
   document_count_ += w.document_count_;
   document_frequencies_.add(w.document_frequencies_);
+  merge_weights(w);
+}
+
+void keyword_weights::merge_weights(const keyword_weights& w) {
   weight_t weights(w.weights_);
   weights.insert(weights_.begin(), weights_.end());
   weights_.swap(weights);
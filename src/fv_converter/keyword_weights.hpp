@@ -41,12 +41,24 @@ class keyword_weights {
     return document_count_;
   }
 
+  const counter<std::string>& get_document_frequencies() const {
+    return document_frequencies_;
+  }
+
+  // Exchanges the document count and frequencies with the given ones
+  void swap_document_frequencies(
+      size_t& document_count,
+      counter<std::string>& frequencies);
+
   void add_weight(const std::string& key, float weight);
 
   float get_user_weight(const std::string& key) const;
 
   void merge(const keyword_weights& w);
 
+  // Merges only user weights and leaves document frequencies untouched
+  void merge_weights(const keyword_weights& w);
+
   void clear();
 
   MSGPACK_DEFINE(document_count_, document_frequencies_, weights_);
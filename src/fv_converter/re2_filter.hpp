@@ -30,6 +30,10 @@ class re2_filter : public string_filter {
 
   void filter(const std::string& input, std::string& output) const;
 
+  const std::string& pattern() const {
+    return re_.pattern();
+  }
+
  private:
   re2_filter();
 
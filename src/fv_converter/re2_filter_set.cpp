@@ -0,0 +1,77 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include "re2_filter_set.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <glog/logging.h>
+#include "exception.hpp"
+#include "re2_filter.hpp"
+
+namespace jubatus {
+namespace fv_converter {
+
+re2_filter_set::re2_filter_set()
+    : set_(new re2::RE2::Set(re2::RE2::DefaultOptions, re2::RE2::UNANCHORED)),
+      size_(0),
+      compiled_(false) {
+}
+
+int re2_filter_set::add(const re2_filter& filter) {
+  if (compiled_) {
+    throw JUBATUS_EXCEPTION(
+        converter_exception("cannot add a filter to compiled re2_filter_set"));
+  }
+  std::string error;
+  int id = set_->Add(filter.pattern(), &error);
+  if (id >= 0) {
+    ++size_;
+  }
+  return id;
+}
+
+void re2_filter_set::compile() {
+  if (!set_->Compile()) {
+    throw JUBATUS_EXCEPTION(
+        converter_exception("failed to compile regular expression set"));
+  }
+  compiled_ = true;
+}
+
+void re2_filter_set::match(
+    const std::string& input,
+    std::vector<int>& ids) const {
+  ids.clear();
+  re2::RE2::Set::ErrorInfo error;
+  if (set_->Match(input, &ids, &error)
+      || error.kind == re2::RE2::Set::kNoError) {
+    std::sort(ids.begin(), ids.end());
+    return;
+  }
+
+  LOG(WARNING) << "failed to match regular expression set (error "
+               << error.kind << "), trying each filter";
+  // every filter can rewrite input
+  ids.clear();
+  for (size_t i = 0; i < size_; ++i) {
+    ids.push_back(static_cast<int>(i));
+  }
+}
+
+}  // namespace fv_converter
+}  // namespace jubatus
@@ -0,0 +1,61 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#ifndef JUBATUS_FV_CONVERTER_RE2_FILTER_SET_HPP_
+#define JUBATUS_FV_CONVERTER_RE2_FILTER_SET_HPP_
+
+#include <string>
+#include <vector>
+#include <pficommon/lang/scoped_ptr.h>
+#include <re2/set.h>
+
+namespace jubatus {
+namespace fv_converter {
+
+class re2_filter;
+
+// Compiles patterns of many re2_filters into one RE2::Set so that an input
+// is scanned only once to know which filters can rewrite it.
+// A filter whose pattern does not occur in the input leaves it unchanged.
+// Needs RE2 whose RE2::Set::Match tells a failure from no match.
+class re2_filter_set {
+ public:
+  re2_filter_set();
+
+  // Returns id of the filter in this set, or -1 if it cannot be added.
+  int add(const re2_filter& filter);
+
+  // Must be called after all filters are added.
+  void compile();
+
+  // Stores sorted ids of filters whose pattern occurs in input.
+  // If the set fails to match input, stores ids of all filters.
+  void match(const std::string& input, std::vector<int>& ids) const;
+
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  pfi::lang::scoped_ptr<re2::RE2::Set> set_;
+  size_t size_;
+  bool compiled_;
+};
+
+}  // namespace fv_converter
+}  // namespace jubatus
+
+#endif  // JUBATUS_FV_CONVERTER_RE2_FILTER_SET_HPP_
@@ -0,0 +1,54 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "re2_filter.hpp"
+#include "re2_filter_set.hpp"
+
+namespace jubatus {
+namespace fv_converter {
+
+TEST(re2_filter_set, trivial) {
+  re2_filter f1("a+", "A");
+  re2_filter f2("[0-9]+", "");
+  re2_filter f3("<[^>]*>", "");
+
+  re2_filter_set s;
+  int id1 = s.add(f1);
+  int id2 = s.add(f2);
+  int id3 = s.add(f3);
+  s.compile();
+  EXPECT_EQ(3u, s.size());
+
+  std::vector<int> ids;
+  s.match("bcd", ids);
+  EXPECT_TRUE(ids.empty());
+
+  s.match("<b>12</b>", ids);
+  ASSERT_EQ(2u, ids.size());
+  EXPECT_EQ(id2, ids[0]);
+  EXPECT_EQ(id3, ids[1]);
+
+  s.match("xax1", ids);
+  ASSERT_EQ(2u, ids.size());
+  EXPECT_EQ(id1, ids[0]);
+  EXPECT_EQ(id2, ids[1]);
+}
+
+}  // namespace fv_converter
+}  // namespace jubatus
@@ -36,12 +36,13 @@ struct is_zero {
 }  // namespace
 
 weight_manager::weight_manager()
-    : diff_weights_(),
+    : document_frequencies_(),
+      diff_weights_(),
       master_weights_() {
 }
 
 void weight_manager::update_weight(const sfv_t& fv) {
-  diff_weights_.update_document_frequency(fv);
+  document_frequencies_.add_document(fv);
 }
 
 void weight_manager::get_weight(sfv_t& fv) const {
@@ -80,5 +81,45 @@ void weight_manager::add_weight(const std::string& key, float weight) {
   diff_weights_.add_weight(key, weight);
 }
 
+keyword_weights weight_manager::get_diff() const {
+  keyword_weights diff(diff_weights_);
+  size_t document_count = 0;
+  counter<std::string> freqs;
+  document_frequencies_.get_diff(document_count, freqs);
+  diff.swap_document_frequencies(document_count, freqs);
+  return diff;
+}
+
+void weight_manager::put_diff(const keyword_weights& diff) {
+  document_frequencies_.put_diff(
+      diff.get_document_count(), diff.get_document_frequencies());
+  master_weights_.merge_weights(diff);
+  diff_weights_.clear();
+}
+
+void weight_manager::get_weights(
+    keyword_weights& diff,
+    keyword_weights& master) const {
+  diff = get_diff();
+
+  master = master_weights_;
+  size_t document_count = 0;
+  counter<std::string> freqs;
+  document_frequencies_.get_master(document_count, freqs);
+  master.swap_document_frequencies(document_count, freqs);
+}
+
+void weight_manager::set_weights(
+    const keyword_weights& diff,
+    const keyword_weights& master) {
+  document_frequencies_.set(
+      diff.get_document_count(), diff.get_document_frequencies(),
+      master.get_document_count(), master.get_document_frequencies());
+  diff_weights_.clear();
+  diff_weights_.merge_weights(diff);
+  master_weights_.clear();
+  master_weights_.merge_weights(master);
+}
+
 }  // namespace fv_converter
 }  // namespace jubatus
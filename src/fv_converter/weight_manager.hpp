@@ -24,11 +24,15 @@
 #include "../common/type.hpp"
 #include "counter.hpp"
 #include "datum.hpp"
+#include "document_frequency_counter.hpp"
 #include "keyword_weights.hpp"
 
 namespace jubatus {
 namespace fv_converter {
 
+// Document frequencies are kept in a document_frequency_counter, so
+// update_weight and get_weight may be called concurrently. Other members
+// must be called exclusively.
 class weight_manager {
  public:
   weight_manager();
@@ -38,45 +42,51 @@ class weight_manager {
 
   void add_weight(const std::string& key, float weight);
 
-  const keyword_weights& get_diff() const {
-    return diff_weights_;
-  }
+  keyword_weights get_diff() const;
 
-  void put_diff(const keyword_weights& diff) {
-    master_weights_.merge(diff);
-    diff_weights_.clear();
-  }
+  void put_diff(const keyword_weights& diff);
 
   void clear() {
+    document_frequencies_.clear();
     diff_weights_.clear();
     master_weights_.clear();
   }
 
   void save(std::ostream& os) {
     pfi::data::serialization::binary_oarchive oa(os);
-    oa << diff_weights_;
-    oa << master_weights_;
+    keyword_weights diff, master;
+    get_weights(diff, master);
+    oa << diff;
+    oa << master;
   }
   void load(std::istream& is) {
     pfi::data::serialization::binary_iarchive ia(is);
-    ia >> diff_weights_;
-    ia >> master_weights_;
+    keyword_weights diff, master;
+    ia >> diff;
+    ia >> master;
+    set_weights(diff, master);
   }
 
   template<class Archiver>
   void serialize(Archiver& ar) {
-    ar & MEMBER(diff_weights_) & MEMBER(master_weights_);
+    keyword_weights diff, master;
+    if (!ar.is_read) {
+      get_weights(diff, master);
+    }
+    ar & NAMED_MEMBER("diff_weights_", diff)
+        & NAMED_MEMBER("master_weights_", master);
+    if (ar.is_read) {
+      set_weights(diff, master);
+    }
   }
 
  private:
   size_t get_document_count() const {
-    return diff_weights_.get_document_count() +
-        master_weights_.get_document_count();
+    return document_frequencies_.get_document_count();
   }
 
   size_t get_document_frequency(const std::string& key) const {
-    return diff_weights_.get_document_frequency(key) +
-        master_weights_.get_document_frequency(key);
+    return document_frequencies_.get_document_frequency(key);
   }
 
   double get_user_weight(const std::string& key) const {
@@ -86,6 +96,13 @@ class weight_manager {
 
   double get_global_weight(const std::string& key) const;
 
+  // Builds / restores the serialized form, which keeps document
+  // frequencies in keyword_weights
+  void get_weights(keyword_weights& diff, keyword_weights& master) const;
+  void set_weights(const keyword_weights& diff, const keyword_weights& master);
+
+  document_frequency_counter document_frequencies_;
+  // user weights only; document frequencies are in document_frequencies_
   keyword_weights diff_weights_;
   keyword_weights master_weights_;
 };
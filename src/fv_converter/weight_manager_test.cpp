@@ -15,6 +15,7 @@
 // Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include <cmath>
+#include <sstream>
 #include <utility>
 #include <gtest/gtest.h>
 #include "../common/type.hpp"
@@ -72,5 +73,39 @@ TEST(weight_manager, trivial) {
   }
 }
 
+TEST(weight_manager, save_load) {
+  weight_manager m;
+  sfv_t fv;
+  fv.push_back(std::make_pair("/title$this@space#bin/idf", 1.0));
+  m.update_weight(fv);
+  m.add_weight("/address$tokyo@str", 1.5);
+  m.put_diff(m.get_diff());
+  m.update_weight(fv);
+  m.update_weight(sfv_t());
+
+  std::stringstream ss;
+  m.save(ss);
+  weight_manager m2;
+  m2.load(ss);
+
+  keyword_weights w = m2.get_diff();
+  EXPECT_EQ(2u, w.get_document_count());
+  EXPECT_EQ(1u, w.get_document_frequency("/title$this@space#bin/idf"));
+
+  // df = 2, |D| = 3
+  sfv_t fv2(fv);
+  m.get_weight(fv);
+  m2.get_weight(fv2);
+  ASSERT_EQ(1u, fv2.size());
+  EXPECT_FLOAT_EQ(fv[0].second, fv2[0].second);
+  EXPECT_FLOAT_EQ(log((3.0 + 1) / (2.0 + 1)), fv2[0].second);
+
+  sfv_t fv3;
+  fv3.push_back(std::make_pair("/address$tokyo@str#bin/weight", 1.0));
+  m2.get_weight(fv3);
+  ASSERT_EQ(1u, fv3.size());
+  EXPECT_FLOAT_EQ(1.5, fv3[0].second);
+}
+
 }  // namespace fv_converter
 }  // namespace jubatus
@@ -37,6 +37,30 @@ class word_splitter {
   virtual void split(
       const std::string& string,
       std::vector<std::pair<size_t, size_t> >& ret_boundaries) const = 0;
+
+  // Plugins built before split_many was added have no vtable entry for it,
+  // so dynamic_splitter calls split_many of a plugin only when the plugin
+  // exports the ABI version as follows:
+  //
+  //   extern "C" int jubatus_word_splitter_abi_version() {
+  //     return jubatus::fv_converter::word_splitter::ABI_VERSION;
+  //   }
+  static const int ABI_VERSION = 1;
+
+  // Splits many strings at once. i-th element of ret_boundaries holds
+  // the boundaries of i-th string. Splitters that have large per-call
+  // setup cost (e.g. MeCab) can override this to share it among strings.
+  virtual void split_many(
+      const std::vector<std::string>& strings,
+      std::vector<std::vector<std::pair<size_t, size_t> > >& ret_boundaries)
+      const {
+    std::vector<std::vector<std::pair<size_t, size_t> > > bounds(
+        strings.size());
+    for (size_t i = 0; i < strings.size(); ++i) {
+      split(strings[i], bounds[i]);
+    }
+    bounds.swap(ret_boundaries);
+  }
 };
 
 }  // namespace fv_converter
@@ -38,34 +38,29 @@ static MeCab::Model* create_mecab_model(const char* arg) {
   }
 }
 
-mecab_splitter::mecab_splitter()
-    : model_(create_mecab_model("")) {
-}
-
-mecab_splitter::mecab_splitter(const char* arg)
-    : model_(create_mecab_model(arg)) {
+static MeCab::Tagger* create_mecab_tagger(MeCab::Model* model) {
+  MeCab::Tagger* t = model->createTagger();
+  if (!t) {
+    std::string msg("cannot make mecab tagger: ");
+    msg += MeCab::getTaggerError();
+    throw JUBATUS_EXCEPTION(converter_exception(msg));
+  } else {
+    return t;
+  }
 }
 
-void mecab_splitter::split(
+static void split_with_lattice(
+    const MeCab::Tagger& tagger,
+    MeCab::Lattice& lattice,
     const std::string& string,
-    std::vector<std::pair<size_t, size_t> >& ret_boundaries) const {
-  pfi::lang::scoped_ptr<MeCab::Tagger> tagger(model_->createTagger());
-  if (!tagger) {
-    // cannot create tagger
-    return;
-  }
-  pfi::lang::scoped_ptr<MeCab::Lattice> lattice(model_->createLattice());
-  if (!lattice) {
-    // cannot create lattice
-    return;
-  }
-  lattice->set_sentence(string.c_str());
-  if (!tagger->parse(lattice.get())) {
+    std::vector<std::pair<size_t, size_t> >& ret_boundaries) {
+  lattice.set_sentence(string.c_str());
+  if (!tagger.parse(&lattice)) {
     // parse error
     return;
   }
 
-  const MeCab::Node* node = lattice->bos_node();
+  const MeCab::Node* node = lattice.bos_node();
   size_t p = 0;
 
   std::vector<std::pair<size_t, size_t> > bounds;
@@ -82,9 +77,51 @@ void mecab_splitter::split(
   bounds.swap(ret_boundaries);
 }
 
+mecab_splitter::mecab_splitter()
+    : model_(create_mecab_model("")),
+      tagger_(create_mecab_tagger(model_.get())) {
+}
+
+mecab_splitter::mecab_splitter(const char* arg)
+    : model_(create_mecab_model(arg)),
+      tagger_(create_mecab_tagger(model_.get())) {
+}
+
+void mecab_splitter::split(
+    const std::string& string,
+    std::vector<std::pair<size_t, size_t> >& ret_boundaries) const {
+  pfi::lang::scoped_ptr<MeCab::Lattice> lattice(model_->createLattice());
+  if (!lattice) {
+    // cannot create lattice
+    return;
+  }
+  split_with_lattice(*tagger_, *lattice, string, ret_boundaries);
+}
+
+void mecab_splitter::split_many(
+    const std::vector<std::string>& strings,
+    std::vector<std::vector<std::pair<size_t, size_t> > >& ret_boundaries)
+    const {
+  std::vector<std::vector<std::pair<size_t, size_t> > > bounds(
+      strings.size());
+  // one lattice is reused for all strings in this call
+  pfi::lang::scoped_ptr<MeCab::Lattice> lattice(model_->createLattice());
+  if (lattice) {
+    for (size_t i = 0; i < strings.size(); ++i) {
+      split_with_lattice(*tagger_, *lattice, strings[i], bounds[i]);
+      lattice->clear();
+    }
+  }
+  bounds.swap(ret_boundaries);
+}
+
 }  // namespace jubatus
 
 extern "C" {
+int jubatus_word_splitter_abi_version() {
+  return jubatus::fv_converter::word_splitter::ABI_VERSION;
+}
+
 jubatus::mecab_splitter* create(
     const std::map<std::string, std::string>& params) {
   std::string param =
@@ -36,8 +36,15 @@ class mecab_splitter : public fv_converter::word_splitter {
   void split(const std::string& string,
              std::vector<std::pair<size_t, size_t> >& ret_boundaries) const;
 
+  void split_many(
+      const std::vector<std::string>& strings,
+      std::vector<std::vector<std::pair<size_t, size_t> > >& ret_boundaries)
+      const;
+
  private:
   pfi::lang::scoped_ptr<MeCab::Model> model_;
+  // Tagger made from Model can be shared among threads, but Lattice cannot.
+  pfi::lang::scoped_ptr<MeCab::Tagger> tagger_;
 };
 
 }  // namespace jubatus
@@ -44,6 +44,23 @@ TEST(mecab_splitter, trivial) {
   ASSERT_EQ(exp, bs);
 }
 
+TEST(mecab_splitter, split_many) {
+  mecab_splitter m;
+  std::vector<std::string> strings;
+  strings.push_back("本日は晴天なり");
+  strings.push_back("");
+  strings.push_back(" テスト テスト ");
+  std::vector<std::vector<std::pair<size_t, size_t> > > bs;
+  m.split_many(strings, bs);
+
+  ASSERT_EQ(3u, bs.size());
+  for (size_t i = 0; i < strings.size(); ++i) {
+    std::vector<std::pair<size_t, size_t> > exp;
+    m.split(strings[i], exp);
+    EXPECT_EQ(exp, bs[i]);
+  }
+}
+
 TEST(mecab_splitter, illegal_argument) {
   EXPECT_THROW(mecab_splitter("-r unknown_file"), converter_exception);
 }
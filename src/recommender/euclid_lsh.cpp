@@ -17,6 +17,7 @@
 #include "euclid_lsh.hpp"
 
 #include <cmath>
+#include <limits>
 #include <queue>
 #include <utility>
 #include <string>
@@ -25,6 +26,7 @@
 #include <pficommon/data/serialization.h>
 #include <pficommon/lang/cast.h>
 #include <pficommon/math/random.h>
+#include "../common/exception.hpp"
 #include "../common/hash.hpp"
 #include "../storage/lsh_util.hpp"
 #include "../storage/lsh_vector.hpp"
@@ -57,24 +59,15 @@ float calc_norm(const sfv_t& sfv) {
   return sqrt(sqnorm);
 }
 
-vector<float> lsh_function(
-    const sfv_t& query,
-    size_t dimension,
-    float bin_width) {
-  vector<float> hash(dimension);
-  for (size_t i = 0; i < query.size(); ++i) {
-    const uint32_t seed = hash_util::calc_string_hash(query[i].first);
-    mtrand rnd(seed);
-    for (size_t j = 0; j < hash.size(); ++j) {
-      hash[j] += query[i].second * rnd.next_gaussian();
-    }
-  }
-  for (size_t j = 0; j < dimension; ++j) {
-    hash[j] /= bin_width;
-  }
-  return hash;
+// SplitMix64
+uint64_t mix_hash(uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
 }
 
+const float TWO_PI = 6.28318530717958647692f;
+
 }  // namespace
 
 euclid_lsh::config::config()
@@ -97,14 +90,40 @@ euclid_lsh::euclid_lsh()
     : lsh_index_(DEFAULT_LSH_NUM, DEFAULT_TABLE_NUM, DEFAULT_SEED),
       bin_width_(DEFAULT_BIN_WIDTH),
       num_probe_(DEFAULT_NUM_PROBE),
-      retain_projection_(DEFAULT_RETAIN_PROJECTION) {
+      retain_projection_(DEFAULT_RETAIN_PROJECTION),
+      projection_cache_size_(0),
+      projection_(MTRAND_PROJECTION) {
+  reset_projection_cache();
 }
 
 euclid_lsh::euclid_lsh(const config& config)
     : lsh_index_(config.lsh_num, config.table_num, config.seed),
       bin_width_(config.bin_width),
       num_probe_(config.probe_num),
-      retain_projection_(config.retain_projection) {
+      retain_projection_(config.retain_projection),
+      projection_cache_size_(0),
+      projection_(MTRAND_PROJECTION) {
+  if (config.projection_cache_size) {
+    if (*config.projection_cache_size <= 0) {
+      throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error(
+          "projection_cache_size must be positive"));
+    }
+    projection_cache_size_ = *config.projection_cache_size;
+  }
+  if (config.projection) {
+    projection_ = parse_projection(*config.projection);
+  }
+  if (config.thread_num) {
+    if (*config.thread_num <= 0) {
+      throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error(
+          "thread_num must be positive"));
+    }
+    lsh_index_.set_thread_num(*config.thread_num);
+  }
+  if (config.retain_original_rows) {
+    set_retain_original_rows(*config.retain_original_rows);
+  }
+  reset_projection_cache();
 }
 
 euclid_lsh::~euclid_lsh() {
@@ -136,9 +155,8 @@ void euclid_lsh::similar_row(
     size_t ret_num) const {
   ids.clear();
 
-  const vector<float> hash = lsh_function(query,
-                                          lsh_index_.all_lsh_num(),
-                                          bin_width_);
+  vector<float> hash;
+  calc_lsh_values(query, hash);
   const float norm = calc_norm(query);
   lsh_index_.similar_row(hash, norm, num_probe_, ret_num, ids);
 }
@@ -156,7 +174,9 @@ void euclid_lsh::clear() {
   lsh_index_.clear();
 
   // Clear projection cache
-  pfi::data::unordered_map<uint32_t, std::vector<float> >().swap(projection_);
+  if (projection_cache_) {
+    projection_cache_->clear();
+  }
 }
 
 void euclid_lsh::clear_row(const string& id) {
@@ -165,13 +185,11 @@ void euclid_lsh::clear_row(const string& id) {
 }
 
 void euclid_lsh::update_row(const string& id, const sfv_diff_t& diff) {
-  orig_.set_row(id, diff);
   sfv_t row;
-  orig_.get_row(id, row);
+  update_original_row(id, diff, row);
 
-  const vector<float> hash = lsh_function(row,
-                                          lsh_index_.all_lsh_num(),
-                                          bin_width_);
+  vector<float> hash;
+  calc_lsh_values(row, hash);
   const float norm = calc_norm(row);
   lsh_index_.set_row(id, hash, norm);
 }
@@ -192,44 +210,109 @@ const storage::lsh_index_storage* euclid_lsh::get_const_storage() const {
   return &lsh_index_;
 }
 
-vector<float> euclid_lsh::calculate_lsh(const sfv_t& query) {
-  vector<float> hash(lsh_index_.all_lsh_num());
+euclid_lsh::projection_type euclid_lsh::parse_projection(
+    const string& projection) {
+  if (projection == "mtrand") {
+    return MTRAND_PROJECTION;
+  } else if (projection == "hash") {
+    return HASH_PROJECTION;
+  } else {
+    throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error(
+        "unknown projection: " + projection));
+  }
+}
+
+string euclid_lsh::projection_name(projection_type projection) {
+  return projection == HASH_PROJECTION ? "hash" : "mtrand";
+}
+
+void euclid_lsh::calc_lsh_values(
+    const sfv_t& query,
+    vector<float>& hash) const {
+  hash.assign(lsh_index_.all_lsh_num(), 0.f);
+  vector<float> buffer;
   for (size_t i = 0; i < query.size(); ++i) {
-    const uint32_t seed = hash_util::calc_string_hash(query[i].first);
-    const vector<float> proj = get_projection(seed);
+    const uint64_t key = hash_util::calc_string_hash(query[i].first);
+    const vector<float>* proj = &buffer;
+    projection_cache::projection_ptr cached;
+    if (projection_cache_) {
+      cached = projection_cache_->get(key);
+      if (!cached) {
+        pfi::lang::shared_ptr<vector<float> > p(new vector<float>);
+        make_projection(key, *p);
+        cached = p;
+        projection_cache_->put(key, cached);
+      }
+      proj = cached.get();
+    } else {
+      make_projection(key, buffer);
+    }
+
+    const float val = query[i].second;
     for (size_t j = 0; j < hash.size(); ++j) {
-      hash[j] += query[i].second * proj[j];
+      hash[j] += val * (*proj)[j];
     }
   }
   for (size_t j = 0; j < hash.size(); ++j) {
     hash[j] /= bin_width_;
   }
-  return hash;
 }
 
-vector<float> euclid_lsh::get_projection(uint32_t seed) {
-  vector<float> tmpl_proj;
-  vector<float>& proj = retain_projection_ ? projection_[seed] : tmpl_proj;
+void euclid_lsh::make_projection(uint64_t key, vector<float>& proj) const {
+  proj.resize(lsh_index_.all_lsh_num());
+  if (projection_ == MTRAND_PROJECTION) {
+    mtrand rnd(static_cast<uint32_t>(key));
+    for (size_t j = 0; j < proj.size(); ++j) {
+      proj[j] = rnd.next_gaussian();
+    }
+    return;
+  }
 
-  if (proj.empty()) {
-    mtrand rnd(seed);
-    proj.resize(lsh_index_.all_lsh_num());
-    for (size_t i = 0; i < proj.size(); ++i) {
-      proj[i] = rnd.next_gaussian();
+  // Box-Muller transform of two uniform numbers taken from the hash of
+  // (key, j), giving entries 2j and 2j + 1
+  for (size_t j = 0; j < proj.size(); j += 2) {
+    const uint64_t h = mix_hash(key + (j + 1) * 0x9e3779b97f4a7c15ULL);
+    const float u1 = (static_cast<float>(h >> 40) + 0.5f) / 16777216.f;
+    const float u2 = static_cast<float>(h & 0xffffff) / 16777216.f;
+    const float r = std::sqrt(-2.f * std::log(u1));
+    proj[j] = r * std::cos(TWO_PI * u2);
+    if (j + 1 < proj.size()) {
+      proj[j + 1] = r * std::sin(TWO_PI * u2);
     }
   }
-  return proj;
+}
+
+void euclid_lsh::reset_projection_cache() {
+  if (projection_cache_size_ > 0) {
+    projection_cache_.reset(new projection_cache(projection_cache_size_));
+  } else if (retain_projection_) {
+    projection_cache_.reset(
+        new projection_cache(std::numeric_limits<size_t>::max()));
+  } else {
+    projection_cache_.reset();
+  }
 }
 
 bool euclid_lsh::save_impl(ostream& os) {
+  save_model_header(os, projection_name(projection_));
   pfi::data::serialization::binary_oarchive oa(os);
   oa << *this;
   return true;
 }
 
 bool euclid_lsh::load_impl(istream& is) {
+  // models saved before the projection was recorded use mtrand
+  string projection = projection_name(MTRAND_PROJECTION);
+  load_model_header(is, projection);
+  // hash values of the model are not comparable with those of the config
+  if (parse_projection(projection) != projection_) {
+    throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error(
+        "euclid_lsh projection of the model is " + projection + ", but "
+        + projection_name(projection_) + " is configured"));
+  }
   pfi::data::serialization::binary_iarchive ia(is);
   ia >> *this;
+  reset_projection_cache();
   return true;
 }
 
@@ -21,9 +21,12 @@
 #include <utility>
 #include <string>
 #include <vector>
+#include <pficommon/data/optional.h>
 #include <pficommon/data/serialization.h>
 #include <pficommon/data/unordered_map.h>
+#include <pficommon/lang/shared_ptr.h>
 #include <pficommon/text/json.h>
+#include "projection_cache.hpp"
 #include "recommender_base.hpp"
 #include "../storage/lsh_index_storage.hpp"
 
@@ -50,12 +53,27 @@ class euclid_lsh : public recommender_base {
     float bin_width;
     int32_t probe_num;
     int32_t seed;
+    // caches projections of all features unless projection_cache_size is
+    // given
     bool retain_projection;
+    // caches projections of at most this number of recently used features
+    pfi::data::optional<int64_t> projection_cache_size;
+    // "mtrand" (default) draws projections of each feature from a Mersenne
+    // Twister seeded by the feature. "hash" computes each entry from a hash
+    // of the feature and the index of the entry, which is much faster.
+    pfi::data::optional<std::string> projection;
+    // number of threads to probe tables and rank candidates
+    pfi::data::optional<int64_t> thread_num;
+    // keep original rows for decode_row and complete_row (default true).
+    // Without them, update_row replaces rows instead of updating columns.
+    pfi::data::optional<bool> retain_original_rows;
 
     template<typename Ar>
     void serialize(Ar& ar) {
       ar & MEMBER(lsh_num) & MEMBER(table_num) & MEMBER(bin_width) &
-        MEMBER(probe_num) & MEMBER(seed) & MEMBER(retain_projection);
+        MEMBER(probe_num) & MEMBER(seed) & MEMBER(retain_projection) &
+        MEMBER(projection_cache_size) & MEMBER(projection) &
+        MEMBER(thread_num) & MEMBER(retain_original_rows);
     }
   };
 
@@ -94,12 +112,23 @@ class euclid_lsh : public recommender_base {
   friend class pfi::data::serialization::access;
   template <typename Ar>
   void serialize(Ar& ar) {
+    // projections are not saved; the map is kept for compatibility
+    pfi::data::unordered_map<uint32_t, std::vector<float> > projection;
     ar & MEMBER(lsh_index_) & MEMBER(bin_width_) & MEMBER(num_probe_) &
-      MEMBER(projection_) & MEMBER(retain_projection_);
+      NAMED_MEMBER("projection_", projection) & MEMBER(retain_projection_);
   }
 
-  std::vector<float> calculate_lsh(const sfv_t& query);
-  std::vector<float> get_projection(uint32_t seed);
+  enum projection_type {
+    MTRAND_PROJECTION,
+    HASH_PROJECTION
+  };
+
+  static projection_type parse_projection(const std::string& projection);
+  static std::string projection_name(projection_type projection);
+
+  void calc_lsh_values(const sfv_t& query, std::vector<float>& hash) const;
+  void make_projection(uint64_t key, std::vector<float>& projection) const;
+  void reset_projection_cache();
 
   virtual bool save_impl(std::ostream& os);
   virtual bool load_impl(std::istream& is);
@@ -108,8 +137,12 @@ class euclid_lsh : public recommender_base {
   float bin_width_;
   uint32_t num_probe_;
 
-  pfi::data::unordered_map<uint32_t, std::vector<float> > projection_;
   bool retain_projection_;
+  // 0 means that the size is not limited
+  size_t projection_cache_size_;
+  pfi::lang::shared_ptr<projection_cache> projection_cache_;
+  // recorded in saved models as hashes of rows depend on it
+  projection_type projection_;
 };
 
 }  // namespace recommender
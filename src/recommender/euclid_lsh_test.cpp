@@ -14,6 +14,7 @@
 // License along with this library; if not, write to the Free Software
 // Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
+#include <sstream>
 #include <string>
 #include <utility>
 #include <vector>
@@ -24,6 +25,7 @@
 #include <pficommon/math/random.h>
 
 #include "euclid_lsh.hpp"
+#include "../common/exception.hpp"
 #include "../common/hash.hpp"
 #include "../common/portable_mixer.hpp"  // TODO(suma): use linear_mixer
 #include "../storage/lsh_index_storage.hpp"
@@ -153,5 +155,91 @@ INSTANTIATE_TEST_CASE_P(
     euclid_lsh_mix_test,
     ::testing::Values(make_pair(2, make_euclid_lsh_config())));
 
+namespace {
+
+// wide bins put all rows of the tests in the same buckets
+euclid_lsh::config make_wide_bin_config() {
+  euclid_lsh::config config = make_euclid_lsh_config();
+  config.bin_width = 100;
+  return config;
+}
+
+void update_random_rows(euclid_lsh& r1, euclid_lsh& r2) {
+  mtrand rand(1);
+  for (size_t i = 0; i < 100; ++i) {
+    sfv_t row;
+    for (size_t j = 0; j < 5; ++j) {
+      // features are shared by some rows
+      row.push_back(make_pair(lexical_cast<string>(rand.next_int(20)),
+                              rand.next_gaussian()));
+    }
+    r1.update_row(lexical_cast<string>(i), row);
+    r2.update_row(lexical_cast<string>(i), row);
+  }
+}
+
+void expect_same_neighbors(const euclid_lsh& r1, const euclid_lsh& r2) {
+  const sfv_t query = make_dense_sfv("1 -1 0.5 2 0 1");
+  vector<pair<string, float> > expect, actual;
+  r1.neighbor_row(query, expect, 10);
+  r2.neighbor_row(query, actual, 10);
+  EXPECT_EQ(10u, expect.size());
+  EXPECT_EQ(expect, actual);
+}
+
+}  // namespace
+
+TEST(euclid_lsh, projection_cache) {
+  euclid_lsh::config config = make_wide_bin_config();
+  euclid_lsh r1(config);
+  // smaller than the number of features
+  config.projection_cache_size = 3;
+  euclid_lsh r2(config);
+
+  update_random_rows(r1, r2);
+  expect_same_neighbors(r1, r2);
+
+  config.projection_cache_size = 0;
+  EXPECT_THROW(euclid_lsh r3(config), jubatus::exception::runtime_error);
+}
+
+TEST(euclid_lsh, hash_projection) {
+  euclid_lsh::config config = make_wide_bin_config();
+  config.projection = string("hash");
+  euclid_lsh r(config);
+
+  r.update_row("a", make_dense_sfv("1 1 0 0"));
+  r.update_row("b", make_dense_sfv("0 0 5 5"));
+  r.update_row("c", make_dense_sfv("1 2 0 0"));
+
+  vector<pair<string, float> > ids;
+  r.neighbor_row(make_dense_sfv("1 1 0 0"), ids, 3);
+  ASSERT_EQ(3u, ids.size());
+  EXPECT_EQ("a", ids[0].first);
+  EXPECT_EQ("c", ids[1].first);
+  EXPECT_EQ("b", ids[2].first);
+
+  config.projection = string("unknown");
+  EXPECT_THROW(euclid_lsh r2(config), jubatus::exception::runtime_error);
+}
+
+TEST(euclid_lsh, save_load_projection) {
+  euclid_lsh::config config = make_wide_bin_config();
+  config.projection = string("hash");
+  euclid_lsh r1(config), r2(config);
+  update_random_rows(r1, r2);
+
+  std::stringstream ss;
+  r1.save(ss);
+  // models are not loaded with another projection
+  std::stringstream ss2(ss.str());
+  euclid_lsh r4(make_wide_bin_config());
+  EXPECT_THROW(r4.load(ss2), jubatus::exception::runtime_error);
+
+  euclid_lsh r3(config);
+  r3.load(ss);
+  expect_same_neighbors(r2, r3);
+}
+
 }  // namespace recommender
 }  // namespace jubatus
@@ -0,0 +1,216 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include "hnsw.hpp"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+#include <pficommon/data/serialization.h>
+#include "../common/exception.hpp"
+#include "../common/hash.hpp"
+
+using std::istream;
+using std::make_pair;
+using std::ostream;
+using std::pair;
+using std::string;
+using std::vector;
+using jubatus::storage::hnsw_index_storage;
+
+namespace jubatus {
+namespace recommender {
+
+const int64_t hnsw::DEFAULT_EF_SEARCH = 50;
+const int32_t hnsw::DEFAULT_SEED = 1091;
+
+hnsw::config::config()
+    : m(hnsw_index_storage::DEFAULT_M),
+      ef_construction(hnsw_index_storage::DEFAULT_EF_CONSTRUCTION),
+      ef_search(DEFAULT_EF_SEARCH),
+      seed(DEFAULT_SEED) {
+}
+
+hnsw::hnsw()
+    : hnsw_index_(
+          hnsw_index_storage::DEFAULT_M,
+          hnsw_index_storage::DEFAULT_EF_CONSTRUCTION,
+          hnsw_index_storage::EUCLIDEAN,
+          DEFAULT_SEED),
+      ef_search_(DEFAULT_EF_SEARCH) {
+}
+
+hnsw::hnsw(const config& config)
+    : hnsw_index_(
+          config.m,
+          config.ef_construction,
+          parse_metric(config.metric ? *config.metric : "euclidean"),
+          config.seed),
+      ef_search_(config.ef_search) {
+  if (config.m < 2) {
+    throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error(
+        "m must be at least 2"));
+  }
+  if (config.ef_construction <= 0) {
+    throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error(
+        "ef_construction must be positive"));
+  }
+  if (config.ef_search <= 0) {
+    throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error(
+        "ef_search must be positive"));
+  }
+  if (config.retain_original_rows) {
+    set_retain_original_rows(*config.retain_original_rows);
+  }
+}
+
+hnsw::~hnsw() {
+}
+
+void hnsw::neighbor_row(
+    const sfv_t& query,
+    vector<pair<string, float> >& ids,
+    size_t ret_num) const {
+  hnsw_index_storage::sparse_vector_t vec;
+  make_vector(query, vec);
+  search(vec, ids, ret_num);
+}
+
+void hnsw::neighbor_row(
+    const string& id,
+    vector<pair<string, float> >& ids,
+    size_t ret_num) const {
+  ids.clear();
+  hnsw_index_storage::sparse_vector_t vec;
+  if (hnsw_index_.get_row(id, vec)) {
+    search(vec, ids, ret_num);
+  }
+}
+
+void hnsw::similar_row(
+    const sfv_t& query,
+    vector<pair<string, float> >& ids,
+    size_t ret_num) const {
+  neighbor_row(query, ids, ret_num);
+  to_similarities(ids);
+}
+
+void hnsw::similar_row(
+    const string& id,
+    vector<pair<string, float> >& ids,
+    size_t ret_num) const {
+  neighbor_row(id, ids, ret_num);
+  to_similarities(ids);
+}
+
+void hnsw::clear() {
+  orig_.clear();
+  hnsw_index_.clear();
+}
+
+void hnsw::clear_row(const string& id) {
+  orig_.remove_row(id);
+  hnsw_index_.remove_row(id);
+}
+
+void hnsw::update_row(const string& id, const sfv_diff_t& diff) {
+  sfv_t row;
+  update_original_row(id, diff, row);
+
+  hnsw_index_storage::sparse_vector_t vec;
+  make_vector(row, vec);
+  hnsw_index_.set_row(id, vec);
+}
+
+void hnsw::get_all_row_ids(vector<string>& ids) const {
+  hnsw_index_.get_all_row_ids(ids);
+}
+
+string hnsw::type() const {
+  return "hnsw";
+}
+
+hnsw_index_storage* hnsw::get_storage() {
+  return &hnsw_index_;
+}
+
+const hnsw_index_storage* hnsw::get_const_storage() const {
+  return &hnsw_index_;
+}
+
+hnsw_index_storage::metric_type hnsw::parse_metric(const string& metric) {
+  if (metric == "euclidean") {
+    return hnsw_index_storage::EUCLIDEAN;
+  } else if (metric == "cosine") {
+    return hnsw_index_storage::COSINE;
+  } else {
+    throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error(
+        "unknown metric: " + metric));
+  }
+}
+
+void hnsw::make_vector(
+    const sfv_t& row,
+    hnsw_index_storage::sparse_vector_t& vec) {
+  // features are identified by their hashes in all servers
+  vec.clear();
+  vec.reserve(row.size());
+  for (size_t i = 0; i < row.size(); ++i) {
+    vec.push_back(make_pair(
+        hash_util::calc_string_hash(row[i].first), row[i].second));
+  }
+  std::sort(vec.begin(), vec.end());
+
+  size_t size = 0;
+  for (size_t i = 0; i < vec.size(); ++i) {
+    if (size > 0 && vec[size - 1].first == vec[i].first) {
+      vec[size - 1].second += vec[i].second;
+    } else {
+      vec[size++] = vec[i];
+    }
+  }
+  vec.resize(size);
+}
+
+void hnsw::search(
+    const hnsw_index_storage::sparse_vector_t& query,
+    vector<pair<string, float> >& ids,
+    size_t ret_num) const {
+  hnsw_index_.similar_row(query, std::max(ef_search_, ret_num), ret_num, ids);
+}
+
+void hnsw::to_similarities(vector<pair<string, float> >& ids) const {
+  const bool cosine = hnsw_index_.metric() == hnsw_index_storage::COSINE;
+  for (size_t i = 0; i < ids.size(); ++i) {
+    ids[i].second = cosine ? 1 - ids[i].second : -ids[i].second;
+  }
+}
+
+bool hnsw::save_impl(ostream& os) {
+  pfi::data::serialization::binary_oarchive oa(os);
+  oa << *this;
+  return true;
+}
+
+bool hnsw::load_impl(istream& is) {
+  pfi::data::serialization::binary_iarchive ia(is);
+  ia >> *this;
+  return true;
+}
+
+}  // namespace recommender
+}  // namespace jubatus
@@ -0,0 +1,130 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#ifndef JUBATUS_RECOMMENDER_HNSW_HPP_
+#define JUBATUS_RECOMMENDER_HNSW_HPP_
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include <pficommon/data/optional.h>
+#include <pficommon/data/serialization.h>
+#include "recommender_base.hpp"
+#include "../storage/hnsw_index_storage.hpp"
+
+namespace jubatus {
+namespace recommender {
+
+// Approximate nearest neighbor search with a hierarchical navigable small
+// world graph. Unlike the LSH methods, rows are compared by their exact
+// distances, so similar_row finds close rows that hashes fail to bucket
+// together.
+class hnsw : public recommender_base {
+ public:
+  using recommender_base::similar_row;
+  using recommender_base::neighbor_row;
+
+  static const int64_t DEFAULT_EF_SEARCH;
+  static const int32_t DEFAULT_SEED;
+
+  struct config {
+    config();
+
+    // maximum number of links of each row in each layer
+    int64_t m;
+    // number of candidates of links searched when rows are added
+    int64_t ef_construction;
+    // number of candidates searched by queries (at least ret_num)
+    int64_t ef_search;
+    int32_t seed;
+    // "euclidean" (default) or "cosine"
+    pfi::data::optional<std::string> metric;
+    // keep original rows for decode_row and complete_row (default true).
+    // Without them, update_row replaces rows instead of updating columns.
+    pfi::data::optional<bool> retain_original_rows;
+
+    template<typename Ar>
+    void serialize(Ar& ar) {
+      ar & MEMBER(m) & MEMBER(ef_construction) & MEMBER(ef_search) &
+        MEMBER(seed) & MEMBER(metric) & MEMBER(retain_original_rows);
+    }
+  };
+
+  hnsw();
+  explicit hnsw(const config& config);
+  ~hnsw();
+
+  // distances of rows
+  virtual void neighbor_row(
+      const sfv_t& query,
+      std::vector<std::pair<std::string, float> >& ids,
+      size_t ret_num) const;
+  virtual void neighbor_row(
+      const std::string& id,
+      std::vector<std::pair<std::string, float> >& ids,
+      size_t ret_num) const;
+
+  // negative euclidean distances or cosine similarities of rows
+  virtual void similar_row(
+      const sfv_t& query,
+      std::vector<std::pair<std::string, float> >& ids,
+      size_t ret_num) const;
+  virtual void similar_row(
+      const std::string& id,
+      std::vector<std::pair<std::string, float> >& ids,
+      size_t ret_num) const;
+
+  virtual void clear();
+  virtual void clear_row(const std::string& id);
+  virtual void update_row(const std::string& id, const sfv_diff_t& diff);
+  virtual void get_all_row_ids(std::vector<std::string>& ids) const;
+
+  virtual std::string type() const;
+  virtual storage::hnsw_index_storage* get_storage();
+  virtual const storage::hnsw_index_storage* get_const_storage() const;
+
+ private:
+  friend class pfi::data::serialization::access;
+  template <typename Ar>
+  void serialize(Ar& ar) {
+    ar & MEMBER(hnsw_index_);
+  }
+
+  static storage::hnsw_index_storage::metric_type parse_metric(
+      const std::string& metric);
+  static void make_vector(
+      const sfv_t& row,
+      storage::hnsw_index_storage::sparse_vector_t& vec);
+
+  void search(
+      const storage::hnsw_index_storage::sparse_vector_t& query,
+      std::vector<std::pair<std::string, float> >& ids,
+      size_t ret_num) const;
+  void to_similarities(std::vector<std::pair<std::string, float> >& ids)
+      const;
+
+  virtual bool save_impl(std::ostream& os);
+  virtual bool load_impl(std::istream& is);
+
+  storage::hnsw_index_storage hnsw_index_;
+  size_t ef_search_;
+};
+
+}  // namespace recommender
+}  // namespace jubatus
+
+#endif  // JUBATUS_RECOMMENDER_HNSW_HPP_
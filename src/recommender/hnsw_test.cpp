@@ -0,0 +1,184 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <pficommon/lang/cast.h>
+
+#include "hnsw.hpp"
+#include "../common/exception.hpp"
+
+using std::make_pair;
+using std::pair;
+using std::string;
+using std::stringstream;
+using std::vector;
+using pfi::lang::lexical_cast;
+
+namespace jubatus {
+namespace recommender {
+
+namespace {
+
+sfv_t make_row(float x, float y) {
+  sfv_t v;
+  v.push_back(make_pair("x", x));
+  v.push_back(make_pair("y", y));
+  return v;
+}
+
+hnsw::config make_config(const string& metric) {
+  hnsw::config config;
+  config.m = 4;
+  config.ef_construction = 20;
+  config.metric = metric;
+  return config;
+}
+
+}  // namespace
+
+TEST(hnsw, invalid_config) {
+  EXPECT_THROW(hnsw(make_config("unknown")),
+               jubatus::exception::runtime_error);
+  hnsw::config config = make_config("euclidean");
+  config.m = 1;
+  EXPECT_THROW((hnsw(config)), jubatus::exception::runtime_error);
+  config = make_config("euclidean");
+  config.ef_search = 0;
+  EXPECT_THROW((hnsw(config)), jubatus::exception::runtime_error);
+}
+
+TEST(hnsw, euclidean) {
+  hnsw r(make_config("euclidean"));
+  for (int i = 0; i < 10; ++i) {
+    r.update_row("r" + lexical_cast<string>(i), make_row(i, 0));
+  }
+
+  vector<pair<string, float> > ids;
+  r.neighbor_row(make_row(3, 4), ids, 2);
+  ASSERT_EQ(2u, ids.size());
+  EXPECT_EQ("r3", ids[0].first);
+  EXPECT_FLOAT_EQ(4.f, ids[0].second);
+
+  r.similar_row(make_row(3, 4), ids, 2);
+  ASSERT_EQ(2u, ids.size());
+  EXPECT_EQ("r3", ids[0].first);
+  EXPECT_FLOAT_EQ(-4.f, ids[0].second);
+
+  // ef_search is raised to ret_num
+  r.similar_row(make_row(0, 0), ids, 10);
+  EXPECT_EQ(10u, ids.size());
+
+  r.neighbor_row("r9", ids, 2);
+  ASSERT_EQ(2u, ids.size());
+  EXPECT_EQ("r9", ids[0].first);
+  EXPECT_FLOAT_EQ(0.f, ids[0].second);
+  EXPECT_EQ("r8", ids[1].first);
+  EXPECT_FLOAT_EQ(1.f, ids[1].second);
+
+  r.neighbor_row("unknown", ids, 2);
+  EXPECT_TRUE(ids.empty());
+}
+
+TEST(hnsw, cosine) {
+  hnsw r(make_config("cosine"));
+  r.update_row("r1", make_row(1, 0));
+  r.update_row("r2", make_row(1, 1));
+  r.update_row("r3", make_row(0, 1));
+
+  vector<pair<string, float> > ids;
+  r.similar_row(make_row(10, 0), ids, 3);
+  ASSERT_EQ(3u, ids.size());
+  EXPECT_EQ("r1", ids[0].first);
+  EXPECT_NEAR(1.f, ids[0].second, 1e-6);
+  EXPECT_EQ("r2", ids[1].first);
+  EXPECT_NEAR(0.7071068f, ids[1].second, 1e-6);
+  EXPECT_EQ("r3", ids[2].first);
+  EXPECT_NEAR(0.f, ids[2].second, 1e-6);
+}
+
+TEST(hnsw, update_and_clear_row) {
+  hnsw r(make_config("euclidean"));
+  r.update_row("r1", make_row(1, 0));
+  r.update_row("r2", make_row(5, 0));
+  // columns are updated
+  sfv_t diff;
+  diff.push_back(make_pair("y", 5.f));
+  r.update_row("r1", diff);
+
+  vector<pair<string, float> > ids;
+  r.neighbor_row(make_row(1, 5), ids, 2);
+  ASSERT_EQ(2u, ids.size());
+  EXPECT_EQ("r1", ids[0].first);
+  EXPECT_FLOAT_EQ(0.f, ids[0].second);
+
+  r.clear_row("r1");
+  r.neighbor_row(make_row(1, 5), ids, 2);
+  ASSERT_EQ(1u, ids.size());
+  EXPECT_EQ("r2", ids[0].first);
+
+  vector<string> rows;
+  r.get_all_row_ids(rows);
+  ASSERT_EQ(1u, rows.size());
+
+  r.clear();
+  r.get_all_row_ids(rows);
+  EXPECT_TRUE(rows.empty());
+}
+
+TEST(hnsw, mix) {
+  hnsw r1(make_config("euclidean")), r2(make_config("euclidean"));
+  r1.update_row("r1", make_row(1, 0));
+  r2.update_row("r2", make_row(0, 1));
+
+  string d1, d2;
+  r1.get_storage()->get_diff(d1);
+  r2.get_storage()->get_diff(d2);
+  r1.get_storage()->mix(d1, d2);
+  r1.get_storage()->set_mixed_and_clear_diff(d2);
+  r2.get_storage()->set_mixed_and_clear_diff(d2);
+
+  vector<pair<string, float> > ids;
+  r2.neighbor_row(make_row(1, 0), ids, 1);
+  ASSERT_EQ(1u, ids.size());
+  EXPECT_EQ("r1", ids[0].first);
+  EXPECT_FLOAT_EQ(0.f, ids[0].second);
+  r1.neighbor_row(make_row(0, 1), ids, 1);
+  ASSERT_EQ(1u, ids.size());
+  EXPECT_EQ("r2", ids[0].first);
+}
+
+TEST(hnsw, save_load_metric) {
+  hnsw r(make_config("cosine"));
+  r.update_row("r1", make_row(1, 0));
+  stringstream ss;
+  r.save(ss);
+
+  // the metric of the model is used rather than that of the config
+  hnsw r2(make_config("euclidean"));
+  r2.load(ss);
+  vector<pair<string, float> > ids;
+  r2.similar_row(make_row(5, 0), ids, 1);
+  ASSERT_EQ(1u, ids.size());
+  EXPECT_NEAR(1.f, ids[0].second, 1e-6);
+}
+
+}  // namespace recommender
+}  // namespace jubatus
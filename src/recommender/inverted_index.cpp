@@ -34,6 +34,15 @@ namespace recommender {
 inverted_index::inverted_index() {
 }
 
+inverted_index::inverted_index(const config& config) {
+  if (config.topk_pruning) {
+    inv_.set_topk_pruning(*config.topk_pruning);
+  }
+  if (config.quantize_values) {
+    inv_.set_quantize_values(*config.quantize_values);
+  }
+}
+
 inverted_index::~inverted_index() {
 }
 
@@ -48,6 +57,46 @@ void inverted_index::similar_row(
   inv_.calc_scores(query, ids, ret_num);
 }
 
+void inverted_index::similar_rows_range(
+    const vector<sfv_t>& queries,
+    size_t begin,
+    size_t end,
+    vector<vector<pair<string, float> > >& ids,
+    size_t ret_num) const {
+  if (ret_num == 0) {
+    for (size_t i = begin; i < end; ++i) {
+      ids[i].clear();
+    }
+    return;
+  }
+  vector<const sfv_t*> query_ptrs;
+  for (size_t i = begin; i < end; ++i) {
+    query_ptrs.push_back(&queries[i]);
+  }
+  vector<vector<pair<string, float> > > scores;
+  inv_.calc_scores_many(query_ptrs, scores, ret_num);
+  for (size_t i = begin; i < end; ++i) {
+    ids[i].swap(scores[i - begin]);
+  }
+}
+
+void inverted_index::similar_rows_range(
+    const vector<string>& row_ids,
+    size_t begin,
+    size_t end,
+    vector<vector<pair<string, float> > >& ids,
+    size_t ret_num) const {
+  vector<sfv_t> queries(end - begin);
+  for (size_t i = begin; i < end; ++i) {
+    decode_row(row_ids[i], queries[i - begin]);
+  }
+  vector<vector<pair<string, float> > > scores(queries.size());
+  similar_rows_range(queries, 0, queries.size(), scores, ret_num);
+  for (size_t i = begin; i < end; ++i) {
+    ids[i].swap(scores[i - begin]);
+  }
+}
+
 void inverted_index::neighbor_row(
     const sfv_t& query,
     vector<pair<string, float> >& ids,
@@ -20,6 +20,8 @@
 #include <string>
 #include <utility>
 #include <vector>
+#include <pficommon/data/optional.h>
+#include <pficommon/data/serialization.h>
 #include "recommender_base.hpp"
 #include "../storage/recommender_storage.hpp"
 
@@ -28,7 +30,20 @@ namespace recommender {
 
 class inverted_index : public recommender_base {
  public:
+  struct config {
+    // skip rows which cannot reach the top ret_num results in similar_row
+    pfi::data::optional<bool> topk_pruning;
+    // store values of posting lists in 16 bits
+    pfi::data::optional<bool> quantize_values;
+
+    template<typename Ar>
+    void serialize(Ar& ar) {
+      ar & MEMBER(topk_pruning) & MEMBER(quantize_values);
+    }
+  };
+
   inverted_index();
+  explicit inverted_index(const config& config);
   ~inverted_index();
 
   void similar_row(
@@ -47,6 +62,20 @@ class inverted_index : public recommender_base {
   storage::recommender_storage_base* get_storage();
   const storage::recommender_storage_base* get_const_storage() const;
 
+ protected:
+  void similar_rows_range(
+      const std::vector<sfv_t>& queries,
+      size_t begin,
+      size_t end,
+      std::vector<std::vector<std::pair<std::string, float> > >& ids,
+      size_t ret_num) const;
+  void similar_rows_range(
+      const std::vector<std::string>& row_ids,
+      size_t begin,
+      size_t end,
+      std::vector<std::vector<std::pair<std::string, float> > >& ids,
+      size_t ret_num) const;
+
  private:
   bool save_impl(std::ostream&);
   bool load_impl(std::istream&);
@@ -48,6 +48,19 @@ lsh::lsh(uint64_t base_num)
 
 lsh::lsh(const config& config)
     : base_num_(config.bit_num) {
+  if (config.multi_index) {
+    row2lshvals_.set_multi_index(*config.multi_index);
+  }
+  if (config.thread_num) {
+    if (*config.thread_num <= 0) {
+      throw JUBATUS_EXCEPTION(
+          jubatus::exception::runtime_error("thread_num must be positive"));
+    }
+    row2lshvals_.set_thread_num(*config.thread_num);
+  }
+  if (config.retain_original_rows) {
+    set_retain_original_rows(*config.retain_original_rows);
+  }
 }
 
 lsh::lsh()
@@ -81,6 +94,34 @@ void lsh::neighbor_row(
   }
 }
 
+void lsh::similar_row(
+    const string& id,
+    vector<pair<string, float> >& ids,
+    size_t ret_num) const {
+  if (retains_original_rows()) {
+    recommender_base::similar_row(id, ids, ret_num);
+    return;
+  }
+  // signatures in the index are used instead of original rows
+  ids.clear();
+  bit_vector bv;
+  row2lshvals_.get_row(id, bv);
+  if (ret_num == 0 || bv.bit_num() == 0) {
+    return;
+  }
+  row2lshvals_.similar_row(bv, ids, ret_num);
+}
+
+void lsh::neighbor_row(
+    const string& id,
+    vector<pair<string, float> >& ids,
+    size_t ret_num) const {
+  similar_row(id, ids, ret_num);
+  for (size_t i = 0; i < ids.size(); ++i) {
+    ids[i].second = 1 - ids[i].second;
+  }
+}
+
 void lsh::clear() {
   orig_.clear();
   pfi::data::unordered_map<std::string, std::vector<float> >()
@@ -117,9 +158,8 @@ void lsh::generate_column_base(const string& column) {
 
 void lsh::update_row(const string& id, const sfv_diff_t& diff) {
   generate_column_bases(diff);
-  orig_.set_row(id, diff);
   sfv_t row;
-  orig_.get_row(id, row);
+  update_original_row(id, diff, row);
   bit_vector bv;
   calc_lsh_values(row, bv);
   row2lshvals_.set_row(id, bv);
@@ -20,6 +20,7 @@
 #include <string>
 #include <utility>
 #include <vector>
+#include <pficommon/data/optional.h>
 #include <pficommon/data/serialization.h>
 
 #include "recommender_base.hpp"
@@ -34,10 +35,18 @@ class lsh : public recommender_base {
     config();
 
     int64_t bit_num;
+    // search rows with multi-index hashing instead of scanning all rows
+    pfi::data::optional<bool> multi_index;
+    // number of threads to scan rows in similar_row
+    pfi::data::optional<int64_t> thread_num;
+    // keep original rows for decode_row and complete_row (default true).
+    // Without them, update_row replaces rows instead of updating columns.
+    pfi::data::optional<bool> retain_original_rows;
 
     template<typename Ar>
     void serialize(Ar& ar) {
-      ar & MEMBER(bit_num);
+      ar & MEMBER(bit_num) & MEMBER(multi_index) & MEMBER(thread_num)
+          & MEMBER(retain_original_rows);
     }
   };
 
@@ -54,6 +63,14 @@ class lsh : public recommender_base {
       const sfv_t& query,
       std::vector<std::pair<std::string, float> >& ids,
       size_t ret_num) const;
+  void similar_row(
+      const std::string& id,
+      std::vector<std::pair<std::string, float> >& ids,
+      size_t ret_num) const;
+  void neighbor_row(
+      const std::string& id,
+      std::vector<std::pair<std::string, float> >& ids,
+      size_t ret_num) const;
   void clear();
   void clear_row(const std::string& id);
   void update_row(const std::string& id, const sfv_diff_t& diff);
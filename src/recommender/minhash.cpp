@@ -36,11 +36,29 @@ namespace recommender {
 const uint64_t minhash::hash_prime = 0xc3a5c85c97cb3127ULL;
 
 minhash::minhash()
-    : hash_num_(64) {
+    : hash_num_(64),
+      scheme_(K_PERMUTATION) {
 }
 
 minhash::minhash(const config& config)
-    : hash_num_(config.hash_num) {
+    : hash_num_(config.hash_num),
+      scheme_(K_PERMUTATION) {
+  if (config.scheme) {
+    scheme_ = parse_scheme(*config.scheme);
+  }
+  if (config.multi_index) {
+    row2minhashvals_.set_multi_index(*config.multi_index);
+  }
+  if (config.thread_num) {
+    if (*config.thread_num <= 0) {
+      throw JUBATUS_EXCEPTION(
+          jubatus::exception::runtime_error("thread_num must be positive"));
+    }
+    row2minhashvals_.set_thread_num(*config.thread_num);
+  }
+  if (config.retain_original_rows) {
+    set_retain_original_rows(*config.retain_original_rows);
+  }
 }
 
 minhash::~minhash() {
@@ -70,6 +88,34 @@ void minhash::neighbor_row(
   }
 }
 
+void minhash::similar_row(
+    const string& id,
+    vector<pair<string, float> >& ids,
+    size_t ret_num) const {
+  if (retains_original_rows()) {
+    recommender_base::similar_row(id, ids, ret_num);
+    return;
+  }
+  // signatures in the index are used instead of original rows
+  ids.clear();
+  bit_vector bv;
+  row2minhashvals_.get_row(id, bv);
+  if (ret_num == 0 || bv.bit_num() == 0) {
+    return;
+  }
+  row2minhashvals_.similar_row(bv, ids, ret_num);
+}
+
+void minhash::neighbor_row(
+    const string& id,
+    vector<pair<string, float> >& ids,
+    size_t ret_num) const {
+  similar_row(id, ids, ret_num);
+  for (size_t i = 0; i < ids.size(); ++i) {
+    ids[i].second = 1 - ids[i].second;
+  }
+}
+
 void minhash::clear() {
   orig_.clear();
   row2minhashvals_.clear();
@@ -80,7 +126,27 @@ void minhash::clear_row(const string& id) {
   row2minhashvals_.remove_row(id);
 }
 
+minhash::scheme_type minhash::parse_scheme(const string& scheme) {
+  if (scheme == "k_permutation") {
+    return K_PERMUTATION;
+  } else if (scheme == "one_permutation") {
+    return ONE_PERMUTATION;
+  } else {
+    throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error(
+        "unknown minhash scheme: " + scheme));
+  }
+}
+
+string minhash::scheme_name(scheme_type scheme) {
+  return scheme == ONE_PERMUTATION ? "one_permutation" : "k_permutation";
+}
+
 void minhash::calc_minhash_values(const sfv_t& sfv, bit_vector& bv) const {
+  if (scheme_ == ONE_PERMUTATION) {
+    calc_one_permutation_values(sfv, bv);
+    return;
+  }
+
   vector<float> min_values_buffer(hash_num_, FLT_MAX);
   vector<uint64_t> hash_buffer(hash_num_);
   for (size_t i = 0; i < sfv.size(); ++i) {
@@ -103,11 +169,56 @@ void minhash::calc_minhash_values(const sfv_t& sfv, bit_vector& bv) const {
   }
 }
 
-void minhash::update_row(const string& id, const sfv_diff_t& diff) {
-  orig_.set_row(id, diff);
+void minhash::calc_one_permutation_values(
+    const sfv_t& sfv,
+    bit_vector& bv) const {
+  // each feature is hashed once and goes into one of the bins, where the
+  // minimum value is kept in the same way as calc_minhash_values
+  vector<float> min_values_buffer(hash_num_, FLT_MAX);
+  vector<uint64_t> hash_buffer(hash_num_);
+  vector<bool> filled(hash_num_);
+  size_t filled_num = 0;
+  for (size_t i = 0; i < sfv.size(); ++i) {
+    uint64_t a = hash_util::calc_string_hash(sfv[i].first);
+    uint64_t b = hash_num_;
+    uint64_t c = hash_prime;
+    hash_mix64(a, b, c);
+    hash_mix64(a, b, c);
+    const uint64_t bin = b % hash_num_;
+    float r = static_cast<float>(a) / static_cast<float>(0xFFFFFFFFFFFFFFFFLLU);
+    float hashval = -log(r) / sfv[i].second;
+    if (!filled[bin] || hashval < min_values_buffer[bin]) {
+      min_values_buffer[bin] = hashval;
+      hash_buffer[bin] = c;
+      if (!filled[bin]) {
+        filled[bin] = true;
+        ++filled_num;
+      }
+    }
+  }
 
+  bv.resize_and_clear(hash_num_);
+  if (filled_num == 0) {
+    return;
+  }
+  for (uint64_t i = 0; i < hash_num_; ++i) {
+    uint64_t bin = i;
+    // An empty bin takes the value of the first filled bin in a sequence
+    // of bins which depends only on the bin, so that similar rows are
+    // likely to take the same value (optimal densification)
+    for (uint64_t attempt = 1; !filled[bin]; ++attempt) {
+      bin = finalize_hash((i << 32) + attempt) % hash_num_;
+    }
+    // bins taking the same value give different bits
+    if (finalize_hash(hash_buffer[bin] ^ i) & 1LLU) {
+      bv.set_bit(i);
+    }
+  }
+}
+
+void minhash::update_row(const string& id, const sfv_diff_t& diff) {
   sfv_t row;
-  orig_.get_row(id, row);
+  update_original_row(id, diff, row);
   bit_vector bv;
   calc_minhash_values(row, bv);
   row2minhashvals_.set_row(id, bv);
@@ -157,6 +268,16 @@ void minhash::hash_mix64(uint64_t& a, uint64_t& b, uint64_t& c) {
   c ^= (b >> 22);
 }
 
+// finalizer of MurmurHash3
+uint64_t minhash::finalize_hash(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
 float minhash::calc_hash(uint64_t a, uint64_t b, float val) {
   uint64_t c = hash_prime;
   hash_mix64(a, b, c);
@@ -169,11 +290,21 @@ string minhash::type() const {
   return string("minhash");
 }
 bool minhash::save_impl(std::ostream& os) {
+  save_model_header(os, scheme_name(scheme_));
   pfi::data::serialization::binary_oarchive oa(os);
   oa << row2minhashvals_;
   return true;
 }
 bool minhash::load_impl(std::istream& is) {
+  // models saved before the scheme was recorded use k_permutation
+  string scheme = scheme_name(K_PERMUTATION);
+  load_model_header(is, scheme);
+  // hash values of the model are not comparable with those of the config
+  if (parse_scheme(scheme) != scheme_) {
+    throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error(
+        "minhash scheme of the model is " + scheme + ", but "
+        + scheme_name(scheme_) + " is configured"));
+  }
   pfi::data::serialization::binary_iarchive ia(is);
   ia >> row2minhashvals_;
   return true;
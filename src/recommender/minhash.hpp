@@ -20,6 +20,7 @@
 #include <string>
 #include <utility>
 #include <vector>
+#include <pficommon/data/optional.h>
 #include <pficommon/data/serialization.h>
 
 #include "recommender_base.hpp"
@@ -36,10 +37,23 @@ class minhash : public recommender_base {
     }
 
     int64_t hash_num;
+    // "k_permutation" (default) computes hash_num hashes of each feature.
+    // "one_permutation" hashes each feature once into one of hash_num bins
+    // and fills empty bins from others, which is much faster for rows with
+    // many features.
+    pfi::data::optional<std::string> scheme;
+    // search rows with multi-index hashing instead of scanning all rows
+    pfi::data::optional<bool> multi_index;
+    // number of threads to scan rows in similar_row
+    pfi::data::optional<int64_t> thread_num;
+    // keep original rows for decode_row and complete_row (default true).
+    // Without them, update_row replaces rows instead of updating columns.
+    pfi::data::optional<bool> retain_original_rows;
 
     template<typename Ar>
     void serialize(Ar& ar) {
-      ar & MEMBER(hash_num);
+      ar & MEMBER(hash_num) & MEMBER(scheme) & MEMBER(multi_index)
+          & MEMBER(thread_num) & MEMBER(retain_original_rows);
     }
   };
 
@@ -55,6 +69,14 @@ class minhash : public recommender_base {
       const sfv_t& query,
       std::vector<std::pair<std::string, float> >& ids,
       size_t ret_num) const;
+  void similar_row(
+      const std::string& id,
+      std::vector<std::pair<std::string, float> >& ids,
+      size_t ret_num) const;
+  void neighbor_row(
+      const std::string& id,
+      std::vector<std::pair<std::string, float> >& ids,
+      size_t ret_num) const;
   void clear();
   void clear_row(const std::string& id);
   void update_row(const std::string& id, const sfv_diff_t& diff);
@@ -67,13 +89,27 @@ class minhash : public recommender_base {
   bool save_impl(std::ostream&);
   bool load_impl(std::istream&);
 
+  enum scheme_type {
+    K_PERMUTATION,
+    ONE_PERMUTATION
+  };
+
+  static scheme_type parse_scheme(const std::string& scheme);
+  static std::string scheme_name(scheme_type scheme);
+
   void calc_minhash_values(const sfv_t& sfv, storage::bit_vector& bv) const;
+  void calc_one_permutation_values(
+      const sfv_t& sfv,
+      storage::bit_vector& bv) const;
 
   static float calc_hash(uint64_t a, uint64_t b, float val);
   static void hash_mix64(uint64_t& a, uint64_t& b, uint64_t& c);
+  static uint64_t finalize_hash(uint64_t h);
 
   static const uint64_t hash_prime;
   uint64_t hash_num_;
+  // recorded in saved models as signatures depend on it
+  scheme_type scheme_;
   storage::bit_index_storage row2minhashvals_;
 };
 
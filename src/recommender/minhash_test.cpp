@@ -0,0 +1,171 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <pficommon/data/serialization.h>
+#include <pficommon/lang/cast.h>
+
+#include "minhash.hpp"
+#include "../common/exception.hpp"
+#include "../storage/sparse_matrix_storage.hpp"
+
+using std::make_pair;
+using std::pair;
+using std::string;
+using std::stringstream;
+using std::vector;
+using pfi::lang::lexical_cast;
+
+namespace jubatus {
+namespace recommender {
+
+namespace {
+
+// features [begin, end) with weight 1
+sfv_t make_range(size_t begin, size_t end) {
+  sfv_t v;
+  for (size_t i = begin; i < end; ++i) {
+    v.push_back(make_pair("f" + lexical_cast<string>(i), 1.f));
+  }
+  return v;
+}
+
+minhash::config make_config(const string& scheme) {
+  minhash::config config;
+  config.hash_num = 256;
+  config.scheme = scheme;
+  return config;
+}
+
+}  // namespace
+
+TEST(minhash, invalid_scheme) {
+  EXPECT_THROW(minhash(make_config("unknown")),
+               jubatus::exception::runtime_error);
+}
+
+TEST(minhash, one_permutation) {
+  minhash r(make_config("one_permutation"));
+  // Jaccard similarities to the query are 1, 0.6, 0.2 and 0
+  r.update_row("r1", make_range(0, 100));
+  r.update_row("r2", make_range(25, 125));
+  r.update_row("r3", make_range(67, 167));
+  r.update_row("r4", make_range(200, 300));
+
+  vector<pair<string, float> > ids;
+  r.similar_row(make_range(0, 100), ids, 4);
+  ASSERT_EQ(4u, ids.size());
+  EXPECT_EQ("r1", ids[0].first);
+  EXPECT_FLOAT_EQ(1.f, ids[0].second);
+  EXPECT_EQ("r2", ids[1].first);
+  EXPECT_EQ("r3", ids[2].first);
+  EXPECT_EQ("r4", ids[3].first);
+
+  // half of the bits of different rows match by chance
+  EXPECT_NEAR(0.8, ids[1].second, 0.1);
+  EXPECT_NEAR(0.6, ids[2].second, 0.1);
+  EXPECT_NEAR(0.5, ids[3].second, 0.1);
+
+  // rows with fewer features than hashes
+  r.update_row("r5", make_range(1000, 1003));
+  r.similar_row(make_range(1000, 1003), ids, 1);
+  ASSERT_EQ(1u, ids.size());
+  EXPECT_EQ("r5", ids[0].first);
+  EXPECT_FLOAT_EQ(1.f, ids[0].second);
+}
+
+TEST(minhash, save_load_scheme) {
+  minhash r(make_config("one_permutation"));
+  r.update_row("r1", make_range(0, 100));
+  stringstream ss;
+  r.save(ss);
+
+  // models are not loaded with another scheme
+  stringstream ss2(ss.str());
+  minhash r3(make_config("k_permutation"));
+  EXPECT_THROW(r3.load(ss2), jubatus::exception::runtime_error);
+
+  minhash r2(make_config("one_permutation"));
+  r2.load(ss);
+  vector<pair<string, float> > ids;
+  r2.similar_row(make_range(0, 100), ids, 1);
+  ASSERT_EQ(1u, ids.size());
+  EXPECT_FLOAT_EQ(1.f, ids[0].second);
+}
+
+TEST(minhash, load_old_model) {
+  minhash r(make_config("k_permutation"));
+  r.update_row("r1", make_range(0, 100));
+
+  // models saved before the scheme was recorded
+  stringstream ss;
+  {
+    pfi::data::serialization::binary_oarchive oa(ss);
+    storage::sparse_matrix_storage orig;
+    oa << orig;
+  }
+  static_cast<storage::bit_index_storage*>(r.get_storage())->save(ss);
+
+  stringstream ss2(ss.str());
+  minhash r3(make_config("one_permutation"));
+  EXPECT_THROW(r3.load(ss2), jubatus::exception::runtime_error);
+
+  minhash r2(make_config("k_permutation"));
+  r2.load(ss);
+  vector<pair<string, float> > ids;
+  r2.similar_row(make_range(0, 100), ids, 1);
+  ASSERT_EQ(1u, ids.size());
+  EXPECT_EQ("r1", ids[0].first);
+  EXPECT_FLOAT_EQ(1.f, ids[0].second);
+}
+
+TEST(minhash, drop_original_rows) {
+  minhash::config config = make_config("k_permutation");
+  config.retain_original_rows = false;
+  minhash r(config);
+  r.update_row("r1", make_range(0, 100));
+  r.update_row("r2", make_range(50, 150));
+
+  sfv_t row;
+  EXPECT_THROW(r.decode_row("r1", row), jubatus::exception::runtime_error);
+  EXPECT_THROW(r.complete_row("r1", row), jubatus::exception::runtime_error);
+
+  // rows are found with their signatures
+  vector<pair<string, float> > ids;
+  r.similar_row("r1", ids, 2);
+  ASSERT_EQ(2u, ids.size());
+  EXPECT_EQ("r1", ids[0].first);
+  EXPECT_FLOAT_EQ(1.f, ids[0].second);
+  EXPECT_EQ("r2", ids[1].first);
+  r.neighbor_row("r1", ids, 1);
+  ASSERT_EQ(1u, ids.size());
+  EXPECT_FLOAT_EQ(0.f, ids[0].second);
+
+  // rows are replaced rather than updated
+  r.update_row("r1", make_range(100, 150));
+  r.similar_row(make_range(100, 150), ids, 1);
+  ASSERT_EQ(1u, ids.size());
+  EXPECT_EQ("r1", ids[0].first);
+  EXPECT_FLOAT_EQ(1.f, ids[0].second);
+}
+
+}  // namespace recommender
+}  // namespace jubatus
@@ -0,0 +1,310 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include "pq.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <utility>
+#include <vector>
+#include <glog/logging.h>
+#include <pficommon/data/serialization.h>
+#include "../common/exception.hpp"
+#include "../common/hash.hpp"
+
+using std::istream;
+using std::make_pair;
+using std::ostream;
+using std::pair;
+using std::string;
+using std::vector;
+using pfi::data::unordered_map;
+using jubatus::storage::pq_index_storage;
+
+namespace jubatus {
+namespace recommender {
+
+namespace {
+
+struct less_second {
+  bool operator()(
+      const pair<string, float>& l,
+      const pair<string, float>& r) const {
+    return l.second < r.second;
+  }
+};
+
+}  // namespace
+
+const int32_t pq::DEFAULT_SEED = 1091;
+
+pq::config::config()
+    : dimension(pq_index_storage::DEFAULT_DIMENSION),
+      subspace_num(pq_index_storage::DEFAULT_SUBSPACE_NUM),
+      centroid_num(pq_index_storage::DEFAULT_CENTROID_NUM),
+      train_size(pq_index_storage::DEFAULT_TRAIN_SIZE),
+      seed(DEFAULT_SEED) {
+}
+
+pq::pq()
+    : pq_index_(
+          pq_index_storage::DEFAULT_DIMENSION,
+          pq_index_storage::DEFAULT_SUBSPACE_NUM,
+          pq_index_storage::DEFAULT_CENTROID_NUM,
+          pq_index_storage::DEFAULT_TRAIN_SIZE,
+          DEFAULT_SEED),
+      rerank_num_(0) {
+  pq_index_.set_vector_source(this);
+}
+
+pq::pq(const config& config)
+    : pq_index_(
+          config.dimension,
+          config.subspace_num,
+          config.centroid_num,
+          config.train_size,
+          config.seed),
+      rerank_num_(0) {
+  if (config.dimension <= 0 || config.subspace_num <= 0) {
+    throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error(
+        "dimension and subspace_num must be positive"));
+  }
+  if (config.dimension % config.subspace_num != 0) {
+    throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error(
+        "dimension must be a multiple of subspace_num"));
+  }
+  if (config.centroid_num <= 0 || config.centroid_num > 256) {
+    throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error(
+        "centroid_num must be between 1 and 256"));
+  }
+  if (config.train_size < config.centroid_num) {
+    throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error(
+        "train_size must be at least centroid_num"));
+  }
+  if (config.retain_original_rows) {
+    set_retain_original_rows(*config.retain_original_rows);
+  }
+  if (config.columns) {
+    if (config.columns->size() != static_cast<size_t>(config.dimension)) {
+      throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error(
+          "columns must have dimension features"));
+    }
+    columns_ = *config.columns;
+    for (size_t i = 0; i < columns_.size(); ++i) {
+      if (!column_ids_.insert(make_pair(columns_[i], i)).second) {
+        throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error(
+            "duplicate feature in columns: " + columns_[i]));
+      }
+    }
+  }
+  if (config.rerank_num) {
+    if (*config.rerank_num <= 0) {
+      throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error(
+          "rerank_num must be positive"));
+    }
+    if (!retains_original_rows()) {
+      throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error(
+          "rerank_num requires original rows"));
+    }
+    rerank_num_ = *config.rerank_num;
+  }
+  if (retains_original_rows()) {
+    pq_index_.set_vector_source(this);
+  }
+}
+
+pq::~pq() {
+}
+
+void pq::neighbor_row(
+    const sfv_t& query,
+    vector<pair<string, float> >& ids,
+    size_t ret_num) const {
+  vector<float> vec;
+  make_vector(query, vec);
+  search(vec, ids, ret_num);
+}
+
+void pq::neighbor_row(
+    const string& id,
+    vector<pair<string, float> >& ids,
+    size_t ret_num) const {
+  ids.clear();
+  vector<float> vec;
+  if (pq_index_.get_row(id, vec)) {
+    search(vec, ids, ret_num);
+  }
+}
+
+void pq::similar_row(
+    const sfv_t& query,
+    vector<pair<string, float> >& ids,
+    size_t ret_num) const {
+  neighbor_row(query, ids, ret_num);
+  for (size_t i = 0; i < ids.size(); ++i) {
+    ids[i].second = -ids[i].second;
+  }
+}
+
+void pq::similar_row(
+    const string& id,
+    vector<pair<string, float> >& ids,
+    size_t ret_num) const {
+  neighbor_row(id, ids, ret_num);
+  for (size_t i = 0; i < ids.size(); ++i) {
+    ids[i].second = -ids[i].second;
+  }
+}
+
+void pq::clear() {
+  orig_.clear();
+  pq_index_.clear();
+}
+
+void pq::clear_row(const string& id) {
+  orig_.remove_row(id);
+  pq_index_.remove_row(id);
+}
+
+void pq::update_row(const string& id, const sfv_diff_t& diff) {
+  sfv_t row;
+  update_original_row(id, diff, row);
+  if (column_ids_.empty()) {
+    log_collisions(diff);
+  }
+
+  vector<float> vec;
+  make_vector(row, vec);
+  pq_index_.set_row(id, vec);
+}
+
+void pq::get_all_row_ids(vector<string>& ids) const {
+  pq_index_.get_all_row_ids(ids);
+}
+
+string pq::type() const {
+  return "pq";
+}
+
+pq_index_storage* pq::get_storage() {
+  return &pq_index_;
+}
+
+const pq_index_storage* pq::get_const_storage() const {
+  return &pq_index_;
+}
+
+void pq::make_vector(const sfv_t& row, vector<float>& vec) const {
+  vec.assign(pq_index_.dimension(), 0.f);
+  if (!column_ids_.empty()) {
+    for (size_t i = 0; i < row.size(); ++i) {
+      unordered_map<string, size_t>::const_iterator it =
+          column_ids_.find(row[i].first);
+      if (it != column_ids_.end()) {
+        vec[it->second] += row[i].second;
+      }
+    }
+    return;
+  }
+  for (size_t i = 0; i < row.size(); ++i) {
+    vec[hash_util::calc_string_hash(row[i].first) % vec.size()] +=
+        row[i].second;
+  }
+}
+
+void pq::log_collisions(const sfv_t& row) {
+  if (hashed_features_.empty()) {
+    hashed_features_.resize(pq_index_.dimension());
+    collided_.resize(pq_index_.dimension());
+  }
+  for (size_t i = 0; i < row.size(); ++i) {
+    const string& feature = row[i].first;
+    const size_t c =
+        hash_util::calc_string_hash(feature) % hashed_features_.size();
+    if (hashed_features_[c].empty()) {
+      hashed_features_[c] = feature;
+    } else if (!collided_[c] && hashed_features_[c] != feature) {
+      collided_[c] = true;
+      LOG(WARNING) << "features " << hashed_features_[c] << " and "
+                   << feature << " are hashed into the column " << c
+                   << ", which can be avoided by columns";
+    }
+  }
+}
+
+bool pq::get_vector(const string& id, vector<float>& vec) const {
+  sfv_t row;
+  orig_.get_row(id, row);
+  if (row.empty()) {
+    return false;
+  }
+  make_vector(row, vec);
+  return true;
+}
+
+void pq::search(
+    const vector<float>& query,
+    vector<pair<string, float> >& ids,
+    size_t ret_num) const {
+  if (rerank_num_ == 0) {
+    pq_index_.similar_row(query, ret_num, ids);
+    return;
+  }
+
+  // rows given by MIX have no original rows, and keep approximate distances
+  pq_index_.similar_row(query, std::max(rerank_num_, ret_num), ids);
+  sfv_t row;
+  vector<float> vec;
+  for (size_t i = 0; i < ids.size(); ++i) {
+    orig_.get_row(ids[i].first, row);
+    if (row.empty()) {
+      continue;
+    }
+    make_vector(row, vec);
+    float d = 0;
+    for (size_t j = 0; j < vec.size(); ++j) {
+      d += (vec[j] - query[j]) * (vec[j] - query[j]);
+    }
+    ids[i].second = std::sqrt(d);
+  }
+  std::stable_sort(ids.begin(), ids.end(), less_second());
+  if (ids.size() > ret_num) {
+    ids.resize(ret_num);
+  }
+}
+
+bool pq::save_impl(ostream& os) {
+  pfi::data::serialization::binary_oarchive oa(os);
+  oa << columns_ << pq_index_;
+  return true;
+}
+
+bool pq::load_impl(istream& is) {
+  pfi::data::serialization::binary_iarchive ia(is);
+  // vectors of the model are not comparable with those of the config
+  vector<string> columns;
+  ia >> columns;
+  if (columns != columns_) {
+    throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error(
+        "columns of the model differ from the configured ones"));
+  }
+  ia >> pq_index_;
+  return true;
+}
+
+}  // namespace recommender
+}  // namespace jubatus
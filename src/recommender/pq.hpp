@@ -0,0 +1,142 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#ifndef JUBATUS_RECOMMENDER_PQ_HPP_
+#define JUBATUS_RECOMMENDER_PQ_HPP_
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include <pficommon/data/optional.h>
+#include <pficommon/data/serialization.h>
+#include <pficommon/data/unordered_map.h>
+#include <pficommon/lang/noncopyable.h>
+#include "recommender_base.hpp"
+#include "../storage/pq_index_storage.hpp"
+
+namespace jubatus {
+namespace recommender {
+
+// Euclidean nearest neighbors of rows compressed by product quantization,
+// for large numbers of rows of numeric features, e.g. embeddings.
+// Features are hashed into dimension columns of dense vectors unless the
+// features of columns are given, and collisions of hashed features are
+// logged once per column.
+// Not copyable as pq_index_ refers to the recommender for original rows.
+class pq : public recommender_base,
+    private storage::pq_vector_source,
+    pfi::lang::noncopyable {
+ public:
+  using recommender_base::similar_row;
+  using recommender_base::neighbor_row;
+
+  static const int32_t DEFAULT_SEED;
+
+  struct config {
+    config();
+
+    int64_t dimension;
+    // number of bytes of each row, which divides dimension
+    int64_t subspace_num;
+    // number of centroids of each subspace (<= 256)
+    int64_t centroid_num;
+    // number of rows to train the codebook with
+    int64_t train_size;
+    int32_t seed;
+    // number of rows ranked by approximate distances, which are ranked
+    // again by exact distances of original rows when given
+    pfi::data::optional<int64_t> rerank_num;
+    // keep original rows for decode_row, complete_row and rerank_num
+    // (default true)
+    pfi::data::optional<bool> retain_original_rows;
+    // names of the features of dimension columns, in place of hashing
+    // them; the other features are ignored
+    pfi::data::optional<std::vector<std::string> > columns;
+
+    template<typename Ar>
+    void serialize(Ar& ar) {
+      ar & MEMBER(dimension) & MEMBER(subspace_num) & MEMBER(centroid_num) &
+        MEMBER(train_size) & MEMBER(seed) & MEMBER(rerank_num) &
+        MEMBER(retain_original_rows) & MEMBER(columns);
+    }
+  };
+
+  pq();
+  explicit pq(const config& config);
+  ~pq();
+
+  // euclidean distances of rows
+  virtual void neighbor_row(
+      const sfv_t& query,
+      std::vector<std::pair<std::string, float> >& ids,
+      size_t ret_num) const;
+  virtual void neighbor_row(
+      const std::string& id,
+      std::vector<std::pair<std::string, float> >& ids,
+      size_t ret_num) const;
+
+  // negative euclidean distances of rows
+  virtual void similar_row(
+      const sfv_t& query,
+      std::vector<std::pair<std::string, float> >& ids,
+      size_t ret_num) const;
+  virtual void similar_row(
+      const std::string& id,
+      std::vector<std::pair<std::string, float> >& ids,
+      size_t ret_num) const;
+
+  virtual void clear();
+  virtual void clear_row(const std::string& id);
+  virtual void update_row(const std::string& id, const sfv_diff_t& diff);
+  virtual void get_all_row_ids(std::vector<std::string>& ids) const;
+
+  virtual std::string type() const;
+  virtual storage::pq_index_storage* get_storage();
+  virtual const storage::pq_index_storage* get_const_storage() const;
+
+ private:
+  void make_vector(const sfv_t& row, std::vector<float>& vec) const;
+  void log_collisions(const sfv_t& row);
+  // vectors of original rows, which pq_index_ encodes again when its
+  // codebook is changed
+  virtual bool get_vector(
+      const std::string& id,
+      std::vector<float>& vec) const;
+  void search(
+      const std::vector<float>& query,
+      std::vector<std::pair<std::string, float> >& ids,
+      size_t ret_num) const;
+
+  virtual bool save_impl(std::ostream& os);
+  virtual bool load_impl(std::istream& is);
+
+  storage::pq_index_storage pq_index_;
+  // 0 means that rows are not ranked again
+  size_t rerank_num_;
+  // configured features of columns, which are empty if hashed
+  std::vector<std::string> columns_;
+  pfi::data::unordered_map<std::string, size_t> column_ids_;
+  // the first feature hashed into each column, and whether another one
+  // was hashed into it
+  std::vector<std::string> hashed_features_;
+  std::vector<bool> collided_;
+};
+
+}  // namespace recommender
+}  // namespace jubatus
+
+#endif  // JUBATUS_RECOMMENDER_PQ_HPP_
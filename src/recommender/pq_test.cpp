@@ -0,0 +1,164 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <pficommon/lang/cast.h>
+#include <pficommon/math/random.h>
+
+#include "pq.hpp"
+#include "../common/exception.hpp"
+
+using std::make_pair;
+using std::pair;
+using std::string;
+using std::vector;
+using pfi::lang::lexical_cast;
+using pfi::math::random::mtrand;
+
+namespace jubatus {
+namespace recommender {
+
+namespace {
+
+sfv_t make_random_row(mtrand& rand) {
+  sfv_t v;
+  for (size_t i = 0; i < 8; ++i) {
+    v.push_back(make_pair("e" + lexical_cast<string>(i),
+                          static_cast<float>(rand.next_double())));
+  }
+  return v;
+}
+
+pq::config make_config() {
+  pq::config config;
+  config.dimension = 64;
+  config.subspace_num = 8;
+  config.centroid_num = 16;
+  config.train_size = 100;
+  return config;
+}
+
+}  // namespace
+
+TEST(pq, invalid_config) {
+  pq::config config = make_config();
+  config.subspace_num = 7;
+  EXPECT_THROW((pq(config)), jubatus::exception::runtime_error);
+  config = make_config();
+  config.centroid_num = 257;
+  EXPECT_THROW((pq(config)), jubatus::exception::runtime_error);
+  config = make_config();
+  config.train_size = 10;
+  EXPECT_THROW((pq(config)), jubatus::exception::runtime_error);
+  config = make_config();
+  config.rerank_num = 10;
+  config.retain_original_rows = false;
+  EXPECT_THROW((pq(config)), jubatus::exception::runtime_error);
+  config = make_config();
+  config.columns = vector<string>(63, "x");
+  EXPECT_THROW((pq(config)), jubatus::exception::runtime_error);
+  config.columns->push_back("y");
+  EXPECT_THROW((pq(config)), jubatus::exception::runtime_error);
+}
+
+TEST(pq, similar_row) {
+  pq r(make_config());
+  mtrand rand(0);
+  vector<sfv_t> rows;
+  for (size_t i = 0; i < 200; ++i) {
+    rows.push_back(make_random_row(rand));
+    r.update_row("r" + lexical_cast<string>(i), rows.back());
+  }
+  EXPECT_TRUE(r.get_const_storage()->is_trained());
+
+  vector<pair<string, float> > ids;
+  r.similar_row(rows[10], ids, 10);
+  ASSERT_EQ(10u, ids.size());
+  for (size_t i = 0; i < ids.size(); ++i) {
+    EXPECT_GE(0.f, ids[i].second);
+  }
+  r.neighbor_row("r10", ids, 10);
+  ASSERT_EQ(10u, ids.size());
+  for (size_t i = 1; i < ids.size(); ++i) {
+    EXPECT_LE(ids[i - 1].second, ids[i].second);
+  }
+
+  r.clear_row("r10");
+  vector<string> all;
+  r.get_all_row_ids(all);
+  EXPECT_EQ(199u, all.size());
+  r.neighbor_row("r10", ids, 10);
+  EXPECT_TRUE(ids.empty());
+}
+
+TEST(pq, rerank) {
+  pq::config config = make_config();
+  config.rerank_num = 200;
+  pq r(config);
+  mtrand rand(0);
+  vector<sfv_t> rows;
+  for (size_t i = 0; i < 200; ++i) {
+    rows.push_back(make_random_row(rand));
+    r.update_row("r" + lexical_cast<string>(i), rows.back());
+  }
+
+  // all rows are ranked by exact distances
+  for (size_t q = 0; q < 10; ++q) {
+    vector<pair<string, float> > ids;
+    r.neighbor_row(rows[q], ids, 3);
+    ASSERT_EQ(3u, ids.size());
+    EXPECT_EQ("r" + lexical_cast<string>(q), ids[0].first);
+    EXPECT_FLOAT_EQ(0.f, ids[0].second);
+  }
+}
+
+TEST(pq, columns) {
+  pq::config config = make_config();
+  config.columns = vector<string>();
+  for (size_t i = 0; i < 64; ++i) {
+    config.columns->push_back("e" + lexical_cast<string>(i));
+  }
+  pq r(config);
+  sfv_t row;
+  row.push_back(make_pair("e0", 1.f));
+  row.push_back(make_pair("e1", 2.f));
+  row.push_back(make_pair("unknown", 3.f));
+  r.update_row("r", row);
+
+  // features are not mixed up, and unknown ones are ignored
+  vector<float> v;
+  ASSERT_TRUE(r.get_const_storage()->get_row("r", v));
+  ASSERT_EQ(64u, v.size());
+  EXPECT_EQ(1.f, v[0]);
+  EXPECT_EQ(2.f, v[1]);
+  for (size_t i = 2; i < v.size(); ++i) {
+    EXPECT_EQ(0.f, v[i]);
+  }
+
+  std::stringstream ss;
+  r.save(ss);
+  pq hashed(make_config());
+  EXPECT_THROW(hashed.load(ss), jubatus::exception::runtime_error);
+}
+
+}  // namespace recommender
+}  // namespace jubatus
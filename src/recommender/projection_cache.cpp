@@ -0,0 +1,88 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include "projection_cache.hpp"
+
+#include <utility>
+#include <pficommon/concurrent/lock.h>
+
+using pfi::concurrent::scoped_lock;
+
+namespace jubatus {
+namespace recommender {
+
+projection_cache::projection_cache(size_t max_size)
+    : max_size_(max_size),
+      shard_max_size_(max_size / SHARD_NUM + (max_size % SHARD_NUM != 0)) {
+}
+
+projection_cache::projection_ptr projection_cache::get(uint64_t key) {
+  shard& s = get_shard(key);
+  scoped_lock lk(s.mutex);
+  index_t::iterator it = s.index.find(key);
+  if (it == s.index.end()) {
+    return projection_ptr();
+  }
+  s.entries.splice(s.entries.begin(), s.entries, it->second);
+  return it->second->second;
+}
+
+void projection_cache::put(uint64_t key, const projection_ptr& projection) {
+  if (shard_max_size_ == 0) {
+    return;
+  }
+
+  shard& s = get_shard(key);
+  scoped_lock lk(s.mutex);
+  index_t::iterator it = s.index.find(key);
+  if (it != s.index.end()) {
+    it->second->second = projection;
+    s.entries.splice(s.entries.begin(), s.entries, it->second);
+    return;
+  }
+
+  s.entries.push_front(std::make_pair(key, projection));
+  s.index[key] = s.entries.begin();
+  while (s.index.size() > shard_max_size_) {
+    s.index.erase(s.entries.back().first);
+    s.entries.pop_back();
+  }
+}
+
+void projection_cache::clear() {
+  for (size_t i = 0; i < SHARD_NUM; ++i) {
+    scoped_lock lk(shards_[i].mutex);
+    shards_[i].entries.clear();
+    index_t().swap(shards_[i].index);
+  }
+}
+
+size_t projection_cache::size() const {
+  size_t size = 0;
+  for (size_t i = 0; i < SHARD_NUM; ++i) {
+    scoped_lock lk(shards_[i].mutex);
+    size += shards_[i].index.size();
+  }
+  return size;
+}
+
+projection_cache::shard& projection_cache::get_shard(uint64_t key) {
+  // lower bits of keys are used by the index in each shard
+  return shards_[(key >> 32) % SHARD_NUM];
+}
+
+}  // namespace recommender
+}  // namespace jubatus
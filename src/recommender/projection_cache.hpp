@@ -0,0 +1,74 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#ifndef JUBATUS_RECOMMENDER_PROJECTION_CACHE_HPP_
+#define JUBATUS_RECOMMENDER_PROJECTION_CACHE_HPP_
+
+#include <stdint.h>
+#include <list>
+#include <utility>
+#include <vector>
+#include <pficommon/concurrent/mutex.h>
+#include <pficommon/data/unordered_map.h>
+#include <pficommon/lang/shared_ptr.h>
+
+namespace jubatus {
+namespace recommender {
+
+// LRU cache of random projections of features, keyed by feature hashes.
+// Keys are split into shards with their own locks and LRU lists, so that
+// threads looking up different features rarely wait for each other.
+class projection_cache {
+ public:
+  typedef pfi::lang::shared_ptr<const std::vector<float> > projection_ptr;
+
+  // max_size is the total number of projections of all shards
+  explicit projection_cache(size_t max_size);
+
+  // Returns NULL if key is not cached
+  projection_ptr get(uint64_t key);
+  void put(uint64_t key, const projection_ptr& projection);
+
+  void clear();
+
+  size_t size() const;
+  size_t max_size() const {
+    return max_size_;
+  }
+
+ private:
+  typedef std::list<std::pair<uint64_t, projection_ptr> > entry_list_t;
+  typedef pfi::data::unordered_map<uint64_t, entry_list_t::iterator> index_t;
+
+  struct shard {
+    mutable pfi::concurrent::mutex mutex;
+    entry_list_t entries;
+    index_t index;
+  };
+
+  static const size_t SHARD_NUM = 16;
+
+  shard& get_shard(uint64_t key);
+
+  size_t max_size_;
+  size_t shard_max_size_;
+  shard shards_[SHARD_NUM];
+};
+
+}  // namespace recommender
+}  // namespace jubatus
+
+#endif  // JUBATUS_RECOMMENDER_PROJECTION_CACHE_HPP_
@@ -0,0 +1,69 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include <vector>
+#include <gtest/gtest.h>
+#include "projection_cache.hpp"
+
+using std::vector;
+
+namespace jubatus {
+namespace recommender {
+
+namespace {
+
+projection_cache::projection_ptr make_projection(float x) {
+  return projection_cache::projection_ptr(new vector<float>(2, x));
+}
+
+}  // namespace
+
+TEST(projection_cache, get_and_put) {
+  projection_cache cache(100);
+  EXPECT_FALSE(cache.get(1));
+
+  cache.put(1, make_projection(1));
+  cache.put(2, make_projection(2));
+  ASSERT_TRUE(cache.get(1));
+  EXPECT_EQ(1.f, (*cache.get(1))[0]);
+  EXPECT_EQ(2u, cache.size());
+
+  cache.put(1, make_projection(3));
+  EXPECT_EQ(3.f, (*cache.get(1))[0]);
+  EXPECT_EQ(2u, cache.size());
+
+  cache.clear();
+  EXPECT_EQ(0u, cache.size());
+  EXPECT_FALSE(cache.get(2));
+}
+
+TEST(projection_cache, lru) {
+  // all keys are in the same shard
+  projection_cache cache(32);
+  cache.put(1, make_projection(1));
+  cache.put(2, make_projection(2));
+  cache.get(1);
+  cache.put(3, make_projection(3));
+
+  EXPECT_TRUE(cache.get(1));
+  EXPECT_FALSE(cache.get(2));
+  EXPECT_TRUE(cache.get(3));
+  EXPECT_EQ(2u, cache.size());
+  EXPECT_EQ(32u, cache.max_size());
+}
+
+}  // namespace recommender
+}  // namespace jubatus
@@ -20,6 +20,8 @@
 #include "inverted_index.hpp"
 #include "lsh.hpp"
 #include "euclid_lsh.hpp"
+#include "hnsw.hpp"
+#include "pq.hpp"
 #include "minhash.hpp"
 #include "recommender_mock.hpp"
 
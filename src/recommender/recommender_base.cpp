@@ -19,8 +19,10 @@
 #include <string>
 #include <utility>
 #include <vector>
+#include <pficommon/lang/bind.h>
 #include "recommender_base.hpp"
-#include "../common/vector_util.hpp"
+#include "../common/exception.hpp"
+#include "../common/parallel.hpp"
 
 using std::make_pair;
 using std::pair;
@@ -31,9 +33,104 @@ using std::vector;
 namespace jubatus {
 namespace recommender {
 
+namespace {
+
+// smallest number of queries answered by one thread
+const size_t MIN_BATCH_CHUNK_SIZE = 8;
+// smallest number of entries summed by one thread of complete_row
+const size_t MIN_COMPLETE_CHUNK_ENTRY_NUM = 16384;
+// column_accumulator uses an array when columns are at most this times
+// as many as the entries to add
+const size_t DENSE_ACCUMULATOR_RATIO = 4;
+
+typedef storage::compact_matrix_storage::entry entry_t;
+typedef vector<pair<uint32_t, float> > column_sums_t;
+
+struct weighted_row {
+  const entry_t* entries;
+  size_t size;
+  float ratio;
+};
+
+// Sums of values of each column id
+class column_accumulator {
+ public:
+  column_accumulator(size_t column_num, size_t entry_num)
+      : dense_(column_num <= entry_num * DENSE_ACCUMULATOR_RATIO) {
+    if (dense_) {
+      sums_.resize(column_num);
+      used_.resize(column_num);
+    }
+  }
+
+  void add(uint32_t column, float value) {
+    if (!dense_) {
+      sparse_sums_[column] += value;
+      return;
+    }
+    if (!used_[column]) {
+      used_[column] = true;
+      columns_.push_back(column);
+    }
+    sums_[column] += value;
+  }
+
+  void get(column_sums_t& ret) const {
+    ret.clear();
+    if (!dense_) {
+      ret.assign(sparse_sums_.begin(), sparse_sums_.end());
+      return;
+    }
+    ret.reserve(columns_.size());
+    for (size_t i = 0; i < columns_.size(); ++i) {
+      ret.push_back(make_pair(columns_[i], sums_[columns_[i]]));
+    }
+  }
+
+ private:
+  bool dense_;
+  vector<float> sums_;
+  vector<char> used_;
+  vector<uint32_t> columns_;
+  pfi::data::unordered_map<uint32_t, float> sparse_sums_;
+};
+
+void sum_rows(
+    const vector<weighted_row>& rows,
+    size_t begin,
+    size_t end,
+    size_t column_num,
+    column_sums_t& sums) {
+  size_t entry_num = 0;
+  for (size_t i = begin; i < end; ++i) {
+    entry_num += rows[i].size;
+  }
+  column_accumulator acc(column_num, entry_num);
+  for (size_t i = begin; i < end; ++i) {
+    const weighted_row& row = rows[i];
+    for (size_t j = 0; j < row.size; ++j) {
+      acc.add(row.entries[j].column, row.entries[j].value * row.ratio);
+    }
+  }
+  acc.get(sums);
+}
+
+void sum_rows_chunk(
+    const vector<weighted_row>* rows,
+    size_t column_num,
+    vector<column_sums_t>* chunk_sums,
+    size_t chunk,
+    size_t begin,
+    size_t end) {
+  sum_rows(*rows, begin, end, column_num, (*chunk_sums)[chunk]);
+}
+
+}  // namespace
+
 const uint64_t recommender_base::complete_row_similar_num_ = 128;
 
-recommender_base::recommender_base() {
+recommender_base::recommender_base()
+    : retain_original_rows_(true) {
 }
 
 recommender_base::~recommender_base() {
@@ -42,6 +139,7 @@ recommender_base::~recommender_base() {
 void recommender_base::similar_row(
     const std::string& id, std::vector<std::pair<std::string, float> >& ids,
     size_t ret_num) const {
+  check_original_rows();
   ids.clear();
   sfv_t sfv;
   orig_.get_row(id, sfv);
@@ -52,56 +150,210 @@ void recommender_base::neighbor_row(
     const string& id,
     vector<pair<string, float> >& ids,
     size_t ret_num) const {
+  check_original_rows();
   ids.clear();
   sfv_t sfv;
   orig_.get_row(id, sfv);
   neighbor_row(sfv, ids, ret_num);
 }
 
+void recommender_base::similar_rows(
+    const vector<sfv_t>& queries,
+    vector<vector<pair<string, float> > >& ids,
+    size_t ret_num,
+    size_t thread_num) const {
+  similar_rows_batch<sfv_t> batch = {&queries, &ids, ret_num};
+  run_similar_rows(batch, thread_num);
+}
+
+void recommender_base::similar_rows(
+    const vector<string>& row_ids,
+    vector<vector<pair<string, float> > >& ids,
+    size_t ret_num,
+    size_t thread_num) const {
+  similar_rows_batch<string> batch = {&row_ids, &ids, ret_num};
+  run_similar_rows(batch, thread_num);
+}
+
+void recommender_base::similar_rows_range(
+    const vector<sfv_t>& queries,
+    size_t begin,
+    size_t end,
+    vector<vector<pair<string, float> > >& ids,
+    size_t ret_num) const {
+  for (size_t i = begin; i < end; ++i) {
+    similar_row(queries[i], ids[i], ret_num);
+  }
+}
+
+void recommender_base::similar_rows_range(
+    const vector<string>& row_ids,
+    size_t begin,
+    size_t end,
+    vector<vector<pair<string, float> > >& ids,
+    size_t ret_num) const {
+  for (size_t i = begin; i < end; ++i) {
+    similar_row(row_ids[i], ids[i], ret_num);
+  }
+}
+
+template <typename Query>
+void recommender_base::run_similar_rows(
+    const similar_rows_batch<Query>& batch,
+    size_t thread_num) const {
+  const size_t size = batch.queries->size();
+  batch.ids->clear();
+  batch.ids->resize(size);
+  common::run_chunks(
+      pfi::lang::bind(&recommender_base::similar_rows_chunk<Query>, this,
+                      &batch, pfi::lang::_2, pfi::lang::_3),
+      size, common::get_chunk_num(size, thread_num, MIN_BATCH_CHUNK_SIZE));
+}
+
+template <typename Query>
+void recommender_base::similar_rows_chunk(
+    const similar_rows_batch<Query>* batch,
+    size_t begin,
+    size_t end) const {
+  similar_rows_range(*batch->queries, begin, end, *batch->ids,
+                     batch->ret_num);
+}
+
 void recommender_base::decode_row(const std::string& id, sfv_t& ret) const {
+  check_original_rows();
   ret.clear();
   orig_.get_row(id, ret);
 }
 
 void recommender_base::complete_row(const std::string& id, sfv_t& ret) const {
+  complete_row(id, ret, 1);
+}
+
+void recommender_base::complete_row(const sfv_t& query, sfv_t& ret) const {
+  complete_row(query, ret, 1);
+}
+
+void recommender_base::complete_row(
+    const std::string& id,
+    sfv_t& ret,
+    size_t thread_num) const {
+  check_original_rows();
   ret.clear();
   sfv_t sfv;
   orig_.get_row(id, sfv);
-  complete_row(sfv, ret);
+  complete_row(sfv, ret, thread_num);
 }
 
-void recommender_base::complete_row(const sfv_t& query, sfv_t& ret) const {
+void recommender_base::complete_row(
+    const sfv_t& query,
+    sfv_t& ret,
+    size_t thread_num) const {
+  check_original_rows();
   ret.clear();
   vector<pair<string, float> > ids;
   similar_row(query, ids, complete_row_similar_num_);
-  if (ids.size() == 0) {
-    return;
-  }
 
-  size_t exist_row_num = 0;
+  // rows are read in place and summed by column ids, which are converted to
+  // strings only for the result
+  vector<weighted_row> rows;
+  size_t entry_num = 0;
   for (size_t i = 0; i < ids.size(); ++i) {
-    sfv_t row;
-    orig_.get_row(ids[i].first, row);
-    if (row.size() == 0) {
+    weighted_row row;
+    row.entries = orig_.get_row_entries(ids[i].first, row.size);
+    if (!row.entries) {
       continue;
-    } else {
-      ++exist_row_num;
     }
-    float ratio = ids[i].second;
-    for (size_t j = 0; j < row.size(); ++j) {
-      ret.push_back(make_pair(row[j].first, row[j].second * ratio));
+    row.ratio = ids[i].second;
+    rows.push_back(row);
+    entry_num += row.size;
+  }
+  if (rows.empty()) {
+    return;
+  }
+
+  const size_t column_num = orig_.column_num();
+  const size_t chunk_num = common::get_chunk_num(
+      entry_num, thread_num, MIN_COMPLETE_CHUNK_ENTRY_NUM);
+  column_sums_t sums;
+  if (chunk_num <= 1) {
+    sum_rows(rows, 0, rows.size(), column_num, sums);
+  } else {
+    vector<column_sums_t> chunk_sums(chunk_num);
+    common::run_chunks(
+        pfi::lang::bind(&sum_rows_chunk, &rows, column_num, &chunk_sums,
+                        pfi::lang::_1, pfi::lang::_2, pfi::lang::_3),
+        rows.size(), chunk_num);
+
+    column_accumulator acc(column_num, entry_num);
+    for (size_t i = 0; i < chunk_num; ++i) {
+      for (size_t j = 0; j < chunk_sums[i].size(); ++j) {
+        acc.add(chunk_sums[i][j].first, chunk_sums[i][j].second);
+      }
     }
+    acc.get(sums);
   }
 
-  if (exist_row_num == 0) {
+  ret.reserve(sums.size());
+  for (size_t i = 0; i < sums.size(); ++i) {
+    ret.push_back(make_pair(orig_.get_column(sums[i].first),
+                            sums[i].second / rows.size()));
+  }
+  sort(ret.begin(), ret.end());
+}
+
+void recommender_base::update_original_row(
+    const string& id,
+    const sfv_diff_t& diff,
+    sfv_t& row) {
+  if (!retain_original_rows_) {
+    row = diff;
     return;
   }
-  sort_and_merge(ret);
-  for (size_t i = 0; i < ret.size(); ++i) {
-    ret[i].second /= exist_row_num;
+  orig_.set_row(id, diff);
+  orig_.get_row(id, row);
+}
+
+void recommender_base::check_original_rows() const {
+  if (!retain_original_rows_) {
+    throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error(
+        "original rows are not retained"));
   }
 }
 
+namespace {
+
+// Storages saved in old models start with the number of rows, which never
+// matches this marker
+const char MODEL_HEADER_MARKER[] = "\xff\xff\xff\xff";
+const size_t MODEL_HEADER_MARKER_SIZE = 4;
+
+}  // namespace
+
+void recommender_base::save_model_header(
+    std::ostream& os,
+    const std::string& header) {
+  os.write(MODEL_HEADER_MARKER, MODEL_HEADER_MARKER_SIZE);
+  pfi::data::serialization::binary_oarchive oa(os);
+  oa << const_cast<std::string&>(header);
+}
+
+bool recommender_base::load_model_header(
+    std::istream& is,
+    std::string& header) {
+  std::istream::pos_type pos = is.tellg();
+  char marker[MODEL_HEADER_MARKER_SIZE];
+  is.read(marker, MODEL_HEADER_MARKER_SIZE);
+  if (!is || !std::equal(marker, marker + MODEL_HEADER_MARKER_SIZE,
+                         MODEL_HEADER_MARKER)) {
+    is.clear();
+    is.seekg(pos);
+    return false;
+  }
+  pfi::data::serialization::binary_iarchive ia(is);
+  ia >> header;
+  return true;
+}
+
 void recommender_base::save(std::ostream& os) {
   pfi::data::serialization::binary_oarchive oa(os);
   oa << orig_;
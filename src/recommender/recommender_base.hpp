@@ -22,8 +22,9 @@
 #include <utility>
 #include <pficommon/data/unordered_map.h>
 #include <pficommon/lang/shared_ptr.h>
+#include "../common/exception.hpp"
 #include "../common/type.hpp"
-#include "../storage/sparse_matrix_storage.hpp"
+#include "../storage/compact_matrix_storage.hpp"
 #include "../storage/recommender_storage_base.hpp"
 #include "recommender_type.hpp"
 
@@ -63,8 +64,28 @@ class recommender_base {
       const std::string& id,
       std::vector<std::pair<std::string, float> >& ids,
       size_t ret_num) const;
+  // Batch versions of similar_row, which split queries into at most
+  // thread_num chunks answered concurrently
+  void similar_rows(
+      const std::vector<sfv_t>& queries,
+      std::vector<std::vector<std::pair<std::string, float> > >& ids,
+      size_t ret_num,
+      size_t thread_num) const;
+  void similar_rows(
+      const std::vector<std::string>& row_ids,
+      std::vector<std::vector<std::pair<std::string, float> > >& ids,
+      size_t ret_num,
+      size_t thread_num) const;
+
   void complete_row(const std::string& id, sfv_t& ret) const;
   void complete_row(const sfv_t& query, sfv_t& ret) const;
+  // Same as above, but rows of neighbors are summed in at most thread_num
+  // threads
+  void complete_row(
+      const std::string& id,
+      sfv_t& ret,
+      size_t thread_num) const;
+  void complete_row(const sfv_t& query, sfv_t& ret, size_t thread_num) const;
   void decode_row(const std::string& id, sfv_t& ret) const;
 
   void save(std::ostream&);
@@ -77,8 +98,68 @@ class recommender_base {
   virtual bool save_impl(std::ostream&) = 0;
   virtual bool load_impl(std::istream&) = 0;
 
+  // For save_impl and load_impl of recommenders which record how their
+  // models were built, e.g. hash schemes. Models saved before the header
+  // was introduced have no header, and load_model_header returns false
+  // for them without consuming the stream.
+  static void save_model_header(std::ostream& os, const std::string& header);
+  static bool load_model_header(std::istream& is, std::string& header);
+
+  // Answers queries[begin, end) for similar_rows in one thread. Recommenders
+  // override them to share work between queries.
+  virtual void similar_rows_range(
+      const std::vector<sfv_t>& queries,
+      size_t begin,
+      size_t end,
+      std::vector<std::vector<std::pair<std::string, float> > >& ids,
+      size_t ret_num) const;
+  virtual void similar_rows_range(
+      const std::vector<std::string>& row_ids,
+      size_t begin,
+      size_t end,
+      std::vector<std::vector<std::pair<std::string, float> > >& ids,
+      size_t ret_num) const;
+
+  // For recommenders whose index can find rows without their original
+  // vectors. When disabled, orig_ is kept empty, update_original_row
+  // replaces rows instead of updating their columns, and decode_row,
+  // complete_row and the default similar_row and neighbor_row for ids throw.
+  void set_retain_original_rows(bool retain) {
+    retain_original_rows_ = retain;
+  }
+  bool retains_original_rows() const {
+    return retain_original_rows_;
+  }
+  // Updates the row in orig_ with diff, and returns the updated row
+  void update_original_row(
+      const std::string& id,
+      const sfv_diff_t& diff,
+      sfv_t& row);
+
   static const uint64_t complete_row_similar_num_;
-  storage::sparse_matrix_storage orig_;
+  storage::compact_matrix_storage orig_;
+
+ private:
+  template <typename Query>
+  struct similar_rows_batch {
+    const std::vector<Query>* queries;
+    std::vector<std::vector<std::pair<std::string, float> > >* ids;
+    size_t ret_num;
+  };
+
+  template <typename Query>
+  void run_similar_rows(
+      const similar_rows_batch<Query>& batch,
+      size_t thread_num) const;
+  template <typename Query>
+  void similar_rows_chunk(
+      const similar_rows_batch<Query>* batch,
+      size_t begin,
+      size_t end) const;
+
+  void check_original_rows() const;
+
+  bool retain_original_rows_;
 };
 
 }  // namespace recommender
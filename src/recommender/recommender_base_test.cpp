@@ -20,6 +20,8 @@
 #include <vector>
 
 #include <gtest/gtest.h>
+#include <pficommon/data/unordered_map.h>
+#include <pficommon/lang/cast.h>
 
 #include "../storage/norm.hpp"
 #include "recommender_base.hpp"
@@ -111,8 +113,63 @@ TEST(recommender_base, complete_row) {
   r.complete_row(q, ret);
   ASSERT_EQ(3u, ret.size());
   EXPECT_EQ("a1", ret[0].first);
+  EXPECT_FLOAT_EQ(1.5, ret[0].second);
   EXPECT_EQ("a2", ret[1].first);
+  EXPECT_FLOAT_EQ(1.0, ret[1].second);
   EXPECT_EQ("b1", ret[2].first);
+  EXPECT_FLOAT_EQ(0.5, ret[2].second);
+}
+
+// returns all of 128 rows, each of which has 300 columns
+class many_rows_recommender : public recommender_impl {
+ public:
+  many_rows_recommender() {
+    for (size_t i = 0; i < 128; ++i) {
+      sfv_t row;
+      for (size_t j = 0; j < 300; ++j) {
+        row.push_back(make_pair(pfi::lang::lexical_cast<string>(i + j),
+                                static_cast<float>(j % 7)));
+      }
+      orig_.set_row(row_name(i), row);
+    }
+  }
+
+  void similar_row(
+      const sfv_t& query,
+      vector<pair<string, float> >& ids,
+      size_t ret_num) const {
+    ids.clear();
+    for (size_t i = 0; i < 128; ++i) {
+      ids.push_back(make_pair(row_name(i), 1.f / (i + 1)));
+    }
+  }
+
+  static string row_name(size_t i) {
+    return "row" + pfi::lang::lexical_cast<string>(i);
+  }
+};
+
+TEST(recommender_base, complete_row_in_threads) {
+  many_rows_recommender r;
+  pfi::data::unordered_map<string, float> expected;
+  for (size_t i = 0; i < 128; ++i) {
+    for (size_t j = 0; j < 300; ++j) {
+      expected[pfi::lang::lexical_cast<string>(i + j)] +=
+          (j % 7) / (i + 1.f) / 128;
+    }
+  }
+
+  for (size_t thread_num = 1; thread_num <= 4; thread_num *= 2) {
+    sfv_t ret;
+    r.complete_row(sfv_t(), ret, thread_num);
+    ASSERT_EQ(expected.size(), ret.size());
+    for (size_t i = 0; i < ret.size(); ++i) {
+      if (i > 0) {
+        EXPECT_LT(ret[i - 1].first, ret[i].first);
+      }
+      EXPECT_NEAR(expected[ret[i].first], ret[i].second, 1e-5);
+    }
+  }
 }
 
 TEST(recommender_base, get_all_row_ids) {
@@ -34,14 +34,22 @@ recommender_base* recommender_factory::create_recommender(
     const string& name,
     const config& param) {
   if (name == "inverted_index") {
-    // inverted_index doesn't have parameter
-    return new inverted_index;
+    // parameter of inverted_index is optional
+    if (param.type() == json::Null) {
+      return new inverted_index;
+    }
+    return new inverted_index(
+        config_cast_check<inverted_index::config>(param));
   } else if (name == "minhash") {
     return new minhash(config_cast_check<minhash::config>(param));
   } else if (name == "lsh") {
     return new lsh(config_cast_check<lsh::config>(param));
   } else if (name == "euclid_lsh") {
     return new euclid_lsh(config_cast_check<euclid_lsh::config>(param));
+  } else if (name == "hnsw") {
+    return new hnsw(config_cast_check<hnsw::config>(param));
+  } else if (name == "pq") {
+    return new pq(config_cast_check<pq::config>(param));
   } else {
     throw JUBATUS_EXCEPTION(unsupported_method(name));
   }
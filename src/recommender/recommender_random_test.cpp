@@ -22,6 +22,7 @@
 
 #include <gtest/gtest.h>
 #include <pficommon/lang/cast.h>
+#include <pficommon/math/random.h>
 
 #include "recommender.hpp"
 #include "../classifier/classifier_test_util.hpp"
@@ -257,11 +258,55 @@ TYPED_TEST_P(recommender_random_test, mix) {
   compare_recommenders(expect, mixed, false);
 }
 
+TYPED_TEST_P(recommender_random_test, similar_rows) {
+  TypeParam r;
+  pfi::math::random::mtrand rand(1);
+  for (size_t i = 0; i < 100; ++i) {
+    r.update_row("r_" + lexical_cast<string>(i),
+                 make_vec(rand.next_double(), rand.next_double(),
+                          rand.next_double()));
+  }
+
+  vector<string> row_ids;
+  vector<sfv_t> queries;
+  for (size_t i = 0; i < 40; ++i) {
+    row_ids.push_back("r_" + lexical_cast<string>(i));
+    queries.push_back(make_vec(rand.next_double(), rand.next_double(),
+                               rand.next_double()));
+  }
+
+  for (size_t thread_num = 1; thread_num <= 4; thread_num *= 4) {
+    vector<vector<pair<string, float> > > from_ids, from_queries;
+    r.similar_rows(row_ids, from_ids, 10, thread_num);
+    r.similar_rows(queries, from_queries, 10, thread_num);
+    ASSERT_EQ(row_ids.size(), from_ids.size());
+    ASSERT_EQ(queries.size(), from_queries.size());
+    for (size_t i = 0; i < row_ids.size(); ++i) {
+      vector<pair<string, float> > expected;
+      static_cast<const recommender_base&>(r).similar_row(
+          row_ids[i], expected, 10);
+      ASSERT_EQ(expected.size(), from_ids[i].size());
+      for (size_t j = 0; j < expected.size(); ++j) {
+        EXPECT_EQ(expected[j].first, from_ids[i][j].first);
+        EXPECT_NEAR(expected[j].second, from_ids[i][j].second, 1e-5);
+      }
+
+      r.similar_row(queries[i], expected, 10);
+      ASSERT_EQ(expected.size(), from_queries[i].size());
+      for (size_t j = 0; j < expected.size(); ++j) {
+        EXPECT_EQ(expected[j].first, from_queries[i][j].first);
+        EXPECT_NEAR(expected[j].second, from_queries[i][j].second, 1e-5);
+      }
+    }
+  }
+}
+
 REGISTER_TYPED_TEST_CASE_P(recommender_random_test,
     trivial, random, save_load, get_all_row_ids,
-    diff, mix);
+    diff, mix, similar_rows);
 
-typedef testing::Types<inverted_index, lsh, minhash, euclid_lsh>
+typedef testing::Types<inverted_index, lsh, minhash, euclid_lsh, hnsw,
+    pq>
   recommender_types;
 
 INSTANTIATE_TYPED_TEST_CASE_P(rt, recommender_random_test, recommender_types);
@@ -36,6 +36,12 @@ class anomaly {
     return f.get<std::pair<std::string, float> >();
   }
 
+  std::vector<std::pair<std::string, float> > add_bulk(std::string name,
+       std::vector<datum> rows) {
+    msgpack::rpc::future f = c_.call("add_bulk", name, rows);
+    return f.get<std::vector<std::pair<std::string, float> > >();
+  }
+
   float update(std::string name, std::string id, datum row) {
     msgpack::rpc::future f = c_.call("update", name, id, row);
     return f.get<float>();
@@ -51,6 +57,12 @@ class anomaly {
     return f.get<float>();
   }
 
+  std::vector<float> calc_score_bulk(std::string name,
+       std::vector<datum> rows) {
+    msgpack::rpc::future f = c_.call("calc_score_bulk", name, rows);
+    return f.get<std::vector<float> >();
+  }
+
   std::vector<std::string> get_all_rows(std::string name) {
     msgpack::rpc::future f = c_.call("get_all_rows", name);
     return f.get<std::vector<std::string> >();
@@ -72,6 +84,12 @@ class anomaly {
     return f.get<std::map<std::string, std::map<std::string, std::string> > >();
   }
 
+  std::vector<float> update_bulk(std::string name,
+       std::vector<std::string> ids, std::vector<datum> rows) {
+    msgpack::rpc::future f = c_.call("update_bulk", name, ids, rows);
+    return f.get<std::vector<float> >();
+  }
+
   msgpack::rpc::client& get_client() {
     return c_;
   }
@@ -30,10 +30,16 @@ class anomaly_impl_ : public anomaly<anomaly_impl_> {
   }
 
   std::pair<std::string, float> add(std::string name, datum row) {
-    JWLOCK__(p_);
+    NOLOCK__(p_);
     return get_p()->add(row);
   }
 
+  std::vector<std::pair<std::string, float> > add_bulk(std::string name,
+       std::vector<datum> rows) {
+    NOLOCK__(p_);
+    return get_p()->add_bulk(rows);
+  }
+
   float update(std::string name, std::string id, datum row) {
     JWLOCK__(p_);
     return get_p()->update(id, row);
@@ -49,6 +55,12 @@ class anomaly_impl_ : public anomaly<anomaly_impl_> {
     return get_p()->calc_score(row);
   }
 
+  std::vector<float> calc_score_bulk(std::string name,
+       std::vector<datum> rows) {
+    JRLOCK__(p_);
+    return get_p()->calc_score_bulk(rows);
+  }
+
   std::vector<std::string> get_all_rows(std::string name) {
     JRLOCK__(p_);
     return get_p()->get_all_rows();
@@ -69,6 +81,12 @@ class anomaly_impl_ : public anomaly<anomaly_impl_> {
     JRLOCK__(p_);
     return p_->get_status();
   }
+
+  std::vector<float> update_bulk(std::string name,
+       std::vector<std::string> ids, std::vector<datum> rows) {
+    NOLOCK__(p_);
+    return get_p()->update_bulk(ids, rows);
+  }
   int run() { return p_->start(*this); }
   common::cshared_ptr<anomaly_serv> get_p() { return p_->server(); }
 
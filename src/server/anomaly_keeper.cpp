@@ -23,11 +23,15 @@ int run_keeper(int argc, char* argv[]) {
     k.register_async_cht<2, bool>("clear_row", pfi::lang::function<bool(bool,
          bool)>(&jubatus::framework::all_and));
     k.register_async_random<std::pair<std::string, float>, datum>("add");
+    k.register_async_random<std::vector<std::pair<std::string, float> >,
+         std::vector<datum> >("add_bulk");
     k.register_async_cht<2, float, datum>("update", pfi::lang::function<float(
         float, float)>(&jubatus::framework::pass<float>));
     k.register_async_broadcast<bool>("clear", pfi::lang::function<bool(bool,
          bool)>(&jubatus::framework::all_and));
     k.register_async_random<float, datum>("calc_score");
+    k.register_async_random<std::vector<float>, std::vector<datum> >(
+        "calc_score_bulk");
     k.register_async_broadcast<std::vector<std::string> >("get_all_rows",
          pfi::lang::function<std::vector<std::string>(std::vector<std::string>,
          std::vector<std::string>)>(&jubatus::framework::concat<std::string>));
@@ -17,11 +17,13 @@
 #include "anomaly_serv.hpp"
 
 #include <cassert>
+#include <map>
 #include <string>
 #include <utility>
 #include <vector>
 #include <glog/logging.h>
 #include <pficommon/concurrent/lock.h>
+#include <pficommon/data/optional.h>
 #include <pficommon/text/json.h>
 
 #include "../common/global_id_generator_standalone.hpp"
@@ -66,13 +68,24 @@ struct anomaly_serv_config {
   //            jsonconfig::config ?
   jsonconfig::config parameter;
   pfi::text::json::json converter;
+  pfi::data::optional<jsonconfig::config> row_limit;
 
   template<typename Ar>
   void serialize(Ar& ar) {
-    ar & MEMBER(method) & MEMBER(parameter) & MEMBER(converter);
+    ar & MEMBER(method) & MEMBER(parameter) & MEMBER(converter)
+        & MEMBER(row_limit);
   }
 };
 
+// rows sent to a server, and their positions in the batch
+struct host_rows {
+  vector<string> ids;
+  vector<datum> data;
+  vector<size_t> positions;
+};
+
+typedef std::map<pair<string, int>, host_rows> host_rows_map;
+
 }  // namespace
 
 anomaly_serv::anomaly_serv(
@@ -89,7 +102,7 @@ anomaly_serv::anomaly_serv(
   } else {
     zk_ = zk;
     common::global_id_generator_zk* idgen_zk =
-        new common::global_id_generator_zk();
+        new common::global_id_generator_zk(a.id_lease_size);
     idgen_.reset(idgen_zk);
 
     string counter_path;
@@ -105,6 +118,7 @@ anomaly_serv::~anomaly_serv() {
 void anomaly_serv::get_status(status_t& status) const {
   status_t my_status;
   my_status["storage"] = anomaly_->get_model()->type();
+  anomaly_->get_status(my_status);
 
   status.insert(my_status.begin(), my_status.end());
 }
@@ -126,12 +140,18 @@ bool anomaly_serv::set_config(const std::string& config) {
   }
 #endif
 
-  anomaly_.reset(
+  pfi::lang::shared_ptr<driver::anomaly> new_anomaly(
       new driver::anomaly(
           anomaly::anomaly_factory::create_anomaly(
               conf.method, conf.parameter),
           mixer_,
           fv_converter::make_fv_converter(conf.converter)));
+  if (conf.row_limit) {
+    new_anomaly->set_row_limits(
+        jsonconfig::config_cast_check<driver::row_limiter::config>(
+            *conf.row_limit));
+  }
+  anomaly_ = new_anomaly;
 
   LOG(INFO) << "config loaded: " << config;
   return true;
@@ -151,17 +171,32 @@ bool anomaly_serv::clear_row(const string& id) {
 
 // nolock, random
 pair<string, float> anomaly_serv::add(const datum& d) {
-  check_set_config();
-
-  uint64_t id = idgen_->generate();
-  string id_str = pfi::lang::lexical_cast<string>(id);
+  string id_str;
+  {
+    pfi::concurrent::scoped_rlock lk(rw_mutex());
+    check_set_config();
+    uint64_t id = idgen_->generate();
+    id_str = pfi::lang::lexical_cast<string>(id);
+  }
 
 #ifdef HAVE_ZOOKEEPER_H
   if (argv().is_standalone()) {
 #endif
     fv_converter::datum data;
     convert(d, data);
-    return anomaly_->add(id_str, data);
+
+    // feature extraction does not modify the model except for document
+    // frequencies, so it runs under the read lock
+    sfv_t v;
+    {
+      pfi::concurrent::scoped_rlock lk(rw_mutex());
+      check_set_config();
+      anomaly_->convert_for_add(data, v);
+    }
+    pfi::concurrent::scoped_wlock lk(rw_mutex());
+    event_model_updated();
+    check_set_config();
+    return anomaly_->add(id_str, v);
 #ifdef HAVE_ZOOKEEPER_H
   } else {
     return add_zk(id_str, d);
@@ -178,21 +213,148 @@ pair<string, float> anomaly_serv::add_zk(const string&id_str, const datum& d) {
         membership_error("no server found in cht: " + argv().name));
   }
   // this sequences MUST success,
-  // in case of failures the whole request should be canceled
+  // in case of failures the whole request should be canceled;
+  // rows already sent to other owners are NOT rolled back
   score = selective_update(nodes[0].first, nodes[0].second, id_str, d);
 
+  update_replicas(nodes, id_str, d);
+  DLOG(INFO) << "point added: " << id_str;
+  return make_pair(id_str, score);
+}
+
+// nolock, random
+vector<pair<string, float> > anomaly_serv::add_bulk(const vector<datum>& data) {
+  // ids are allocated at once instead of a ZooKeeper operation for each
+  vector<string> ids(data.size());
+  {
+    pfi::concurrent::scoped_rlock lk(rw_mutex());
+    check_set_config();
+    vector<uint64_t> new_ids;
+    idgen_->generate_many(data.size(), new_ids);
+    for (size_t i = 0; i < ids.size(); ++i) {
+      ids[i] = pfi::lang::lexical_cast<string>(new_ids[i]);
+    }
+  }
+
+#ifdef HAVE_ZOOKEEPER_H
+  if (argv().is_standalone()) {
+#endif
+    return add_bulk_local(ids, data);
+#ifdef HAVE_ZOOKEEPER_H
+  } else {
+    return add_bulk_zk(ids, data);
+  }
+#endif
+}
+
+vector<pair<string, float> > anomaly_serv::add_bulk_local(
+    const vector<string>& ids,
+    const vector<datum>& data) {
+  vector<fv_converter::datum> ds(data.size());
+  for (size_t i = 0; i < data.size(); ++i) {
+    convert(data[i], ds[i]);
+  }
+
+  // as add, feature extraction runs under the read lock
+  vector<sfv_t> vs;
+  {
+    pfi::concurrent::scoped_rlock lk(rw_mutex());
+    check_set_config();
+    anomaly_->convert_for_add(ds, vs, argv().threadnum);
+  }
+  pfi::concurrent::scoped_wlock lk(rw_mutex());
+  event_model_updated();
+  check_set_config();
+  return anomaly_->add_bulk(ids, vs, argv().threadnum);
+}
+
+vector<pair<string, float> > anomaly_serv::add_bulk_zk(
+    const vector<string>& ids,
+    const vector<datum>& data) {
+  // rows are grouped by their owners and replicas, each of which is called
+  // once, and scores given by the owners are returned
+  host_rows_map owners, replicas;
+  for (size_t i = 0; i < ids.size(); ++i) {
+    vector<pair<string, int> > nodes;
+    find_from_cht(ids[i], 2, nodes);
+    if (nodes.empty()) {
+      throw JUBATUS_EXCEPTION(
+          membership_error("no server found in cht: " + argv().name));
+    }
+    for (size_t j = 0; j < nodes.size(); ++j) {
+      host_rows& rows = (j == 0 ? owners : replicas)[nodes[j]];
+      rows.ids.push_back(ids[i]);
+      rows.data.push_back(data[i]);
+      rows.positions.push_back(i);
+    }
+  }
+
+  // this sequences MUST success,
+  // in case of failures the whole request should be canceled;
+  // rows already sent to other owners are NOT rolled back
+  vector<pair<string, float> > ret(ids.size());
+  for (host_rows_map::const_iterator it = owners.begin();
+      it != owners.end(); ++it) {
+    const host_rows& rows = it->second;
+    vector<float> scores = selective_update_bulk(
+        it->first.first, it->first.second, rows.ids, rows.data);
+    if (scores.size() != rows.ids.size()) {
+      throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error(
+          "invalid number of scores from " + it->first.first));
+    }
+    for (size_t i = 0; i < scores.size(); ++i) {
+      ret[rows.positions[i]] = make_pair(rows.ids[i], scores[i]);
+    }
+  }
+
+  for (host_rows_map::const_iterator it = replicas.begin();
+      it != replicas.end(); ++it) {
+    try {
+      DLOG(INFO) << "request to " << it->first.first << ":"
+          << it->first.second;
+      selective_update_bulk(it->first.first, it->first.second,
+                            it->second.ids, it->second.data);
+    } catch (const std::runtime_error& e) {
+      LOG(WARNING) << "cannot create " << it->second.ids.size()
+          << " replicas: " << it->first.first << ":" << it->first.second;
+      LOG(WARNING) << e.what();
+    }
+  }
+
+  DLOG(INFO) << ids.size() << " points added";
+  return ret;
+}
+
+void anomaly_serv::update_replicas(
+    const vector<pair<string, int> >& nodes,
+    const string& id,
+    const datum& d) {
   for (size_t i = 1; i < nodes.size(); ++i) {
     try {
       DLOG(INFO) << "request to " << nodes[i].first << ":" << nodes[i].second;
-      selective_update(nodes[i].first, nodes[i].second, id_str, d);
+      selective_update(nodes[i].first, nodes[i].second, id, d);
     } catch (const std::runtime_error& e) {
       LOG(WARNING) << "cannot create " << i << "th replica: "
           << nodes[i].first << ":" << nodes[i].second;
       LOG(WARNING) << e.what();
     }
   }
-  DLOG(INFO) << "point added: " << id_str;
-  return make_pair(id_str, score);
+}
+
+vector<float> anomaly_serv::update_bulk(
+    const vector<string>& ids,
+    const vector<datum>& data) {
+  if (ids.size() != data.size()) {
+    throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error(
+        "ids and rows must have the same size"));
+  }
+  vector<pair<string, float> > ret = add_bulk_local(ids, data);
+  vector<float> scores(ret.size());
+  for (size_t i = 0; i < ret.size(); ++i) {
+    scores[i] = ret[i].second;
+  }
+  DLOG(INFO) << ids.size() << " points updated";
+  return scores;
 }
 
 float anomaly_serv::update(const string& id, const datum& d) {
@@ -219,6 +381,15 @@ float anomaly_serv::calc_score(const datum& d) const {
   return anomaly_->calc_score(data);
 }
 
+vector<float> anomaly_serv::calc_score_bulk(const vector<datum>& data) const {
+  check_set_config();
+  vector<fv_converter::datum> ds(data.size());
+  for (size_t i = 0; i < data.size(); ++i) {
+    convert(data[i], ds[i]);
+  }
+  return anomaly_->calc_score_bulk(ds, argv().threadnum);
+}
+
 vector<string> anomaly_serv::get_all_rows() const {
   check_set_config();
   return anomaly_->get_all_rows();
@@ -260,5 +431,20 @@ float anomaly_serv::selective_update(
   }
 }
 
+vector<float> anomaly_serv::selective_update_bulk(
+    const string& host,
+    int port,
+    const vector<string>& ids,
+    const vector<datum>& data) {
+  // nolock context
+  if (host == argv().eth && port == argv().port) {
+    return update_bulk(ids, data);
+  } else {  // needs no lock
+    // many rows take longer than one row of selective_update
+    client::anomaly c(host, port, argv().timeout);
+    return c.update_bulk(argv().name, ids, data);
+  }
+}
+
 }  // namespace server
 }  // namespace jubatus
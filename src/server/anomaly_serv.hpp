@@ -54,11 +54,19 @@ class anomaly_serv : public framework::server_base {
   bool clear_row(const std::string& id);
 
   std::pair<std::string, float> add(const datum& d);
+  // in a cluster, some of the rows may have been added when it throws
+  std::vector<std::pair<std::string, float> > add_bulk(
+      const std::vector<datum>& data);
   float update(const std::string& id, const datum& d);
+  // adds rows sent by add_bulk of another server, and returns their scores
+  std::vector<float> update_bulk(
+      const std::vector<std::string>& ids,
+      const std::vector<datum>& data);
 
   bool clear();
 
   float calc_score(const datum& d) const;
+  std::vector<float> calc_score_bulk(const std::vector<datum>& data) const;
 
   std::vector<std::string> get_all_rows() const;
 
@@ -66,6 +74,16 @@ class anomaly_serv : public framework::server_base {
 
  private:
   std::pair<std::string, float> add_zk(const std::string& id, const datum& d);
+  std::vector<std::pair<std::string, float> > add_bulk_local(
+      const std::vector<std::string>& ids,
+      const std::vector<datum>& data);
+  std::vector<std::pair<std::string, float> > add_bulk_zk(
+      const std::vector<std::string>& ids,
+      const std::vector<datum>& data);
+  void update_replicas(
+      const std::vector<std::pair<std::string, int> >& nodes,
+      const std::string& id,
+      const datum& d);
   void find_from_cht(
       const std::string& key,
       size_t n,
@@ -76,6 +94,11 @@ class anomaly_serv : public framework::server_base {
       int port,
       const std::string& id,
       const datum& d);
+  std::vector<float> selective_update_bulk(
+      const std::string& host,
+      int port,
+      const std::vector<std::string>& ids,
+      const std::vector<datum>& data);
 
   pfi::lang::shared_ptr<framework::mixer::mixer> mixer_;
   pfi::lang::shared_ptr<driver::anomaly> anomaly_;
@@ -27,6 +27,9 @@ class anomaly : public jubatus::common::mprpc::rpc_server {
          pfi::lang::bind(&Impl::clear_row, impl, pfi::lang::_1, pfi::lang::_2));
     rpc_server::add<std::pair<std::string, float>(std::string, datum)>("add",
          pfi::lang::bind(&Impl::add, impl, pfi::lang::_1, pfi::lang::_2));
+    rpc_server::add<std::vector<std::pair<std::string, float> >(std::string,
+         std::vector<datum>)>("add_bulk", pfi::lang::bind(&Impl::add_bulk,
+         impl, pfi::lang::_1, pfi::lang::_2));
     rpc_server::add<float(std::string, std::string, datum)>("update",
          pfi::lang::bind(&Impl::update, impl, pfi::lang::_1, pfi::lang::_2,
          pfi::lang::_3));
@@ -34,6 +37,9 @@ class anomaly : public jubatus::common::mprpc::rpc_server {
          impl, pfi::lang::_1));
     rpc_server::add<float(std::string, datum)>("calc_score", pfi::lang::bind(
         &Impl::calc_score, impl, pfi::lang::_1, pfi::lang::_2));
+    rpc_server::add<std::vector<float>(std::string, std::vector<datum>)>(
+        "calc_score_bulk", pfi::lang::bind(&Impl::calc_score_bulk, impl,
+         pfi::lang::_1, pfi::lang::_2));
     rpc_server::add<std::vector<std::string>(std::string)>("get_all_rows",
          pfi::lang::bind(&Impl::get_all_rows, impl, pfi::lang::_1));
     rpc_server::add<bool(std::string, std::string)>("save", pfi::lang::bind(
@@ -43,6 +49,10 @@ class anomaly : public jubatus::common::mprpc::rpc_server {
     rpc_server::add<std::map<std::string, std::map<std::string, std::string> >(
         std::string)>("get_status", pfi::lang::bind(&Impl::get_status, impl,
          pfi::lang::_1));
+    rpc_server::add<std::vector<float>(std::string, std::vector<std::string>,
+         std::vector<datum>)>("update_bulk", pfi::lang::bind(
+        &Impl::update_bulk, impl, pfi::lang::_1, pfi::lang::_2,
+         pfi::lang::_3));
   }
 };
 
@@ -26,7 +26,7 @@ class classifier_impl_ : public classifier<classifier_impl_> {
 
   int32_t train(std::string name, std::vector<std::pair<std::string,
        datum> > data) {
-    JWLOCK__(p_);
+    NOLOCK__(p_);
     return get_p()->train(data);
   }
 
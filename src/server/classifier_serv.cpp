@@ -20,6 +20,7 @@
 #include <utility>
 #include <vector>
 
+#include <pficommon/concurrent/lock.h>
 #include <pficommon/text/json.h>
 #include <pficommon/data/optional.h>
 
@@ -87,6 +88,7 @@ void classifier_serv::get_status(status_t& status) const {
   storage::storage_base* model = classifier_->get_model();
   model->get_status(my_status);
   my_status["storage"] = model->type();
+  classifier_->get_status(my_status);
 
   status.insert(my_status.begin(), my_status.end());
 }
@@ -126,16 +128,32 @@ string classifier_serv::get_config() {
 }
 
 int classifier_serv::train(const vector<pair<string, jubatus::datum> >& data) {
-  check_set_config();
-
-  int count = 0;
-
-  fv_converter::datum d;
+  // nolock context
+  vector<pair<string, fv_converter::datum> > examples(data.size());
   for (size_t i = 0; i < data.size(); ++i) {
     // TODO(IDL): remove conversion
-    convert<jubatus::datum, fv_converter::datum>(data[i].second, d);
-    classifier_->train(std::make_pair(data[i].first, d));
+    examples[i].first = data[i].first;
+    convert<jubatus::datum, fv_converter::datum>(
+        data[i].second, examples[i].second);
+  }
+
+  // feature extraction does not modify the model except for document
+  // frequencies, so it runs under the read lock
+  vector<pair<string, sfv_t> > converted;
+  {
+    pfi::concurrent::scoped_rlock lk(rw_mutex());
+    check_set_config();
+    classifier_->convert_for_train(examples, converted, argv().threadnum);
+  }
+  {
+    pfi::concurrent::scoped_wlock lk(rw_mutex());
+    event_model_updated();
+    check_set_config();
+    classifier_->train(converted);
+  }
 
+  int count = 0;
+  for (size_t i = 0; i < data.size(); ++i) {
     DLOG(INFO) << "trained: " << data[i].first;
     count++;
   }
@@ -148,13 +166,15 @@ vector<vector<estimate_result> > classifier_serv::classify(
   check_set_config();
 
   vector<vector<estimate_result> > ret;
-  fv_converter::datum d;
-
+  vector<fv_converter::datum> ds(data.size());
   for (size_t i = 0; i < data.size(); ++i) {
     // TODO(IDL): remove conversion
-    convert<jubatus::datum, fv_converter::datum>(data[i], d);
+    convert<jubatus::datum, fv_converter::datum>(data[i], ds[i]);
+  }
 
-    classify_result scores = classifier_->classify(d);
+  vector<classify_result> results = classifier_->classify(ds);
+  for (size_t i = 0; i < results.size(); ++i) {
+    const classify_result& scores = results[i];
 
     vector<estimate_result> r;
     for (classify_result::const_iterator p = scores.begin();
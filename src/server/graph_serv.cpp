@@ -117,7 +117,7 @@ graph_serv::graph_serv(
     zk_ = zk;
 
     common::global_id_generator_zk* idgen_zk =
-        new common::global_id_generator_zk();
+        new common::global_id_generator_zk(a.id_lease_size);
     idgen_.reset(idgen_zk);
 
     std::string counter_path;
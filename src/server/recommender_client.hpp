@@ -63,6 +63,19 @@ class recommender {
     return f.get<similar_result>();
   }
 
+  std::vector<similar_result> similar_row_from_ids(std::string name,
+       std::vector<std::string> ids, uint32_t size) {
+    msgpack::rpc::future f = c_.call("similar_row_from_ids", name, ids, size);
+    return f.get<std::vector<similar_result> >();
+  }
+
+  std::vector<similar_result> similar_row_from_datums(std::string name,
+       std::vector<datum> rows, uint32_t size) {
+    msgpack::rpc::future f = c_.call("similar_row_from_datums", name, rows,
+         size);
+    return f.get<std::vector<similar_result> >();
+  }
+
   datum decode_row(std::string name, std::string id) {
     msgpack::rpc::future f = c_.call("decode_row", name, id);
     return f.get<datum>();
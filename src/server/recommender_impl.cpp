@@ -30,7 +30,7 @@ class recommender_impl_ : public recommender<recommender_impl_> {
   }
 
   bool update_row(std::string name, std::string id, datum row) {
-    JWLOCK__(p_);
+    NOLOCK__(p_);
     return get_p()->update_row(id, row);
   }
 
@@ -61,6 +61,18 @@ class recommender_impl_ : public recommender<recommender_impl_> {
     return get_p()->similar_row_from_datum(row, size);
   }
 
+  std::vector<similar_result> similar_row_from_ids(std::string name,
+       std::vector<std::string> ids, uint32_t size) {
+    JRLOCK__(p_);
+    return get_p()->similar_row_from_ids(ids, size);
+  }
+
+  std::vector<similar_result> similar_row_from_datums(std::string name,
+       std::vector<datum> rows, uint32_t size) {
+    JRLOCK__(p_);
+    return get_p()->similar_row_from_datums(rows, size);
+  }
+
   datum decode_row(std::string name, std::string id) {
     JRLOCK__(p_);
     return get_p()->decode_row(id);
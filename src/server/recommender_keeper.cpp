@@ -35,6 +35,9 @@ int run_keeper(int argc, char* argv[]) {
         &jubatus::framework::pass<similar_result>));
     k.register_async_random<similar_result, datum, uint32_t>(
         "similar_row_from_datum");
+    k.register_cht_batch<similar_result, uint32_t>("similar_row_from_ids");
+    k.register_async_random<std::vector<similar_result>, std::vector<datum>,
+         uint32_t>("similar_row_from_datums");
     k.register_async_cht<2, datum>("decode_row", pfi::lang::function<datum(
         datum, datum)>(&jubatus::framework::pass<datum>));
     k.register_async_broadcast<std::vector<std::string> >("get_all_rows",
@@ -20,6 +20,7 @@
 #include <utility>
 #include <vector>
 
+#include <pficommon/concurrent/lock.h>
 #include <pficommon/text/json.h>
 #include <pficommon/data/optional.h>
 
@@ -57,10 +58,12 @@ struct recommender_serv_config {
   // TODO(unnonouno): if must use parameter
   pfi::data::optional<jsonconfig::config> parameter;
   pfi::text::json::json converter;
+  pfi::data::optional<jsonconfig::config> row_limit;
 
   template<typename Ar>
   void serialize(Ar& ar) {
-    ar & MEMBER(method) & MEMBER(parameter) & MEMBER(converter);
+    ar & MEMBER(method) & MEMBER(parameter) & MEMBER(converter)
+        & MEMBER(row_limit);
   }
 };
 
@@ -82,6 +85,9 @@ void recommender_serv::get_status(status_t& status) const {
   status_t my_status;
   my_status["clear_row_cnt"] = lexical_cast<string>(clear_row_cnt_);
   my_status["update_row_cnt"] = lexical_cast<string>(update_row_cnt_);
+  if (recommender_) {
+    recommender_->get_status(my_status);
+  }
 
   status.insert(my_status.begin(), my_status.end());
 }
@@ -98,12 +104,18 @@ bool recommender_serv::set_config(const std::string &config) {
     param = jsonconfig::config(*conf.parameter);
   }
 
-  recommender_.reset(
+  pfi::lang::shared_ptr<driver::recommender> new_recommender(
       new driver::recommender(
           recommender::recommender_factory::create_recommender(
               conf.method, param),
           mixer_,
           fv_converter::make_fv_converter(conf.converter)));
+  if (conf.row_limit) {
+    new_recommender->set_row_limits(
+        jsonconfig::config_cast_check<driver::row_limiter::config>(
+            *conf.row_limit));
+  }
+  recommender_ = new_recommender;
 
   LOG(INFO) << "config loaded: " << config;
   return true;
@@ -125,13 +137,25 @@ bool recommender_serv::clear_row(std::string id) {
 }
 
 bool recommender_serv::update_row(std::string id, datum dat) {
-  check_set_config();
-
-  ++update_row_cnt_;
+  // nolock context
   fv_converter::datum d;
   convert<jubatus::datum, fv_converter::datum>(dat, d);
 
-  recommender_->update_row(id, d);
+  // feature extraction does not modify the model except for document
+  // frequencies, so it runs under the read lock
+  sfv_t v;
+  {
+    pfi::concurrent::scoped_rlock lk(rw_mutex());
+    check_set_config();
+    recommender_->convert_for_update_row(d, v);
+  }
+  {
+    pfi::concurrent::scoped_wlock lk(rw_mutex());
+    event_model_updated();
+    check_set_config();
+    ++update_row_cnt_;
+    recommender_->update_row(id, v);
+  }
   DLOG(INFO) << "row updated: " << id;
 
   return true;
@@ -152,7 +176,8 @@ bool recommender_serv::clear() {
 datum recommender_serv::complete_row_from_id(std::string id) {
   check_set_config();
 
-  fv_converter::datum ret = recommender_->complete_row_from_id(id);
+  fv_converter::datum ret =
+      recommender_->complete_row_from_id(id, argv().threadnum);
 
   datum ret0;
   convert<fv_converter::datum, datum>(ret, ret0);
@@ -165,7 +190,8 @@ datum recommender_serv::complete_row_from_datum(datum dat) {
   fv_converter::datum d;
   convert<jubatus::datum, fv_converter::datum>(dat, d);
 
-  fv_converter::datum ret = recommender_->complete_row_from_datum(d);
+  fv_converter::datum ret =
+      recommender_->complete_row_from_datum(d, argv().threadnum);
 
   datum ret0;
   convert<fv_converter::datum, datum>(ret, ret0);
@@ -190,6 +216,27 @@ similar_result recommender_serv::similar_row_from_datum(datum data, size_t s) {
   return recommender_->similar_row_from_datum(d, s);
 }
 
+std::vector<similar_result> recommender_serv::similar_row_from_ids(
+    const std::vector<std::string>& ids,
+    size_t ret_num) {
+  check_set_config();
+
+  return recommender_->similar_row_from_ids(ids, ret_num, argv().threadnum);
+}
+
+std::vector<similar_result> recommender_serv::similar_row_from_datums(
+    const std::vector<datum>& data,
+    size_t size) {
+  check_set_config();
+
+  std::vector<fv_converter::datum> ds(data.size());
+  for (size_t i = 0; i < data.size(); ++i) {
+    convert<datum, fv_converter::datum>(data[i], ds[i]);
+  }
+
+  return recommender_->similar_row_from_datums(ds, size, argv().threadnum);
+}
+
 datum recommender_serv::decode_row(std::string id) {
   check_set_config();
 
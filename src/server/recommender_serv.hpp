@@ -56,6 +56,12 @@ class recommender_serv : public framework::server_base {
   datum complete_row_from_datum(datum dat);
   similar_result similar_row_from_id(std::string id, size_t ret_num);
   similar_result similar_row_from_datum(datum, size_t);
+  std::vector<similar_result> similar_row_from_ids(
+      const std::vector<std::string>& ids,
+      size_t ret_num);
+  std::vector<similar_result> similar_row_from_datums(
+      const std::vector<datum>& data,
+      size_t size);
 
   float calc_similarity(const datum&, const datum&);
   float calc_l2norm(const datum& q);
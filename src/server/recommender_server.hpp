@@ -42,6 +42,14 @@ class recommender : public jubatus::common::mprpc::rpc_server {
     rpc_server::add<similar_result(std::string, datum, uint32_t)>(
         "similar_row_from_datum", pfi::lang::bind(&Impl::similar_row_from_datum,
          impl, pfi::lang::_1, pfi::lang::_2, pfi::lang::_3));
+    rpc_server::add<std::vector<similar_result>(std::string,
+         std::vector<std::string>, uint32_t)>("similar_row_from_ids",
+         pfi::lang::bind(&Impl::similar_row_from_ids, impl, pfi::lang::_1,
+         pfi::lang::_2, pfi::lang::_3));
+    rpc_server::add<std::vector<similar_result>(std::string,
+         std::vector<datum>, uint32_t)>("similar_row_from_datums",
+         pfi::lang::bind(&Impl::similar_row_from_datums, impl, pfi::lang::_1,
+         pfi::lang::_2, pfi::lang::_3));
     rpc_server::add<datum(std::string, std::string)>("decode_row",
          pfi::lang::bind(&Impl::decode_row, impl, pfi::lang::_1,
          pfi::lang::_2));
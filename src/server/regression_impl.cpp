@@ -26,7 +26,7 @@ class regression_impl_ : public regression<regression_impl_> {
 
   int32_t train(std::string name, std::vector<std::pair<float,
        datum> > train_data) {
-    JWLOCK__(p_);
+    NOLOCK__(p_);
     return get_p()->train(train_data);
   }
 
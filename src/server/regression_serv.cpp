@@ -20,6 +20,7 @@
 #include <utility>
 #include <vector>
 
+#include <pficommon/concurrent/lock.h>
 #include <pficommon/text/json.h>
 #include <pficommon/data/optional.h>
 
@@ -84,6 +85,7 @@ void regression_serv::get_status(status_t& status) const {
   storage::storage_base* model = regression_->get_model();
   model->get_status(my_status);
   my_status["storage"] = model->type();
+  regression_->get_status(my_status);
 
   status.insert(my_status.begin(), my_status.end());
 }
@@ -122,15 +124,32 @@ string regression_serv::get_config() {
 }
 
 int regression_serv::train(const vector<pair<float, jubatus::datum> >& data) {
-  check_set_config();
+  // nolock context
+  vector<pair<float, fv_converter::datum> > examples(data.size());
+  for (size_t i = 0; i < data.size(); ++i) {
+    // TODO(IDL): remove conversion
+    examples[i].first = data[i].first;
+    convert<jubatus::datum, fv_converter::datum>(
+        data[i].second, examples[i].second);
+  }
 
-  int count = 0;
+  // feature extraction does not modify the model except for document
+  // frequencies, so it runs under the read lock
+  vector<pair<float, sfv_t> > converted;
+  {
+    pfi::concurrent::scoped_rlock lk(rw_mutex());
+    check_set_config();
+    regression_->convert_for_train(examples, converted, argv().threadnum);
+  }
+  {
+    pfi::concurrent::scoped_wlock lk(rw_mutex());
+    event_model_updated();
+    check_set_config();
+    regression_->train(converted);
+  }
 
-  fv_converter::datum d;
+  int count = 0;
   for (size_t i = 0; i < data.size(); ++i) {
-    // TODO(IDL): remove conversion
-    convert<jubatus::datum, fv_converter::datum>(data[i].second, d);
-    regression_->train(std::make_pair(data[i].first, d));
     DLOG(INFO) << "trained: " << data[i].first;
     count++;
   }
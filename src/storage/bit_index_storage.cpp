@@ -15,7 +15,7 @@
 // Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "bit_index_storage.hpp"
-#include <functional>
+#include <algorithm>
 #include <iterator>
 #include <sstream>
 #include <string>
@@ -23,9 +23,11 @@
 #include <vector>
 #include <pficommon/data/serialization.h>
 #include <pficommon/data/serialization/unordered_map.h>
+#include <pficommon/lang/bind.h>
+#include <pficommon/lang/shared_ptr.h>
 #include "fixed_size_heap.hpp"
+#include "../common/parallel.hpp"
 
-using std::greater;
 using std::istringstream;
 using std::ostringstream;
 using std::make_pair;
@@ -36,7 +38,9 @@ using std::vector;
 namespace jubatus {
 namespace storage {
 
-bit_index_storage::bit_index_storage() {
+bit_index_storage::bit_index_storage()
+    : thread_num_(1),
+      multi_index_(false) {
 }
 
 bit_index_storage::~bit_index_storage() {
@@ -44,6 +48,7 @@ bit_index_storage::~bit_index_storage() {
 
 void bit_index_storage::set_row(const string& row, const bit_vector& bv) {
   bitvals_diff_[row] = bv;
+  mark_overwritten(row);
 }
 
 void bit_index_storage::get_row(const string& row, bit_vector& bv) const {
@@ -55,8 +60,16 @@ void bit_index_storage::get_row(const string& row, bit_vector& bv) const {
     }
   }
   {
-    bit_table_t::const_iterator it = bitvals_.find(row);
-    if (it != bitvals_.end()) {
+    pfi::data::unordered_map<string, uint64_t>::const_iterator it =
+        row2slot_.find(row);
+    if (it != row2slot_.end()) {
+      arena_.get(it->second, bv);
+      return;
+    }
+  }
+  {
+    bit_table_t::const_iterator it = unpacked_rows_.find(row);
+    if (it != unpacked_rows_.end()) {
       bv = it->second;
       return;
     }
@@ -66,22 +79,38 @@ void bit_index_storage::get_row(const string& row, bit_vector& bv) const {
 
 void bit_index_storage::remove_row(const string& row) {
   bitvals_diff_[row] = bit_vector();
+  mark_overwritten(row);
 }
 
 void bit_index_storage::clear() {
-  bit_table_t().swap(bitvals_);
+  set_master_table(bit_table_t());
   bit_table_t().swap(bitvals_diff_);
+  vector<uint64_t>().swap(overwritten_);
+}
+
+void bit_index_storage::set_multi_index(bool enabled) {
+  multi_index_ = enabled;
+  build_index();
+}
+
+void bit_index_storage::set_thread_num(size_t thread_num) {
+  thread_num_ = std::max(thread_num, static_cast<size_t>(1));
 }
 
 void bit_index_storage::get_all_row_ids(std::vector<std::string>& ids) const {
   ids.clear();
-  for (bit_table_t::const_iterator it = bitvals_.begin(); it != bitvals_.end();
-      ++it) {
+  for (pfi::data::unordered_map<string, uint64_t>::const_iterator it =
+           row2slot_.begin(); it != row2slot_.end(); ++it) {
+    ids.push_back(it->first);
+  }
+  for (bit_table_t::const_iterator it = unpacked_rows_.begin();
+      it != unpacked_rows_.end(); ++it) {
     ids.push_back(it->first);
   }
   for (bit_table_t::const_iterator it = bitvals_diff_.begin();
       it != bitvals_diff_.end(); ++it) {
-    if (bitvals_.find(it->first) == bitvals_.end()) {
+    if (row2slot_.find(it->first) == row2slot_.end()
+        && unpacked_rows_.find(it->first) == unpacked_rows_.end()) {
       ids.push_back(it->first);
     }
   }
@@ -103,9 +132,10 @@ void bit_index_storage::set_mixed_and_clear_diff(const string& mixed_diff_str) {
   bi >> mixed_diff;
   for (bit_table_t::const_iterator it = mixed_diff.begin();
       it != mixed_diff.end(); ++it) {
-    bitvals_[it->first] = it->second;
+    put_master_row(it->first, it->second);
   }
   bitvals_diff_.clear();
+  std::fill(overwritten_.begin(), overwritten_.end(), 0);
 }
 
 void bit_index_storage::mix(const string& lhs, string& rhs) const {
@@ -135,17 +165,195 @@ void bit_index_storage::mix(const string& lhs, string& rhs) const {
   rhs = os.str();  // TODO(unknown) remove redudant copy
 }
 
-typedef fixed_size_heap<pair<uint64_t, string>,
-    greater<pair<uint64_t, string> > > heap_type;
+namespace {
+
+// (hamming similarity, row)
+typedef pair<uint64_t, const string*> score_type;
 
-static void similar_row_one(
+struct greater_score {
+  bool operator()(const score_type& x, const score_type& y) const {
+    return x.first != y.first ? x.first > y.first : *x.second > *y.second;
+  }
+};
+
+typedef fixed_size_heap<score_type, greater_score> heap_type;
+
+void similar_row_one(
     const bit_vector& x,
-    const pair<string, bit_vector>& y,
+    const bit_table_t::value_type& y,
     heap_type& heap) {
   uint64_t match_num = x.calc_hamming_similarity(y.second);
-  heap.push(make_pair(match_num, y.first));
+  heap.push(make_pair(match_num, &y.first));
 }
 
+bool is_overwritten(const bit_table_t& diff, const string& row) {
+  return !diff.empty() && diff.find(row) != diff.end();
+}
+
+bool test_bit(const vector<uint64_t>& bits, uint64_t pos) {
+  return pos / 64 < bits.size() && ((bits[pos / 64] >> (pos % 64)) & 1LLU);
+}
+
+// Adds rows in diff and rows in master which are not packed to heap
+void similar_row_unpacked(
+    const bit_vector& bv,
+    const bit_table_t& unpacked_rows,
+    const bit_table_t& diff,
+    heap_type& heap) {
+  for (bit_table_t::const_iterator it = diff.begin(); it != diff.end();
+      ++it) {
+    similar_row_one(bv, *it, heap);
+  }
+  for (bit_table_t::const_iterator it = unpacked_rows.begin();
+      it != unpacked_rows.end(); ++it) {
+    if (!is_overwritten(diff, it->first)) {
+      similar_row_one(bv, *it, heap);
+    }
+  }
+}
+
+// Adds rows in slots of bit_vector_arena to heap
+class slot_scanner {
+ public:
+  slot_scanner(
+      const bit_vector& bv,
+      const bit_vector_arena& arena,
+      const vector<const string*>& slot2row,
+      const vector<uint64_t>& overwritten)
+      : bv_(bv),
+        arena_(arena),
+        slot2row_(slot2row),
+        overwritten_(overwritten) {
+  }
+
+  void add(uint64_t slot, heap_type& heap) const {
+    if (arena_.is_used(slot) && !test_bit(overwritten_, slot)) {
+      heap.push(make_pair(arena_.calc_hamming_similarity(bv_, slot),
+                          slot2row_[slot]));
+    }
+  }
+
+  void scan(uint64_t begin, uint64_t end, heap_type* heap) const {
+    if (bv_.bit_num() != arena_.bit_num()) {
+      for (uint64_t slot = begin; slot < end; ++slot) {
+        add(slot, *heap);
+      }
+      return;
+    }
+
+    uint32_t similarities[BLOCK_SIZE];
+    for (uint64_t block = begin; block < end; block += BLOCK_SIZE) {
+      const uint64_t block_end = std::min(block + BLOCK_SIZE, end);
+      arena_.calc_hamming_similarity(bv_, block, block_end, similarities);
+      for (uint64_t slot = block; slot < block_end; ++slot) {
+        if (arena_.is_used(slot) && !test_bit(overwritten_, slot)) {
+          heap->push(make_pair(similarities[slot - block], slot2row_[slot]));
+        }
+      }
+    }
+  }
+
+ private:
+  // number of slots whose similarities are computed at once
+  static const uint64_t BLOCK_SIZE = 256;
+
+  const bit_vector& bv_;
+  const bit_vector_arena& arena_;
+  const vector<const string*>& slot2row_;
+  const vector<uint64_t>& overwritten_;
+};
+
+// Smallest number of slots scanned by one thread
+const uint64_t MIN_CHUNK_SIZE = 32768;
+
+void scan_chunk(
+    const slot_scanner* scanner,
+    vector<pfi::lang::shared_ptr<heap_type> >* heaps,
+    size_t chunk,
+    size_t begin,
+    size_t end) {
+  scanner->scan(begin, end, (*heaps)[chunk].get());
+}
+
+// Scans all slots with at most thread_num threads
+void scan_slots(
+    const slot_scanner& scanner,
+    uint64_t slot_num,
+    size_t thread_num,
+    heap_type& heap) {
+  const size_t chunk_num =
+      common::get_chunk_num(slot_num, thread_num, MIN_CHUNK_SIZE);
+  if (chunk_num <= 1) {
+    scanner.scan(0, slot_num, &heap);
+    return;
+  }
+
+  vector<pfi::lang::shared_ptr<heap_type> > heaps;
+  for (size_t i = 0; i < chunk_num; ++i) {
+    heaps.push_back(pfi::lang::shared_ptr<heap_type>(
+        new heap_type(heap.get_max_size())));
+  }
+  common::run_chunks(
+      pfi::lang::bind(&scan_chunk, &scanner, &heaps,
+                      pfi::lang::_1, pfi::lang::_2, pfi::lang::_3),
+      slot_num, chunk_num);
+  vector<score_type> scores;
+  for (size_t i = 0; i < chunk_num; ++i) {
+    heaps[i]->get_sorted(scores);
+    for (size_t j = 0; j < scores.size(); ++j) {
+      heap.push(scores[j]);
+    }
+  }
+}
+
+// Probing a row costs about this many times as much as scanning a row
+const size_t PROBE_COST = 16;
+
+// Adds rows in the index to heap until no other row can reach the top of
+// heap, probing chunks with increasing radius. Returns false when this
+// costs more than scanning all rows.
+bool probe_index(
+    const bit_vector& bv,
+    const multi_index_hash& index,
+    const slot_scanner& scanner,
+    uint64_t slot_num,
+    heap_type& heap) {
+  const double max_cost = static_cast<double>(index.size()) / PROBE_COST;
+  // bitmap of slots found
+  vector<uint64_t> found((slot_num + 63) / 64);
+  size_t found_num = 0;
+  vector<uint64_t> probed;
+  for (uint64_t r = 0; r <= index.min_chunk_bits(); ++r) {
+    if (found_num + index.get_probe_num(r)
+        + index.get_expected_probe_size(r) > max_cost) {
+      return false;
+    }
+    probed.clear();
+    index.probe(bv, r, probed);
+    for (size_t i = 0; i < probed.size(); ++i) {
+      const uint64_t slot = probed[i];
+      const uint64_t mask = 1LLU << (slot % 64);
+      if (found[slot / 64] & mask) {
+        continue;
+      }
+      found[slot / 64] |= mask;
+      ++found_num;
+      scanner.add(slot, heap);
+    }
+
+    // rows not found yet differ by more than r bits in every chunk
+    int64_t bound = static_cast<int64_t>(bv.bit_num())
+        - static_cast<int64_t>(index.chunk_num() * (r + 1));
+    if (heap.size() == heap.get_max_size()
+        && static_cast<int64_t>(heap.top().first) > bound) {
+      break;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
 void bit_index_storage::similar_row(
     const bit_vector& bv,
     vector<pair<string, float> >& ids,
@@ -156,25 +364,140 @@ void bit_index_storage::similar_row(
     return;
   }
 
+  vector<score_type> scores;
+  if (multi_index_) {
+    similar_row_indexed(bv, scores, ret_num);
+  } else {
+    similar_row_scan(bv, scores, ret_num);
+  }
+
+  for (size_t i = 0; i < scores.size() && i < ret_num; ++i) {
+    ids.push_back(make_pair(*scores[i].second,
+                            static_cast<float>(scores[i].first) / bit_num));
+  }
+}
+
+void bit_index_storage::similar_row_scan(
+    const bit_vector& bv,
+    vector<score_type>& scores,
+    uint64_t ret_num) const {
   heap_type heap(ret_num);
+  similar_row_unpacked(bv, unpacked_rows_, bitvals_diff_, heap);
+  slot_scanner scanner(bv, arena_, slot2row_, overwritten_);
+  scan_slots(scanner, arena_.slot_num(), thread_num_, heap);
+  heap.get_sorted(scores);
+}
+
+void bit_index_storage::similar_row_indexed(
+    const bit_vector& bv,
+    vector<score_type>& scores,
+    uint64_t ret_num) const {
+  if (ret_num == 0) {
+    return;
+  }
+
+  if (bv.bit_num() == index_.bit_num()) {
+    heap_type heap(ret_num);
+    similar_row_unpacked(bv, unpacked_rows_, bitvals_diff_, heap);
+    slot_scanner scanner(bv, arena_, slot2row_, overwritten_);
+    if (probe_index(bv, index_, scanner, arena_.slot_num(), heap)) {
+      heap.get_sorted(scores);
+      return;
+    }
+  }
+
+  similar_row_scan(bv, scores, ret_num);
+}
+
+void bit_index_storage::get_master_table(bit_table_t& bitvals) const {
+  bitvals = unpacked_rows_;
+  for (pfi::data::unordered_map<string, uint64_t>::const_iterator it =
+           row2slot_.begin(); it != row2slot_.end(); ++it) {
+    arena_.get(it->second, bitvals[it->first]);
+  }
+}
+
+void bit_index_storage::set_master_table(const bit_table_t& bitvals) {
+  arena_.clear();
+  pfi::data::unordered_map<string, uint64_t>().swap(row2slot_);
+  vector<const string*>().swap(slot2row_);
+  bit_table_t().swap(unpacked_rows_);
+  for (bit_table_t::const_iterator it = bitvals.begin(); it != bitvals.end();
+      ++it) {
+    put_master_row(it->first, it->second);
+  }
 
+  vector<uint64_t>().swap(overwritten_);
   for (bit_table_t::const_iterator it = bitvals_diff_.begin();
       it != bitvals_diff_.end(); ++it) {
-    similar_row_one(bv, *it, heap);
+    mark_overwritten(it->first);
   }
-  for (bit_table_t::const_iterator it = bitvals_.begin(); it != bitvals_.end();
-      ++it) {
-    if (bitvals_diff_.find(it->first) != bitvals_diff_.end()) {
-      continue;
-    }
-    similar_row_one(bv, *it, heap);
+  build_index();
+}
+
+void bit_index_storage::put_master_row(
+    const string& row,
+    const bit_vector& bv) {
+  remove_master_row(row);
+  if (!arena_.accepts(bv)) {
+    // e.g. removed rows
+    unpacked_rows_[row] = bv;
+    return;
   }
 
-  vector<pair<uint64_t, string> > scores;
-  heap.get_sorted(scores);
-  for (size_t i = 0; i < scores.size() && i < ret_num; ++i) {
-    ids.push_back(make_pair(scores[i].second,
-                            static_cast<float>(scores[i].first) / bit_num));
+  uint64_t slot = arena_.add(bv);
+  if (slot >= slot2row_.size()) {
+    slot2row_.resize(slot + 1);
+  }
+  slot2row_[slot] = &row2slot_.insert(make_pair(row, slot)).first->first;
+  if (multi_index_) {
+    index_.insert(slot, bv);
+  }
+}
+
+void bit_index_storage::remove_master_row(const string& row) {
+  pfi::data::unordered_map<string, uint64_t>::iterator it =
+      row2slot_.find(row);
+  if (it == row2slot_.end()) {
+    unpacked_rows_.erase(row);
+    return;
+  }
+
+  uint64_t slot = it->second;
+  if (multi_index_) {
+    bit_vector bv;
+    arena_.get(slot, bv);
+    index_.remove(slot, bv);
+  }
+  arena_.remove(slot);
+  slot2row_[slot] = NULL;
+  row2slot_.erase(it);
+}
+
+void bit_index_storage::mark_overwritten(const string& row) {
+  pfi::data::unordered_map<string, uint64_t>::const_iterator it =
+      row2slot_.find(row);
+  if (it == row2slot_.end()) {
+    return;
+  }
+  uint64_t slot = it->second;
+  if (slot / 64 >= overwritten_.size()) {
+    overwritten_.resize(slot / 64 + 1);
+  }
+  overwritten_[slot / 64] |= 1LLU << (slot % 64);
+}
+
+void bit_index_storage::build_index() {
+  index_.clear();
+  if (!multi_index_) {
+    return;
+  }
+  bit_vector bv;
+  for (uint64_t slot = 0; slot < arena_.slot_num(); ++slot) {
+    if (arena_.is_used(slot)) {
+      arena_.get(slot, bv);
+      index_.insert(slot, bv);
+    }
   }
 }
 
@@ -27,6 +27,8 @@
 #include "storage_type.hpp"
 #include "sparse_matrix_storage.hpp"
 #include "bit_vector.hpp"
+#include "bit_vector_arena.hpp"
+#include "multi_index_hash.hpp"
 #include "recommender_storage_base.hpp"
 
 namespace jubatus {
@@ -49,6 +51,13 @@ class bit_index_storage : public recommender_storage_base {
       uint64_t ret_num) const;
   std::string name() const;
 
+  // When enabled, similar_row looks up rows of the master table with
+  // multi-index hashing and re-ranks them exactly, instead of scanning all
+  // rows. Results are the same as the scan.
+  void set_multi_index(bool enabled);
+  // similar_row scans rows with at most thread_num threads
+  void set_thread_num(size_t thread_num);
+
   bool save(std::ostream& os);
   bool load(std::istream& is);
 
@@ -60,11 +69,52 @@ class bit_index_storage : public recommender_storage_base {
   friend class pfi::data::serialization::access;
   template <class Ar>
   void serialize(Ar& ar) {
-    ar & MEMBER(bitvals_) & MEMBER(bitvals_diff_);
+    // the master table is stored as a map to keep the format compatible
+    bit_table_t bitvals;
+    if (!ar.is_read) {
+      get_master_table(bitvals);
+    }
+    ar & NAMED_MEMBER("bitvals_", bitvals) & MEMBER(bitvals_diff_);
+    if (ar.is_read) {
+      set_master_table(bitvals);
+    }
   }
 
-  bit_table_t bitvals_;
+  void get_master_table(bit_table_t& bitvals) const;
+  void set_master_table(const bit_table_t& bitvals);
+
+  void put_master_row(const std::string& row, const bit_vector& bv);
+  void remove_master_row(const std::string& row);
+  void mark_overwritten(const std::string& row);
+
+  void similar_row_scan(
+      const bit_vector& bv,
+      std::vector<std::pair<uint64_t, const std::string*> >& scores,
+      uint64_t ret_num) const;
+  void similar_row_indexed(
+      const bit_vector& bv,
+      std::vector<std::pair<uint64_t, const std::string*> >& scores,
+      uint64_t ret_num) const;
+  void build_index();
+
+  // rows of the master table are packed in arena_ if their length is the
+  // same as the others, and are kept in unpacked_rows_ otherwise, e.g.
+  // removed rows
+  bit_vector_arena arena_;
+  pfi::data::unordered_map<std::string, uint64_t> row2slot_;
+  // keys of row2slot_ by slots
+  std::vector<const std::string*> slot2row_;
+  bit_table_t unpacked_rows_;
+
   bit_table_t bitvals_diff_;
+  // bitmap of slots overwritten by bitvals_diff_
+  std::vector<uint64_t> overwritten_;
+
+  size_t thread_num_;
+
+  // for multi-index hashing of arena_ by slots; not serialized
+  bool multi_index_;
+  multi_index_hash index_;
 };
 
 }  // namespace storage
@@ -135,5 +135,133 @@ TEST(bit_index_storage, mix) {
   EXPECT_TRUE(v == bit_vector());
 }
 
+namespace {
+
+// deterministic pseudo random numbers for tests
+class xorshift {
+ public:
+  xorshift() : x_(88172645463325252ULL) {
+  }
+
+  uint64_t next() {
+    x_ ^= x_ << 13;
+    x_ ^= x_ >> 7;
+    x_ ^= x_ << 17;
+    return x_;
+  }
+
+ private:
+  uint64_t x_;
+};
+
+// rows are noisy copies of a few centers so that some are near each other
+bit_vector make_random_vector(xorshift& rand, size_t bit_num) {
+  bit_vector v;
+  v.resize_and_clear(bit_num);
+  uint64_t center = rand.next() % 8;
+  for (size_t i = 0; i < bit_num; ++i) {
+    bool bit = (center * 0x9e3779b97f4a7c15ULL >> (i % 64)) & 1;
+    if (rand.next() % 8 == 0) {
+      bit = !bit;
+    }
+    if (bit) {
+      v.set_bit(i);
+    }
+  }
+  return v;
+}
+
+void set_random_rows(
+    xorshift& rand,
+    size_t begin,
+    size_t end,
+    bit_index_storage& s1,
+    bit_index_storage& s2) {
+  for (size_t i = begin; i < end; ++i) {
+    std::ostringstream row;
+    row << "r" << i;
+    bit_vector v = make_random_vector(rand, 80);
+    s1.set_row(row.str(), v);
+    s2.set_row(row.str(), v);
+  }
+}
+
+void mix(bit_index_storage& s) {
+  string diff;
+  s.get_diff(diff);
+  s.set_mixed_and_clear_diff(diff);
+}
+
+void expect_same_rows(
+    xorshift& rand,
+    const bit_index_storage& s1,
+    const bit_index_storage& s2) {
+  for (size_t q = 0; q < 20; ++q) {
+    bit_vector v = make_random_vector(rand, 80);
+    vector<pair<string, float> > expected, actual;
+    s1.similar_row(v, expected, 10);
+    s2.similar_row(v, actual, 10);
+    EXPECT_EQ(expected, actual);
+  }
+}
+
+}  // namespace
+
+TEST(bit_index_storage, multi_index) {
+  xorshift rand;
+  bit_index_storage s1, s2;
+  s2.set_multi_index(true);
+
+  set_random_rows(rand, 0, 500, s1, s2);
+  expect_same_rows(rand, s1, s2);
+
+  mix(s1);
+  mix(s2);
+  expect_same_rows(rand, s1, s2);
+
+  // overwrite and remove rows in the diff and the master
+  set_random_rows(rand, 400, 600, s1, s2);
+  for (size_t i = 0; i < 500; i += 7) {
+    std::ostringstream row;
+    row << "r" << i;
+    s1.remove_row(row.str());
+    s2.remove_row(row.str());
+  }
+  expect_same_rows(rand, s1, s2);
+
+  mix(s1);
+  mix(s2);
+  expect_same_rows(rand, s1, s2);
+
+  // the index is rebuilt on load
+  stringstream ss;
+  s2.save(ss);
+  bit_index_storage s3;
+  s3.set_multi_index(true);
+  s3.load(ss);
+  expect_same_rows(rand, s1, s3);
+}
+
+TEST(bit_index_storage, thread_num) {
+  xorshift rand;
+  bit_index_storage s1, s2;
+  s2.set_thread_num(4);
+
+  // enough rows to be scanned by several threads
+  set_random_rows(rand, 0, 70000, s1, s2);
+  mix(s1);
+  mix(s2);
+  expect_same_rows(rand, s1, s2);
+
+  set_random_rows(rand, 69000, 70100, s1, s2);
+  for (size_t i = 0; i < 70000; i += 3) {
+    std::ostringstream row;
+    row << "r" << i;
+    s1.remove_row(row.str());
+    s2.remove_row(row.str());
+  }
+  expect_same_rows(rand, s1, s2);
+}
+
 }  // namespace storage
 }  // namespace jubatus
@@ -46,6 +46,23 @@ void bit_vector::set_bit(uint64_t pos) {
   bits_[pos / BLOCKSIZE] |= (1LLU << (pos % BLOCKSIZE));
 }
 
+void bit_vector::set_blocks(const uint64_t* blocks, uint64_t bit_num) {
+  bit_num_ = bit_num;
+  bits_.assign(blocks, blocks + (bit_num + BLOCKSIZE - 1) / BLOCKSIZE);
+}
+
+uint64_t bit_vector::get_bits(uint64_t pos, uint64_t len) const {
+  if (len == 0) {
+    return 0;
+  }
+  const uint64_t offset = pos % BLOCKSIZE;
+  uint64_t bits = bits_[pos / BLOCKSIZE] >> offset;
+  if (offset + len > BLOCKSIZE) {
+    bits |= bits_[pos / BLOCKSIZE + 1] << (BLOCKSIZE - offset);
+  }
+  return len == BLOCKSIZE ? bits : bits & ((1LLU << len) - 1);
+}
+
 uint64_t bit_vector::calc_hamming_similarity(const bit_vector& bv) const {
   size_t bit_num, max_index;
   if (bit_num_ < bv.bit_num_) {
@@ -36,6 +36,15 @@ class bit_vector {
   void resize_and_clear(uint64_t bit_num);
   void set_bit(uint64_t pos);
   uint64_t calc_hamming_similarity(const bit_vector& bv) const;
+  // Returns len (<= 64) bits from pos as an integer whose lowest bit is
+  // the bit at pos
+  uint64_t get_bits(uint64_t pos, uint64_t len) const;
+
+  // 64-bit blocks of bits; the lowest bit of the first block is the bit at 0
+  const std::vector<uint64_t>& get_blocks() const {
+    return bits_;
+  }
+  void set_blocks(const uint64_t* blocks, uint64_t bit_num);
 
   static uint64_t pop_count(uint64_t r) {
     r = (r & 0x5555555555555555ULL) + ((r >> 1) & 0x5555555555555555ULL);
@@ -0,0 +1,208 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include "bit_vector_arena.hpp"
+
+#include <algorithm>
+#include <vector>
+#include "../common/exception.hpp"
+
+// POPCNT is used through the target attribute and selected at runtime, so
+// that binaries built for generic x86 CPUs still run everywhere.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+    && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 8))
+#define JUBATUS_STORAGE_POPCNT_DISPATCH
+#endif
+
+namespace jubatus {
+namespace storage {
+
+namespace {
+
+typedef void (*similarity_kernel_t)(
+    const uint64_t* rows,
+    uint64_t block_num,
+    uint64_t row_num,
+    const uint64_t* query,
+    uint64_t bit_num,
+    uint32_t* similarities);
+
+void calc_similarity_generic(
+    const uint64_t* rows,
+    uint64_t block_num,
+    uint64_t row_num,
+    const uint64_t* query,
+    uint64_t bit_num,
+    uint32_t* similarities) {
+  for (uint64_t i = 0; i < row_num; ++i, rows += block_num) {
+    uint64_t diff = 0;
+    for (uint64_t j = 0; j < block_num; ++j) {
+      diff += bit_vector::pop_count(rows[j] ^ query[j]);
+    }
+    similarities[i] = static_cast<uint32_t>(bit_num - diff);
+  }
+}
+
+#ifdef JUBATUS_STORAGE_POPCNT_DISPATCH
+__attribute__((target("popcnt")))
+void calc_similarity_popcnt(
+    const uint64_t* rows,
+    uint64_t block_num,
+    uint64_t row_num,
+    const uint64_t* query,
+    uint64_t bit_num,
+    uint32_t* similarities) {
+  if (block_num == 1) {
+    // the most common case, e.g. 64 hashes
+    const uint64_t q = query[0];
+    for (uint64_t i = 0; i < row_num; ++i) {
+      similarities[i] =
+          static_cast<uint32_t>(bit_num - __builtin_popcountll(rows[i] ^ q));
+    }
+    return;
+  }
+  for (uint64_t i = 0; i < row_num; ++i, rows += block_num) {
+    uint64_t diff = 0;
+    for (uint64_t j = 0; j < block_num; ++j) {
+      diff += __builtin_popcountll(rows[j] ^ query[j]);
+    }
+    similarities[i] = static_cast<uint32_t>(bit_num - diff);
+  }
+}
+#endif
+
+bool detect_pop_count() {
+#ifdef JUBATUS_STORAGE_POPCNT_DISPATCH
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("popcnt");
+#else
+  return false;
+#endif
+}
+
+const bool hardware_pop_count = detect_pop_count();
+
+similarity_kernel_t select_kernel() {
+#ifdef JUBATUS_STORAGE_POPCNT_DISPATCH
+  if (hardware_pop_count) {
+    return calc_similarity_popcnt;
+  }
+#endif
+  return calc_similarity_generic;
+}
+
+const similarity_kernel_t calc_similarity = select_kernel();
+
+}  // namespace
+
+bit_vector_arena::bit_vector_arena()
+    : bit_num_(0),
+      block_num_(0),
+      slot_num_(0),
+      size_(0) {
+}
+
+bool bit_vector_arena::accepts(const bit_vector& bv) const {
+  return bv.bit_num() > 0 && (size_ == 0 || bv.bit_num() == bit_num_);
+}
+
+uint64_t bit_vector_arena::add(const bit_vector& bv) {
+  if (!accepts(bv)) {
+    throw JUBATUS_EXCEPTION(
+        jubatus::exception::runtime_error("bit_num mismatch"));
+  }
+  if (size_ == 0 && bv.bit_num() != bit_num_) {
+    clear();
+    bit_num_ = bv.bit_num();
+    block_num_ = bv.get_blocks().size();
+  }
+
+  uint64_t slot;
+  if (free_slots_.empty()) {
+    slot = slot_num_++;
+    blocks_.insert(blocks_.end(), bv.get_blocks().begin(),
+                   bv.get_blocks().end());
+    if (slot % 64 == 0) {
+      used_.push_back(0);
+    }
+  } else {
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+    std::copy(bv.get_blocks().begin(), bv.get_blocks().end(),
+              blocks_.begin() + slot * block_num_);
+  }
+  used_[slot / 64] |= 1LLU << (slot % 64);
+  ++size_;
+  return slot;
+}
+
+void bit_vector_arena::remove(uint64_t slot) {
+  if (slot >= slot_num_ || !is_used(slot)) {
+    return;
+  }
+  std::fill(blocks_.begin() + slot * block_num_,
+            blocks_.begin() + (slot + 1) * block_num_, 0);
+  used_[slot / 64] &= ~(1LLU << (slot % 64));
+  free_slots_.push_back(slot);
+  --size_;
+}
+
+void bit_vector_arena::get(uint64_t slot, bit_vector& bv) const {
+  bv.set_blocks(get_blocks(slot), bit_num_);
+}
+
+void bit_vector_arena::clear() {
+  bit_num_ = 0;
+  block_num_ = 0;
+  slot_num_ = 0;
+  size_ = 0;
+  std::vector<uint64_t>().swap(blocks_);
+  std::vector<uint64_t>().swap(used_);
+  std::vector<uint64_t>().swap(free_slots_);
+}
+
+uint64_t bit_vector_arena::calc_hamming_similarity(
+    const bit_vector& bv,
+    uint64_t slot) const {
+  if (bv.bit_num() != bit_num_) {
+    bit_vector row;
+    get(slot, row);
+    return bv.calc_hamming_similarity(row);
+  }
+  uint32_t similarity;
+  calc_similarity(get_blocks(slot), block_num_, 1, &bv.get_blocks()[0],
+                  bit_num_, &similarity);
+  return similarity;
+}
+
+void bit_vector_arena::calc_hamming_similarity(
+    const bit_vector& bv,
+    uint64_t begin,
+    uint64_t end,
+    uint32_t* similarities) const {
+  if (begin >= end) {
+    return;
+  }
+  calc_similarity(get_blocks(begin), block_num_, end - begin,
+                  &bv.get_blocks()[0], bit_num_, similarities);
+}
+
+bool bit_vector_arena::has_hardware_pop_count() {
+  return hardware_pop_count;
+}
+
+}  // namespace storage
+}  // namespace jubatus
@@ -0,0 +1,93 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#ifndef JUBATUS_STORAGE_BIT_VECTOR_ARENA_HPP_
+#define JUBATUS_STORAGE_BIT_VECTOR_ARENA_HPP_
+
+#include <stdint.h>
+#include <vector>
+#include "bit_vector.hpp"
+
+namespace jubatus {
+namespace storage {
+
+// Bit vectors of the same length packed in one contiguous array, so that
+// they can be scanned without chasing pointers. Each vector is addressed by
+// its slot, and slots of removed vectors are reused.
+// Hamming similarities are computed with the POPCNT instruction when the
+// CPU supports it.
+class bit_vector_arena {
+ public:
+  bit_vector_arena();
+
+  // Whether bv can be added, i.e. the arena is empty or bv has bit_num()
+  // bits. Vectors of 0 bits cannot be added.
+  bool accepts(const bit_vector& bv) const;
+
+  // Returns the slot of bv
+  uint64_t add(const bit_vector& bv);
+  void remove(uint64_t slot);
+  void get(uint64_t slot, bit_vector& bv) const;
+  void clear();
+
+  bool is_used(uint64_t slot) const {
+    return (used_[slot / 64] >> (slot % 64)) & 1LLU;
+  }
+
+  // Same as bit_vector::calc_hamming_similarity for the vector in slot
+  uint64_t calc_hamming_similarity(const bit_vector& bv, uint64_t slot) const;
+  // Similarities of slots in [begin, end) to bv, which must have bit_num()
+  // bits. Results for unused slots are meaningless.
+  void calc_hamming_similarity(
+      const bit_vector& bv,
+      uint64_t begin,
+      uint64_t end,
+      uint32_t* similarities) const;
+
+  size_t size() const {
+    return size_;
+  }
+
+  // Number of slots including unused ones
+  uint64_t slot_num() const {
+    return slot_num_;
+  }
+
+  uint64_t bit_num() const {
+    return bit_num_;
+  }
+
+  static bool has_hardware_pop_count();
+
+ private:
+  const uint64_t* get_blocks(uint64_t slot) const {
+    return &blocks_[slot * block_num_];
+  }
+
+  uint64_t bit_num_;
+  uint64_t block_num_;
+  uint64_t slot_num_;
+  size_t size_;
+  std::vector<uint64_t> blocks_;
+  // bitmap of used slots
+  std::vector<uint64_t> used_;
+  std::vector<uint64_t> free_slots_;
+};
+
+}  // namespace storage
+}  // namespace jubatus
+
+#endif  // JUBATUS_STORAGE_BIT_VECTOR_ARENA_HPP_
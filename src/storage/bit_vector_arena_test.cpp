@@ -0,0 +1,122 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include <vector>
+#include <gtest/gtest.h>
+#include "bit_vector_arena.hpp"
+#include "../common/exception.hpp"
+
+using std::vector;
+
+namespace jubatus {
+namespace storage {
+
+namespace {
+
+bit_vector make_vector(uint64_t bit_num, uint64_t seed) {
+  bit_vector v;
+  v.resize_and_clear(bit_num);
+  for (uint64_t i = 0; i < bit_num; ++i) {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    if (seed >> 63) {
+      v.set_bit(i);
+    }
+  }
+  return v;
+}
+
+}  // namespace
+
+TEST(bit_vector_arena, add_and_get) {
+  bit_vector_arena arena;
+  EXPECT_EQ(0u, arena.size());
+  EXPECT_FALSE(arena.accepts(bit_vector()));
+
+  vector<bit_vector> vs;
+  for (uint64_t i = 0; i < 100; ++i) {
+    vs.push_back(make_vector(80, i));
+    EXPECT_EQ(i, arena.add(vs.back()));
+  }
+  EXPECT_EQ(100u, arena.size());
+  EXPECT_EQ(80u, arena.bit_num());
+  EXPECT_FALSE(arena.accepts(make_vector(64, 0)));
+  EXPECT_THROW(arena.add(make_vector(64, 0)),
+               jubatus::exception::runtime_error);
+
+  for (uint64_t i = 0; i < vs.size(); ++i) {
+    bit_vector v;
+    arena.get(i, v);
+    EXPECT_TRUE(vs[i] == v);
+  }
+}
+
+TEST(bit_vector_arena, remove) {
+  bit_vector_arena arena;
+  for (uint64_t i = 0; i < 100; ++i) {
+    arena.add(make_vector(64, i));
+  }
+  arena.remove(10);
+  arena.remove(70);
+  arena.remove(70);
+  EXPECT_EQ(98u, arena.size());
+  EXPECT_FALSE(arena.is_used(10));
+  EXPECT_FALSE(arena.is_used(70));
+  EXPECT_TRUE(arena.is_used(11));
+
+  // slots are reused
+  bit_vector v = make_vector(64, 1000);
+  uint64_t slot = arena.add(v);
+  EXPECT_TRUE(slot == 10 || slot == 70);
+  EXPECT_EQ(100u, arena.slot_num());
+  bit_vector w;
+  arena.get(slot, w);
+  EXPECT_TRUE(v == w);
+
+  // bit_num can change once all vectors are removed
+  arena.clear();
+  EXPECT_TRUE(arena.accepts(make_vector(32, 0)));
+  EXPECT_EQ(0u, arena.add(make_vector(32, 0)));
+  EXPECT_EQ(32u, arena.bit_num());
+}
+
+TEST(bit_vector_arena, calc_hamming_similarity) {
+  const uint64_t bit_nums[] = {1, 63, 64, 65, 200};
+  for (size_t n = 0; n < sizeof(bit_nums) / sizeof(bit_nums[0]); ++n) {
+    bit_vector_arena arena;
+    vector<bit_vector> vs;
+    for (uint64_t i = 0; i < 50; ++i) {
+      vs.push_back(make_vector(bit_nums[n], i));
+      arena.add(vs.back());
+    }
+
+    bit_vector query = make_vector(bit_nums[n], 12345);
+    vector<uint32_t> similarities(vs.size());
+    arena.calc_hamming_similarity(query, 0, vs.size(), &similarities[0]);
+    for (size_t i = 0; i < vs.size(); ++i) {
+      uint64_t expected = query.calc_hamming_similarity(vs[i]);
+      EXPECT_EQ(expected, similarities[i]);
+      EXPECT_EQ(expected, arena.calc_hamming_similarity(query, i));
+    }
+
+    // vectors of other lengths are compared in the same way as bit_vector
+    bit_vector other = make_vector(bit_nums[n] + 3, 1);
+    EXPECT_EQ(other.calc_hamming_similarity(vs[7]),
+              arena.calc_hamming_similarity(other, 7));
+  }
+}
+
+}  // namespace storage
+}  // namespace jubatus
@@ -73,5 +73,36 @@ TEST(bit_vector, calc_hamming_similarity) {
   EXPECT_EQ(77u, v1.calc_hamming_similarity(v2));
 }
 
+TEST(bit_vector, get_bits) {
+  bit_vector v;
+  v.resize_and_clear(80);
+  v.set_bit(0);
+  v.set_bit(3);
+  v.set_bit(63);
+  v.set_bit(64);
+  v.set_bit(79);
+
+  EXPECT_EQ(9u, v.get_bits(0, 4));
+  EXPECT_EQ(4u, v.get_bits(1, 3));
+  EXPECT_EQ(0u, v.get_bits(4, 16));
+  // across blocks
+  EXPECT_EQ(3u, v.get_bits(63, 2));
+  EXPECT_EQ(0x8001u, v.get_bits(64, 16));
+  EXPECT_EQ(0x8000000000000009ULL, v.get_bits(0, 64));
+}
+
+TEST(bit_vector, set_blocks) {
+  bit_vector v1;
+  v1.resize_and_clear(80);
+  v1.set_bit(3);
+  v1.set_bit(70);
+
+  bit_vector v2;
+  v2.set_blocks(&v1.get_blocks()[0], 80);
+  EXPECT_EQ(80u, v2.bit_num());
+  EXPECT_EQ(2u, v2.get_blocks().size());
+  EXPECT_TRUE(v1 == v2);
+}
+
 }  // namespace storage
 }  // namespace jubatus
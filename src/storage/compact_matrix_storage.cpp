@@ -0,0 +1,231 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include "compact_matrix_storage.hpp"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+#include "../common/exception.hpp"
+
+using std::make_pair;
+using std::pair;
+using std::string;
+using std::vector;
+
+namespace jubatus {
+namespace storage {
+
+namespace {
+
+// Unused slots are not reclaimed while the array is smaller than this
+const size_t MIN_COMPACT_SIZE = 1024;
+
+const uint64_t MAX_COLUMN_ID = 0xffffffffLLU;
+
+template <typename E>
+struct less_column {
+  bool operator()(const E& l, const E& r) const {
+    return l.column < r.column;
+  }
+};
+
+}  // namespace
+
+compact_matrix_storage::compact_matrix_storage()
+    : live_entry_num_(0) {
+}
+
+compact_matrix_storage::~compact_matrix_storage() {
+}
+
+void compact_matrix_storage::set(
+    const string& row,
+    const string& column,
+    float val) {
+  set_row(row, vector<pair<string, float> >(1, make_pair(column, val)));
+}
+
+void compact_matrix_storage::set_row(
+    const string& row,
+    const vector<pair<string, float> >& columns) {
+  vector<entry> updates(columns.size());
+  for (size_t i = 0; i < columns.size(); ++i) {
+    const uint64_t id = column2id_.get_id(columns[i].first);
+    if (id > MAX_COLUMN_ID) {
+      throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error(
+          "too many columns in compact_matrix_storage"));
+    }
+    updates[i].column = static_cast<uint32_t>(id);
+    updates[i].value = columns[i].second;
+  }
+  // the last value is used for duplicated columns
+  std::stable_sort(updates.begin(), updates.end(), less_column<entry>());
+
+  row_location& location = rows_[row];
+  const entry* current =
+      entries_.empty() ? 0 : &entries_[0] + location.offset;
+  const entry* current_end = current + location.size;
+
+  vector<entry> merged;
+  merged.reserve(location.size + updates.size());
+  for (size_t i = 0; i < updates.size(); ++i) {
+    if (i + 1 < updates.size() && updates[i].column == updates[i + 1].column) {
+      continue;
+    }
+    while (current != current_end && current->column < updates[i].column) {
+      merged.push_back(*current++);
+    }
+    if (current != current_end && current->column == updates[i].column) {
+      ++current;
+    }
+    merged.push_back(updates[i]);
+  }
+  merged.insert(merged.end(), current, current_end);
+
+  put_row(location, merged);
+  compact_if_sparse();
+}
+
+void compact_matrix_storage::get_row(
+    const string& row,
+    vector<pair<string, float> >& columns) const {
+  columns.clear();
+  row_table_t::const_iterator it = rows_.find(row);
+  if (it == rows_.end()) {
+    return;
+  }
+  const row_location& location = it->second;
+  columns.reserve(location.size);
+  for (uint32_t i = 0; i < location.size; ++i) {
+    const entry& e = entries_[location.offset + i];
+    columns.push_back(make_pair(column2id_.get_key(e.column), e.value));
+  }
+}
+
+const compact_matrix_storage::entry* compact_matrix_storage::get_row_entries(
+    const string& row,
+    size_t& size) const {
+  row_table_t::const_iterator it = rows_.find(row);
+  if (it == rows_.end() || it->second.size == 0) {
+    size = 0;
+    return NULL;
+  }
+  size = it->second.size;
+  return &entries_[it->second.offset];
+}
+
+void compact_matrix_storage::remove_row(const string& row) {
+  row_table_t::iterator it = rows_.find(row);
+  if (it == rows_.end()) {
+    return;
+  }
+  live_entry_num_ -= it->second.size;
+  rows_.erase(it);
+  compact_if_sparse();
+}
+
+void compact_matrix_storage::get_all_row_ids(vector<string>& ids) const {
+  ids.clear();
+  ids.reserve(rows_.size());
+  for (row_table_t::const_iterator it = rows_.begin(); it != rows_.end();
+      ++it) {
+    ids.push_back(it->first);
+  }
+}
+
+void compact_matrix_storage::clear() {
+  row_table_t().swap(rows_);
+  vector<entry>().swap(entries_);
+  live_entry_num_ = 0;
+  key_manager().swap(column2id_);
+}
+
+void compact_matrix_storage::get_table(tbl_t& tbl) const {
+  tbl.clear();
+  for (row_table_t::const_iterator it = rows_.begin(); it != rows_.end();
+      ++it) {
+    row_t& row = tbl[it->first];
+    for (uint32_t i = 0; i < it->second.size; ++i) {
+      const entry& e = entries_[it->second.offset + i];
+      row[e.column] = e.value;
+    }
+  }
+}
+
+void compact_matrix_storage::set_table(const tbl_t& tbl) {
+  row_table_t().swap(rows_);
+  vector<entry>().swap(entries_);
+  live_entry_num_ = 0;
+
+  vector<entry> entries;
+  for (tbl_t::const_iterator it = tbl.begin(); it != tbl.end(); ++it) {
+    entries.clear();
+    for (row_t::const_iterator jt = it->second.begin();
+        jt != it->second.end(); ++jt) {
+      if (jt->first > MAX_COLUMN_ID) {
+        throw JUBATUS_EXCEPTION(jubatus::exception::runtime_error(
+            "too many columns in compact_matrix_storage"));
+      }
+      entry e;
+      e.column = static_cast<uint32_t>(jt->first);
+      e.value = jt->second;
+      entries.push_back(e);
+    }
+    std::sort(entries.begin(), entries.end(), less_column<entry>());
+    put_row(rows_[it->first], entries);
+  }
+}
+
+void compact_matrix_storage::put_row(
+    row_location& location,
+    const vector<entry>& entries) {
+  live_entry_num_ = live_entry_num_ - location.size + entries.size();
+  if (entries.size() > location.capacity) {
+    // the old space is left unused until compact_if_sparse
+    location.offset = entries_.size();
+    location.capacity = entries.size();
+    entries_.insert(entries_.end(), entries.begin(), entries.end());
+  } else {
+    std::copy(entries.begin(), entries.end(),
+              entries_.begin() + location.offset);
+  }
+  location.size = entries.size();
+}
+
+void compact_matrix_storage::compact_if_sparse() {
+  if (entries_.size() < MIN_COMPACT_SIZE
+      || entries_.size() < 2 * live_entry_num_) {
+    return;
+  }
+
+  vector<entry> entries;
+  entries.reserve(live_entry_num_);
+  for (row_table_t::iterator it = rows_.begin(); it != rows_.end(); ++it) {
+    row_location& location = it->second;
+    const size_t offset = entries.size();
+    entries.insert(entries.end(),
+                   entries_.begin() + location.offset,
+                   entries_.begin() + location.offset + location.size);
+    location.offset = offset;
+    location.capacity = location.size;
+  }
+  entries_.swap(entries);
+}
+
+}  // namespace storage
+}  // namespace jubatus
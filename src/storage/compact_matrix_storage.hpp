@@ -0,0 +1,120 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#ifndef JUBATUS_STORAGE_COMPACT_MATRIX_STORAGE_HPP_
+#define JUBATUS_STORAGE_COMPACT_MATRIX_STORAGE_HPP_
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include <pficommon/data/serialization.h>
+#include <pficommon/data/serialization/unordered_map.h>
+#include <pficommon/data/unordered_map.h>
+#include "../common/key_manager.hpp"
+#include "storage_type.hpp"
+
+namespace jubatus {
+namespace storage {
+
+// Rows of sparse vectors, which takes much less memory than
+// sparse_matrix_storage. Columns of each row are kept sorted by their ids in
+// one contiguous array shared by all rows, and space of removed or moved
+// rows is reclaimed when it becomes larger than the space of the rows.
+// Serialized data is compatible with sparse_matrix_storage.
+class compact_matrix_storage {
+ public:
+  struct entry {
+    uint32_t column;
+    float value;
+  };
+
+  compact_matrix_storage();
+  ~compact_matrix_storage();
+
+  void set(const std::string& row, const std::string& column, float val);
+  // Overwrites given columns of the row, and keeps other columns
+  void set_row(
+      const std::string& row,
+      const std::vector<std::pair<std::string, float> >& columns);
+  void get_row(
+      const std::string& row,
+      std::vector<std::pair<std::string, float> >& columns) const;
+  // Entries of the row without copying them, which are valid until the
+  // storage is modified. Returns NULL if the row does not exist or is empty.
+  const entry* get_row_entries(const std::string& row, size_t& size) const;
+  void remove_row(const std::string& row);
+  void get_all_row_ids(std::vector<std::string>& ids) const;
+  void clear();
+
+  size_t row_num() const {
+    return rows_.size();
+  }
+
+  // Number of columns of all rows, and that of slots of the array
+  size_t entry_num() const {
+    return live_entry_num_;
+  }
+  size_t allocated_entry_num() const {
+    return entries_.size();
+  }
+
+  // Columns in entries have ids in [0, column_num())
+  size_t column_num() const {
+    return column2id_.size();
+  }
+  const std::string& get_column(uint32_t column) const {
+    return column2id_.get_key(column);
+  }
+
+ private:
+  struct row_location {
+    uint64_t offset;
+    uint32_t size;
+    uint32_t capacity;
+  };
+
+  typedef pfi::data::unordered_map<std::string, row_location> row_table_t;
+
+  friend class pfi::data::serialization::access;
+  template <class Ar>
+  void serialize(Ar& ar) {
+    tbl_t tbl;
+    if (!ar.is_read) {
+      get_table(tbl);
+    }
+    ar & NAMED_MEMBER("tbl_", tbl) & MEMBER(column2id_);
+    if (ar.is_read) {
+      set_table(tbl);
+    }
+  }
+
+  void get_table(tbl_t& tbl) const;
+  void set_table(const tbl_t& tbl);
+
+  void put_row(row_location& location, const std::vector<entry>& entries);
+  void compact_if_sparse();
+
+  row_table_t rows_;
+  std::vector<entry> entries_;
+  size_t live_entry_num_;
+  key_manager column2id_;
+};
+
+}  // namespace storage
+}  // namespace jubatus
+
+#endif  // JUBATUS_STORAGE_COMPACT_MATRIX_STORAGE_HPP_
@@ -0,0 +1,179 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <gtest/gtest.h>
+#include <pficommon/lang/cast.h>
+#include "compact_matrix_storage.hpp"
+#include "sparse_matrix_storage.hpp"
+
+using std::make_pair;
+using std::pair;
+using std::sort;
+using std::string;
+using std::stringstream;
+using std::vector;
+using pfi::lang::lexical_cast;
+
+namespace jubatus {
+namespace storage {
+
+namespace {
+
+typedef vector<pair<string, float> > columns_t;
+
+columns_t make_columns(const string& c1, float v1) {
+  return columns_t(1, make_pair(c1, v1));
+}
+
+columns_t make_columns(const string& c1, float v1, const string& c2, float v2) {
+  columns_t columns = make_columns(c1, v1);
+  columns.push_back(make_pair(c2, v2));
+  return columns;
+}
+
+}  // namespace
+
+TEST(compact_matrix_storage, empty) {
+  compact_matrix_storage s;
+  columns_t row;
+  s.get_row("row", row);
+  EXPECT_TRUE(row.empty());
+
+  vector<string> ids;
+  s.get_all_row_ids(ids);
+  EXPECT_TRUE(ids.empty());
+}
+
+TEST(compact_matrix_storage, set_row) {
+  compact_matrix_storage s;
+  s.set_row("r1", make_columns("c1", 1, "c2", 2));
+  s.set_row("r2", make_columns("c2", 4, "c3", 5));
+  // c2 is overwritten, and the last value is used for duplicated columns
+  s.set_row("r1", make_columns("c2", 3, "c4", 6));
+  s.set_row("r1", make_columns("c3", 7, "c3", 8));
+
+  columns_t row;
+  s.get_row("r1", row);
+  ASSERT_EQ(4u, row.size());
+  EXPECT_EQ(make_pair(string("c1"), 1.f), row[0]);
+  EXPECT_EQ(make_pair(string("c2"), 3.f), row[1]);
+  EXPECT_EQ(make_pair(string("c3"), 8.f), row[2]);
+  EXPECT_EQ(make_pair(string("c4"), 6.f), row[3]);
+
+  s.get_row("r2", row);
+  EXPECT_EQ(make_columns("c2", 4, "c3", 5), row);
+  EXPECT_EQ(6u, s.entry_num());
+
+  vector<string> ids;
+  s.get_all_row_ids(ids);
+  sort(ids.begin(), ids.end());
+  ASSERT_EQ(2u, ids.size());
+  EXPECT_EQ("r1", ids[0]);
+  EXPECT_EQ("r2", ids[1]);
+}
+
+TEST(compact_matrix_storage, remove_row) {
+  compact_matrix_storage s;
+  for (size_t i = 0; i < 1000; ++i) {
+    s.set_row(lexical_cast<string>(i), make_columns("c1", i, "c2", i));
+  }
+  for (size_t i = 0; i < 1000; i += 2) {
+    s.remove_row(lexical_cast<string>(i));
+  }
+  for (size_t i = 1; i < 1000; i += 4) {
+    s.set_row(lexical_cast<string>(i), make_columns("c3", i));
+  }
+  EXPECT_EQ(500u, s.row_num());
+  EXPECT_EQ(1250u, s.entry_num());
+  // unused space is reclaimed
+  EXPECT_GT(2 * s.entry_num(), s.allocated_entry_num());
+
+  columns_t row;
+  s.get_row("0", row);
+  EXPECT_TRUE(row.empty());
+  s.get_row("3", row);
+  EXPECT_EQ(make_columns("c1", 3, "c2", 3), row);
+  s.get_row("5", row);
+  ASSERT_EQ(3u, row.size());
+  EXPECT_EQ(make_pair(string("c3"), 5.f), row[2]);
+
+  s.clear();
+  EXPECT_EQ(0u, s.row_num());
+  s.get_row("3", row);
+  EXPECT_TRUE(row.empty());
+}
+
+TEST(compact_matrix_storage, get_row_entries) {
+  compact_matrix_storage s;
+  s.set_row("r1", make_columns("c2", 2, "c1", 1));
+  s.set_row("r2", make_columns("c3", 3));
+
+  size_t size;
+  EXPECT_TRUE(s.get_row_entries("r3", size) == NULL);
+  EXPECT_EQ(0u, size);
+
+  const compact_matrix_storage::entry* entries = s.get_row_entries("r1", size);
+  ASSERT_TRUE(entries != NULL);
+  ASSERT_EQ(2u, size);
+  EXPECT_EQ(3u, s.column_num());
+  EXPECT_EQ("c2", s.get_column(entries[0].column));
+  EXPECT_EQ(2.f, entries[0].value);
+  EXPECT_EQ("c1", s.get_column(entries[1].column));
+  EXPECT_EQ(1.f, entries[1].value);
+}
+
+TEST(compact_matrix_storage, compatible_with_sparse_matrix_storage) {
+  sparse_matrix_storage s1;
+  s1.set_row("r1", make_columns("c1", 1, "c2", 2));
+  s1.set_row("r2", make_columns("c2", 3));
+
+  stringstream ss1;
+  {
+    pfi::data::serialization::binary_oarchive oa(ss1);
+    oa << s1;
+  }
+  compact_matrix_storage s2;
+  {
+    pfi::data::serialization::binary_iarchive ia(ss1);
+    ia >> s2;
+  }
+  columns_t row;
+  s2.get_row("r1", row);
+  EXPECT_EQ(make_columns("c1", 1, "c2", 2), row);
+  s2.set_row("r3", make_columns("c3", 4));
+
+  stringstream ss2;
+  {
+    pfi::data::serialization::binary_oarchive oa(ss2);
+    oa << s2;
+  }
+  sparse_matrix_storage s3;
+  {
+    pfi::data::serialization::binary_iarchive ia(ss2);
+    ia >> s3;
+  }
+  EXPECT_EQ(2.f, s3.get("r1", "c2"));
+  EXPECT_EQ(3.f, s3.get("r2", "c2"));
+  EXPECT_EQ(4.f, s3.get("r3", "c3"));
+}
+
+}  // namespace storage
+}  // namespace jubatus
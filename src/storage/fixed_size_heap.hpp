@@ -66,6 +66,12 @@ class fixed_size_heap {
     return max_size_;
   }
 
+  // The element which is dropped first, i.e. the last one of get_sorted.
+  // Only available when size() == get_max_size().
+  const T& top() const {
+    return data_.front();
+  }
+
  private:
   std::vector<T> data_;
   const size_t max_size_;
@@ -78,5 +78,18 @@ TEST(fixed_size_heap, reverse) {
   EXPECT_EQ(7, v[2]);
 }
 
+TEST(fixed_size_heap, top) {
+  fixed_size_heap<int, greater<int> > h(3);
+  for (int i = 0; i < 10; ++i) {
+    h.push(i * 7 % 10);
+    if (h.size() == h.get_max_size()) {
+      vector<int> v;
+      h.get_sorted(v);
+      EXPECT_EQ(v.back(), h.top());
+    }
+  }
+  EXPECT_EQ(7, h.top());
+}
+
 }  // namespace storage
 }  // namespace jubatus
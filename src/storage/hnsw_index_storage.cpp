@@ -0,0 +1,836 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include "hnsw_index_storage.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <pficommon/concurrent/lock.h>
+#include <pficommon/concurrent/mutex.h>
+#include <pficommon/data/serialization.h>
+
+using std::greater;
+using std::istream;
+using std::istringstream;
+using std::make_pair;
+using std::ostream;
+using std::ostringstream;
+using std::pair;
+using std::priority_queue;
+using std::string;
+using std::vector;
+using pfi::concurrent::scoped_lock;
+using pfi::data::unordered_map;
+using pfi::lang::shared_ptr;
+
+namespace jubatus {
+namespace storage {
+
+// Marks of nodes visited by a search. Marks are invalidated at once by
+// changing the tag, so that a list is reused without clearing it.
+class hnsw_visited_list {
+ public:
+  hnsw_visited_list()
+      : tag_(0) {
+  }
+
+  void reset(size_t node_num) {
+    if (marks_.size() < node_num) {
+      marks_.resize(node_num, 0);
+    }
+    ++tag_;
+    if (tag_ == 0) {
+      std::fill(marks_.begin(), marks_.end(), 0);
+      tag_ = 1;
+    }
+  }
+
+  // Returns false if node is already visited
+  bool visit(uint32_t node) {
+    if (marks_[node] == tag_) {
+      return false;
+    }
+    marks_[node] = tag_;
+    return true;
+  }
+
+ private:
+  vector<uint16_t> marks_;
+  uint16_t tag_;
+};
+
+// Visited lists shared by concurrent searches
+class hnsw_visited_pool {
+ public:
+  shared_ptr<hnsw_visited_list> acquire() {
+    scoped_lock lk(mutex_);
+    if (lists_.empty()) {
+      return shared_ptr<hnsw_visited_list>(new hnsw_visited_list);
+    }
+    shared_ptr<hnsw_visited_list> list = lists_.back();
+    lists_.pop_back();
+    return list;
+  }
+
+  void release(const shared_ptr<hnsw_visited_list>& list) {
+    scoped_lock lk(mutex_);
+    lists_.push_back(list);
+  }
+
+ private:
+  pfi::concurrent::mutex mutex_;
+  vector<shared_ptr<hnsw_visited_list> > lists_;
+};
+
+namespace {
+
+const uint32_t NO_NODE = 0xffffffffu;
+const int MAX_LEVEL = 32;
+
+class visited_list_lease {
+ public:
+  visited_list_lease(hnsw_visited_pool& pool, size_t node_num)
+      : pool_(pool),
+        list_(pool.acquire()) {
+    list_->reset(node_num);
+  }
+
+  ~visited_list_lease() {
+    pool_.release(list_);
+  }
+
+  hnsw_visited_list& get() {
+    return *list_;
+  }
+
+ private:
+  hnsw_visited_pool& pool_;
+  shared_ptr<hnsw_visited_list> list_;
+};
+
+hnsw_diff_t extract_diff(const string& diff_str) {
+  istringstream iss(diff_str);
+  pfi::data::serialization::binary_iarchive bi(iss);
+  hnsw_diff_t diff;
+  bi >> diff;
+  return diff;
+}
+
+string serialize_diff(const hnsw_diff_t& diff) {
+  ostringstream oss;
+  pfi::data::serialization::binary_oarchive bo(oss);
+  bo << const_cast<hnsw_diff_t&>(diff);
+  return oss.str();
+}
+
+hnsw_row make_diff_row(const hnsw_index_storage::sparse_vector_t& vec) {
+  hnsw_row row;
+  row.columns.reserve(vec.size());
+  row.values.reserve(vec.size());
+  for (size_t i = 0; i < vec.size(); ++i) {
+    row.columns.push_back(vec[i].first);
+    row.values.push_back(vec[i].second);
+  }
+  return row;
+}
+
+hnsw_index_storage::sparse_vector_t make_vector(const hnsw_row& row) {
+  hnsw_index_storage::sparse_vector_t vec;
+  vec.reserve(row.columns.size());
+  for (size_t i = 0; i < row.columns.size() && i < row.values.size(); ++i) {
+    vec.push_back(make_pair(row.columns[i], row.values[i]));
+  }
+  return vec;
+}
+
+float calc_dot(
+    const uint64_t* xc,
+    const float* xv,
+    size_t xn,
+    const uint64_t* yc,
+    const float* yv,
+    size_t yn) {
+  float dot = 0;
+  size_t i = 0, j = 0;
+  while (i < xn && j < yn) {
+    if (xc[i] < yc[j]) {
+      ++i;
+    } else if (yc[j] < xc[i]) {
+      ++j;
+    } else {
+      dot += xv[i] * yv[j];
+      ++i;
+      ++j;
+    }
+  }
+  return dot;
+}
+
+struct is_node {
+  explicit is_node(uint32_t node)
+      : node(node) {
+  }
+
+  bool operator()(const pair<float, uint32_t>& n) const {
+    return n.second == node;
+  }
+
+  uint32_t node;
+};
+
+}  // namespace
+
+const size_t hnsw_index_storage::DEFAULT_M = 16;
+const size_t hnsw_index_storage::DEFAULT_EF_CONSTRUCTION = 100;
+
+hnsw_index_storage::hnsw_index_storage()
+    : m_(DEFAULT_M),
+      ef_construction_(DEFAULT_EF_CONSTRUCTION),
+      metric_(EUCLIDEAN),
+      seed_(0),
+      rand_(0),
+      garbage_size_(0),
+      entry_point_(NO_NODE),
+      max_level_(-1),
+      visited_pool_(new hnsw_visited_pool) {
+}
+
+hnsw_index_storage::hnsw_index_storage(
+    size_t m,
+    size_t ef_construction,
+    metric_type metric,
+    uint32_t seed)
+    : m_(m),
+      ef_construction_(ef_construction),
+      metric_(metric),
+      seed_(seed),
+      rand_(seed),
+      garbage_size_(0),
+      entry_point_(NO_NODE),
+      max_level_(-1),
+      visited_pool_(new hnsw_visited_pool) {
+}
+
+hnsw_index_storage::~hnsw_index_storage() {
+}
+
+void hnsw_index_storage::set_row(
+    const string& row,
+    const sparse_vector_t& vec) {
+  put_row(row, vec);
+  diff_[row] = make_diff_row(vec);
+}
+
+bool hnsw_index_storage::get_row(const string& row, sparse_vector_t& vec)
+    const {
+  vec.clear();
+  unordered_map<string, uint32_t>::const_iterator it = row2node_.find(row);
+  if (it == row2node_.end()) {
+    return false;
+  }
+  vector_view v = get_vector(it->second);
+  vec.reserve(v.size);
+  for (size_t i = 0; i < v.size; ++i) {
+    vec.push_back(make_pair(v.columns[i], v.values[i]));
+  }
+  return true;
+}
+
+void hnsw_index_storage::remove_row(const string& row) {
+  delete_row(row);
+  hnsw_row removed;
+  removed.removed = true;
+  diff_[row] = removed;
+}
+
+void hnsw_index_storage::clear() {
+  reset_graph();
+  hnsw_diff_t().swap(diff_);
+  rand_ = pfi::math::random::mtrand(seed_);
+}
+
+void hnsw_index_storage::get_all_row_ids(vector<string>& ids) const {
+  ids.clear();
+  ids.reserve(row2node_.size());
+  for (unordered_map<string, uint32_t>::const_iterator it = row2node_.begin();
+      it != row2node_.end(); ++it) {
+    ids.push_back(it->first);
+  }
+}
+
+void hnsw_index_storage::similar_row(
+    const sparse_vector_t& query,
+    size_t ef,
+    size_t ret_num,
+    vector<pair<string, float> >& ids) const {
+  ids.clear();
+  if (entry_point_ == NO_NODE || ret_num == 0) {
+    return;
+  }
+
+  vector<uint64_t> columns;
+  vector<float> values;
+  const vector_view q = make_view(query, columns, values);
+  uint32_t entry = entry_point_;
+  for (int level = max_level_; level > 0; --level) {
+    entry = search_upper_layer(q, entry, level);
+  }
+  vector<scored_node> entries(
+      1, make_pair(calc_distance(q, get_vector(entry)), entry));
+  vector<scored_node> found;
+  search_layer(q, entries, std::max(ef, ret_num), 0, found);
+
+  ids.reserve(std::min(ret_num, found.size()));
+  for (size_t i = 0; i < found.size() && ids.size() < ret_num; ++i) {
+    float distance = found[i].first;
+    if (metric_ == EUCLIDEAN) {
+      distance = std::sqrt(distance);
+    }
+    ids.push_back(make_pair(*node2row_[found[i].second], distance));
+  }
+}
+
+string hnsw_index_storage::name() const {
+  return "hnsw_index_storage";
+}
+
+bool hnsw_index_storage::save(ostream& os) {
+  compact_vectors();
+  pfi::data::serialization::binary_oarchive oa(os);
+  oa << *this;
+  return true;
+}
+
+bool hnsw_index_storage::load(istream& is) {
+  pfi::data::serialization::binary_iarchive ia(is);
+  ia >> *this;
+  // levels of rows added after load differ from those of the saved server,
+  // which does not matter to search
+  rand_ = pfi::math::random::mtrand(
+      seed_ + static_cast<uint32_t>(node2row_.size()));
+  return true;
+}
+
+void hnsw_index_storage::get_diff(string& diff) const {
+  diff = serialize_diff(diff_);
+}
+
+void hnsw_index_storage::set_mixed_and_clear_diff(const string& mixed_diff) {
+  const hnsw_diff_t diff = extract_diff(mixed_diff);
+  for (hnsw_diff_t::const_iterator it = diff.begin(); it != diff.end(); ++it) {
+    if (it->second.removed) {
+      delete_row(it->first);
+    } else {
+      put_row(it->first, make_vector(it->second));
+    }
+  }
+  hnsw_diff_t().swap(diff_);
+}
+
+void hnsw_index_storage::mix(const string& lhs, string& rhs) const {
+  const hnsw_diff_t diff_l = extract_diff(lhs);
+  hnsw_diff_t diff_r = extract_diff(rhs);
+  for (hnsw_diff_t::const_iterator it = diff_l.begin(); it != diff_l.end();
+      ++it) {
+    diff_r[it->first] = it->second;
+  }
+  rhs = serialize_diff(diff_r);
+}
+
+// private
+
+void hnsw_index_storage::get_node_rows(vector<string>& rows) const {
+  rows.clear();
+  rows.resize(node2row_.size());
+  for (size_t i = 0; i < node2row_.size(); ++i) {
+    if (node2row_[i]) {
+      rows[i] = *node2row_[i];
+    }
+  }
+}
+
+void hnsw_index_storage::set_node_rows(const vector<string>& rows) {
+  // removed nodes have no rows, as empty row ids are not accepted
+  unordered_map<string, uint32_t>().swap(row2node_);
+  node2row_.assign(rows.size(), 0);
+  vector<uint32_t>().swap(free_nodes_);
+  for (size_t i = 0; i < rows.size(); ++i) {
+    if (!rows[i].empty()) {
+      unordered_map<string, uint32_t>::iterator it =
+          row2node_.insert(make_pair(rows[i], static_cast<uint32_t>(i))).first;
+      node2row_[i] = &it->first;
+    } else {
+      free_nodes_.push_back(static_cast<uint32_t>(i));
+    }
+  }
+}
+
+void hnsw_index_storage::get_node_offsets(vector<uint64_t>& offsets) const {
+  offsets.clear();
+  if (offsets_.empty()) {
+    return;
+  }
+  offsets.reserve(offsets_.size() + 1);
+  offsets.insert(offsets.end(), offsets_.begin(), offsets_.end());
+  offsets.push_back(columns_.size());
+}
+
+void hnsw_index_storage::set_node_offsets(const vector<uint64_t>& offsets) {
+  offsets_.clear();
+  sizes_.clear();
+  for (size_t i = 0; i + 1 < offsets.size(); ++i) {
+    offsets_.push_back(offsets[i]);
+    sizes_.push_back(static_cast<uint32_t>(offsets[i + 1] - offsets[i]));
+  }
+  garbage_size_ = 0;
+}
+
+void hnsw_index_storage::put_row(
+    const string& row,
+    const sparse_vector_t& vec) {
+  unordered_map<string, uint32_t>::iterator it = row2node_.find(row);
+  if (it != row2node_.end()) {
+    if (has_vector(it->second, vec)) {
+      return;
+    }
+    node2row_[it->second] = 0;
+    free_nodes_.push_back(it->second);
+    row2node_.erase(it);
+  }
+
+  uint32_t node;
+  if (free_nodes_.empty()) {
+    node = add_node(vec, draw_level());
+  } else {
+    node = free_nodes_.back();
+    free_nodes_.pop_back();
+    reuse_node(node, vec);
+  }
+  it = row2node_.insert(make_pair(row, node)).first;
+  node2row_[node] = &it->first;
+  insert_node(node);
+}
+
+void hnsw_index_storage::delete_row(const string& row) {
+  unordered_map<string, uint32_t>::iterator it = row2node_.find(row);
+  if (it == row2node_.end()) {
+    return;
+  }
+  node2row_[it->second] = 0;
+  free_nodes_.push_back(it->second);
+  row2node_.erase(it);
+}
+
+void hnsw_index_storage::reset_graph() {
+  vector<uint64_t>().swap(offsets_);
+  vector<uint32_t>().swap(sizes_);
+  vector<uint64_t>().swap(columns_);
+  vector<float>().swap(values_);
+  garbage_size_ = 0;
+  vector<float>().swap(norms_);
+  vector<uint8_t>().swap(levels_);
+  vector<uint32_t>().swap(links0_);
+  unordered_map<uint32_t, upper_links_t>().swap(upper_links_);
+  entry_point_ = NO_NODE;
+  max_level_ = -1;
+  unordered_map<string, uint32_t>().swap(row2node_);
+  vector<const string*>().swap(node2row_);
+  vector<uint32_t>().swap(free_nodes_);
+}
+
+uint32_t hnsw_index_storage::add_node(const sparse_vector_t& vec, int level) {
+  const uint32_t node = static_cast<uint32_t>(node2row_.size());
+  offsets_.push_back(columns_.size());
+  sizes_.push_back(static_cast<uint32_t>(vec.size()));
+  for (size_t i = 0; i < vec.size(); ++i) {
+    columns_.push_back(vec[i].first);
+    values_.push_back(vec[i].second);
+  }
+  norms_.push_back(calc_norm(vec));
+  levels_.push_back(static_cast<uint8_t>(level));
+  links0_.resize(links0_.size() + get_max_links(0) + 1, 0);
+  if (level > 0) {
+    upper_links_[node].resize(level);
+  }
+  node2row_.push_back(0);
+  return node;
+}
+
+void hnsw_index_storage::reuse_node(
+    uint32_t node,
+    const sparse_vector_t& vec) {
+  // Former neighbors of the node are relinked among their links and those
+  // of the node, as in hnswlib. The node keeps its level and its links to
+  // route the search in insert_node, which replaces them. Other links to
+  // the node are left to route queries, as links to removed nodes are.
+  for (int level = 0; level <= levels_[node]; ++level) {
+    const pair<const uint32_t*, size_t> links = get_links(node, level);
+    const vector<uint32_t> former(links.first, links.first + links.second);
+    for (size_t i = 0; i < former.size(); ++i) {
+      relink_without(former[i], node, former, level);
+    }
+  }
+  set_vector(node, vec);
+}
+
+void hnsw_index_storage::relink_without(
+    uint32_t from,
+    uint32_t node,
+    const vector<uint32_t>& others,
+    int level) {
+  const pair<const uint32_t*, size_t> links = get_links(from, level);
+  vector<uint32_t> ids(links.first, links.first + links.second);
+  ids.insert(ids.end(), others.begin(), others.end());
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+  const vector_view v = get_vector(from);
+  vector<scored_node> candidates;
+  candidates.reserve(ids.size());
+  for (size_t i = 0; i < ids.size(); ++i) {
+    const uint32_t n = ids[i];
+    if (n != from && n != node && !is_removed(n)) {
+      candidates.push_back(make_pair(calc_distance(v, get_vector(n)), n));
+    }
+  }
+  std::sort(candidates.begin(), candidates.end());
+  vector<uint32_t> new_links;
+  select_neighbors(candidates, get_max_links(level), new_links);
+  set_links(from, level, new_links);
+}
+
+void hnsw_index_storage::set_vector(
+    uint32_t node,
+    const sparse_vector_t& vec) {
+  if (vec.size() > sizes_[node]) {
+    garbage_size_ += sizes_[node];
+    offsets_[node] = columns_.size();
+    columns_.resize(columns_.size() + vec.size());
+    values_.resize(values_.size() + vec.size());
+  } else {
+    garbage_size_ += sizes_[node] - vec.size();
+  }
+  const uint64_t begin = offsets_[node];
+  for (size_t i = 0; i < vec.size(); ++i) {
+    columns_[begin + i] = vec[i].first;
+    values_[begin + i] = vec[i].second;
+  }
+  sizes_[node] = static_cast<uint32_t>(vec.size());
+  norms_[node] = calc_norm(vec);
+
+  // copies vectors when more than half of the elements are garbage, so
+  // that the cost is amortized
+  if (garbage_size_ * 2 > columns_.size()) {
+    compact_vectors();
+  }
+}
+
+void hnsw_index_storage::compact_vectors() {
+  vector<uint64_t> columns;
+  vector<float> values;
+  columns.reserve(columns_.size() - garbage_size_);
+  values.reserve(values_.size() - garbage_size_);
+  for (size_t i = 0; i < offsets_.size(); ++i) {
+    const uint64_t begin = offsets_[i];
+    offsets_[i] = columns.size();
+    columns.insert(columns.end(), columns_.begin() + begin,
+                   columns_.begin() + begin + sizes_[i]);
+    values.insert(values.end(), values_.begin() + begin,
+                  values_.begin() + begin + sizes_[i]);
+  }
+  columns_.swap(columns);
+  values_.swap(values);
+  garbage_size_ = 0;
+}
+
+void hnsw_index_storage::insert_node(uint32_t node) {
+  const int level = levels_[node];
+  if (entry_point_ == NO_NODE) {
+    entry_point_ = node;
+    max_level_ = level;
+    return;
+  }
+
+  const vector_view q = get_vector(node);
+  uint32_t entry = entry_point_;
+  for (int l = max_level_; l > level; --l) {
+    entry = search_upper_layer(q, entry, l);
+  }
+
+  vector<scored_node> entries(
+      1, make_pair(calc_distance(q, get_vector(entry)), entry));
+  vector<scored_node> found;
+  vector<uint32_t> neighbors;
+  for (int l = std::min(level, static_cast<int>(max_level_)); l >= 0; --l) {
+    search_layer(q, entries, ef_construction_, l, found);
+    // reused nodes may be found by links to them
+    found.erase(std::remove_if(found.begin(), found.end(), is_node(node)),
+                found.end());
+    select_neighbors(found, m_, neighbors);
+    set_links(node, l, neighbors);
+    for (size_t i = 0; i < neighbors.size(); ++i) {
+      connect(neighbors[i], node, l);
+    }
+    if (!found.empty()) {
+      entries.swap(found);
+    }
+  }
+
+  if (level > max_level_) {
+    entry_point_ = node;
+    max_level_ = level;
+  }
+}
+
+int hnsw_index_storage::draw_level() {
+  // levels follow the geometric distribution with ratio 1 / m
+  const double r = 1.0 - rand_.next_double();
+  const double level = -std::log(r) / std::log(static_cast<double>(m_));
+  return std::min(static_cast<int>(level), MAX_LEVEL);
+}
+
+hnsw_index_storage::vector_view hnsw_index_storage::get_vector(
+    uint32_t node) const {
+  vector_view v;
+  const uint64_t begin = offsets_[node];
+  v.size = sizes_[node];
+  v.columns = v.size ? &columns_[begin] : 0;
+  v.values = v.size ? &values_[begin] : 0;
+  v.norm = norms_[node];
+  return v;
+}
+
+hnsw_index_storage::vector_view hnsw_index_storage::make_view(
+    const sparse_vector_t& vec,
+    vector<uint64_t>& columns,
+    vector<float>& values) {
+  columns.resize(vec.size());
+  values.resize(vec.size());
+  for (size_t i = 0; i < vec.size(); ++i) {
+    columns[i] = vec[i].first;
+    values[i] = vec[i].second;
+  }
+
+  vector_view v;
+  v.size = vec.size();
+  v.columns = v.size ? &columns[0] : 0;
+  v.values = v.size ? &values[0] : 0;
+  v.norm = calc_norm(vec);
+  return v;
+}
+
+float hnsw_index_storage::calc_norm(const sparse_vector_t& vec) {
+  float norm = 0;
+  for (size_t i = 0; i < vec.size(); ++i) {
+    norm += vec[i].second * vec[i].second;
+  }
+  return std::sqrt(norm);
+}
+
+float hnsw_index_storage::calc_distance(
+    const vector_view& x,
+    const vector_view& y) const {
+  const float dot = calc_dot(
+      x.columns, x.values, x.size, y.columns, y.values, y.size);
+  if (metric_ == COSINE) {
+    if (x.norm == 0 || y.norm == 0) {
+      return 1;
+    }
+    return 1 - dot / (x.norm * y.norm);
+  }
+  // squared distance, which is rooted only for results
+  return std::max(x.norm * x.norm + y.norm * y.norm - 2 * dot, 0.f);
+}
+
+bool hnsw_index_storage::has_vector(uint32_t node, const sparse_vector_t& vec)
+    const {
+  const vector_view v = get_vector(node);
+  if (v.size != vec.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < v.size; ++i) {
+    if (v.columns[i] != vec[i].first || v.values[i] != vec[i].second) {
+      return false;
+    }
+  }
+  return true;
+}
+
+pair<const uint32_t*, size_t> hnsw_index_storage::get_links(
+    uint32_t node,
+    int level) const {
+  if (level == 0) {
+    const uint32_t* links = &links0_[node * (get_max_links(0) + 1)];
+    return make_pair(links + 1, static_cast<size_t>(links[0]));
+  }
+  const vector<uint32_t>& links =
+      upper_links_.find(node)->second[level - 1];
+  return make_pair(links.empty() ? 0 : &links[0], links.size());
+}
+
+void hnsw_index_storage::set_links(
+    uint32_t node,
+    int level,
+    const vector<uint32_t>& links) {
+  if (level == 0) {
+    uint32_t* slots = &links0_[node * (get_max_links(0) + 1)];
+    slots[0] = static_cast<uint32_t>(links.size());
+    std::copy(links.begin(), links.end(), slots + 1);
+  } else {
+    upper_links_[node][level - 1] = links;
+  }
+}
+
+void hnsw_index_storage::connect(uint32_t from, uint32_t to, int level) {
+  const pair<const uint32_t*, size_t> links = get_links(from, level);
+  if (std::find(links.first, links.first + links.second, to)
+      != links.first + links.second) {
+    // reused nodes may be linked already
+    return;
+  }
+  const size_t max_links = get_max_links(level);
+  vector<uint32_t> new_links(links.first, links.first + links.second);
+  if (links.second < max_links) {
+    new_links.push_back(to);
+    set_links(from, level, new_links);
+    return;
+  }
+
+  // too many links: keep diverse ones among them, dropping removed nodes
+  const vector_view v = get_vector(from);
+  vector<scored_node> candidates;
+  candidates.reserve(links.second + 1);
+  candidates.push_back(make_pair(calc_distance(v, get_vector(to)), to));
+  for (size_t i = 0; i < links.second; ++i) {
+    const uint32_t n = links.first[i];
+    if (!is_removed(n)) {
+      candidates.push_back(make_pair(calc_distance(v, get_vector(n)), n));
+    }
+  }
+  std::sort(candidates.begin(), candidates.end());
+  select_neighbors(candidates, max_links, new_links);
+  set_links(from, level, new_links);
+}
+
+uint32_t hnsw_index_storage::search_upper_layer(
+    const vector_view& query,
+    uint32_t entry,
+    int level) const {
+  uint32_t current = entry;
+  float current_distance = calc_distance(query, get_vector(current));
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    const pair<const uint32_t*, size_t> links = get_links(current, level);
+    for (size_t i = 0; i < links.second; ++i) {
+      const uint32_t n = links.first[i];
+      const float d = calc_distance(query, get_vector(n));
+      if (d < current_distance) {
+        current = n;
+        current_distance = d;
+        changed = true;
+      }
+    }
+  }
+  return current;
+}
+
+void hnsw_index_storage::search_layer(
+    const vector_view& query,
+    const vector<scored_node>& entries,
+    size_t ef,
+    int level,
+    vector<scored_node>& found) const {
+  visited_list_lease lease(*visited_pool_, node2row_.size());
+  hnsw_visited_list& visited = lease.get();
+
+  // removed nodes are followed but not found
+  priority_queue<scored_node, vector<scored_node>, greater<scored_node> >
+      candidates;
+  priority_queue<scored_node> nearest;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (visited.visit(entries[i].second)) {
+      candidates.push(entries[i]);
+      if (!is_removed(entries[i].second)) {
+        nearest.push(entries[i]);
+      }
+    }
+  }
+
+  while (!candidates.empty()) {
+    const scored_node c = candidates.top();
+    if (nearest.size() >= ef && c.first > nearest.top().first) {
+      break;
+    }
+    candidates.pop();
+
+    const pair<const uint32_t*, size_t> links = get_links(c.second, level);
+    for (size_t i = 0; i < links.second; ++i) {
+      const uint32_t n = links.first[i];
+      if (!visited.visit(n)) {
+        continue;
+      }
+      const float d = calc_distance(query, get_vector(n));
+      if (nearest.size() < ef || d < nearest.top().first) {
+        candidates.push(make_pair(d, n));
+        if (!is_removed(n)) {
+          nearest.push(make_pair(d, n));
+          if (nearest.size() > ef) {
+            nearest.pop();
+          }
+        }
+      }
+    }
+  }
+
+  found.resize(nearest.size());
+  for (size_t i = found.size(); i > 0; --i) {
+    found[i - 1] = nearest.top();
+    nearest.pop();
+  }
+}
+
+void hnsw_index_storage::select_neighbors(
+    const vector<scored_node>& candidates,
+    size_t max_num,
+    vector<uint32_t>& neighbors) const {
+  // candidates closer to selected neighbors than to the node are skipped to
+  // link the node to various directions
+  neighbors.clear();
+  for (size_t i = 0; i < candidates.size() && neighbors.size() < max_num;
+      ++i) {
+    const vector_view v = get_vector(candidates[i].second);
+    bool diverse = true;
+    for (size_t j = 0; j < neighbors.size(); ++j) {
+      if (calc_distance(v, get_vector(neighbors[j])) < candidates[i].first) {
+        diverse = false;
+        break;
+      }
+    }
+    if (diverse) {
+      neighbors.push_back(candidates[i].second);
+    }
+  }
+}
+
+}  // namespace storage
+}  // namespace jubatus
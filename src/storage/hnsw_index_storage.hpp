@@ -0,0 +1,253 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#ifndef JUBATUS_STORAGE_HNSW_INDEX_STORAGE_HPP_
+#define JUBATUS_STORAGE_HNSW_INDEX_STORAGE_HPP_
+
+#include <stdint.h>
+#include <iosfwd>
+#include <string>
+#include <utility>
+#include <vector>
+#include <pficommon/data/serialization.h>
+#include <pficommon/data/serialization/unordered_map.h>
+#include <pficommon/data/unordered_map.h>
+#include <pficommon/lang/noncopyable.h>
+#include <pficommon/lang/shared_ptr.h>
+#include <pficommon/math/random.h>
+#include "recommender_storage_base.hpp"
+
+namespace jubatus {
+namespace storage {
+
+// Row of hnsw_index_storage sent by MIX. Columns are hashes of feature names
+// so that they are the same in all servers.
+struct hnsw_row {
+  hnsw_row()
+      : removed(false) {
+  }
+
+  std::vector<uint64_t> columns;
+  std::vector<float> values;
+  bool removed;
+
+  template <class Ar>
+  void serialize(Ar& ar) {
+    ar & MEMBER(columns) & MEMBER(values) & MEMBER(removed);
+  }
+};
+
+typedef pfi::data::unordered_map<std::string, hnsw_row> hnsw_diff_t;
+
+class hnsw_visited_pool;
+
+// Approximate nearest neighbor search of sparse vectors with a hierarchical
+// navigable small world graph (Malkov and Yashunin, 2016).
+// Each row is a node of the graph linked to at most m close rows in each of
+// its layers (2m in the bottom layer), and queries walk down the layers
+// greedily. Removed rows are kept in the graph to route queries, but are
+// never returned, and their nodes are reused by rows added later, so that
+// the graph is never rebuilt.
+// Rows are MIXed as vectors, and each server builds its own graph.
+// Not copyable as nodes refer to their rows in row2node_.
+class hnsw_index_storage : public recommender_storage_base,
+    pfi::lang::noncopyable {
+ public:
+  // pairs of column hashes and values sorted by columns without duplicates
+  typedef std::vector<std::pair<uint64_t, float> > sparse_vector_t;
+
+  enum metric_type {
+    EUCLIDEAN,
+    COSINE  // 1 - cosine similarity
+  };
+
+  static const size_t DEFAULT_M;
+  static const size_t DEFAULT_EF_CONSTRUCTION;
+
+  hnsw_index_storage();
+  hnsw_index_storage(
+      size_t m,
+      size_t ef_construction,
+      metric_type metric,
+      uint32_t seed);
+  virtual ~hnsw_index_storage();
+
+  void set_row(const std::string& row, const sparse_vector_t& vec);
+  // Returns false if the row does not exist
+  bool get_row(const std::string& row, sparse_vector_t& vec) const;
+  void remove_row(const std::string& row);
+  void clear();
+  void get_all_row_ids(std::vector<std::string>& ids) const;
+
+  // Returns at most ret_num rows in ascending order of their distances to
+  // query, searching ef (>= ret_num) closest rows found in the bottom layer
+  void similar_row(
+      const sparse_vector_t& query,
+      size_t ef,
+      size_t ret_num,
+      std::vector<std::pair<std::string, float> >& ids) const;
+
+  size_t size() const {
+    return row2node_.size();
+  }
+  // the number of nodes including those of removed rows
+  size_t node_num() const {
+    return node2row_.size();
+  }
+  metric_type metric() const {
+    return metric_;
+  }
+  std::string name() const;
+
+  bool save(std::ostream& os);
+  bool load(std::istream& is);
+
+  virtual void get_diff(std::string& diff) const;
+  virtual void set_mixed_and_clear_diff(const std::string& mixed_diff);
+  virtual void mix(const std::string& lhs, std::string& rhs) const;
+
+ private:
+  typedef std::pair<float, uint32_t> scored_node;
+  typedef std::vector<std::vector<uint32_t> > upper_links_t;
+
+  struct vector_view {
+    const uint64_t* columns;
+    const float* values;
+    size_t size;
+    float norm;
+  };
+
+  friend class pfi::data::serialization::access;
+  template <class Ar>
+  void serialize(Ar& ar) {
+    int32_t metric = metric_;
+    std::vector<std::string> rows;
+    // vectors of nodes are [offsets[i], offsets[i + 1]) in saved models
+    std::vector<uint64_t> offsets;
+    if (!ar.is_read) {
+      get_node_rows(rows);
+      get_node_offsets(offsets);
+    }
+    ar & MEMBER(m_) & MEMBER(ef_construction_)
+        & NAMED_MEMBER("metric_", metric) & NAMED_MEMBER("offsets_", offsets)
+        & MEMBER(columns_) & MEMBER(values_) & MEMBER(norms_)
+        & MEMBER(levels_) & MEMBER(links0_) & MEMBER(upper_links_)
+        & NAMED_MEMBER("rows_", rows) & MEMBER(entry_point_)
+        & MEMBER(max_level_) & MEMBER(diff_);
+    if (ar.is_read) {
+      metric_ = static_cast<metric_type>(metric);
+      set_node_offsets(offsets);
+      set_node_rows(rows);
+    }
+  }
+
+  void get_node_rows(std::vector<std::string>& rows) const;
+  void set_node_rows(const std::vector<std::string>& rows);
+  // vectors must be compacted
+  void get_node_offsets(std::vector<uint64_t>& offsets) const;
+  void set_node_offsets(const std::vector<uint64_t>& offsets);
+
+  void put_row(const std::string& row, const sparse_vector_t& vec);
+  void delete_row(const std::string& row);
+  void reset_graph();
+
+  uint32_t add_node(const sparse_vector_t& vec, int level);
+  void reuse_node(uint32_t node, const sparse_vector_t& vec);
+  // Replaces links of from with those to close nodes among its links and
+  // others, except for node
+  void relink_without(
+      uint32_t from,
+      uint32_t node,
+      const std::vector<uint32_t>& others,
+      int level);
+  void set_vector(uint32_t node, const sparse_vector_t& vec);
+  void compact_vectors();
+  void insert_node(uint32_t node);
+  int draw_level();
+
+  vector_view get_vector(uint32_t node) const;
+  // columns and values are buffers referred by the view
+  static vector_view make_view(
+      const sparse_vector_t& vec,
+      std::vector<uint64_t>& columns,
+      std::vector<float>& values);
+  static float calc_norm(const sparse_vector_t& vec);
+  float calc_distance(const vector_view& x, const vector_view& y) const;
+  bool has_vector(uint32_t node, const sparse_vector_t& vec) const;
+
+  bool is_removed(uint32_t node) const {
+    return node2row_[node] == 0;
+  }
+  size_t get_max_links(int level) const {
+    return level == 0 ? 2 * m_ : m_;
+  }
+  std::pair<const uint32_t*, size_t> get_links(
+      uint32_t node,
+      int level) const;
+  void set_links(uint32_t node, int level, const std::vector<uint32_t>& links);
+  void connect(uint32_t from, uint32_t to, int level);
+
+  uint32_t search_upper_layer(
+      const vector_view& query,
+      uint32_t entry,
+      int level) const;
+  void search_layer(
+      const vector_view& query,
+      const std::vector<scored_node>& entries,
+      size_t ef,
+      int level,
+      std::vector<scored_node>& found) const;
+  void select_neighbors(
+      const std::vector<scored_node>& candidates,
+      size_t max_num,
+      std::vector<uint32_t>& neighbors) const;
+
+  size_t m_;
+  size_t ef_construction_;
+  metric_type metric_;
+  uint32_t seed_;
+  pfi::math::random::mtrand rand_;
+
+  // vectors of nodes are sizes_[i] elements from offsets_[i] of columns_ and
+  // values_, which have garbage_size_ elements of no nodes
+  std::vector<uint64_t> offsets_;
+  std::vector<uint32_t> sizes_;
+  std::vector<uint64_t> columns_;
+  std::vector<float> values_;
+  size_t garbage_size_;
+  std::vector<float> norms_;
+  std::vector<uint8_t> levels_;
+  // the number of links of each node in the bottom layer followed by them
+  std::vector<uint32_t> links0_;
+  // links of nodes in layers above the bottom
+  pfi::data::unordered_map<uint32_t, upper_links_t> upper_links_;
+  uint32_t entry_point_;
+  int32_t max_level_;
+
+  pfi::data::unordered_map<std::string, uint32_t> row2node_;
+  // NULL for removed nodes
+  std::vector<const std::string*> node2row_;
+  // removed nodes to be reused
+  std::vector<uint32_t> free_nodes_;
+
+  hnsw_diff_t diff_;
+  pfi::lang::shared_ptr<hnsw_visited_pool> visited_pool_;
+};
+
+}  // namespace storage
+}  // namespace jubatus
+
+#endif  // JUBATUS_STORAGE_HNSW_INDEX_STORAGE_HPP_
@@ -0,0 +1,351 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <gtest/gtest.h>
+#include <pficommon/lang/cast.h>
+#include <pficommon/math/random.h>
+#include "hnsw_index_storage.hpp"
+
+using std::make_pair;
+using std::pair;
+using std::string;
+using std::stringstream;
+using std::vector;
+using pfi::lang::lexical_cast;
+using pfi::math::random::mtrand;
+
+namespace jubatus {
+namespace storage {
+
+namespace {
+
+typedef hnsw_index_storage::sparse_vector_t sparse_vector_t;
+
+sparse_vector_t make_random_vector(mtrand& rand) {
+  // 8 of 32 columns
+  sparse_vector_t v;
+  for (uint64_t c = 0; c < 32; ++c) {
+    if (rand.next_int(4) == 0) {
+      v.push_back(make_pair(c, static_cast<float>(rand.next_double())));
+    }
+  }
+  return v;
+}
+
+float calc_euclid_distance(const sparse_vector_t& x, const sparse_vector_t& y) {
+  vector<float> dx(32), dy(32);
+  for (size_t i = 0; i < x.size(); ++i) {
+    dx[x[i].first] = x[i].second;
+  }
+  for (size_t i = 0; i < y.size(); ++i) {
+    dy[y[i].first] = y[i].second;
+  }
+  float d = 0;
+  for (size_t i = 0; i < dx.size(); ++i) {
+    d += (dx[i] - dy[i]) * (dx[i] - dy[i]);
+  }
+  return std::sqrt(d);
+}
+
+vector<string> similar_row_ids(
+    const hnsw_index_storage& s,
+    const sparse_vector_t& query,
+    size_t ret_num) {
+  vector<pair<string, float> > res;
+  s.similar_row(query, 50, ret_num, res);
+  vector<string> ids;
+  for (size_t i = 0; i < res.size(); ++i) {
+    ids.push_back(res[i].first);
+  }
+  return ids;
+}
+
+void mix_by_itself(hnsw_index_storage& s) {
+  string diff;
+  s.get_diff(diff);
+  s.set_mixed_and_clear_diff(diff);
+}
+
+}  // namespace
+
+TEST(hnsw_index_storage, name) {
+  hnsw_index_storage s;
+  EXPECT_EQ("hnsw_index_storage", s.name());
+}
+
+TEST(hnsw_index_storage, empty_similar_row) {
+  hnsw_index_storage s;
+  vector<pair<string, float> > res;
+  s.similar_row(sparse_vector_t(1, make_pair(1, 1.f)), 10, 10, res);
+  EXPECT_TRUE(res.empty());
+}
+
+TEST(hnsw_index_storage, set_row_and_get_row) {
+  hnsw_index_storage s;
+  sparse_vector_t v;
+  v.push_back(make_pair(3, 1.f));
+  v.push_back(make_pair(7, 2.f));
+  s.set_row("r1", v);
+
+  sparse_vector_t w;
+  EXPECT_TRUE(s.get_row("r1", w));
+  EXPECT_TRUE(v == w);
+  EXPECT_FALSE(s.get_row("r2", w));
+  EXPECT_EQ(1u, s.size());
+}
+
+TEST(hnsw_index_storage, recall) {
+  hnsw_index_storage s(8, 50, hnsw_index_storage::EUCLIDEAN, 1);
+  mtrand rand(0);
+  vector<sparse_vector_t> vs;
+  for (size_t i = 0; i < 2000; ++i) {
+    vs.push_back(make_random_vector(rand));
+    s.set_row(lexical_cast<string>(i), vs.back());
+  }
+
+  size_t hit = 0;
+  for (size_t q = 0; q < 50; ++q) {
+    sparse_vector_t query = make_random_vector(rand);
+    float nearest = -1;
+    size_t nearest_id = 0;
+    for (size_t i = 0; i < vs.size(); ++i) {
+      float d = calc_euclid_distance(query, vs[i]);
+      if (nearest < 0 || d < nearest) {
+        nearest = d;
+        nearest_id = i;
+      }
+    }
+
+    vector<pair<string, float> > res;
+    s.similar_row(query, 50, 10, res);
+    ASSERT_EQ(10u, res.size());
+    for (size_t i = 1; i < res.size(); ++i) {
+      EXPECT_LE(res[i - 1].second, res[i].second);
+    }
+    if (res[0].first == lexical_cast<string>(nearest_id)) {
+      ++hit;
+      EXPECT_NEAR(nearest, res[0].second, 1e-3);
+    }
+  }
+  EXPECT_LE(45u, hit);
+}
+
+TEST(hnsw_index_storage, cosine) {
+  hnsw_index_storage s(4, 20, hnsw_index_storage::COSINE, 1);
+  sparse_vector_t v1, v2;
+  v1.push_back(make_pair(1, 1.f));
+  v2.push_back(make_pair(1, 1.f));
+  v2.push_back(make_pair(2, 1.f));
+  s.set_row("r1", v1);
+  s.set_row("r2", v2);
+  s.set_row("r3", sparse_vector_t());
+
+  // lengths do not matter
+  sparse_vector_t query(1, make_pair(1, 5.f));
+  vector<pair<string, float> > res;
+  s.similar_row(query, 10, 3, res);
+  ASSERT_EQ(3u, res.size());
+  EXPECT_EQ("r1", res[0].first);
+  EXPECT_NEAR(0.f, res[0].second, 1e-6);
+  EXPECT_EQ("r2", res[1].first);
+  EXPECT_NEAR(1 - std::sqrt(0.5), res[1].second, 1e-6);
+  EXPECT_EQ("r3", res[2].first);
+  EXPECT_FLOAT_EQ(1.f, res[2].second);
+}
+
+TEST(hnsw_index_storage, remove_and_update_row) {
+  hnsw_index_storage s(4, 20, hnsw_index_storage::EUCLIDEAN, 1);
+  mtrand rand(0);
+  for (size_t i = 0; i < 100; ++i) {
+    s.set_row(lexical_cast<string>(i), make_random_vector(rand));
+  }
+  sparse_vector_t v = make_random_vector(rand);
+  s.set_row("x", v);
+  EXPECT_EQ("x", similar_row_ids(s, v, 1)[0]);
+
+  s.remove_row("x");
+  s.remove_row("unknown");
+  EXPECT_EQ(100u, s.size());
+  vector<string> ids = similar_row_ids(s, v, 100);
+  EXPECT_EQ(100u, ids.size());
+  EXPECT_TRUE(std::find(ids.begin(), ids.end(), "x") == ids.end());
+
+  // updated rows are found by new vectors only
+  s.set_row("0", v);
+  EXPECT_EQ("0", similar_row_ids(s, v, 1)[0]);
+  EXPECT_EQ(100u, similar_row_ids(s, v, 200).size());
+
+  vector<string> all;
+  s.get_all_row_ids(all);
+  EXPECT_EQ(100u, all.size());
+
+  s.clear();
+  EXPECT_EQ(0u, s.size());
+  EXPECT_TRUE(similar_row_ids(s, v, 1).empty());
+}
+
+TEST(hnsw_index_storage, remove_many_rows) {
+  hnsw_index_storage s(4, 20, hnsw_index_storage::EUCLIDEAN, 1);
+  mtrand rand(0);
+  vector<sparse_vector_t> vs;
+  for (size_t i = 0; i < 2000; ++i) {
+    vs.push_back(make_random_vector(rand));
+    s.set_row(lexical_cast<string>(i), vs.back());
+  }
+  // removed rows still route queries
+  for (size_t i = 0; i < 1900; ++i) {
+    s.remove_row(lexical_cast<string>(i));
+  }
+  EXPECT_EQ(100u, s.size());
+  for (size_t i = 1900; i < 2000; ++i) {
+    EXPECT_EQ(lexical_cast<string>(i), similar_row_ids(s, vs[i], 1)[0]);
+  }
+  EXPECT_EQ(100u, similar_row_ids(s, vs[0], 200).size());
+}
+
+TEST(hnsw_index_storage, reuse_removed_nodes) {
+  hnsw_index_storage s(4, 20, hnsw_index_storage::EUCLIDEAN, 1);
+  mtrand rand(0);
+  vector<sparse_vector_t> vs;
+  for (size_t i = 0; i < 200; ++i) {
+    vs.push_back(make_random_vector(rand));
+    s.set_row(lexical_cast<string>(i), vs.back());
+  }
+
+  // updated and new rows take nodes of removed rows
+  for (size_t t = 0; t < 5; ++t) {
+    for (size_t i = 0; i < 200; i += 2) {
+      vs[i] = make_random_vector(rand);
+      s.set_row(lexical_cast<string>(i), vs[i]);
+    }
+    for (size_t i = 1; i < 200; i += 2) {
+      s.remove_row(lexical_cast<string>(i));
+      vs[i] = make_random_vector(rand);
+      s.set_row(lexical_cast<string>(i), vs[i]);
+    }
+  }
+  EXPECT_EQ(200u, s.size());
+  EXPECT_EQ(200u, s.node_num());
+
+  size_t found = 0;
+  for (size_t i = 0; i < 200; ++i) {
+    sparse_vector_t v;
+    ASSERT_TRUE(s.get_row(lexical_cast<string>(i), v));
+    EXPECT_TRUE(vs[i] == v);
+    if (similar_row_ids(s, vs[i], 1)[0] == lexical_cast<string>(i)) {
+      ++found;
+    }
+  }
+  EXPECT_LE(180u, found);
+
+  stringstream ss;
+  s.save(ss);
+  hnsw_index_storage s2;
+  s2.load(ss);
+  for (size_t i = 0; i < 200; ++i) {
+    sparse_vector_t v;
+    ASSERT_TRUE(s2.get_row(lexical_cast<string>(i), v));
+    EXPECT_TRUE(vs[i] == v);
+  }
+}
+
+TEST(hnsw_index_storage, mix) {
+  hnsw_index_storage s1, s2, s3;
+  sparse_vector_t v1(1, make_pair(1, 1.f));
+  sparse_vector_t v2(1, make_pair(2, 1.f));
+  sparse_vector_t v3(1, make_pair(3, 1.f));
+  s1.set_row("r1", v1);
+  s1.set_row("r2", v2);
+  mix_by_itself(s1);
+  s2.set_row("r1", v1);
+  s2.set_row("r2", v2);
+  mix_by_itself(s2);
+  s3.set_row("r1", v1);
+  s3.set_row("r2", v2);
+  mix_by_itself(s3);
+
+  s1.set_row("r1", v3);
+  s2.remove_row("r2");
+  s3.set_row("r3", v3);
+
+  string d1, d2, d3;
+  s1.get_diff(d1);
+  s2.get_diff(d2);
+  s3.get_diff(d3);
+  s1.mix(d1, d2);
+  s1.mix(d2, d3);
+  s1.set_mixed_and_clear_diff(d3);
+  s2.set_mixed_and_clear_diff(d3);
+  s3.set_mixed_and_clear_diff(d3);
+
+  hnsw_index_storage* ss[] = {&s1, &s2, &s3};
+  for (size_t i = 0; i < 3; ++i) {
+    vector<string> ids;
+    ss[i]->get_all_row_ids(ids);
+    std::sort(ids.begin(), ids.end());
+    ASSERT_EQ(2u, ids.size());
+    EXPECT_EQ("r1", ids[0]);
+    EXPECT_EQ("r3", ids[1]);
+    sparse_vector_t v;
+    ss[i]->get_row("r1", v);
+    EXPECT_TRUE(v3 == v);
+
+    string diff;
+    ss[i]->get_diff(diff);
+    hnsw_index_storage empty;
+    string empty_diff;
+    empty.get_diff(empty_diff);
+    EXPECT_EQ(empty_diff, diff);
+  }
+}
+
+TEST(hnsw_index_storage, save_and_load) {
+  hnsw_index_storage s(4, 20, hnsw_index_storage::COSINE, 1);
+  mtrand rand(0);
+  vector<sparse_vector_t> vs;
+  for (size_t i = 0; i < 200; ++i) {
+    vs.push_back(make_random_vector(rand));
+    s.set_row(lexical_cast<string>(i), vs.back());
+  }
+  s.remove_row("0");
+
+  stringstream ss;
+  s.save(ss);
+  hnsw_index_storage s2;
+  s2.load(ss);
+  EXPECT_EQ(hnsw_index_storage::COSINE, s2.metric());
+  EXPECT_EQ(199u, s2.size());
+
+  vector<pair<string, float> > res1, res2;
+  s.similar_row(vs[5], 20, 10, res1);
+  s2.similar_row(vs[5], 20, 10, res2);
+  EXPECT_TRUE(res1 == res2);
+  sparse_vector_t v;
+  EXPECT_FALSE(s2.get_row("0", v));
+
+  // rows are added to the loaded graph
+  s2.set_row("x", vs[0]);
+  EXPECT_EQ("x", similar_row_ids(s2, vs[0], 1)[0]);
+}
+
+}  // namespace storage
+}  // namespace jubatus
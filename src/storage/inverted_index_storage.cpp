@@ -17,11 +17,15 @@
 #include "inverted_index_storage.hpp"
 #include <algorithm>
 #include <cmath>
+#include <functional>
+#include <limits>
 #include <sstream>
 #include <string>
 #include <utility>
 #include <vector>
+#include <pficommon/concurrent/lock.h>
 
+using pfi::concurrent::scoped_lock;
 using std::istringstream;
 using std::make_pair;
 using std::ostringstream;
@@ -45,6 +49,13 @@ static void convert_diff(
   diff = os.str();
 }
 
+namespace {
+
+// When more columns than this became unbounded, all row bounds are reset
+const size_t MAX_UNBOUNDED_COLUMNS = 1024;
+
+}  // namespace
+
 static void revert_diff(
     const string& diff,
     sparse_matrix_storage& storage,
@@ -55,7 +66,9 @@ static void revert_diff(
   bi >> norm;
 }
 
-inverted_index_storage::inverted_index_storage() {
+inverted_index_storage::inverted_index_storage()
+    : quantize_values_(false),
+      topk_pruning_(false) {
 }
 
 inverted_index_storage::~inverted_index_storage() {
@@ -71,10 +84,22 @@ void inverted_index_storage::set(
     column_id = column2id_.get_id(column);
   } else {
     float cur_val = get(row, column);
-    column2norm_diff_[column_id] -= cur_val * cur_val;
+    add_column_norm_diff(column_id, -cur_val * cur_val);
+    if (topk_pruning_ && val * val < cur_val * cur_val) {
+      unbounded_columns_.insert(column_id);
+    }
   }
   inv_diff_[row][column_id] = val;
-  column2norm_diff_[column_id] += val * val;
+  add_column_norm_diff(column_id, val * val);
+
+  if (topk_pruning_) {
+    if (unbounded_columns_.size() > MAX_UNBOUNDED_COLUMNS) {
+      reset_row_bounds();
+    } else {
+      scoped_lock lk(row_bounds_mutex_);
+      row_bounds_.erase(row);
+    }
+  }
 }
 
 float inverted_index_storage::get(
@@ -91,10 +116,10 @@ float inverted_index_storage::get(
       return ret;
     }
   }
-  {
-    bool exist = false;
-    float ret = get_from_tbl(row, column_id, inv_, exist);
-    if (exist) {
+  inv_t::const_iterator it = inv_.find(row);
+  if (it != inv_.end()) {
+    float ret;
+    if (it->second.find(column_id, ret)) {
       return ret;
     }
   }
@@ -112,7 +137,7 @@ float inverted_index_storage::get_from_tbl(
     return 0.f;
   }
   tbl_t::const_iterator it = tbl.find(row);
-  if (it == inv_.end()) {
+  if (it == tbl.end()) {
     return 0.f;
   } else {
     row_t::const_iterator it_row = it->second.find(column_id);
@@ -132,24 +157,31 @@ void inverted_index_storage::remove(
 }
 
 void inverted_index_storage::clear() {
-  tbl_t().swap(inv_);
+  inv_t().swap(inv_);
   tbl_t().swap(inv_diff_);
-  imap_float_t().swap(column2norm_);
-  imap_float_t().swap(column2norm_diff_);
+  vector<float>().swap(column2norm_);
+  vector<float>().swap(column2norm_diff_);
+  vector<uint64_t>().swap(column2norm_dirty_);
+  vector<uint32_t>().swap(column2entry_num_);
   key_manager().swap(column2id_);
+  reset_row_bounds();
+}
+
+void inverted_index_storage::set_topk_pruning(bool enabled) {
+  topk_pruning_ = enabled;
+  reset_row_bounds();
+}
+
+void inverted_index_storage::set_quantize_values(bool enabled) {
+  quantize_values_ = enabled;
 }
 
 void inverted_index_storage::get_all_column_ids(
     std::vector<std::string>& ids) const {
   ids.clear();
-  for (imap_float_t::const_iterator it = column2norm_.begin();
-      it != column2norm_.end(); ++it) {
-    ids.push_back(column2id_.get_key(it->first));
-  }
-  for (imap_float_t::const_iterator it = column2norm_diff_.begin();
-      it != column2norm_diff_.end(); ++it) {
-    if (column2norm_.find(it->first) == column2norm_.end()) {
-      ids.push_back(column2id_.get_key(it->first));
+  for (size_t i = 0; i < column2norm_.size(); ++i) {
+    if (column2norm_[i] != 0.f || has_column_norm_diff(i)) {
+      ids.push_back(column2id_.get_key(i));
     }
   }
 }
@@ -167,9 +199,16 @@ void inverted_index_storage::get_diff(std::string& diff_str) const {
   }
 
   map_float_t column2norm_diff;
-  for (imap_float_t::const_iterator it = column2norm_diff_.begin();
-      it != column2norm_diff_.end(); ++it) {
-    column2norm_diff[column2id_.get_key(it->first)] = it->second;
+  for (size_t i = 0; i < column2norm_dirty_.size(); ++i) {
+    if (column2norm_dirty_[i] == 0) {
+      continue;
+    }
+    for (uint64_t column_id = i * 64; column_id < (i + 1) * 64; ++column_id) {
+      if (has_column_norm_diff(column_id)) {
+        column2norm_diff[column2id_.get_key(column_id)] =
+            column2norm_diff_[column_id];
+      }
+    }
   }
   convert_diff(diff, column2norm_diff, diff_str);
 }
@@ -185,29 +224,46 @@ void inverted_index_storage::set_mixed_and_clear_diff(
   mixed_inv.get_all_row_ids(ids);
   for (size_t i = 0; i < ids.size(); ++i) {
     const string& row = ids[i];
-    row_t& v = inv_[row];
+    posting_list& v = inv_[row];
     vector<pair<string, float> > columns;
     mixed_inv.get_row(row, columns);
     for (size_t j = 0; j < columns.size(); ++j) {
       size_t id = column2id_.get_id(columns[j].first);
-      if (columns[j].second == 0.f) {
-        v.erase(id);
-      } else {
-        v[id] = columns[j].second;
+      float cur_val;
+      if (v.find(id, cur_val)) {
+        add_column_entry_num(id, -1);
       }
+      v.set(id, columns[j].second);
+      if (columns[j].second != 0.f) {
+        add_column_entry_num(id, 1);
+      }
+    }
+    if (v.empty()) {
+      inv_.erase(row);
+    } else if (v.needs_compaction()) {
+      compact_posting_list(v);
     }
   }
   inv_diff_.clear();
 
+  std::fill(column2norm_diff_.begin(), column2norm_diff_.end(), 0.f);
+  std::fill(column2norm_dirty_.begin(), column2norm_dirty_.end(), 0);
   for (map_float_t::const_iterator it = mixed_column2norm.begin();
       it != mixed_column2norm.end(); ++it) {
     uint64_t column_index = column2id_.get_id(it->first);
-    column2norm_[column_index] += it->second;
-    if (column2norm_[column_index] == 0.f) {
-      column2norm_.erase(column_index);
+    if (column_index >= column2norm_.size()) {
+      column2norm_.resize(column_index + 1, 0.f);
+    }
+    float& norm = column2norm_[column_index];
+    norm += it->second;
+    if (column_index >= column2entry_num_.size()
+        || column2entry_num_[column_index] == 0) {
+      // rounding errors are left in norms of columns whose values are all
+      // removed
+      norm = 0.f;
     }
   }
-  column2norm_diff_.clear();
+  reset_row_bounds();
 }
 
 void inverted_index_storage::mix(const string& lhs, string& rhs) const {
@@ -236,6 +292,118 @@ void inverted_index_storage::mix(const string& lhs, string& rhs) const {
   convert_diff(rhs_inv_diff, rhs_column2norm_diff, rhs);
 }
 
+void inverted_index_storage::get_inv_table(tbl_t& inv) const {
+  inv.clear();
+  for (inv_t::const_iterator it = inv_.begin(); it != inv_.end(); ++it) {
+    row_t& row = inv[it->first];
+    for (posting_list::const_iterator it_row = it->second.begin();
+         !it_row.is_end(); it_row.next()) {
+      row[it_row.id()] = it_row.value();
+    }
+  }
+}
+
+void inverted_index_storage::set_inv_table(const tbl_t& inv) {
+  inv_t().swap(inv_);
+  vector<uint32_t>().swap(column2entry_num_);
+  for (tbl_t::const_iterator it = inv.begin(); it != inv.end(); ++it) {
+    posting_list& v = inv_[it->first];
+    for (row_t::const_iterator it_row = it->second.begin();
+         it_row != it->second.end(); ++it_row) {
+      v.set(it_row->first, it_row->second);
+    }
+    compact_posting_list(v);
+    for (posting_list::const_iterator it_row = v.begin(); !it_row.is_end();
+         it_row.next()) {
+      add_column_entry_num(it_row.id(), 1);
+    }
+  }
+}
+
+void inverted_index_storage::compact_posting_list(posting_list& list) {
+  if (!quantize_values_) {
+    list.compact(false);
+    return;
+  }
+
+  // Quantization changes values, so norms of their columns are corrected
+  // to be the sums of the stored values. Otherwise set, which subtracts the
+  // square of the stored value, leaves errors in the norms.
+  posting_list::entries_t before, after;
+  list.get_all(before);
+  list.compact(true);
+  list.get_all(after);
+  for (size_t i = 0; i < after.size(); ++i) {
+    const uint64_t column_id = after[i].first;
+    const float diff = after[i].second * after[i].second
+        - before[i].second * before[i].second;
+    if (diff == 0.f) {
+      continue;
+    }
+    if (column_id >= column2norm_.size()) {
+      column2norm_.resize(column_id + 1, 0.f);
+    }
+    column2norm_[column_id] += diff;
+  }
+}
+
+void inverted_index_storage::get_norm_maps(
+    imap_float_t& column2norm,
+    imap_float_t& column2norm_diff) const {
+  column2norm.clear();
+  column2norm_diff.clear();
+  for (size_t i = 0; i < column2norm_.size(); ++i) {
+    if (column2norm_[i] != 0.f) {
+      column2norm[i] = column2norm_[i];
+    }
+    if (has_column_norm_diff(i)) {
+      column2norm_diff[i] = column2norm_diff_[i];
+    }
+  }
+}
+
+void inverted_index_storage::set_norm_maps(
+    const imap_float_t& column2norm,
+    const imap_float_t& column2norm_diff) {
+  vector<float>().swap(column2norm_);
+  vector<float>().swap(column2norm_diff_);
+  vector<uint64_t>().swap(column2norm_dirty_);
+  for (imap_float_t::const_iterator it = column2norm.begin();
+       it != column2norm.end(); ++it) {
+    if (it->first >= column2norm_.size()) {
+      column2norm_.resize(it->first + 1, 0.f);
+    }
+    column2norm_[it->first] = it->second;
+  }
+  for (imap_float_t::const_iterator it = column2norm_diff.begin();
+       it != column2norm_diff.end(); ++it) {
+    add_column_norm_diff(it->first, it->second);
+  }
+}
+
+void inverted_index_storage::add_column_norm_diff(
+    uint64_t column_id,
+    float diff) {
+  if (column_id >= column2norm_.size()) {
+    column2norm_.resize(column_id + 1, 0.f);
+  }
+  if (column2norm_diff_.size() < column2norm_.size()) {
+    column2norm_diff_.resize(column2norm_.size(), 0.f);
+    column2norm_dirty_.resize((column2norm_.size() + 63) / 64, 0);
+  }
+  column2norm_diff_[column_id] += diff;
+  column2norm_dirty_[column_id / 64] |= 1ULL << (column_id % 64);
+}
+
+void inverted_index_storage::add_column_entry_num(
+    uint64_t column_id,
+    int diff) {
+  if (column_id >= column2entry_num_.size()) {
+    column2entry_num_.resize(column_id + 1, 0);
+  }
+  column2entry_num_[column_id] += diff;
+}
+
 bool inverted_index_storage::save(std::ostream& os) {
   pfi::data::serialization::binary_oarchive oa(os);
   oa << *this;
@@ -256,14 +424,37 @@ void inverted_index_storage::calc_scores(
   if (query_norm == 0.f) {
     return;
   }
+
+  vector<pair<float, uint64_t> > sorted_scores;
+  if (topk_pruning_) {
+    calc_scores_topk(query, query_norm, ret_num, sorted_scores);
+  } else {
+    calc_scores_exhaustive(query, query_norm, sorted_scores);
+  }
+  for (size_t i = 0; i < sorted_scores.size() && i < ret_num; ++i) {
+    scores.push_back(
+        make_pair(column2id_.get_key(sorted_scores[i].second),
+                  sorted_scores[i].first));
+  }
+}
+
+void inverted_index_storage::calc_scores_exhaustive(
+    const sfv_t& query,
+    float query_norm,
+    vector<pair<float, uint64_t> >& sorted_scores) const {
   pfi::data::unordered_map<uint64_t, float> i_scores;
   for (size_t i = 0; i < query.size(); ++i) {
     const string& fid = query[i].first;
     float val = query[i].second;
     add_inp_scores(fid, val, i_scores);
   }
+  sort_scores(i_scores, query_norm, sorted_scores);
+}
 
-  vector<pair<float, uint64_t> > sorted_scores;
+void inverted_index_storage::sort_scores(
+    const pfi::data::unordered_map<uint64_t, float>& i_scores,
+    float query_norm,
+    vector<pair<float, uint64_t> >& sorted_scores) const {
   for (pfi::data::unordered_map<uint64_t, float>::const_iterator it = i_scores
       .begin(); it != i_scores.end(); ++it) {
     float norm = calc_columnl2norm(it->first);
@@ -271,11 +462,299 @@ void inverted_index_storage::calc_scores(
     sorted_scores.push_back(make_pair(normed_score, it->first));
   }
   sort(sorted_scores.rbegin(), sorted_scores.rend());
-  for (size_t i = 0; i < sorted_scores.size() && i < ret_num; ++i) {
-    scores.push_back(
-        make_pair(column2id_.get_key(sorted_scores[i].second),
-                  sorted_scores[i].first));
+}
+
+void inverted_index_storage::calc_scores_many(
+    const vector<const sfv_t*>& queries,
+    vector<vector<pair<string, float> > >& scores,
+    size_t ret_num) const {
+  scores.clear();
+  scores.resize(queries.size());
+  if (topk_pruning_) {
+    // columns are pruned with the threshold of each query
+    for (size_t i = 0; i < queries.size(); ++i) {
+      calc_scores(*queries[i], scores[i], ret_num);
+    }
+    return;
+  }
+
+  // queries which have each row
+  typedef pfi::data::unordered_map<string, vector<pair<size_t, float> > >
+      row_queries_t;
+  row_queries_t row_queries;
+  vector<float> query_norms(queries.size());
+  for (size_t i = 0; i < queries.size(); ++i) {
+    query_norms[i] = calc_l2norm(*queries[i]);
+    if (query_norms[i] == 0.f) {
+      continue;
+    }
+    const sfv_t& query = *queries[i];
+    for (size_t j = 0; j < query.size(); ++j) {
+      row_queries[query[j].first].push_back(make_pair(i, query[j].second));
+    }
   }
+
+  vector<pfi::data::unordered_map<uint64_t, float> > i_scores(queries.size());
+  posting_list::entries_t postings;
+  for (row_queries_t::const_iterator it = row_queries.begin();
+       it != row_queries.end(); ++it) {
+    tbl_t::const_iterator it_diff = inv_diff_.find(it->first);
+    inv_t::const_iterator it_master = inv_.find(it->first);
+    get_postings(it_diff != inv_diff_.end() ? &it_diff->second : NULL,
+                 it_master != inv_.end() ? &it_master->second : NULL,
+                 postings);
+    const vector<pair<size_t, float> >& qs = it->second;
+    for (size_t j = 0; j < qs.size(); ++j) {
+      pfi::data::unordered_map<uint64_t, float>& s = i_scores[qs[j].first];
+      const float val = qs[j].second;
+      for (size_t k = 0; k < postings.size(); ++k) {
+        s[postings[k].first] += postings[k].second * val;
+      }
+    }
+  }
+
+  vector<pair<float, uint64_t> > sorted_scores;
+  for (size_t i = 0; i < queries.size(); ++i) {
+    if (query_norms[i] == 0.f) {
+      continue;
+    }
+    sorted_scores.clear();
+    sort_scores(i_scores[i], query_norms[i], sorted_scores);
+    for (size_t j = 0; j < sorted_scores.size() && j < ret_num; ++j) {
+      scores[i].push_back(
+          make_pair(column2id_.get_key(sorted_scores[j].second),
+                    sorted_scores[j].first));
+    }
+  }
+}
+
+struct inverted_index_storage::query_term {
+  float val;
+  // upper bound of |val * value / column norm| in this row
+  float bound;
+  const row_t* diff;
+  const posting_list* master;
+
+  bool operator<(const query_term& t) const {
+    return bound > t.bound;
+  }
+
+  bool find(uint64_t column_id, float& value) const {
+    if (diff) {
+      row_t::const_iterator it = diff->find(column_id);
+      if (it != diff->end()) {
+        value = it->second;
+        return true;
+      }
+    }
+    return master && master->find(column_id, value);
+  }
+};
+
+namespace {
+
+struct candidate {
+  float score;
+  float norm;
+};
+
+typedef pfi::data::unordered_map<uint64_t, candidate> candidates_t;
+
+// Returns the k-th largest value of v, destroying the order of v
+float kth_largest(vector<float>& v, size_t k) {
+  std::nth_element(v.begin(), v.begin() + (k - 1), v.end(),
+                   std::greater<float>());
+  return v[k - 1];
+}
+
+}  // namespace
+
+void inverted_index_storage::calc_scores_topk(
+    const sfv_t& query,
+    float query_norm,
+    size_t ret_num,
+    vector<pair<float, uint64_t> >& sorted_scores) const {
+  if (ret_num == 0) {
+    return;
+  }
+
+  vector<query_term> terms;
+  for (size_t i = 0; i < query.size(); ++i) {
+    if (query[i].second == 0.f) {
+      continue;
+    }
+    query_term t;
+    t.val = query[i].second;
+    tbl_t::const_iterator it_diff = inv_diff_.find(query[i].first);
+    t.diff = it_diff != inv_diff_.end() ? &it_diff->second : NULL;
+    inv_t::const_iterator it = inv_.find(query[i].first);
+    t.master = it != inv_.end() ? &it->second : NULL;
+    if (!t.diff && !t.master) {
+      continue;
+    }
+    t.bound = std::fabs(t.val) * get_row_bound(query[i].first);
+    terms.push_back(t);
+  }
+  std::sort(terms.begin(), terms.end());
+
+  // rest_bounds[j]: upper bound of scores from terms[j], terms[j + 1], ...
+  vector<float> rest_bounds(terms.size() + 1, 0.f);
+  for (size_t j = terms.size(); j > 0; --j) {
+    rest_bounds[j - 1] = rest_bounds[j] + terms[j - 1].bound;
+  }
+
+  // unbounded columns are scored exactly in advance
+  vector<pair<float, uint64_t> > exact_scores;
+  for (pfi::data::unordered_set<uint64_t>::const_iterator it =
+           unbounded_columns_.begin(); it != unbounded_columns_.end(); ++it) {
+    float norm = calc_columnl2norm(*it);
+    if (norm == 0.f) {
+      continue;
+    }
+    float score = 0.f;
+    bool found = false;
+    for (size_t j = 0; j < terms.size(); ++j) {
+      float value;
+      if (terms[j].find(*it, value)) {
+        score += terms[j].val * value / norm;
+        found = true;
+      }
+    }
+    if (found) {
+      exact_scores.push_back(make_pair(score, *it));
+    }
+  }
+
+  candidates_t candidates;
+  float threshold = -std::numeric_limits<float>::infinity();
+  vector<float> lower_bounds;
+  posting_list::entries_t postings;
+  for (size_t j = 0; j < terms.size(); ++j) {
+    const query_term& t = terms[j];
+    if (rest_bounds[j] >= threshold) {
+      // columns which do not appear in previous terms can still reach
+      // the top ret_num; scan all columns in this row
+      get_postings(t.diff, t.master, postings);
+      for (size_t k = 0; k < postings.size(); ++k) {
+        const uint64_t column_id = postings[k].first;
+        if (unbounded_columns_.count(column_id)) {
+          continue;
+        }
+        candidates_t::iterator c = candidates.find(column_id);
+        if (c == candidates.end()) {
+          candidate new_c;
+          new_c.score = 0.f;
+          new_c.norm = calc_columnl2norm(column_id);
+          if (new_c.norm == 0.f) {
+            continue;
+          }
+          c = candidates.insert(make_pair(column_id, new_c)).first;
+        }
+        c->second.score += t.val * postings[k].second / c->second.norm;
+      }
+    } else {
+      // only current candidates can reach the top ret_num
+      for (candidates_t::iterator c = candidates.begin();
+           c != candidates.end(); ++c) {
+        float value;
+        if (t.find(c->first, value)) {
+          c->second.score += t.val * value / c->second.norm;
+        }
+      }
+    }
+
+    if (candidates.size() + exact_scores.size() < ret_num) {
+      continue;
+    }
+
+    // the ret_num-th largest lower bound of final scores
+    const float rest = rest_bounds[j + 1];
+    lower_bounds.clear();
+    for (candidates_t::const_iterator c = candidates.begin();
+         c != candidates.end(); ++c) {
+      lower_bounds.push_back(c->second.score - rest);
+    }
+    for (size_t i = 0; i < exact_scores.size(); ++i) {
+      lower_bounds.push_back(exact_scores[i].first);
+    }
+    threshold = std::max(threshold, kth_largest(lower_bounds, ret_num));
+
+    if (rest_bounds[j + 1] < threshold) {
+      // no more columns are added; drop ones that cannot reach threshold
+      for (candidates_t::iterator c = candidates.begin();
+           c != candidates.end();) {
+        if (c->second.score + rest < threshold) {
+          candidates.erase(c++);
+        } else {
+          ++c;
+        }
+      }
+    }
+  }
+
+  sorted_scores.swap(exact_scores);
+  for (candidates_t::const_iterator c = candidates.begin();
+       c != candidates.end(); ++c) {
+    sorted_scores.push_back(make_pair(c->second.score, c->first));
+  }
+  for (size_t i = 0; i < sorted_scores.size(); ++i) {
+    sorted_scores[i].first /= query_norm;
+  }
+  size_t n = std::min(ret_num, sorted_scores.size());
+  std::partial_sort(sorted_scores.begin(), sorted_scores.begin() + n,
+                    sorted_scores.end(),
+                    std::greater<pair<float, uint64_t> >());
+  sorted_scores.resize(n);
+}
+
+float inverted_index_storage::get_row_bound(const string& row) const {
+  {
+    scoped_lock lk(row_bounds_mutex_);
+    pfi::data::unordered_map<string, float>::const_iterator it =
+        row_bounds_.find(row);
+    if (it != row_bounds_.end()) {
+      return it->second;
+    }
+  }
+  float bound = calc_row_bound(row);
+  scoped_lock lk(row_bounds_mutex_);
+  row_bounds_[row] = bound;
+  return bound;
+}
+
+float inverted_index_storage::calc_row_bound(const string& row) const {
+  // values overwritten by diff are also counted, which only loosens the
+  // bound
+  posting_list::entries_t postings;
+  tbl_t::const_iterator it_diff = inv_diff_.find(row);
+  if (it_diff != inv_diff_.end()) {
+    postings.assign(it_diff->second.begin(), it_diff->second.end());
+  }
+  inv_t::const_iterator it = inv_.find(row);
+  if (it != inv_.end()) {
+    for (posting_list::const_iterator it_row = it->second.begin();
+         !it_row.is_end(); it_row.next()) {
+      postings.push_back(make_pair(it_row.id(), it_row.value()));
+    }
+  }
+
+  float bound = 0.f;
+  for (size_t i = 0; i < postings.size(); ++i) {
+    if (unbounded_columns_.count(postings[i].first)) {
+      continue;
+    }
+    float norm = calc_columnl2norm(postings[i].first);
+    if (norm != 0.f) {
+      bound = std::max(bound, std::fabs(postings[i].second) / norm);
+    }
+  }
+  return bound;
+}
+
+void inverted_index_storage::reset_row_bounds() {
+  scoped_lock lk(row_bounds_mutex_);
+  pfi::data::unordered_map<string, float>().swap(row_bounds_);
+  pfi::data::unordered_set<uint64_t>().swap(unbounded_columns_);
 }
 
 float inverted_index_storage::calc_l2norm(const sfv_t& sfv) {
@@ -288,15 +767,32 @@ float inverted_index_storage::calc_l2norm(const sfv_t& sfv) {
 
 float inverted_index_storage::calc_columnl2norm(uint64_t column_id) const {
   float ret = 0.f;
-  imap_float_t::const_iterator it_diff = column2norm_diff_.find(column_id);
-  if (it_diff != column2norm_diff_.end()) {
-    ret += it_diff->second;
+  if (column_id < column2norm_diff_.size()) {
+    ret += column2norm_diff_[column_id];
   }
-  imap_float_t::const_iterator it = column2norm_.find(column_id);
-  if (it != column2norm_.end()) {
-    ret += it->second;
+  if (column_id < column2norm_.size()) {
+    ret += column2norm_[column_id];
+  }
+  // norms of removed columns may be slightly negative by rounding errors
+  return ret > 0.f ? sqrt(ret) : 0.f;
+}
+
+void inverted_index_storage::get_postings(
+    const row_t* diff,
+    const posting_list* master,
+    posting_list::entries_t& postings) {
+  postings.clear();
+  if (diff) {
+    postings.insert(postings.end(), diff->begin(), diff->end());
+  }
+  if (master) {
+    for (posting_list::const_iterator it = master->begin();
+         !it.is_end(); it.next()) {
+      if (!diff || !diff->count(it.id())) {  // overwritten by diff
+        postings.push_back(make_pair(it.id(), it.value()));
+      }
+    }
   }
-  return sqrt(ret);
 }
 
 void inverted_index_storage::add_inp_scores(
@@ -312,20 +808,20 @@ void inverted_index_storage::add_inp_scores(
     }
   }
 
-  tbl_t::const_iterator it = inv_.find(row);
+  inv_t::const_iterator it = inv_.find(row);
   if (it != inv_.end()) {
-    const row_t& row_v = it->second;
+    const posting_list& row_v = it->second;
     if (it_diff == inv_diff_.end()) {
-      for (row_t::const_iterator row_it = row_v.begin(); row_it != row_v.end();
-          ++row_it) {
-        scores[row_it->first] += row_it->second * val;
+      for (posting_list::const_iterator row_it = row_v.begin();
+          !row_it.is_end(); row_it.next()) {
+        scores[row_it.id()] += row_it.value() * val;
       }
     } else {
       const row_t& row_diff_v = it_diff->second;
-      for (row_t::const_iterator row_it = row_v.begin(); row_it != row_v.end();
-          ++row_it) {
-        if (row_diff_v.find(row_it->first) == row_diff_v.end()) {
-          scores[row_it->first] += row_it->second * val;
+      for (posting_list::const_iterator row_it = row_v.begin();
+          !row_it.is_end(); row_it.next()) {
+        if (row_diff_v.find(row_it.id()) == row_diff_v.end()) {
+          scores[row_it.id()] += row_it.value() * val;
         }
       }
     }
@@ -20,10 +20,13 @@
 #include <string>
 #include <utility>
 #include <vector>
+#include <pficommon/concurrent/mutex.h>
 #include <pficommon/data/serialization.h>
 #include <pficommon/data/serialization/unordered_map.h>
 #include <pficommon/data/unordered_map.h>
+#include <pficommon/data/unordered_set.h>
 #include "storage_type.hpp"
+#include "posting_list.hpp"
 #include "../common/type.hpp"
 #include "../common/key_manager.hpp"
 #include "sparse_matrix_storage.hpp"
@@ -48,6 +51,24 @@ class inverted_index_storage : public recommender_storage_base {
       std::vector<std::pair<std::string, float> >& scores,
       size_t ret_num) const;
 
+  // Same as calc_scores for each query. Posting lists of columns shared by
+  // queries are read once for all of them, except with topk_pruning.
+  void calc_scores_many(
+      const std::vector<const sfv_t*>& queries,
+      std::vector<std::vector<std::pair<std::string, float> > >& scores,
+      size_t ret_num) const;
+
+  // When enabled, calc_scores keeps an upper bound of normalized values of
+  // each row and skips columns that cannot reach the top ret_num scores
+  // (MaxScore). Results are the same as exhaustive scoring, except that
+  // columns with zero norm are not returned.
+  void set_topk_pruning(bool enabled);
+
+  // When enabled, values of posting lists compacted after this call are
+  // stored as 16-bit fixed point numbers, which halves their memory at the
+  // cost of precision.
+  void set_quantize_values(bool enabled);
+
   void get_diff(std::string& diff_str) const;
   void set_mixed_and_clear_diff(const std::string& mixed_diff);
   void mix(const std::string& lhs_str, std::string& rhs_str) const;
@@ -60,6 +81,29 @@ class inverted_index_storage : public recommender_storage_base {
  private:
   static float calc_l2norm(const sfv_t& sfv);
   float calc_columnl2norm(uint64_t column_id) const;
+
+  struct query_term;
+  void calc_scores_exhaustive(
+      const sfv_t& query,
+      float query_norm,
+      std::vector<std::pair<float, uint64_t> >& sorted_scores) const;
+  void sort_scores(
+      const pfi::data::unordered_map<uint64_t, float>& i_scores,
+      float query_norm,
+      std::vector<std::pair<float, uint64_t> >& sorted_scores) const;
+  // postings in diff and those in master not overwritten by diff
+  static void get_postings(
+      const row_t* diff,
+      const posting_list* master,
+      posting_list::entries_t& postings);
+  void calc_scores_topk(
+      const sfv_t& query,
+      float query_norm,
+      size_t ret_num,
+      std::vector<std::pair<float, uint64_t> >& sorted_scores) const;
+  float get_row_bound(const std::string& row) const;
+  float calc_row_bound(const std::string& row) const;
+  void reset_row_bounds();
   float get_from_tbl(
       const std::string& row,
       uint64_t column_id,
@@ -69,8 +113,40 @@ class inverted_index_storage : public recommender_storage_base {
   friend class pfi::data::serialization::access;
   template <class Ar>
   void serialize(Ar& ar) {
-    ar & MEMBER(inv_) & MEMBER(inv_diff_) & MEMBER(column2norm_)
-      & MEMBER(column2norm_diff_) & MEMBER(column2id_);
+    // posting lists and norms are stored as maps to keep the format
+    // compatible
+    tbl_t inv;
+    imap_float_t column2norm, column2norm_diff;
+    if (!ar.is_read) {
+      get_inv_table(inv);
+      get_norm_maps(column2norm, column2norm_diff);
+    }
+    ar & NAMED_MEMBER("inv_", inv) & MEMBER(inv_diff_)
+      & NAMED_MEMBER("column2norm_", column2norm)
+      & NAMED_MEMBER("column2norm_diff_", column2norm_diff)
+      & MEMBER(column2id_);
+    if (ar.is_read) {
+      // set_inv_table corrects norms of quantized values
+      set_norm_maps(column2norm, column2norm_diff);
+      set_inv_table(inv);
+      reset_row_bounds();
+    }
+  }
+  void get_inv_table(tbl_t& inv) const;
+  void set_inv_table(const tbl_t& inv);
+  void compact_posting_list(posting_list& list);
+  void get_norm_maps(
+      imap_float_t& column2norm,
+      imap_float_t& column2norm_diff) const;
+  void set_norm_maps(
+      const imap_float_t& column2norm,
+      const imap_float_t& column2norm_diff);
+
+  void add_column_norm_diff(uint64_t column_id, float diff);
+  void add_column_entry_num(uint64_t column_id, int diff);
+  bool has_column_norm_diff(uint64_t column_id) const {
+    return column_id / 64 < column2norm_dirty_.size()
+        && (column2norm_dirty_[column_id / 64] >> (column_id % 64) & 1);
   }
 
   void add_inp_scores(
@@ -78,11 +154,30 @@ class inverted_index_storage : public recommender_storage_base {
       float val,
       pfi::data::unordered_map<uint64_t, float>& scores) const;
 
-  tbl_t inv_;
+  typedef pfi::data::unordered_map<std::string, posting_list> inv_t;
+
+  inv_t inv_;
   tbl_t inv_diff_;
-  imap_float_t column2norm_;
-  imap_float_t column2norm_diff_;
+  // squared norms of columns indexed by column ID
+  std::vector<float> column2norm_;
+  std::vector<float> column2norm_diff_;
+  // bitmap of columns updated since the last mix
+  std::vector<uint64_t> column2norm_dirty_;
   key_manager column2id_;
+
+  // not serialized
+  bool quantize_values_;
+  // numbers of entries of columns in inv_ indexed by column ID
+  std::vector<uint32_t> column2entry_num_;
+
+  // for top-k pruning; not serialized
+  bool topk_pruning_;
+  // upper bounds of |value| / column norm of rows, computed lazily
+  mutable pfi::data::unordered_map<std::string, float> row_bounds_;
+  mutable pfi::concurrent::mutex row_bounds_mutex_;
+  // columns whose norm decreased after row_bounds_ was reset; their
+  // normalized values may exceed row_bounds_, so they are scored exactly
+  pfi::data::unordered_set<uint64_t> unbounded_columns_;
 };
 
 }  // namespace storage
@@ -0,0 +1,164 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+
+// Benchmark of top-k pruning in inverted_index_storage::calc_scores.
+// Builds a random index whose features follow a Zipf-like distribution
+// and compares latency and recall of exhaustive and pruned scoring.
+//
+// usage: inverted_index_storage_bench [column_num [query_num [ret_num]]]
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include <pficommon/lang/cast.h>
+#include <pficommon/math/random.h>
+#include <pficommon/system/time_util.h>
+#include "inverted_index_storage.hpp"
+
+using jubatus::sfv_t;
+using jubatus::storage::inverted_index_storage;
+using pfi::lang::lexical_cast;
+using pfi::system::time::clock_time;
+using pfi::system::time::get_clock_time;
+using std::pair;
+using std::string;
+using std::vector;
+
+namespace {
+
+const size_t FEATURE_NUM = 100000;
+const size_t FEATURES_PER_ROW = 20;
+const size_t FEATURES_PER_QUERY = 10;
+
+class zipf_generator {
+ public:
+  explicit zipf_generator(size_t n)
+      : cdf_(n) {
+    double sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+      sum += 1.0 / (i + 1);
+      cdf_[i] = sum;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      cdf_[i] /= sum;
+    }
+  }
+
+  size_t next(pfi::math::random::mtrand& rand) {
+    double r = rand.next_double();
+    return std::lower_bound(cdf_.begin(), cdf_.end(), r) - cdf_.begin();
+  }
+
+ private:
+  vector<double> cdf_;
+};
+
+void make_vector(
+    pfi::math::random::mtrand& rand,
+    zipf_generator& zipf,
+    size_t size,
+    sfv_t& v) {
+  v.clear();
+  for (size_t i = 0; i < size; ++i) {
+    size_t f = zipf.next(rand);
+    // rare features have large weights like tf-idf
+    float val = std::log(1.0 + f) + rand.next_double();
+    v.push_back(std::make_pair("f" + lexical_cast<string>(f), val));
+  }
+}
+
+double run(
+    const inverted_index_storage& s,
+    const vector<sfv_t>& queries,
+    size_t ret_num,
+    vector<vector<pair<string, float> > >& results) {
+  results.assign(queries.size(), vector<pair<string, float> >());
+  clock_time start = get_clock_time();
+  for (size_t i = 0; i < queries.size(); ++i) {
+    s.calc_scores(queries[i], results[i], ret_num);
+  }
+  clock_time end = get_clock_time();
+  return static_cast<double>(end - start) / queries.size() * 1000;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  size_t column_num = argc > 1 ? std::atoi(argv[1]) : 100000;
+  size_t query_num = argc > 2 ? std::atoi(argv[2]) : 100;
+  size_t ret_num = argc > 3 ? std::atoi(argv[3]) : 10;
+
+  pfi::math::random::mtrand rand(0);
+  zipf_generator zipf(FEATURE_NUM);
+
+  inverted_index_storage exhaustive, pruned;
+  pruned.set_topk_pruning(true);
+  sfv_t v;
+  for (size_t i = 0; i < column_num; ++i) {
+    make_vector(rand, zipf, FEATURES_PER_ROW, v);
+    string column = "r" + lexical_cast<string>(i);
+    for (size_t j = 0; j < v.size(); ++j) {
+      exhaustive.set(v[j].first, column, v[j].second);
+      pruned.set(v[j].first, column, v[j].second);
+    }
+  }
+
+  // move all data to the master table as a mix does
+  string diff;
+  exhaustive.get_diff(diff);
+  exhaustive.set_mixed_and_clear_diff(diff);
+  pruned.get_diff(diff);
+  pruned.set_mixed_and_clear_diff(diff);
+
+  vector<sfv_t> queries(query_num);
+  for (size_t i = 0; i < query_num; ++i) {
+    make_vector(rand, zipf, FEATURES_PER_QUERY, queries[i]);
+  }
+
+  vector<vector<pair<string, float> > > expected, actual;
+  double exhaustive_ms = run(exhaustive, queries, ret_num, expected);
+  // the first run computes row bounds
+  double cold_ms = run(pruned, queries, ret_num, actual);
+  double pruned_ms = run(pruned, queries, ret_num, actual);
+
+  size_t hit = 0, total = 0;
+  for (size_t i = 0; i < query_num; ++i) {
+    std::set<string> ids;
+    for (size_t j = 0; j < expected[i].size(); ++j) {
+      ids.insert(expected[i][j].first);
+    }
+    for (size_t j = 0; j < actual[i].size(); ++j) {
+      hit += ids.count(actual[i][j].first);
+    }
+    total += expected[i].size();
+  }
+
+  std::cout << "columns: " << column_num
+            << ", queries: " << query_num
+            << ", ret_num: " << ret_num << std::endl;
+  std::cout << "exhaustive: " << exhaustive_ms << " ms/query" << std::endl;
+  std::cout << "pruned (cold): " << cold_ms << " ms/query" << std::endl;
+  std::cout << "pruned: " << pruned_ms << " ms/query" << std::endl;
+  std::cout << "recall: "
+            << (total ? static_cast<double>(hit) / total : 1.0) << std::endl;
+  return 0;
+}
@@ -14,11 +14,14 @@
 // License along with this library; if not, write to the Free Software
 // Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
+#include <algorithm>
 #include <cmath>
+#include <sstream>
 #include <string>
 #include <utility>
 #include <vector>
 #include <gtest/gtest.h>
+#include <pficommon/lang/cast.h>
 #include "inverted_index_storage.hpp"
 
 using std::make_pair;
@@ -127,5 +130,249 @@ TEST(inverted_index_storage, mix) {
   EXPECT_EQ(1.0, s2.get("c2", "r3"));
 }
 
+namespace {
+
+// deterministic pseudo random numbers for tests
+class xorshift {
+ public:
+  xorshift() : x_(88172645463325252ULL) {
+  }
+
+  uint64_t next() {
+    x_ ^= x_ << 13;
+    x_ ^= x_ >> 7;
+    x_ ^= x_ << 17;
+    return x_;
+  }
+
+  float next_float() {
+    return (next() % 1000000) / 1000000.f;
+  }
+
+ private:
+  uint64_t x_;
+};
+
+void set_random_rows(
+    xorshift& rand,
+    size_t begin,
+    size_t end,
+    inverted_index_storage& s1,
+    inverted_index_storage& s2) {
+  for (size_t i = begin; i < end; ++i) {
+    string column = "r" + pfi::lang::lexical_cast<string>(i);
+    for (size_t j = 0; j < 10; ++j) {
+      // skewed feature distribution
+      uint64_t f = rand.next() % 100;
+      f = f * f / 100;
+      string row = "c" + pfi::lang::lexical_cast<string>(f);
+      float val = rand.next_float() + 0.1f;
+      s1.set(row, column, val);
+      s2.set(row, column, val);
+    }
+  }
+}
+
+void expect_same_scores(
+    xorshift& rand,
+    const inverted_index_storage& s1,
+    const inverted_index_storage& s2) {
+  for (size_t q = 0; q < 20; ++q) {
+    sfv_t v;
+    for (size_t j = 0; j < 5; ++j) {
+      uint64_t f = rand.next() % 100;
+      v.push_back(make_pair("c" + pfi::lang::lexical_cast<string>(f * f / 100),
+                            rand.next_float() + 0.1f));
+    }
+    vector<pair<string, float> > expected, actual;
+    s1.calc_scores(v, expected, 10);
+    s2.calc_scores(v, actual, 10);
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+      EXPECT_EQ(expected[i].first, actual[i].first);
+      EXPECT_NEAR(expected[i].second, actual[i].second, 1e-5);
+    }
+  }
+}
+
+}  // namespace
+
+TEST(inverted_index_storage, quantized_norms) {
+  inverted_index_storage s;
+  s.set_quantize_values(true);
+  // values which are not exact when quantized
+  s.set("c1", "r1", 1.0f);
+  s.set("c1", "r2", 0.3f);
+  s.set("c1", "r3", 0.7f);
+  s.set("c2", "r2", 0.1f);
+  string diff;
+  s.get_diff(diff);
+  s.set_mixed_and_clear_diff(diff);
+
+  s.remove("c1", "r2");
+  s.remove("c2", "r2");
+  s.get_diff(diff);
+  s.set_mixed_and_clear_diff(diff);
+
+  vector<string> ids;
+  s.get_all_column_ids(ids);
+  ASSERT_EQ(2u, ids.size());
+  EXPECT_TRUE(std::find(ids.begin(), ids.end(), "r2") == ids.end());
+
+  sfv_t q;
+  q.push_back(make_pair("c1", 1.0f));
+  q.push_back(make_pair("c2", 1.0f));
+  vector<pair<string, float> > scores;
+  s.calc_scores(q, scores, 10);
+  ASSERT_EQ(2u, scores.size());
+  for (size_t i = 0; i < scores.size(); ++i) {
+    EXPECT_FALSE(std::isnan(scores[i].second));
+  }
+}
+
+TEST(inverted_index_storage, norm_after_removing_large_value) {
+  inverted_index_storage s;
+  s.set("c1", "r1", 1000.0f);
+  s.set("c2", "r1", 1.0f);
+  s.set("c2", "r2", 1.0f);
+  string diff;
+  s.get_diff(diff);
+  s.set_mixed_and_clear_diff(diff);
+
+  s.remove("c1", "r1");
+  s.get_diff(diff);
+  s.set_mixed_and_clear_diff(diff);
+
+  vector<string> ids;
+  s.get_all_column_ids(ids);
+  EXPECT_EQ(2u, ids.size());
+
+  sfv_t q;
+  q.push_back(make_pair("c2", 1.0f));
+  vector<pair<string, float> > scores;
+  s.calc_scores(q, scores, 10);
+  ASSERT_EQ(2u, scores.size());
+  EXPECT_FLOAT_EQ(1.0f, scores[0].second);
+  EXPECT_FLOAT_EQ(1.0f, scores[1].second);
+
+  // entries of columns are counted again after load
+  stringstream ss;
+  s.save(ss);
+  inverted_index_storage s2;
+  s2.load(ss);
+  s2.remove("c2", "r1");
+  s2.get_diff(diff);
+  s2.set_mixed_and_clear_diff(diff);
+  s2.get_all_column_ids(ids);
+  ASSERT_EQ(1u, ids.size());
+  EXPECT_EQ("r2", ids[0]);
+}
+
+TEST(inverted_index_storage, topk_pruning) {
+  xorshift rand;
+  inverted_index_storage s1, s2;
+  s2.set_topk_pruning(true);
+
+  set_random_rows(rand, 0, 300, s1, s2);
+  expect_same_scores(rand, s1, s2);
+
+  // move rows to the master table
+  string diff;
+  s1.get_diff(diff);
+  s1.set_mixed_and_clear_diff(diff);
+  s2.get_diff(diff);
+  s2.set_mixed_and_clear_diff(diff);
+  expect_same_scores(rand, s1, s2);
+
+  // overwrite and remove some values so that norms decrease
+  set_random_rows(rand, 200, 400, s1, s2);
+  for (size_t i = 0; i < 100; ++i) {
+    string column = "r" + pfi::lang::lexical_cast<string>(i);
+    s1.remove("c0", column);
+    s2.remove("c0", column);
+  }
+  expect_same_scores(rand, s1, s2);
+}
+
+TEST(inverted_index_storage, calc_scores_many) {
+  xorshift rand;
+  inverted_index_storage s, dummy;
+  set_random_rows(rand, 0, 200, s, dummy);
+  string diff;
+  s.get_diff(diff);
+  s.set_mixed_and_clear_diff(diff);
+  // both of master and diff have values
+  set_random_rows(rand, 150, 300, s, dummy);
+
+  vector<sfv_t> queries(20);
+  for (size_t q = 1; q < queries.size(); ++q) {  // queries[0] is empty
+    for (size_t j = 0; j < 5; ++j) {
+      uint64_t f = rand.next() % 100;
+      queries[q].push_back(make_pair(
+          "c" + pfi::lang::lexical_cast<string>(f * f / 100),
+          rand.next_float() + 0.1f));
+    }
+  }
+  vector<const sfv_t*> query_ptrs;
+  for (size_t q = 0; q < queries.size(); ++q) {
+    query_ptrs.push_back(&queries[q]);
+  }
+
+  for (int pruning = 0; pruning < 2; ++pruning) {
+    s.set_topk_pruning(pruning == 1);
+    vector<vector<pair<string, float> > > actual;
+    s.calc_scores_many(query_ptrs, actual, 10);
+    ASSERT_EQ(queries.size(), actual.size());
+    EXPECT_TRUE(actual[0].empty());
+    for (size_t q = 0; q < queries.size(); ++q) {
+      vector<pair<string, float> > expected;
+      s.calc_scores(queries[q], expected, 10);
+      ASSERT_EQ(expected.size(), actual[q].size());
+      for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(expected[i].first, actual[q][i].first);
+        EXPECT_NEAR(expected[i].second, actual[q][i].second, 1e-5);
+      }
+    }
+  }
+}
+
+TEST(inverted_index_storage, save_load) {
+  xorshift rand;
+  inverted_index_storage s1, dummy;
+  set_random_rows(rand, 0, 200, s1, dummy);
+  string diff;
+  s1.get_diff(diff);
+  s1.set_mixed_and_clear_diff(diff);
+  // keep some values in the diff
+  set_random_rows(rand, 150, 250, s1, dummy);
+  s1.remove("c1", "r0");
+
+  stringstream ss;
+  s1.save(ss);
+  inverted_index_storage s2;
+  s2.load(ss);
+
+  vector<string> ids1, ids2;
+  s1.get_all_column_ids(ids1);
+  s2.get_all_column_ids(ids2);
+  EXPECT_EQ(ids1, ids2);
+  for (size_t i = 0; i < 10; ++i) {
+    string row = "c" + pfi::lang::lexical_cast<string>(i);
+    for (size_t j = 0; j < ids1.size(); ++j) {
+      EXPECT_EQ(s1.get(row, ids1[j]), s2.get(row, ids1[j]));
+    }
+  }
+  expect_same_scores(rand, s1, s2);
+
+  // the diff is also restored
+  string diff1, diff2;
+  s1.get_diff(diff1);
+  s2.get_diff(diff2);
+  inverted_index_storage t1, t2;
+  t1.set_mixed_and_clear_diff(diff1);
+  t2.set_mixed_and_clear_diff(diff2);
+  expect_same_scores(rand, t1, t2);
+}
+
 }  // namespace storage
 }  // namespace jubatus
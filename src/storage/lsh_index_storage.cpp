@@ -24,9 +24,12 @@
 #include <pficommon/data/serialization/unordered_map.h>
 #include <pficommon/data/unordered_map.h>
 #include <pficommon/data/unordered_set.h>
+#include <pficommon/concurrent/lock.h>
+#include <pficommon/lang/bind.h>
 #include <pficommon/lang/cast.h>
 #include <pficommon/math/random.h>
 #include "lsh_util.hpp"
+#include "../common/parallel.hpp"
 
 using std::copy;
 using std::ostream;
@@ -39,7 +42,6 @@ using std::string;
 using std::vector;
 using std::sort;
 using std::partial_sort;
-using std::lower_bound;
 using pfi::data::unordered_map;
 using pfi::data::unordered_set;
 using pfi::math::random::mtrand;
@@ -47,15 +49,103 @@ using pfi::math::random::mtrand;
 namespace jubatus {
 namespace storage {
 
+// Set of ids of candidate rows. As ids given by key_manager are dense,
+// found ids are marked in a bitmap rather than a hash set. The bitmap is
+// taken from the storage, and only the words of found ids are cleared when
+// it is returned, so that a query does not cost the number of all ids.
+class lsh_candidate_set {
+ public:
+  explicit lsh_candidate_set(const lsh_index_storage& storage)
+      : storage_(storage),
+        bitmap_(storage.acquire_candidate_bitmap()),
+        found_(*bitmap_) {
+  }
+
+  ~lsh_candidate_set() {
+    for (size_t i = 0; i < ids_.size(); ++i) {
+      found_[ids_[i] / 64] = 0;
+    }
+    storage_.release_candidate_bitmap(bitmap_);
+  }
+
+  // ids in removed are skipped
+  void insert(
+      const vector<uint64_t>& ids,
+      const unordered_set<uint64_t>* removed) {
+    for (size_t i = 0; i < ids.size(); ++i) {
+      const uint64_t id = ids[i];
+      if (removed && removed->count(id)) {
+        continue;
+      }
+      if (id / 64 >= found_.size()) {
+        found_.resize(id / 64 + 1);
+      }
+      const uint64_t mask = 1LLU << (id % 64);
+      if (!(found_[id / 64] & mask)) {
+        found_[id / 64] |= mask;
+        ids_.push_back(id);
+      }
+    }
+  }
+
+  size_t size() const {
+    return ids_.size();
+  }
+
+  const vector<uint64_t>& ids() const {
+    return ids_;
+  }
+
+ private:
+  const lsh_index_storage& storage_;
+  lsh_index_storage::bitmap_ptr bitmap_;
+  vector<uint64_t>& found_;
+  vector<uint64_t> ids_;
+};
+
 namespace {
 
-struct greater_second {
-  template <typename P>
-  bool operator()(const P& l, const P& r) const {
-    return l.second > r.second;
+typedef pair<uint64_t, float> scored_row;
+
+// Orders rows by scores, and then by ids so that the order does not depend
+// on how candidates are split among threads
+struct greater_score {
+  bool operator()(const scored_row& l, const scored_row& r) const {
+    return l.second > r.second || (l.second == r.second && l.first < r.first);
   }
 };
 
+// Smallest number of tables probed by one thread
+const size_t MIN_PROBE_CHUNK_SIZE = 256;
+
+// Smallest number of candidates ranked by one thread
+const size_t MIN_RANK_CHUNK_SIZE = 2048;
+
+template <typename Worker, typename Result>
+void run_worker(
+    const Worker* worker,
+    vector<Result>* results,
+    size_t chunk,
+    size_t begin,
+    size_t end) {
+  worker->run(begin, end, &(*results)[chunk]);
+}
+
+// Runs worker.run(begin, end, &results[i]) for the i-th of chunk_num
+// chunks of [0, size)
+template <typename Worker, typename Result>
+void run_chunks(
+    const Worker& worker,
+    size_t size,
+    size_t chunk_num,
+    vector<Result>& results) {
+  results.resize(chunk_num);
+  common::run_chunks(
+      pfi::lang::bind(&run_worker<Worker, Result>, &worker, &results,
+                      pfi::lang::_1, pfi::lang::_2, pfi::lang::_3),
+      size, chunk_num);
+}
+
 uint64_t hash_lv(const lsh_vector& lv) {
   uint64_t hash = 14695981039346656037LLU;
   for (size_t i = 0; i < lv.size(); ++i) {
@@ -124,22 +214,176 @@ string serialize_diff(const lsh_master_table_t& table) {
   return oss.str();  // TODO(unknown) remove redundant copy
 }
 
-void retrieve_hit_rows_from_table(
+// Rows of a bucket in lsh_table_diff_ and lsh_table_
+struct bucket_hits {
+  const vector<uint64_t>* diff;
+  const unordered_set<uint64_t>* diff_removed;
+  const vector<uint64_t>* mixed;
+};
+
+const vector<uint64_t>* find_bucket(uint64_t hash, const lsh_table_t& table) {
+  lsh_table_t::const_iterator it = table.find(hash);
+  return it == table.end() ? 0 : &it->second;
+}
+
+bucket_hits find_buckets(
     uint64_t hash,
     const lsh_table_t& table,
-    unordered_set<uint64_t>& cands) {
-  lsh_table_t::const_iterator it = table.find(hash);
-  if (it != table.end()) {
-    const vector<uint64_t>& range = it->second;
-    for (size_t j = 0; j < range.size(); ++j) {
-      cands.insert(range[j]);
+    const lsh_table_t& table_diff,
+    const lsh_tombstone_table_t& tombstones) {
+  bucket_hits hits;
+  hits.diff = find_bucket(hash, table_diff);
+  hits.diff_removed = 0;
+  if (hits.diff && !tombstones.empty()) {
+    lsh_tombstone_table_t::const_iterator it = tombstones.find(hash);
+    if (it != tombstones.end()) {
+      hits.diff_removed = &it->second;
+    }
+  }
+  hits.mixed = find_bucket(hash, table);
+  return hits;
+}
+
+void insert_hits(const bucket_hits& hits, lsh_candidate_set& cands) {
+  if (hits.diff) {
+    cands.insert(*hits.diff, hits.diff_removed);
+  }
+  if (hits.mixed) {
+    cands.insert(*hits.mixed, 0);
+  }
+}
+
+const lsh_entry* find_lsh_entry(
+    const string& row,
+    const lsh_master_table_t& master_table,
+    const lsh_master_table_t& master_table_diff) {
+  lsh_master_table_t::const_iterator it = master_table_diff.find(row);
+  if (it == master_table_diff.end()) {
+    it = master_table.find(row);
+    if (it == master_table.end()) {
+      return 0;
     }
   }
+  return &it->second;
 }
 
+// Finds buckets of diff and mixed tables for each hash
+class bucket_finder {
+ public:
+  bucket_finder(
+      const vector<uint64_t>& hashes,
+      const lsh_table_t& table,
+      const lsh_table_t& table_diff,
+      const lsh_tombstone_table_t& tombstones)
+      : hashes_(hashes),
+        table_(table),
+        table_diff_(table_diff),
+        tombstones_(tombstones) {
+  }
+
+  void run(size_t begin, size_t end, vector<bucket_hits>* hits) const {
+    hits->resize(end - begin);
+    for (size_t i = begin; i < end; ++i) {
+      (*hits)[i - begin] = find_buckets(hashes_[i], table_, table_diff_,
+                                        tombstones_);
+    }
+  }
+
+ private:
+  const vector<uint64_t>& hashes_;
+  const lsh_table_t& table_;
+  const lsh_table_t& table_diff_;
+  const lsh_tombstone_table_t& tombstones_;
+};
+
+// Erases ids in removed from buckets of table
+void compact_buckets(const lsh_table_t& removed, lsh_table_t& table) {
+  for (lsh_table_t::const_iterator it = removed.begin(); it != removed.end();
+      ++it) {
+    lsh_table_t::iterator bucket_it = table.find(it->first);
+    if (bucket_it == table.end()) {
+      continue;
+    }
+    vector<uint64_t> ids(it->second);
+    sort(ids.begin(), ids.end());
+    vector<uint64_t>& bucket = bucket_it->second;
+    size_t n = 0;
+    for (size_t i = 0; i < bucket.size(); ++i) {
+      if (!std::binary_search(ids.begin(), ids.end(), bucket[i])) {
+        bucket[n++] = bucket[i];
+      }
+    }
+    if (n == 0) {
+      table.erase(bucket_it);
+    } else {
+      bucket.resize(n);
+    }
+  }
+}
+
+// Computes the best ret_num scores of candidates
+class candidate_ranker {
+ public:
+  candidate_ranker(
+      const vector<uint64_t>& cands,
+      const bit_vector& query_simhash,
+      float query_norm,
+      uint64_t ret_num,
+      const lsh_master_table_t& master_table,
+      const lsh_master_table_t& master_table_diff,
+      const key_manager& keys)
+      : cands_(cands),
+        query_simhash_(query_simhash),
+        query_norm_(query_norm),
+        ret_num_(ret_num),
+        master_table_(master_table),
+        master_table_diff_(master_table_diff),
+        keys_(keys) {
+  }
+
+  void run(size_t begin, size_t end, vector<scored_row>* scored) const {
+    scored->clear();
+    scored->reserve(end - begin);
+    for (size_t i = begin; i < end; ++i) {
+      const lsh_entry* entry = find_lsh_entry(keys_.get_key(cands_[i]),
+                                              master_table_,
+                                              master_table_diff_);
+      if (!entry || entry->lsh_hash.empty()) {
+        continue;
+      }
+      const float dist = calc_euclidean_distance(*entry, query_simhash_,
+                                                 query_norm_);
+      scored->push_back(make_pair(cands_[i], -dist));
+    }
+    select_top(ret_num_, *scored);
+  }
+
+  // Leaves the best ret_num rows sorted in scored
+  static void select_top(uint64_t ret_num, vector<scored_row>& scored) {
+    if (scored.size() <= ret_num) {
+      sort(scored.begin(), scored.end(), greater_score());
+    } else {
+      partial_sort(scored.begin(),
+                   scored.begin() + ret_num, scored.end(),
+                   greater_score());
+      scored.resize(ret_num);
+    }
+  }
+
+ private:
+  const vector<uint64_t>& cands_;
+  const bit_vector& query_simhash_;
+  const float query_norm_;
+  const uint64_t ret_num_;
+  const lsh_master_table_t& master_table_;
+  const lsh_master_table_t& master_table_diff_;
+  const key_manager& keys_;
+};
+
 }  // namespace
 
-lsh_index_storage::lsh_index_storage() {
+lsh_index_storage::lsh_index_storage()
+    : thread_num_(1) {
 }
 
 lsh_index_storage::lsh_index_storage(
@@ -147,7 +391,8 @@ lsh_index_storage::lsh_index_storage(
     size_t table_num,
     uint32_t seed)
     : shift_(lsh_num * table_num),
-      table_num_(table_num) {
+      table_num_(table_num),
+      thread_num_(1) {
   initialize_shift(seed, shift_);
 }
 
@@ -155,7 +400,8 @@ lsh_index_storage::lsh_index_storage(
     size_t table_num,
     const vector<float>& shift)
     : shift_(shift),
-      table_num_(table_num) {
+      table_num_(table_num),
+      thread_num_(1) {
 }
 
 lsh_index_storage::~lsh_index_storage() {
@@ -174,11 +420,7 @@ void lsh_index_storage::set_row(
   const uint64_t id = key_manager_.get_id(row);
   const vector<uint64_t>& lsh_hash = it->second.lsh_hash;
   for (size_t i = 0; i < lsh_hash.size(); ++i) {
-    vector<uint64_t>& range = lsh_table_diff_[lsh_hash[i]];
-    vector<uint64_t>::iterator it = lower_bound(range.begin(), range.end(), id);
-    if (it == range.end() || id != *it) {
-      range.insert(it, id);
-    }
+    add_to_diff_bucket(lsh_hash[i], id);
   }
 }
 
@@ -191,6 +433,7 @@ void lsh_index_storage::clear() {
   lsh_master_table_t().swap(master_table_diff_);
   lsh_table_t().swap(lsh_table_);
   lsh_table_t().swap(lsh_table_diff_);
+  lsh_tombstone_table_t().swap(diff_tombstones_);
   key_manager_.clear();
 }
 
@@ -204,7 +447,9 @@ void lsh_index_storage::get_all_row_ids(vector<string>& ids) const {
 
   for (lsh_master_table_t::const_iterator it = master_table_.begin();
       it != master_table_.end(); ++it) {
-    if (!it->second.lsh_hash.empty()) {
+    // rows in diff are updated or removed
+    if (!it->second.lsh_hash.empty()
+        && master_table_diff_.find(it->first) == master_table_diff_.end()) {
       id_set.insert(it->first);
     }
   }
@@ -230,13 +475,34 @@ void lsh_index_storage::similar_row(
   const bit_vector bv = binarize(hash);
 
   lsh_probe_generator gen(shifted, table_num_);
-  unordered_set<uint64_t> cands;
+  lsh_candidate_set cands(*this);
+
+  if (common::get_chunk_num(table_num_ + probe_num, thread_num_,
+                            MIN_PROBE_CHUNK_SIZE) > 1) {
+    // all probes are generated beforehand and looked up in parallel
+    vector<uint64_t> hashes;
+    hashes.reserve(table_num_ + probe_num);
+    for (uint64_t i = 0; i < table_num_; ++i) {
+      lsh_vector key = gen.base(i);
+      key.push_back(i);
+      hashes.push_back(hash_lv(key));
+    }
+    gen.init();
+    for (uint64_t i = 0; i < probe_num; ++i) {
+      pair<size_t, lsh_vector> p = gen.get_next_table_and_vector();
+      p.second.push_back(p.first);
+      hashes.push_back(hash_lv(p.second));
+    }
+    retrieve_hit_rows_parallel(hashes, ret_num, cands);
+    get_sorted_similar_rows(cands.ids(), bv, norm, ret_num, ids);
+    return;
+  }
 
   for (uint64_t i = 0; i < table_num_; ++i) {
     lsh_vector key = gen.base(i);
     key.push_back(i);
     if (retrieve_hit_rows(hash_lv(key), ret_num, cands)) {
-      get_sorted_similar_rows(cands, bv, norm, ret_num, ids);
+      get_sorted_similar_rows(cands.ids(), bv, norm, ret_num, ids);
       return;
     }
   }
@@ -249,7 +515,7 @@ void lsh_index_storage::similar_row(
       break;
     }
   }
-  get_sorted_similar_rows(cands, bv, norm, ret_num, ids);
+  get_sorted_similar_rows(cands.ids(), bv, norm, ret_num, ids);
 }
 
 void lsh_index_storage::similar_row(
@@ -264,14 +530,14 @@ void lsh_index_storage::similar_row(
     }
   }
 
-  unordered_set<uint64_t> cands;
+  lsh_candidate_set cands(*this);
   for (size_t i = 0; i < it->second.lsh_hash.size(); ++i) {
     if (retrieve_hit_rows(it->second.lsh_hash[i], ret_num, cands)) {
       break;
     }
   }
 
-  get_sorted_similar_rows(cands,
+  get_sorted_similar_rows(cands.ids(),
                           it->second.simhash_bv,
                           it->second.norm,
                           ret_num, ids);
@@ -281,7 +547,13 @@ string lsh_index_storage::name() const {
   return "lsh_index_storage";
 }
 
+void lsh_index_storage::set_thread_num(size_t thread_num) {
+  thread_num_ = std::max(thread_num, static_cast<size_t>(1));
+}
+
 bool lsh_index_storage::save(ostream& os) {
+  // tombstones are not saved
+  compact_diff_buckets();
   pfi::data::serialization::binary_oarchive oa(os);
   oa << *this;
   return true;
@@ -290,6 +562,7 @@ bool lsh_index_storage::save(ostream& os) {
 bool lsh_index_storage::load(istream& is) {
   pfi::data::serialization::binary_iarchive ia(is);
   ia >> *this;
+  lsh_tombstone_table_t().swap(diff_tombstones_);
   return true;
 }
 
@@ -300,13 +573,12 @@ void lsh_index_storage::get_diff(string& diff) const {
 void lsh_index_storage::set_mixed_and_clear_diff(const string& mixed_diff) {
   lsh_master_table_t diff = extract_diff(mixed_diff);
 
+  remove_model_rows(diff);
   for (lsh_master_table_t::const_iterator it = diff.begin(); it != diff.end();
       ++it) {
     if (it->second.lsh_hash.empty()) {
-      remove_model_row(it->first);
       master_table_.erase(it->first);
     } else {
-      remove_model_row(it->first);
       set_mixed_row(it->first, it->second);
     }
   }
@@ -316,6 +588,7 @@ void lsh_index_storage::set_mixed_and_clear_diff(const string& mixed_diff) {
   // lsh_table_diff_ is actually not MIXed, but must be cleared as well as diff
   // of usual model.
   lsh_table_diff_.clear();
+  diff_tombstones_.clear();
 }
 
 void lsh_index_storage::mix(const string& lhs, string& rhs) const {
@@ -339,35 +612,74 @@ lsh_master_table_t::iterator lsh_index_storage::remove_and_get_row(
     return master_table_diff_.end();
   }
 
-  lsh_master_table_t::iterator entry_it = master_table_diff_.find(row);
-  lsh_master_table_t::iterator ret_it = entry_it;
-  if (entry_it == master_table_diff_.end()) {
-    ret_it = master_table_diff_.insert(make_pair(row, lsh_entry())).first;
-    entry_it = master_table_.find(row);
-    if (entry_it == master_table_.end()) {
-      return ret_it;
-    }
+  lsh_master_table_t::iterator it = master_table_diff_.find(row);
+  if (it == master_table_diff_.end()) {
+    // the row in master_table_ is hidden by the empty entry, and kept to
+    // find its buckets of lsh_table_ when MIXed
+    return master_table_diff_.insert(make_pair(row, lsh_entry())).first;
   }
-  lsh_entry& entry = entry_it->second;
 
+  lsh_entry& entry = it->second;
   for (size_t i = 0; i < entry.lsh_hash.size(); ++i) {
-    lsh_table_t::iterator it = lsh_table_diff_.find(entry.lsh_hash[i]);
-    if (it != lsh_table_diff_.end()) {
-      vector<uint64_t>& range = it->second;
-      vector<uint64_t>::iterator jt = lower_bound(range.begin(),
-                                                  range.end(),
-                                                  row_id);
-      if (jt != range.end() && row_id == *jt) {
-        range.erase(jt);
-        if (range.empty()) {
-          lsh_table_diff_.erase(it);
-        }
+    remove_from_diff_bucket(entry.lsh_hash[i], row_id);
+  }
+  entry = lsh_entry();
+
+  return it;
+}
+
+void lsh_index_storage::add_to_diff_bucket(uint64_t hash, uint64_t id) {
+  if (!diff_tombstones_.empty()) {
+    lsh_tombstone_table_t::iterator it = diff_tombstones_.find(hash);
+    if (it != diff_tombstones_.end() && it->second.erase(id)) {
+      // id is still in the bucket
+      if (it->second.empty()) {
+        diff_tombstones_.erase(it);
       }
+      return;
     }
   }
-  entry = lsh_entry();
+  lsh_table_diff_[hash].push_back(id);
+}
+
+void lsh_index_storage::remove_from_diff_bucket(uint64_t hash, uint64_t id) {
+  lsh_table_t::iterator bucket_it = lsh_table_diff_.find(hash);
+  if (bucket_it == lsh_table_diff_.end()) {
+    return;
+  }
+  vector<uint64_t>& bucket = bucket_it->second;
+  if (bucket.size() == 1) {
+    lsh_table_diff_.erase(bucket_it);
+    diff_tombstones_.erase(hash);
+    return;
+  }
 
-  return ret_it;
+  unordered_set<uint64_t>& removed = diff_tombstones_[hash];
+  removed.insert(id);
+  if (removed.size() * 2 >= bucket.size()) {
+    size_t n = 0;
+    for (size_t i = 0; i < bucket.size(); ++i) {
+      if (!removed.count(bucket[i])) {
+        bucket[n++] = bucket[i];
+      }
+    }
+    if (n == 0) {
+      lsh_table_diff_.erase(bucket_it);
+    } else {
+      bucket.resize(n);
+    }
+    diff_tombstones_.erase(hash);
+  }
+}
+
+void lsh_index_storage::compact_diff_buckets() {
+  lsh_table_t removed;
+  for (lsh_tombstone_table_t::const_iterator it = diff_tombstones_.begin();
+      it != diff_tombstones_.end(); ++it) {
+    removed[it->first].assign(it->second.begin(), it->second.end());
+  }
+  compact_buckets(removed, lsh_table_diff_);
+  diff_tombstones_.clear();
 }
 
 vector<float> lsh_index_storage::make_entry(
@@ -392,26 +704,22 @@ vector<float> lsh_index_storage::make_entry(
 
 // TODO(unknown): Separate implementation detail of processing
 // lsh_table_ into another class
-void lsh_index_storage::remove_model_row(const std::string& row) {
-  const lsh_entry* entry = get_lsh_entry(row);
-  if (!entry) {
-    return;
-  }
-
-  const uint64_t row_id = key_manager_.get_id_const(row);
-  for (size_t i = 0; i < entry->lsh_hash.size(); ++i) {
-    lsh_table_t::iterator it = lsh_table_.find(entry->lsh_hash[i]);
-    if (it != lsh_table_.end()) {
-      vector<uint64_t>& range = it->second;
-      vector<uint64_t>::iterator jt = find(range.begin(), range.end(), row_id);
-      if (jt != range.end()) {
-        range.erase(jt);
-        if (range.empty()) {
-          lsh_table_.erase(it);
-        }
-      }
+void lsh_index_storage::remove_model_rows(const lsh_master_table_t& rows) {
+  // ids are erased from each bucket at once
+  lsh_table_t removed;
+  for (lsh_master_table_t::const_iterator it = rows.begin(); it != rows.end();
+      ++it) {
+    lsh_master_table_t::const_iterator entry_it = master_table_.find(it->first);
+    if (entry_it == master_table_.end()) {
+      continue;
+    }
+    const uint64_t row_id = key_manager_.get_id_const(it->first);
+    const vector<uint64_t>& lsh_hash = entry_it->second.lsh_hash;
+    for (size_t i = 0; i < lsh_hash.size(); ++i) {
+      removed[lsh_hash[i]].push_back(row_id);
     }
   }
+  compact_buckets(removed, lsh_table_);
 }
 
 void lsh_index_storage::set_mixed_row(
@@ -424,42 +732,81 @@ void lsh_index_storage::set_mixed_row(
   }
 }
 
+lsh_index_storage::bitmap_ptr
+lsh_index_storage::acquire_candidate_bitmap() const {
+  pfi::concurrent::scoped_lock lk(candidate_bitmaps_mutex_);
+  if (candidate_bitmaps_.empty()) {
+    return bitmap_ptr(new vector<uint64_t>);
+  }
+  bitmap_ptr bitmap = candidate_bitmaps_.back();
+  candidate_bitmaps_.pop_back();
+  return bitmap;
+}
+
+void lsh_index_storage::release_candidate_bitmap(
+    const bitmap_ptr& bitmap) const {
+  pfi::concurrent::scoped_lock lk(candidate_bitmaps_mutex_);
+  candidate_bitmaps_.push_back(bitmap);
+}
+
 bool lsh_index_storage::retrieve_hit_rows(
     uint64_t hash,
     size_t ret_num,
-    unordered_set<uint64_t>& cands) const {
-  retrieve_hit_rows_from_table(hash, lsh_table_diff_, cands);
-  retrieve_hit_rows_from_table(hash, lsh_table_, cands);
+    lsh_candidate_set& cands) const {
+  insert_hits(find_buckets(hash, lsh_table_, lsh_table_diff_,
+                           diff_tombstones_),
+              cands);
   return cands.size() >= static_cast<uint64_t>(ret_num);
 }
 
+void lsh_index_storage::retrieve_hit_rows_parallel(
+    const vector<uint64_t>& hashes,
+    size_t ret_num,
+    lsh_candidate_set& cands) const {
+  const bucket_finder finder(hashes, lsh_table_, lsh_table_diff_,
+                             diff_tombstones_);
+  vector<vector<bucket_hits> > hits;
+  run_chunks(finder, hashes.size(),
+             common::get_chunk_num(hashes.size(), thread_num_,
+                                   MIN_PROBE_CHUNK_SIZE),
+             hits);
+
+  // buckets are merged in the order of probes to stop at the same probe as
+  // retrieve_hit_rows does
+  for (size_t i = 0; i < hits.size(); ++i) {
+    for (size_t j = 0; j < hits[i].size(); ++j) {
+      insert_hits(hits[i][j], cands);
+      if (cands.size() >= static_cast<uint64_t>(ret_num)) {
+        return;
+      }
+    }
+  }
+}
+
 void lsh_index_storage::get_sorted_similar_rows(
-    const unordered_set<uint64_t>& cands,
+    const vector<uint64_t>& cands,
     const bit_vector& query_simhash,
     float query_norm,
     uint64_t ret_num,
     vector<pair<string, float> >& ids) const {
   // Avoid string copy as far as possible
-  vector<pair<uint64_t, float> > scored;
-  scored.reserve(cands.size());
-  for (unordered_set<uint64_t>::const_iterator it = cands.begin();
-      it != cands.end(); ++it) {
-    const lsh_entry* entry = get_lsh_entry(key_manager_.get_key(*it));
-    if (!entry || entry->lsh_hash.empty()) {
-      continue;
+  const candidate_ranker ranker(cands, query_simhash, query_norm, ret_num,
+                                master_table_, master_table_diff_,
+                                key_manager_);
+  vector<vector<scored_row> > chunk_scored;
+  run_chunks(ranker, cands.size(),
+             common::get_chunk_num(cands.size(), thread_num_,
+                                   MIN_RANK_CHUNK_SIZE),
+             chunk_scored);
+
+  vector<scored_row> scored;
+  scored.swap(chunk_scored[0]);
+  if (chunk_scored.size() > 1) {
+    for (size_t i = 1; i < chunk_scored.size(); ++i) {
+      scored.insert(scored.end(), chunk_scored[i].begin(),
+                    chunk_scored[i].end());
     }
-    const float dist = calc_euclidean_distance(*entry, query_simhash,
-                                               query_norm);
-    scored.push_back(make_pair(*it, -dist));
-  }
-
-  if (scored.size() <= ret_num) {
-    sort(scored.begin(), scored.end(), greater_second());
-  } else {
-    partial_sort(scored.begin(),
-                 scored.begin() + ret_num, scored.end(),
-                 greater_second());
-    scored.resize(ret_num);
+    candidate_ranker::select_top(ret_num, scored);
   }
 
   ids.resize(scored.size());
@@ -470,14 +817,7 @@ void lsh_index_storage::get_sorted_similar_rows(
 }
 
 const lsh_entry* lsh_index_storage::get_lsh_entry(const string& row) const {
-  lsh_master_table_t::const_iterator it = master_table_diff_.find(row);
-  if (it == master_table_diff_.end()) {
-    it = master_table_.find(row);
-    if (it == master_table_.end()) {
-      return 0;
-    }
-  }
-  return &it->second;
+  return find_lsh_entry(row, master_table_, master_table_diff_);
 }
 
 }  // namespace storage
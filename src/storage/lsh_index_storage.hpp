@@ -23,6 +23,8 @@
 #include <vector>
 #include <pficommon/data/unordered_map.h>
 #include <pficommon/data/unordered_set.h>
+#include <pficommon/concurrent/mutex.h>
+#include <pficommon/lang/shared_ptr.h>
 #include "lsh_vector.hpp"
 #include "recommender_storage_base.hpp"
 #include "storage_type.hpp"
@@ -46,6 +48,12 @@ typedef pfi::data::unordered_map<std::string, lsh_entry> lsh_master_table_t;
 
 typedef pfi::data::unordered_map<uint64_t, std::vector<uint64_t> > lsh_table_t;
 
+// Ids removed from buckets of lsh_table_t but not yet erased from them
+typedef pfi::data::unordered_map<uint64_t, pfi::data::unordered_set<uint64_t> >
+    lsh_tombstone_table_t;
+
+class lsh_candidate_set;
+
 class lsh_index_storage : public recommender_storage_base {
  public:
   lsh_index_storage();
@@ -74,6 +82,10 @@ class lsh_index_storage : public recommender_storage_base {
       std::vector<std::pair<std::string, float> >& ids) const;
   std::string name() const;
 
+  // similar_row probes tables and ranks candidates with at most thread_num
+  // threads
+  void set_thread_num(size_t thread_num);
+
   size_t table_num() const {
     return table_num_;
   }
@@ -91,6 +103,9 @@ class lsh_index_storage : public recommender_storage_base {
 
  private:
   typedef pfi::data::unordered_map<uint64_t, std::vector<uint64_t> >lsh_table_t;
+  typedef pfi::lang::shared_ptr<std::vector<uint64_t> > bitmap_ptr;
+
+  friend class lsh_candidate_set;
 
   friend class pfi::data::serialization::access;
   template <class Ar>
@@ -101,6 +116,9 @@ class lsh_index_storage : public recommender_storage_base {
   }
 
   lsh_master_table_t::iterator remove_and_get_row(const std::string& row);
+  void add_to_diff_bucket(uint64_t hash, uint64_t id);
+  void remove_from_diff_bucket(uint64_t hash, uint64_t id);
+  void compact_diff_buckets();
 
   std::vector<float> make_entry(
       const std::vector<float>& hash,
@@ -109,27 +127,45 @@ class lsh_index_storage : public recommender_storage_base {
   bool retrieve_hit_rows(
       uint64_t hash,
       size_t ret_num,
-      pfi::data::unordered_set<uint64_t>& cands) const;
+      lsh_candidate_set& cands) const;
+  void retrieve_hit_rows_parallel(
+      const std::vector<uint64_t>& hashes,
+      size_t ret_num,
+      lsh_candidate_set& cands) const;
 
   void get_sorted_similar_rows(
-      const pfi::data::unordered_set<uint64_t>& cands,
+      const std::vector<uint64_t>& cands,
       const bit_vector& query_simhash,
       float query_norm,
       uint64_t ret_num,
       std::vector<std::pair<std::string, float> >& ids) const;
   const lsh_entry* get_lsh_entry(const std::string& row) const;
-  void remove_model_row(const std::string& row);
+  void remove_model_rows(const lsh_master_table_t& rows);
   void set_mixed_row(const std::string& row, const lsh_entry& entry);
+  bitmap_ptr acquire_candidate_bitmap() const;
+  void release_candidate_bitmap(const bitmap_ptr& bitmap) const;
 
   lsh_master_table_t master_table_;
   lsh_master_table_t master_table_diff_;
 
+  // Rows are appended to buckets in any order. Rows removed from buckets of
+  // lsh_table_diff_ are marked in diff_tombstones_ and erased when they
+  // become half of the bucket, while buckets of lsh_table_ are compacted
+  // when MIXed.
   lsh_table_t lsh_table_;
   lsh_table_t lsh_table_diff_;
+  lsh_tombstone_table_t diff_tombstones_;
 
   std::vector<float> shift_;
   uint64_t table_num_;
   key_manager key_manager_;
+
+  size_t thread_num_;
+
+  // bitmaps of lsh_candidate_set reused among queries, which are all zero
+  // when they are not in use; not serialized
+  mutable std::vector<bitmap_ptr> candidate_bitmaps_;
+  mutable pfi::concurrent::mutex candidate_bitmaps_mutex_;
 };
 
 }  // namespace storage
@@ -21,6 +21,8 @@
 #include <utility>
 #include <vector>
 #include <gtest/gtest.h>
+#include <pficommon/lang/cast.h>
+#include <pficommon/math/random.h>
 #include "lsh_index_storage.hpp"
 
 using std::istringstream;
@@ -29,6 +31,8 @@ using std::pair;
 using std::sort;
 using std::string;
 using std::vector;
+using pfi::lang::lexical_cast;
+using pfi::math::random::mtrand;
 
 namespace jubatus {
 namespace storage {
@@ -44,6 +48,26 @@ vector<float> make_hash(const string& b) {
   return v;
 }
 
+vector<string> similar_row_ids(
+    const lsh_index_storage& s,
+    const vector<float>& hash,
+    uint64_t ret_num) {
+  vector<pair<string, float> > res;
+  s.similar_row(hash, 1, 0, ret_num, res);
+  vector<string> ids;
+  for (size_t i = 0; i < res.size(); ++i) {
+    ids.push_back(res[i].first);
+  }
+  sort(ids.begin(), ids.end());
+  return ids;
+}
+
+void mix_by_itself(lsh_index_storage& s) {
+  string diff;
+  s.get_diff(diff);
+  s.set_mixed_and_clear_diff(diff);
+}
+
 float distance(float norm1, float norm2, float angle_ratio) {
   return std::sqrt(
       norm1 * norm1 + norm2 * norm2
@@ -321,5 +345,95 @@ TEST(lsh_index_storage, set_and_remove_arround_mix) {
   ids.clear();
 }
 
+TEST(lsh_index_storage, update_rows_in_same_bucket) {
+  const vector<float> h1 = make_hash("1 1 1 1");
+  const vector<float> h5 = make_hash("5 5 5 5");
+  lsh_index_storage s(4, 1, 0);
+  for (size_t i = 0; i < 100; ++i) {
+    s.set_row(lexical_cast<string>(i), h1, 1);
+  }
+  for (size_t i = 0; i < 100; i += 2) {
+    s.remove_row(lexical_cast<string>(i));
+  }
+  for (size_t i = 0; i < 100; i += 3) {
+    s.set_row(lexical_cast<string>(i), h5, 1);
+  }
+
+  vector<string> expect1, expect5;
+  for (size_t i = 0; i < 100; ++i) {
+    if (i % 3 == 0) {
+      expect5.push_back(lexical_cast<string>(i));
+    } else if (i % 2 == 1) {
+      expect1.push_back(lexical_cast<string>(i));
+    }
+  }
+  sort(expect1.begin(), expect1.end());
+  sort(expect5.begin(), expect5.end());
+
+  EXPECT_EQ(expect1, similar_row_ids(s, h1, 100));
+  EXPECT_EQ(expect5, similar_row_ids(s, h5, 100));
+
+  std::stringstream ss;
+  s.save(ss);
+  lsh_index_storage s2;
+  s2.load(ss);
+  EXPECT_EQ(expect1, similar_row_ids(s2, h1, 100));
+  EXPECT_EQ(expect5, similar_row_ids(s2, h5, 100));
+
+  mix_by_itself(s);
+  EXPECT_EQ(expect1, similar_row_ids(s, h1, 100));
+  EXPECT_EQ(expect5, similar_row_ids(s, h5, 100));
+}
+
+TEST(lsh_index_storage, update_mixed_row) {
+  const vector<float> h1 = make_hash("1 1 1 1");
+  const vector<float> h5 = make_hash("5 5 5 5");
+  lsh_index_storage s(4, 1, 0);
+  s.set_row("r1", h1, 1);
+  s.set_row("r2", h1, 1);
+  mix_by_itself(s);
+
+  s.set_row("r1", h5, 1);
+  s.remove_row("r2");
+  vector<string> ids;
+  s.get_all_row_ids(ids);
+  EXPECT_EQ(1u, ids.size());
+
+  // r1 is moved out of the bucket of h1 in lsh_table_
+  mix_by_itself(s);
+  EXPECT_TRUE(similar_row_ids(s, h1, 10).empty());
+  EXPECT_EQ(vector<string>(1, "r1"), similar_row_ids(s, h5, 10));
+  s.get_all_row_ids(ids);
+  EXPECT_EQ(vector<string>(1, "r1"), ids);
+}
+
+TEST(lsh_index_storage, thread_num) {
+  lsh_index_storage s1(4, 4, 0), s2(4, 4, 0);
+  s2.set_thread_num(4);
+  mtrand rand(0);
+  for (size_t i = 0; i < 10000; ++i) {
+    vector<float> hash(16);
+    for (size_t j = 0; j < hash.size(); ++j) {
+      hash[j] = 0.5f * rand.next_gaussian();
+    }
+    const string row = lexical_cast<string>(i);
+    s1.set_row(row, hash, 1);
+    s2.set_row(row, hash, 1);
+  }
+
+  // enough probes and candidates to be processed by multiple threads
+  const vector<float> query(16, 0.1f);
+  vector<pair<string, float> > expect, actual;
+  s1.similar_row(query, 1, 1000, 5000, expect);
+  s2.similar_row(query, 1, 1000, 5000, actual);
+  EXPECT_LT(4096u, expect.size());
+  EXPECT_EQ(expect, actual);
+
+  s1.similar_row(query, 1, 1000, 10, expect);
+  s2.similar_row(query, 1, 1000, 10, actual);
+  EXPECT_EQ(10u, expect.size());
+  EXPECT_EQ(expect, actual);
+}
+
 }  // namespace storage
 }  // namespace jubatus
@@ -0,0 +1,170 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include "multi_index_hash.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "../common/exception.hpp"
+
+using std::vector;
+
+namespace jubatus {
+namespace storage {
+
+namespace {
+
+uint64_t binomial(uint64_t n, uint64_t k) {
+  if (k > n) {
+    return 0;
+  }
+  uint64_t ret = 1;
+  for (uint64_t i = 0; i < k; ++i) {
+    ret = ret * (n - i) / (i + 1);
+  }
+  return ret;
+}
+
+}  // namespace
+
+multi_index_hash::multi_index_hash(uint64_t chunk_bits)
+    : chunk_bits_(chunk_bits),
+      bit_num_(0),
+      size_(0) {
+  if (chunk_bits == 0 || chunk_bits > 64) {
+    throw JUBATUS_EXCEPTION(
+        jubatus::exception::runtime_error("invalid chunk_bits"));
+  }
+}
+
+void multi_index_hash::insert(uint64_t id, const bit_vector& bv) {
+  if (size_ == 0 && bit_num_ != bv.bit_num()) {
+    bit_num_ = bv.bit_num();
+    tables_.clear();
+    tables_.resize((bit_num_ + chunk_bits_ - 1) / chunk_bits_);
+  }
+  if (bv.bit_num() != bit_num_) {
+    throw JUBATUS_EXCEPTION(
+        jubatus::exception::runtime_error("bit_num mismatch"));
+  }
+
+  for (size_t i = 0; i < tables_.size(); ++i) {
+    tables_[i][bv.get_bits(i * chunk_bits_, get_chunk_bits(i))]
+        .push_back(id);
+  }
+  ++size_;
+}
+
+void multi_index_hash::remove(uint64_t id, const bit_vector& bv) {
+  if (bv.bit_num() != bit_num_) {
+    return;
+  }
+
+  bool found = false;
+  for (size_t i = 0; i < tables_.size(); ++i) {
+    table_t::iterator it =
+        tables_[i].find(bv.get_bits(i * chunk_bits_, get_chunk_bits(i)));
+    if (it == tables_[i].end()) {
+      continue;
+    }
+    vector<uint64_t>& ids = it->second;
+    vector<uint64_t>::iterator pos = std::find(ids.begin(), ids.end(), id);
+    if (pos == ids.end()) {
+      continue;
+    }
+    found = true;
+    *pos = ids.back();
+    ids.pop_back();
+    if (ids.empty()) {
+      tables_[i].erase(it);
+    }
+  }
+  if (found) {
+    --size_;
+  }
+}
+
+void multi_index_hash::clear() {
+  bit_num_ = 0;
+  size_ = 0;
+  vector<table_t>().swap(tables_);
+}
+
+void multi_index_hash::probe(
+    const bit_vector& bv,
+    uint64_t radius,
+    vector<uint64_t>& ids) const {
+  if (bv.bit_num() != bit_num_) {
+    return;
+  }
+  for (size_t i = 0; i < tables_.size(); ++i) {
+    uint64_t value = bv.get_bits(i * chunk_bits_, get_chunk_bits(i));
+    probe_chunk(i, value, 0, radius, ids);
+  }
+}
+
+uint64_t multi_index_hash::get_probe_num(uint64_t radius) const {
+  uint64_t num = 0;
+  for (size_t i = 0; i < tables_.size(); ++i) {
+    num += binomial(get_chunk_bits(i), radius);
+  }
+  return num;
+}
+
+double multi_index_hash::get_expected_probe_size(uint64_t radius) const {
+  double size = 0;
+  for (size_t i = 0; i < tables_.size(); ++i) {
+    size += binomial(get_chunk_bits(i), radius) * std::ldexp(
+        static_cast<double>(size_), -static_cast<int>(get_chunk_bits(i)));
+  }
+  return size;
+}
+
+uint64_t multi_index_hash::min_chunk_bits() const {
+  if (tables_.empty()) {
+    return 0;
+  }
+  // only the last chunk can be shorter
+  return get_chunk_bits(tables_.size() - 1);
+}
+
+uint64_t multi_index_hash::get_chunk_bits(size_t chunk) const {
+  return std::min(chunk_bits_, bit_num_ - chunk * chunk_bits_);
+}
+
+void multi_index_hash::probe_chunk(
+    size_t chunk,
+    uint64_t value,
+    uint64_t first_bit,
+    uint64_t radius,
+    vector<uint64_t>& ids) const {
+  if (radius == 0) {
+    table_t::const_iterator it = tables_[chunk].find(value);
+    if (it != tables_[chunk].end()) {
+      ids.insert(ids.end(), it->second.begin(), it->second.end());
+    }
+    return;
+  }
+  // flip radius bits at first_bit or later, in increasing order
+  const uint64_t bits = get_chunk_bits(chunk);
+  for (uint64_t b = first_bit; b + radius <= bits; ++b) {
+    probe_chunk(chunk, value ^ (1LLU << b), b + 1, radius - 1, ids);
+  }
+}
+
+}  // namespace storage
+}  // namespace jubatus
@@ -0,0 +1,94 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#ifndef JUBATUS_STORAGE_MULTI_INDEX_HASH_HPP_
+#define JUBATUS_STORAGE_MULTI_INDEX_HASH_HPP_
+
+#include <stdint.h>
+#include <vector>
+#include <pficommon/data/unordered_map.h>
+#include "bit_vector.hpp"
+
+namespace jubatus {
+namespace storage {
+
+// Index of bit vectors for Hamming-space search (multi-index hashing).
+// Bit vectors are split into chunks of chunk_bits bits and each chunk is
+// indexed by its own hash table. When two vectors differ by d bits, some
+// chunk differs by at most d / chunk_num() bits, so probing all chunks
+// with radius 0, 1, ..., r finds every vector within distance
+// chunk_num() * (r + 1) - 1.
+// All vectors in an index must have the same number of bits.
+class multi_index_hash {
+ public:
+  static const uint64_t DEFAULT_CHUNK_BITS = 16;
+
+  explicit multi_index_hash(uint64_t chunk_bits = DEFAULT_CHUNK_BITS);
+
+  void insert(uint64_t id, const bit_vector& bv);
+  void remove(uint64_t id, const bit_vector& bv);
+  void clear();
+
+  // Appends ids of vectors which have a chunk that differs from that of bv
+  // by exactly radius bits. An id can be appended more than once.
+  void probe(
+      const bit_vector& bv,
+      uint64_t radius,
+      std::vector<uint64_t>& ids) const;
+
+  // Number of hash table lookups made by probe with radius
+  uint64_t get_probe_num(uint64_t radius) const;
+  // Expected number of ids appended by probe with radius when indexed
+  // vectors are uniformly distributed
+  double get_expected_probe_size(uint64_t radius) const;
+
+  size_t size() const {
+    return size_;
+  }
+
+  // Number of bits of indexed vectors, or 0 when nothing was inserted
+  uint64_t bit_num() const {
+    return bit_num_;
+  }
+
+  size_t chunk_num() const {
+    return tables_.size();
+  }
+
+  // Bits of the shortest chunk; probing with a larger radius finds nothing
+  uint64_t min_chunk_bits() const;
+
+ private:
+  typedef pfi::data::unordered_map<uint64_t, std::vector<uint64_t> > table_t;
+
+  uint64_t get_chunk_bits(size_t chunk) const;
+  void probe_chunk(
+      size_t chunk,
+      uint64_t value,
+      uint64_t first_bit,
+      uint64_t radius,
+      std::vector<uint64_t>& ids) const;
+
+  const uint64_t chunk_bits_;
+  uint64_t bit_num_;
+  size_t size_;
+  std::vector<table_t> tables_;
+};
+
+}  // namespace storage
+}  // namespace jubatus
+
+#endif  // JUBATUS_STORAGE_MULTI_INDEX_HASH_HPP_
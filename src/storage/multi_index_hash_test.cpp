@@ -0,0 +1,122 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "multi_index_hash.hpp"
+
+using std::string;
+using std::vector;
+
+namespace jubatus {
+namespace storage {
+
+namespace {
+
+bit_vector make_vector(const string& b) {
+  bit_vector v;
+  v.resize_and_clear(b.size());
+  for (size_t i = 0; i < b.size(); ++i) {
+    if (b[i] == '1') {
+      v.set_bit(i);
+    }
+  }
+  return v;
+}
+
+vector<uint64_t> probe(
+    const multi_index_hash& index,
+    const string& b,
+    uint64_t radius) {
+  vector<uint64_t> ids;
+  index.probe(make_vector(b), radius, ids);
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+  return ids;
+}
+
+}  // namespace
+
+TEST(multi_index_hash, trivial) {
+  // 3 chunks: 4, 4 and 2 bits
+  multi_index_hash index(4);
+  index.insert(0, make_vector("0000000000"));
+  index.insert(1, make_vector("1000000000"));
+  index.insert(2, make_vector("1100110011"));
+  EXPECT_EQ(3u, index.size());
+  EXPECT_EQ(10u, index.bit_num());
+  EXPECT_EQ(3u, index.chunk_num());
+  EXPECT_EQ(2u, index.min_chunk_bits());
+
+  // 0 and 1 share the second and third chunks
+  vector<uint64_t> ids = probe(index, "0000000000", 0);
+  ASSERT_EQ(2u, ids.size());
+  EXPECT_EQ(0u, ids[0]);
+  EXPECT_EQ(1u, ids[1]);
+
+  // only the third chunk of 2 differs by 1 bit
+  ids = probe(index, "0000000001", 1);
+  ASSERT_EQ(3u, ids.size());
+
+  ids = probe(index, "1100110011", 0);
+  ASSERT_EQ(1u, ids.size());
+  EXPECT_EQ(2u, ids[0]);
+
+  EXPECT_EQ(4u + 4u + 2u, index.get_probe_num(1));
+  EXPECT_EQ(6u + 6u + 1u, index.get_probe_num(2));
+  EXPECT_EQ(4u + 4u, index.get_probe_num(3));
+}
+
+TEST(multi_index_hash, remove) {
+  multi_index_hash index(4);
+  index.insert(0, make_vector("00000000"));
+  index.insert(1, make_vector("00001111"));
+  index.remove(0, make_vector("00000000"));
+  EXPECT_EQ(1u, index.size());
+
+  vector<uint64_t> ids = probe(index, "00000000", 0);
+  ASSERT_EQ(1u, ids.size());
+  EXPECT_EQ(1u, ids[0]);
+
+  // removing unknown ids does nothing
+  index.remove(5, make_vector("00001111"));
+  EXPECT_EQ(1u, index.size());
+
+  index.remove(1, make_vector("00001111"));
+  EXPECT_EQ(0u, index.size());
+  EXPECT_TRUE(probe(index, "00000000", 0).empty());
+}
+
+TEST(multi_index_hash, bit_num_mismatch) {
+  multi_index_hash index(4);
+  index.insert(0, make_vector("00000000"));
+  EXPECT_THROW(index.insert(1, make_vector("0000")), std::exception);
+  EXPECT_TRUE(probe(index, "0000", 0).empty());
+
+  index.clear();
+  index.insert(1, make_vector("0000"));
+  EXPECT_EQ(4u, index.bit_num());
+}
+
+TEST(multi_index_hash, invalid_chunk_bits) {
+  EXPECT_THROW(multi_index_hash(0), std::exception);
+  EXPECT_THROW(multi_index_hash(65), std::exception);
+}
+
+}  // namespace storage
+}  // namespace jubatus
@@ -0,0 +1,300 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include "posting_list.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+using std::make_pair;
+using std::vector;
+
+namespace jubatus {
+namespace storage {
+
+namespace {
+
+const float QUANTIZED_MAX = 32767.f;
+
+void write_varint(uint64_t v, vector<uint8_t>& out) {
+  while (v >= 0x80) {
+    out.push_back(static_cast<uint8_t>(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(v));
+}
+
+uint64_t read_varint(const vector<uint8_t>& in, size_t& offset) {
+  uint64_t v = 0;
+  for (int shift = 0;; shift += 7) {
+    uint8_t b = in[offset++];
+    v |= static_cast<uint64_t>(b & 0x7f) << shift;
+    if (!(b & 0x80)) {
+      return v;
+    }
+  }
+}
+
+// Approximate size of a node of row_t
+const size_t ROW_NODE_SIZE =
+    sizeof(std::pair<uint64_t, float>) + 2 * sizeof(void*);
+
+}  // namespace
+
+compressed_posting_list::const_iterator::const_iterator(
+    const compressed_posting_list& list)
+    : list_(&list),
+      index_(0),
+      offset_(0),
+      id_(0) {
+  if (list.size_ > 0) {
+    jump_to_block(0);
+  }
+}
+
+void compressed_posting_list::const_iterator::next() {
+  ++index_;
+  if (index_ >= list_->size_) {
+    return;
+  }
+  if (index_ % BLOCK_SIZE == 0) {
+    jump_to_block(index_ / BLOCK_SIZE);
+  } else {
+    id_ += read_varint(list_->ids_, offset_);
+  }
+}
+
+void compressed_posting_list::const_iterator::skip_to(uint64_t id) {
+  if (is_end() || id_ >= id) {
+    return;
+  }
+
+  // skip blocks whose entries are all less than id
+  const vector<uint64_t>& firsts = list_->block_first_ids_;
+  size_t block = index_ / BLOCK_SIZE;
+  size_t last = std::upper_bound(firsts.begin() + block + 1, firsts.end(), id)
+      - firsts.begin() - 1;
+  if (last > block) {
+    jump_to_block(last);
+  }
+
+  while (!is_end() && id_ < id) {
+    next();
+  }
+}
+
+void compressed_posting_list::const_iterator::jump_to_block(size_t block) {
+  index_ = block * BLOCK_SIZE;
+  offset_ = list_->block_offsets_[block];
+  id_ = list_->block_first_ids_[block];
+}
+
+compressed_posting_list::compressed_posting_list()
+    : size_(0),
+      value_type_(CONSTANT_VALUE),
+      value_(0.f) {
+}
+
+void compressed_posting_list::build(const entries_t& entries, bool quantize) {
+  compressed_posting_list list;
+  list.size_ = entries.size();
+
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (i % BLOCK_SIZE == 0) {
+      list.block_first_ids_.push_back(entries[i].first);
+      list.block_offsets_.push_back(list.ids_.size());
+    } else {
+      write_varint(entries[i].first - entries[i - 1].first, list.ids_);
+    }
+  }
+
+  bool constant = true;
+  float max_abs = 0.f;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (entries[i].second != entries[0].second) {
+      constant = false;
+    }
+    max_abs = std::max(max_abs, std::fabs(entries[i].second));
+  }
+
+  if (constant) {
+    list.value_type_ = CONSTANT_VALUE;
+    list.value_ = entries.empty() ? 0.f : entries[0].second;
+  } else if (quantize) {
+    list.value_type_ = QUANTIZED_VALUE;
+    list.value_ = max_abs / QUANTIZED_MAX;
+    list.quantized_values_.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+      list.quantized_values_.push_back(static_cast<int16_t>(
+          std::floor(entries[i].second / list.value_ + 0.5f)));
+    }
+  } else {
+    list.value_type_ = FLOAT_VALUE;
+    list.values_.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+      list.values_.push_back(entries[i].second);
+    }
+  }
+
+  // vectors built above may have extra capacity
+  vector<uint8_t>(list.ids_).swap(list.ids_);
+  vector<uint64_t>(list.block_first_ids_).swap(list.block_first_ids_);
+  vector<uint32_t>(list.block_offsets_).swap(list.block_offsets_);
+  swap(list);
+}
+
+void compressed_posting_list::get_all(entries_t& entries) const {
+  entries.clear();
+  entries.reserve(size_);
+  for (const_iterator it = begin(); !it.is_end(); it.next()) {
+    entries.push_back(make_pair(it.id(), it.value()));
+  }
+}
+
+bool compressed_posting_list::find(uint64_t id, float& value) const {
+  const_iterator it = begin();
+  it.skip_to(id);
+  if (it.is_end() || it.id() != id) {
+    return false;
+  }
+  value = it.value();
+  return true;
+}
+
+size_t compressed_posting_list::memory_size() const {
+  return sizeof(*this)
+      + ids_.capacity() * sizeof(uint8_t)
+      + block_first_ids_.capacity() * sizeof(uint64_t)
+      + block_offsets_.capacity() * sizeof(uint32_t)
+      + values_.capacity() * sizeof(float)
+      + quantized_values_.capacity() * sizeof(int16_t);
+}
+
+void compressed_posting_list::swap(compressed_posting_list& list) {
+  std::swap(size_, list.size_);
+  ids_.swap(list.ids_);
+  block_first_ids_.swap(list.block_first_ids_);
+  block_offsets_.swap(list.block_offsets_);
+  std::swap(value_type_, list.value_type_);
+  std::swap(value_, list.value_);
+  values_.swap(list.values_);
+  quantized_values_.swap(list.quantized_values_);
+}
+
+float compressed_posting_list::get_value(size_t index) const {
+  switch (value_type_) {
+    case FLOAT_VALUE:
+      return values_[index];
+    case QUANTIZED_VALUE:
+      return quantized_values_[index] * value_;
+    default:
+      return value_;
+  }
+}
+
+posting_list::const_iterator::const_iterator(const posting_list& list)
+    : list_(&list),
+      base_(list.compressed_.begin()),
+      update_(list.updates_.begin()) {
+  skip_overridden();
+  skip_removed();
+}
+
+void posting_list::const_iterator::next() {
+  if (!base_.is_end()) {
+    base_.next();
+    skip_overridden();
+  } else {
+    ++update_;
+    skip_removed();
+  }
+}
+
+void posting_list::const_iterator::skip_overridden() {
+  if (list_->updates_.empty()) {
+    return;
+  }
+  while (!base_.is_end() && list_->updates_.count(base_.id())) {
+    base_.next();
+  }
+}
+
+void posting_list::const_iterator::skip_removed() {
+  while (update_ != list_->updates_.end() && update_->second == 0.f) {
+    ++update_;
+  }
+}
+
+void posting_list::set(uint64_t id, float value) {
+  float current;
+  if (value == 0.f && !compressed_.find(id, current)) {
+    updates_.erase(id);
+  } else {
+    updates_[id] = value;
+  }
+}
+
+bool posting_list::find(uint64_t id, float& value) const {
+  row_t::const_iterator it = updates_.find(id);
+  if (it != updates_.end()) {
+    value = it->second;
+    return value != 0.f;
+  }
+  return compressed_.find(id, value);
+}
+
+void posting_list::get_all(entries_t& entries) const {
+  entries.clear();
+  for (const_iterator it = begin(); !it.is_end(); it.next()) {
+    entries.push_back(make_pair(it.id(), it.value()));
+  }
+  std::sort(entries.begin(), entries.end());
+}
+
+bool posting_list::empty() const {
+  // removed entries in updates_ always exist in compressed_
+  size_t removed = 0;
+  for (row_t::const_iterator it = updates_.begin(); it != updates_.end();
+       ++it) {
+    if (it->second != 0.f) {
+      return false;
+    }
+    ++removed;
+  }
+  return removed == compressed_.size();
+}
+
+bool posting_list::needs_compaction() const {
+  return updates_.size() * COMPACTION_RATIO > compressed_.size();
+}
+
+void posting_list::compact(bool quantize) {
+  entries_t entries;
+  get_all(entries);
+  compressed_.build(entries, quantize);
+  row_t().swap(updates_);
+}
+
+size_t posting_list::memory_size() const {
+  return compressed_.memory_size() + sizeof(updates_)
+      + updates_.size() * ROW_NODE_SIZE
+      + updates_.bucket_count() * sizeof(void*);
+}
+
+}  // namespace storage
+}  // namespace jubatus
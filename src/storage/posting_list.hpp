@@ -0,0 +1,182 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#ifndef JUBATUS_STORAGE_POSTING_LIST_HPP_
+#define JUBATUS_STORAGE_POSTING_LIST_HPP_
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+#include "storage_type.hpp"
+
+namespace jubatus {
+namespace storage {
+
+// Read-only list of (column id, value) sorted by column id.
+// Column ids are delta encoded with varints in blocks of BLOCK_SIZE
+// entries, and the first id of each block is kept so that lookups can skip
+// blocks. Values are stored as one constant when all of them are the same,
+// and otherwise as floats or as 16-bit fixed point numbers scaled by the
+// maximum absolute value when quantized.
+class compressed_posting_list {
+ public:
+  typedef std::vector<std::pair<uint64_t, float> > entries_t;
+
+  static const size_t BLOCK_SIZE = 128;
+
+  class const_iterator {
+   public:
+    explicit const_iterator(const compressed_posting_list& list);
+
+    bool is_end() const {
+      return index_ >= list_->size_;
+    }
+
+    uint64_t id() const {
+      return id_;
+    }
+
+    float value() const {
+      return list_->get_value(index_);
+    }
+
+    void next();
+    // moves to the first entry whose id is not less than id
+    void skip_to(uint64_t id);
+
+   private:
+    void jump_to_block(size_t block);
+
+    const compressed_posting_list* list_;
+    size_t index_;
+    size_t offset_;
+    uint64_t id_;
+  };
+
+  compressed_posting_list();
+
+  // entries must be sorted by id and must not have duplicated ids
+  void build(const entries_t& entries, bool quantize);
+  void get_all(entries_t& entries) const;
+  bool find(uint64_t id, float& value) const;
+
+  const_iterator begin() const {
+    return const_iterator(*this);
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  size_t memory_size() const;
+
+  void swap(compressed_posting_list& list);
+
+ private:
+  enum value_type {
+    CONSTANT_VALUE,
+    FLOAT_VALUE,
+    QUANTIZED_VALUE
+  };
+
+  float get_value(size_t index) const;
+
+  size_t size_;
+  // deltas of ids except for the first id of each block
+  std::vector<uint8_t> ids_;
+  std::vector<uint64_t> block_first_ids_;
+  std::vector<uint32_t> block_offsets_;
+
+  value_type value_type_;
+  // the constant value, or the scale of quantized values
+  float value_;
+  std::vector<float> values_;
+  std::vector<int16_t> quantized_values_;
+};
+
+// Posting list of the mixed model: a compressed_posting_list and the
+// updates which are not compressed yet. The updates are merged into the
+// compressed list when they grow large relative to it, so that each mix
+// does not need to rebuild long lists.
+class posting_list {
+ public:
+  typedef compressed_posting_list::entries_t entries_t;
+
+  // Iterates entries in no particular order
+  class const_iterator {
+   public:
+    explicit const_iterator(const posting_list& list);
+
+    bool is_end() const {
+      return base_.is_end() && update_ == list_->updates_.end();
+    }
+
+    uint64_t id() const {
+      return base_.is_end() ? update_->first : base_.id();
+    }
+
+    float value() const {
+      return base_.is_end() ? update_->second : base_.value();
+    }
+
+    void next();
+
+   private:
+    void skip_overridden();
+    void skip_removed();
+
+    const posting_list* list_;
+    compressed_posting_list::const_iterator base_;
+    row_t::const_iterator update_;
+  };
+
+  // updates are compacted when they exceed 1 / COMPACTION_RATIO of
+  // the compressed list
+  static const size_t COMPACTION_RATIO = 8;
+
+  const_iterator begin() const {
+    return const_iterator(*this);
+  }
+
+  // 0 removes the entry
+  void set(uint64_t id, float value);
+  bool find(uint64_t id, float& value) const;
+  void get_all(entries_t& entries) const;
+
+  bool empty() const;
+  bool needs_compaction() const;
+  void compact(bool quantize);
+
+  const compressed_posting_list& get_compressed() const {
+    return compressed_;
+  }
+
+  // updates which override the compressed list; 0 means removed
+  const row_t& get_updates() const {
+    return updates_;
+  }
+
+  size_t memory_size() const;
+
+ private:
+  compressed_posting_list compressed_;
+  row_t updates_;
+};
+
+}  // namespace storage
+}  // namespace jubatus
+
+#endif  // JUBATUS_STORAGE_POSTING_LIST_HPP_
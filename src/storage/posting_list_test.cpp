@@ -0,0 +1,214 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include <map>
+#include <utility>
+#include <vector>
+#include <gtest/gtest.h>
+#include "posting_list.hpp"
+
+using std::make_pair;
+using std::map;
+using std::vector;
+
+namespace jubatus {
+namespace storage {
+
+namespace {
+
+// ids with both small and large gaps, spanning several blocks
+compressed_posting_list::entries_t make_entries(size_t n) {
+  compressed_posting_list::entries_t entries;
+  uint64_t id = 3;
+  for (size_t i = 0; i < n; ++i) {
+    entries.push_back(make_pair(id, static_cast<float>(i % 7) - 3.f));
+    id += (i % 5 == 0) ? 1000000007ULL : i % 3 + 1;
+  }
+  return entries;
+}
+
+}  // namespace
+
+TEST(compressed_posting_list, empty) {
+  compressed_posting_list list;
+  list.build(compressed_posting_list::entries_t(), false);
+  EXPECT_EQ(0u, list.size());
+  EXPECT_TRUE(list.begin().is_end());
+  float value;
+  EXPECT_FALSE(list.find(0, value));
+}
+
+TEST(compressed_posting_list, build) {
+  compressed_posting_list::entries_t entries = make_entries(1000);
+  compressed_posting_list list;
+  list.build(entries, false);
+  EXPECT_EQ(1000u, list.size());
+
+  compressed_posting_list::entries_t actual;
+  list.get_all(actual);
+  EXPECT_EQ(entries, actual);
+
+  for (size_t i = 0; i < entries.size(); ++i) {
+    float value = 0;
+    EXPECT_TRUE(list.find(entries[i].first, value));
+    EXPECT_EQ(entries[i].second, value);
+  }
+  for (size_t i = 0; i + 1 < entries.size(); ++i) {
+    if (entries[i].first + 1 != entries[i + 1].first) {
+      float value;
+      EXPECT_FALSE(list.find(entries[i].first + 1, value));
+    }
+  }
+  float value;
+  EXPECT_FALSE(list.find(0, value));
+}
+
+TEST(compressed_posting_list, constant_value) {
+  compressed_posting_list::entries_t entries;
+  for (uint64_t i = 0; i < 300; ++i) {
+    entries.push_back(make_pair(i * 2, 1.5f));
+  }
+  compressed_posting_list list;
+  list.build(entries, false);
+
+  compressed_posting_list::entries_t actual;
+  list.get_all(actual);
+  EXPECT_EQ(entries, actual);
+  // ids take one byte each and values are not stored
+  EXPECT_GT(entries.size() * 2, list.memory_size() - sizeof(list));
+}
+
+TEST(compressed_posting_list, quantize) {
+  compressed_posting_list::entries_t entries = make_entries(500);
+  compressed_posting_list list;
+  list.build(entries, true);
+
+  compressed_posting_list::entries_t actual;
+  list.get_all(actual);
+  ASSERT_EQ(entries.size(), actual.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    EXPECT_EQ(entries[i].first, actual[i].first);
+    EXPECT_NEAR(entries[i].second, actual[i].second, 3.f / 32767);
+  }
+}
+
+TEST(compressed_posting_list, skip_to) {
+  compressed_posting_list::entries_t entries = make_entries(1000);
+  compressed_posting_list list;
+  list.build(entries, false);
+
+  compressed_posting_list::const_iterator it = list.begin();
+  for (size_t i = 0; i + 1 < entries.size(); i += 37) {
+    it.skip_to(entries[i].first);
+    ASSERT_FALSE(it.is_end());
+    EXPECT_EQ(entries[i].first, it.id());
+    EXPECT_EQ(entries[i].second, it.value());
+
+    // moves to the next entry if id does not exist
+    it.skip_to(entries[i].first + 1);
+    ASSERT_FALSE(it.is_end());
+    EXPECT_EQ(entries[i + 1].first, it.id());
+  }
+
+  // never moves backward
+  uint64_t current = it.id();
+  it.skip_to(0);
+  EXPECT_EQ(current, it.id());
+
+  it.skip_to(entries.back().first + 1);
+  EXPECT_TRUE(it.is_end());
+}
+
+TEST(posting_list, set) {
+  posting_list list;
+  list.set(1, 1.f);
+  list.set(5, 2.f);
+  list.set(3, 3.f);
+  EXPECT_FALSE(list.empty());
+
+  compressed_posting_list::entries_t entries;
+  list.get_all(entries);
+  ASSERT_EQ(3u, entries.size());
+  EXPECT_EQ(1u, entries[0].first);
+  EXPECT_EQ(1.f, entries[0].second);
+  EXPECT_EQ(3u, entries[1].first);
+  EXPECT_EQ(3.f, entries[1].second);
+  EXPECT_EQ(5u, entries[2].first);
+  EXPECT_EQ(2.f, entries[2].second);
+
+  // removing an entry which is not compacted yet
+  list.set(3, 0.f);
+  float value;
+  EXPECT_FALSE(list.find(3, value));
+  list.get_all(entries);
+  EXPECT_EQ(2u, entries.size());
+}
+
+TEST(posting_list, compact) {
+  posting_list list;
+  map<uint64_t, float> expect;
+  for (uint64_t i = 0; i < 1000; ++i) {
+    list.set(i * 3, i % 10);
+    if (i % 10) {
+      expect[i * 3] = i % 10;
+    }
+  }
+  EXPECT_TRUE(list.needs_compaction());
+  list.compact(false);
+  EXPECT_TRUE(list.get_updates().empty());
+  EXPECT_EQ(expect.size(), list.get_compressed().size());
+
+  // updates override the compressed list
+  list.set(3, 0.f);
+  list.set(6, 5.f);
+  list.set(1, 4.f);
+  expect.erase(3);
+  expect[6] = 5.f;
+  expect[1] = 4.f;
+  EXPECT_FALSE(list.needs_compaction());
+
+  compressed_posting_list::entries_t entries;
+  list.get_all(entries);
+  EXPECT_EQ(compressed_posting_list::entries_t(expect.begin(), expect.end()),
+            entries);
+  float value;
+  EXPECT_FALSE(list.find(3, value));
+  EXPECT_TRUE(list.find(6, value));
+  EXPECT_EQ(5.f, value);
+
+  list.compact(false);
+  list.get_all(entries);
+  EXPECT_EQ(compressed_posting_list::entries_t(expect.begin(), expect.end()),
+            entries);
+}
+
+TEST(posting_list, empty) {
+  posting_list list;
+  EXPECT_TRUE(list.empty());
+  list.set(1, 1.f);
+  list.set(2, 1.f);
+  list.compact(false);
+  list.set(1, 0.f);
+  EXPECT_FALSE(list.empty());
+  list.set(2, 0.f);
+  EXPECT_TRUE(list.empty());
+  list.compact(false);
+  EXPECT_TRUE(list.empty());
+  EXPECT_EQ(0u, list.get_compressed().size());
+}
+
+}  // namespace storage
+}  // namespace jubatus
@@ -0,0 +1,530 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include "pq_index_storage.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <pficommon/data/serialization.h>
+#include <pficommon/math/random.h>
+
+using std::istream;
+using std::istringstream;
+using std::make_pair;
+using std::ostream;
+using std::ostringstream;
+using std::pair;
+using std::priority_queue;
+using std::string;
+using std::vector;
+using pfi::data::unordered_map;
+using pfi::math::random::mtrand;
+
+namespace jubatus {
+namespace storage {
+
+namespace {
+
+const size_t KMEANS_ITERATION_NUM = 20;
+
+pq_diff extract_diff(const string& diff_str) {
+  istringstream iss(diff_str);
+  pfi::data::serialization::binary_iarchive bi(iss);
+  pq_diff diff;
+  bi >> diff;
+  return diff;
+}
+
+string serialize_diff(const pq_diff& diff) {
+  ostringstream oss;
+  pfi::data::serialization::binary_oarchive bo(oss);
+  bo << const_cast<pq_diff&>(diff);
+  return oss.str();
+}
+
+struct less_row {
+  template <class T>
+  bool operator()(const T* x, const T* y) const {
+    return x->first < y->first;
+  }
+};
+
+float calc_squared_distance(const float* x, const float* y, size_t size) {
+  float d = 0;
+  for (size_t i = 0; i < size; ++i) {
+    const float diff = x[i] - y[i];
+    d += diff * diff;
+  }
+  return d;
+}
+
+size_t find_nearest(
+    const float* x,
+    const float* centroids,
+    size_t centroid_num,
+    size_t dimension) {
+  size_t nearest = 0;
+  float nearest_distance = calc_squared_distance(x, centroids, dimension);
+  for (size_t c = 1; c < centroid_num; ++c) {
+    const float d = calc_squared_distance(x, centroids + c * dimension,
+                                          dimension);
+    if (d < nearest_distance) {
+      nearest = c;
+      nearest_distance = d;
+    }
+  }
+  return nearest;
+}
+
+// Lloyd's algorithm for weighted points, starting from randomly chosen
+// points. Centroids without points are left as they are.
+void run_kmeans(
+    const vector<float>& points,
+    const vector<double>& weights,
+    size_t dimension,
+    size_t centroid_num,
+    mtrand& rand,
+    float* centroids,
+    double* centroid_weights) {
+  const size_t point_num = weights.size();
+  vector<size_t> order(point_num);
+  for (size_t i = 0; i < point_num; ++i) {
+    order[i] = i;
+  }
+  for (size_t i = 0; i < std::min(centroid_num, point_num); ++i) {
+    std::swap(order[i], order[i + rand.next_int(point_num - i)]);
+  }
+  for (size_t c = 0; c < centroid_num; ++c) {
+    const float* p = &points[order[c % point_num] * dimension];
+    std::copy(p, p + dimension, centroids + c * dimension);
+  }
+
+  vector<size_t> assignment(point_num, centroid_num);
+  vector<double> sums(centroid_num * dimension);
+  for (size_t iteration = 0; iteration < KMEANS_ITERATION_NUM; ++iteration) {
+    bool changed = false;
+    for (size_t i = 0; i < point_num; ++i) {
+      const size_t c = find_nearest(&points[i * dimension], centroids,
+                                    centroid_num, dimension);
+      if (c != assignment[i]) {
+        assignment[i] = c;
+        changed = true;
+      }
+    }
+    if (!changed) {
+      break;
+    }
+
+    std::fill(sums.begin(), sums.end(), 0);
+    std::fill(centroid_weights, centroid_weights + centroid_num, 0);
+    for (size_t i = 0; i < point_num; ++i) {
+      const size_t c = assignment[i];
+      centroid_weights[c] += weights[i];
+      for (size_t d = 0; d < dimension; ++d) {
+        sums[c * dimension + d] += weights[i] * points[i * dimension + d];
+      }
+    }
+    for (size_t c = 0; c < centroid_num; ++c) {
+      if (centroid_weights[c] > 0) {
+        for (size_t d = 0; d < dimension; ++d) {
+          centroids[c * dimension + d] =
+              sums[c * dimension + d] / centroid_weights[c];
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+
+const size_t pq_index_storage::DEFAULT_DIMENSION = 64;
+const size_t pq_index_storage::DEFAULT_SUBSPACE_NUM = 8;
+const size_t pq_index_storage::DEFAULT_CENTROID_NUM = 256;
+const size_t pq_index_storage::DEFAULT_TRAIN_SIZE = 4096;
+
+pq_index_storage::pq_index_storage()
+    : dimension_(DEFAULT_DIMENSION),
+      subspace_num_(DEFAULT_SUBSPACE_NUM),
+      centroid_num_(DEFAULT_CENTROID_NUM),
+      train_size_(DEFAULT_TRAIN_SIZE),
+      seed_(0),
+      vector_source_(NULL) {
+}
+
+pq_index_storage::pq_index_storage(
+    size_t dimension,
+    size_t subspace_num,
+    size_t centroid_num,
+    size_t train_size,
+    uint32_t seed)
+    : dimension_(dimension),
+      subspace_num_(subspace_num),
+      centroid_num_(centroid_num),
+      train_size_(train_size),
+      seed_(seed),
+      vector_source_(NULL) {
+}
+
+pq_index_storage::~pq_index_storage() {
+}
+
+void pq_index_storage::set_row(const string& row, const vector<float>& vec) {
+  put_row(row, vec);
+  pq_row& r = diff_.rows[row];
+  r.values = vec;
+  r.removed = false;
+  train_if_ready();
+}
+
+bool pq_index_storage::get_row(const string& row, vector<float>& vec) const {
+  vec.clear();
+  unordered_map<string, uint64_t>::const_iterator it = row2index_.find(row);
+  if (it != row2index_.end()) {
+    decode(&codes_[it->second * subspace_num_], vec);
+    return true;
+  }
+  pending_rows_t::const_iterator p = pending_.find(row);
+  if (p != pending_.end()) {
+    vec = p->second;
+    return true;
+  }
+  return false;
+}
+
+void pq_index_storage::remove_row(const string& row) {
+  delete_row(row);
+  pq_row& r = diff_.rows[row];
+  r.values.clear();
+  r.removed = true;
+}
+
+void pq_index_storage::clear() {
+  vector<float>().swap(centroids_);
+  vector<double>().swap(centroid_weights_);
+  vector<uint8_t>().swap(codes_);
+  vector<string>().swap(rows_);
+  unordered_map<string, uint64_t>().swap(row2index_);
+  pending_rows_t().swap(pending_);
+  diff_ = pq_diff();
+}
+
+void pq_index_storage::get_all_row_ids(vector<string>& ids) const {
+  ids = rows_;
+  for (pending_rows_t::const_iterator it = pending_.begin();
+      it != pending_.end(); ++it) {
+    ids.push_back(it->first);
+  }
+}
+
+void pq_index_storage::similar_row(
+    const vector<float>& query,
+    size_t ret_num,
+    vector<pair<string, float> >& ids) const {
+  ids.clear();
+  if (ret_num == 0 || query.size() != dimension_) {
+    return;
+  }
+
+  // max heap of the nearest rows
+  priority_queue<pair<float, const string*> > nearest;
+
+  if (!rows_.empty()) {
+    // squared distances from subvectors of the query to all centroids
+    const size_t sub_dim = subspace_dimension();
+    vector<float> table(subspace_num_ * centroid_num_);
+    for (size_t s = 0; s < subspace_num_; ++s) {
+      const float* q = &query[s * sub_dim];
+      const float* c = &centroids_[s * centroid_num_ * sub_dim];
+      for (size_t k = 0; k < centroid_num_; ++k) {
+        table[s * centroid_num_ + k] =
+            calc_squared_distance(q, c + k * sub_dim, sub_dim);
+      }
+    }
+
+    const uint8_t* code = &codes_[0];
+    for (size_t i = 0; i < rows_.size(); ++i, code += subspace_num_) {
+      const float* t = &table[0];
+      float d = 0;
+      for (size_t s = 0; s < subspace_num_; ++s, t += centroid_num_) {
+        d += t[code[s]];
+      }
+      if (nearest.size() < ret_num) {
+        nearest.push(make_pair(d, &rows_[i]));
+      } else if (d < nearest.top().first) {
+        nearest.pop();
+        nearest.push(make_pair(d, &rows_[i]));
+      }
+    }
+  }
+
+  for (pending_rows_t::const_iterator it = pending_.begin();
+      it != pending_.end(); ++it) {
+    const float d =
+        calc_squared_distance(&query[0], &it->second[0], dimension_);
+    if (nearest.size() < ret_num) {
+      nearest.push(make_pair(d, &it->first));
+    } else if (d < nearest.top().first) {
+      nearest.pop();
+      nearest.push(make_pair(d, &it->first));
+    }
+  }
+
+  ids.resize(nearest.size());
+  for (size_t i = ids.size(); i > 0; --i) {
+    ids[i - 1] = make_pair(*nearest.top().second,
+                           std::sqrt(nearest.top().first));
+    nearest.pop();
+  }
+}
+
+string pq_index_storage::name() const {
+  return "pq_index_storage";
+}
+
+bool pq_index_storage::save(ostream& os) {
+  pfi::data::serialization::binary_oarchive oa(os);
+  oa << *this;
+  return true;
+}
+
+bool pq_index_storage::load(istream& is) {
+  pfi::data::serialization::binary_iarchive ia(is);
+  ia >> *this;
+  return true;
+}
+
+void pq_index_storage::get_diff(string& diff) const {
+  diff = serialize_diff(diff_);
+}
+
+void pq_index_storage::set_mixed_and_clear_diff(const string& mixed_diff) {
+  const pq_diff diff = extract_diff(mixed_diff);
+  diff_ = pq_diff();
+
+  if (!diff.centroids.empty() && diff.centroids != centroids_) {
+    set_codebook(diff.centroids, diff.centroid_weights);
+  }
+  for (unordered_map<string, pq_row>::const_iterator it = diff.rows.begin();
+      it != diff.rows.end(); ++it) {
+    if (it->second.removed) {
+      delete_row(it->first);
+    } else {
+      put_row(it->first, it->second.values);
+    }
+  }
+  // the codebook is sent by every MIX for servers which have none
+  diff_.centroids = centroids_;
+  diff_.centroid_weights = centroid_weights_;
+  train_if_ready();
+}
+
+void pq_index_storage::mix(const string& lhs, string& rhs) const {
+  const pq_diff diff_l = extract_diff(lhs);
+  pq_diff diff_r = extract_diff(rhs);
+
+  for (unordered_map<string, pq_row>::const_iterator it = diff_l.rows.begin();
+      it != diff_l.rows.end(); ++it) {
+    diff_r.rows[it->first] = it->second;
+  }
+  merge_codebooks(diff_l, diff_r);
+
+  rhs = serialize_diff(diff_r);
+}
+
+// private
+
+void pq_index_storage::put_row(const string& row, const vector<float>& vec) {
+  if (vec.size() != dimension_) {
+    return;
+  }
+  if (!is_trained()) {
+    pending_[row] = vec;
+    return;
+  }
+
+  unordered_map<string, uint64_t>::const_iterator it = row2index_.find(row);
+  uint64_t index = rows_.size();
+  if (it != row2index_.end()) {
+    index = it->second;
+  } else {
+    rows_.push_back(row);
+    row2index_[row] = index;
+    codes_.resize(codes_.size() + subspace_num_);
+  }
+  encode(vec, &codes_[index * subspace_num_]);
+}
+
+void pq_index_storage::delete_row(const string& row) {
+  pending_.erase(row);
+
+  unordered_map<string, uint64_t>::iterator it = row2index_.find(row);
+  if (it == row2index_.end()) {
+    return;
+  }
+  // the last row is moved to keep codes_ dense
+  const uint64_t index = it->second;
+  const uint64_t last = rows_.size() - 1;
+  row2index_.erase(it);
+  if (index != last) {
+    std::copy(codes_.begin() + last * subspace_num_, codes_.end(),
+              codes_.begin() + index * subspace_num_);
+    rows_[index].swap(rows_[last]);
+    row2index_[rows_[index]] = index;
+  }
+  rows_.pop_back();
+  codes_.resize(last * subspace_num_);
+}
+
+void pq_index_storage::reset_row_index() {
+  unordered_map<string, uint64_t>().swap(row2index_);
+  for (size_t i = 0; i < rows_.size(); ++i) {
+    row2index_[rows_[i]] = i;
+  }
+}
+
+void pq_index_storage::train_if_ready() {
+  if (is_trained() || pending_.size() < train_size_) {
+    return;
+  }
+
+  // rows are sorted to train the same codebook from the same rows
+  vector<const pending_rows_t::value_type*> rows;
+  rows.reserve(pending_.size());
+  for (pending_rows_t::const_iterator it = pending_.begin();
+      it != pending_.end(); ++it) {
+    rows.push_back(&*it);
+  }
+  std::sort(rows.begin(), rows.end(), less_row());
+
+  const size_t sub_dim = subspace_dimension();
+  vector<float> centroids(subspace_num_ * centroid_num_ * sub_dim);
+  vector<double> centroid_weights(subspace_num_ * centroid_num_);
+  const vector<double> weights(rows.size(), 1);
+  vector<float> points(rows.size() * sub_dim);
+  mtrand rand(seed_);
+  for (size_t s = 0; s < subspace_num_; ++s) {
+    for (size_t i = 0; i < rows.size(); ++i) {
+      const float* v = &rows[i]->second[s * sub_dim];
+      std::copy(v, v + sub_dim, &points[i * sub_dim]);
+    }
+    run_kmeans(points, weights, sub_dim, centroid_num_, rand,
+               &centroids[s * centroid_num_ * sub_dim],
+               &centroid_weights[s * centroid_num_]);
+  }
+
+  set_codebook(centroids, centroid_weights);
+  diff_.centroids = centroids_;
+  diff_.centroid_weights = centroid_weights_;
+  diff_.trained = true;
+}
+
+void pq_index_storage::set_codebook(
+    const vector<float>& centroids,
+    const vector<double>& centroid_weights) {
+  // encoded rows are encoded again from their exact vectors, or from
+  // reconstructed ones whose errors add up
+  vector<vector<float> > vecs(rows_.size());
+  for (size_t i = 0; i < rows_.size(); ++i) {
+    if (!vector_source_ || !vector_source_->get_vector(rows_[i], vecs[i])
+        || vecs[i].size() != dimension_) {
+      decode(&codes_[i * subspace_num_], vecs[i]);
+    }
+  }
+  centroids_ = centroids;
+  centroid_weights_ = centroid_weights;
+  for (size_t i = 0; i < rows_.size(); ++i) {
+    encode(vecs[i], &codes_[i * subspace_num_]);
+  }
+  encode_pending_rows();
+}
+
+void pq_index_storage::merge_codebooks(const pq_diff& lhs, pq_diff& rhs)
+    const {
+  if (lhs.centroids.empty()) {
+    return;
+  }
+  // codebooks given by MIX take the place of those trained since then
+  if (rhs.centroids.empty() || (rhs.trained && !lhs.trained)) {
+    rhs.centroids = lhs.centroids;
+    rhs.centroid_weights = lhs.centroid_weights;
+    rhs.trained = lhs.trained;
+    return;
+  }
+  if (!rhs.trained || !lhs.trained || lhs.centroids == rhs.centroids) {
+    return;
+  }
+
+  // centroids of both codebooks are clustered with their weights
+  const size_t sub_dim = subspace_dimension();
+  const size_t size = centroid_num_ * sub_dim;
+  vector<float> centroids(subspace_num_ * size);
+  vector<double> centroid_weights(subspace_num_ * centroid_num_);
+  mtrand rand(seed_);
+  for (size_t s = 0; s < subspace_num_; ++s) {
+    vector<float> points(lhs.centroids.begin() + s * size,
+                         lhs.centroids.begin() + (s + 1) * size);
+    points.insert(points.end(), rhs.centroids.begin() + s * size,
+                  rhs.centroids.begin() + (s + 1) * size);
+    vector<double> weights(
+        lhs.centroid_weights.begin() + s * centroid_num_,
+        lhs.centroid_weights.begin() + (s + 1) * centroid_num_);
+    weights.insert(weights.end(),
+                   rhs.centroid_weights.begin() + s * centroid_num_,
+                   rhs.centroid_weights.begin() + (s + 1) * centroid_num_);
+    run_kmeans(points, weights, sub_dim, centroid_num_, rand,
+               &centroids[s * size], &centroid_weights[s * centroid_num_]);
+  }
+  rhs.centroids.swap(centroids);
+  rhs.centroid_weights.swap(centroid_weights);
+}
+
+void pq_index_storage::encode_pending_rows() {
+  for (pending_rows_t::const_iterator it = pending_.begin();
+      it != pending_.end(); ++it) {
+    rows_.push_back(it->first);
+    row2index_[it->first] = rows_.size() - 1;
+    codes_.resize(codes_.size() + subspace_num_);
+    encode(it->second, &codes_[codes_.size() - subspace_num_]);
+  }
+  pending_rows_t().swap(pending_);
+}
+
+void pq_index_storage::encode(const vector<float>& vec, uint8_t* code) const {
+  const size_t sub_dim = subspace_dimension();
+  for (size_t s = 0; s < subspace_num_; ++s) {
+    code[s] = static_cast<uint8_t>(find_nearest(
+        &vec[s * sub_dim], &centroids_[s * centroid_num_ * sub_dim],
+        centroid_num_, sub_dim));
+  }
+}
+
+void pq_index_storage::decode(const uint8_t* code, vector<float>& vec) const {
+  const size_t sub_dim = subspace_dimension();
+  vec.resize(dimension_);
+  for (size_t s = 0; s < subspace_num_; ++s) {
+    const float* c =
+        &centroids_[(s * centroid_num_ + code[s]) * sub_dim];
+    std::copy(c, c + sub_dim, &vec[s * sub_dim]);
+  }
+}
+
+}  // namespace storage
+}  // namespace jubatus
@@ -0,0 +1,207 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#ifndef JUBATUS_STORAGE_PQ_INDEX_STORAGE_HPP_
+#define JUBATUS_STORAGE_PQ_INDEX_STORAGE_HPP_
+
+#include <stdint.h>
+#include <iosfwd>
+#include <string>
+#include <utility>
+#include <vector>
+#include <pficommon/data/serialization.h>
+#include <pficommon/data/serialization/unordered_map.h>
+#include <pficommon/data/unordered_map.h>
+#include "recommender_storage_base.hpp"
+
+namespace jubatus {
+namespace storage {
+
+struct pq_row {
+  pq_row()
+      : removed(false) {
+  }
+
+  std::vector<float> values;
+  bool removed;
+
+  template <class Ar>
+  void serialize(Ar& ar) {
+    ar & MEMBER(values) & MEMBER(removed);
+  }
+};
+
+struct pq_diff {
+  pq_diff()
+      : trained(false) {
+  }
+
+  pfi::data::unordered_map<std::string, pq_row> rows;
+  // codebook of the server, which is empty if none
+  std::vector<float> centroids;
+  std::vector<double> centroid_weights;
+  // true if the codebook was trained since the last MIX, and false if it
+  // was given by MIX
+  bool trained;
+
+  template <class Ar>
+  void serialize(Ar& ar) {
+    ar & MEMBER(rows) & MEMBER(centroids) & MEMBER(centroid_weights)
+        & MEMBER(trained);
+  }
+};
+
+// Exact vectors of rows, which are encoded again instead of reconstructed
+// ones when the codebook is changed
+class pq_vector_source {
+ public:
+  virtual ~pq_vector_source() {
+  }
+  // Returns false if the row has no exact vector
+  virtual bool get_vector(
+      const std::string& row,
+      std::vector<float>& vec) const = 0;
+};
+
+// Dense vectors compressed by product quantization (Jegou et al., 2011).
+// Vectors are split into subspace_num subvectors, and each of them is
+// stored as the index of the nearest of centroid_num (<= 256) centroids of
+// its subspace, i.e. in subspace_num bytes. Queries are compared with the
+// centroids of each subspace once, and rows are ranked by sums of looked up
+// distances.
+// Rows are kept as they are until train_size rows are given to train the
+// codebook by k-means. Servers send their codebooks by MIX: codebooks
+// trained by several servers in the same MIX are merged by k-means of their
+// centroids, and those trained after a codebook is given by MIX are
+// replaced with it. Rows are sent as vectors and encoded by each server.
+class pq_index_storage : public recommender_storage_base {
+ public:
+  static const size_t DEFAULT_DIMENSION;
+  static const size_t DEFAULT_SUBSPACE_NUM;
+  static const size_t DEFAULT_CENTROID_NUM;
+  static const size_t DEFAULT_TRAIN_SIZE;
+
+  pq_index_storage();
+  // dimension must be a multiple of subspace_num
+  pq_index_storage(
+      size_t dimension,
+      size_t subspace_num,
+      size_t centroid_num,
+      size_t train_size,
+      uint32_t seed);
+  virtual ~pq_index_storage();
+
+  // source must outlive the storage, and may be NULL
+  void set_vector_source(const pq_vector_source* source) {
+    vector_source_ = source;
+  }
+
+  // vec has dimension() values
+  void set_row(const std::string& row, const std::vector<float>& vec);
+  // Returns reconstructed vectors of encoded rows, and false if the row
+  // does not exist
+  bool get_row(const std::string& row, std::vector<float>& vec) const;
+  void remove_row(const std::string& row);
+  void clear();
+  void get_all_row_ids(std::vector<std::string>& ids) const;
+
+  // Returns at most ret_num rows in ascending order of their approximate
+  // euclidean distances to query
+  void similar_row(
+      const std::vector<float>& query,
+      size_t ret_num,
+      std::vector<std::pair<std::string, float> >& ids) const;
+
+  size_t dimension() const {
+    return dimension_;
+  }
+  size_t size() const {
+    return rows_.size() + pending_.size();
+  }
+  bool is_trained() const {
+    return !centroids_.empty();
+  }
+  std::string name() const;
+
+  bool save(std::ostream& os);
+  bool load(std::istream& is);
+
+  virtual void get_diff(std::string& diff) const;
+  virtual void set_mixed_and_clear_diff(const std::string& mixed_diff);
+  virtual void mix(const std::string& lhs, std::string& rhs) const;
+
+ private:
+  typedef pfi::data::unordered_map<std::string, std::vector<float> >
+      pending_rows_t;
+
+  friend class pfi::data::serialization::access;
+  template <class Ar>
+  void serialize(Ar& ar) {
+    ar & MEMBER(dimension_) & MEMBER(subspace_num_) & MEMBER(centroid_num_)
+        & MEMBER(train_size_) & MEMBER(seed_) & MEMBER(centroids_)
+        & MEMBER(centroid_weights_) & MEMBER(codes_) & MEMBER(rows_)
+        & MEMBER(pending_) & MEMBER(diff_);
+    if (ar.is_read) {
+      reset_row_index();
+    }
+  }
+
+  size_t subspace_dimension() const {
+    return dimension_ / subspace_num_;
+  }
+
+  void put_row(const std::string& row, const std::vector<float>& vec);
+  void delete_row(const std::string& row);
+  void reset_row_index();
+
+  void train_if_ready();
+  void set_codebook(
+      const std::vector<float>& centroids,
+      const std::vector<double>& centroid_weights);
+  // Merges the codebook of lhs into that of rhs
+  void merge_codebooks(const pq_diff& lhs, pq_diff& rhs) const;
+  void encode_pending_rows();
+
+  void encode(const std::vector<float>& vec, uint8_t* code) const;
+  void decode(const uint8_t* code, std::vector<float>& vec) const;
+
+  size_t dimension_;
+  size_t subspace_num_;
+  size_t centroid_num_;
+  size_t train_size_;
+  uint32_t seed_;
+
+  // centroids of the subspace s are
+  // [s * centroid_num_ * subspace_dimension(), ...), and their weights are
+  // the numbers of vectors which they were trained with
+  std::vector<float> centroids_;
+  std::vector<double> centroid_weights_;
+
+  // codes of the i-th encoded row are [i * subspace_num_, ...)
+  std::vector<uint8_t> codes_;
+  std::vector<std::string> rows_;
+  pfi::data::unordered_map<std::string, uint64_t> row2index_;
+  // rows given before the codebook is trained
+  pending_rows_t pending_;
+
+  pq_diff diff_;
+  const pq_vector_source* vector_source_;
+};
+
+}  // namespace storage
+}  // namespace jubatus
+
+#endif  // JUBATUS_STORAGE_PQ_INDEX_STORAGE_HPP_
@@ -0,0 +1,323 @@
+// Jubatus: Online machine learning framework for distributed environment
+// Copyright (C) 2013 Preferred Infrastructure and Nippon Telegraph and Telephone Corporation.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License version 2.1 as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <gtest/gtest.h>
+#include <pficommon/lang/cast.h>
+#include <pficommon/math/random.h>
+#include "pq_index_storage.hpp"
+
+using std::make_pair;
+using std::pair;
+using std::string;
+using std::stringstream;
+using std::vector;
+using pfi::lang::lexical_cast;
+using pfi::math::random::mtrand;
+
+namespace jubatus {
+namespace storage {
+
+namespace {
+
+// vectors around one of 4 centers
+vector<float> make_vector(mtrand& rand, size_t center) {
+  vector<float> v(8);
+  for (size_t i = 0; i < v.size(); ++i) {
+    v[i] = (i % 4 == center ? 10 : 0) + rand.next_double();
+  }
+  return v;
+}
+
+vector<string> similar_row_ids(
+    const pq_index_storage& s,
+    const vector<float>& query,
+    size_t ret_num) {
+  vector<pair<string, float> > res;
+  s.similar_row(query, ret_num, res);
+  vector<string> ids;
+  for (size_t i = 0; i < res.size(); ++i) {
+    ids.push_back(res[i].first);
+  }
+  return ids;
+}
+
+void add_rows(
+    pq_index_storage& s,
+    const string& prefix,
+    size_t num,
+    uint32_t seed) {
+  mtrand rand(seed);
+  for (size_t i = 0; i < num; ++i) {
+    s.set_row(prefix + lexical_cast<string>(i), make_vector(rand, i % 4));
+  }
+}
+
+// exact vectors of rows added by add_rows
+class vector_map : public pq_vector_source {
+ public:
+  void add_rows(
+      pq_index_storage& s,
+      const string& prefix,
+      size_t num,
+      uint32_t seed) {
+    mtrand rand(seed);
+    for (size_t i = 0; i < num; ++i) {
+      const string row = prefix + lexical_cast<string>(i);
+      vecs_.push_back(make_pair(row, make_vector(rand, i % 4)));
+      s.set_row(row, vecs_.back().second);
+    }
+  }
+
+  bool get_vector(const string& row, vector<float>& vec) const {
+    for (size_t i = 0; i < vecs_.size(); ++i) {
+      if (vecs_[i].first == row) {
+        vec = vecs_[i].second;
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  vector<pair<string, vector<float> > > vecs_;
+};
+
+}  // namespace
+
+TEST(pq_index_storage, name) {
+  pq_index_storage s;
+  EXPECT_EQ("pq_index_storage", s.name());
+}
+
+TEST(pq_index_storage, exact_before_training) {
+  pq_index_storage s(8, 4, 16, 100, 1);
+  vector<float> v1(8, 0), v2(8, 0);
+  v2[0] = 3;
+  v2[1] = 4;
+  s.set_row("r1", v1);
+  s.set_row("r2", v2);
+  EXPECT_FALSE(s.is_trained());
+
+  vector<pair<string, float> > res;
+  s.similar_row(v1, 2, res);
+  ASSERT_EQ(2u, res.size());
+  EXPECT_EQ("r1", res[0].first);
+  EXPECT_FLOAT_EQ(0.f, res[0].second);
+  EXPECT_EQ("r2", res[1].first);
+  EXPECT_FLOAT_EQ(5.f, res[1].second);
+
+  vector<float> v;
+  EXPECT_TRUE(s.get_row("r2", v));
+  EXPECT_TRUE(v2 == v);
+}
+
+TEST(pq_index_storage, train_and_search) {
+  pq_index_storage s(8, 4, 16, 100, 1);
+  add_rows(s, "r", 99, 0);
+  EXPECT_FALSE(s.is_trained());
+  add_rows(s, "s", 1, 0);
+  EXPECT_TRUE(s.is_trained());
+  EXPECT_EQ(100u, s.size());
+
+  // rows around the same center are found
+  mtrand rand(1);
+  for (size_t c = 0; c < 4; ++c) {
+    vector<pair<string, float> > res;
+    s.similar_row(make_vector(rand, c), 10, res);
+    ASSERT_EQ(10u, res.size());
+    for (size_t i = 0; i < res.size(); ++i) {
+      if (res[i].first[0] == 'r') {
+        EXPECT_EQ(c, lexical_cast<size_t>(res[i].first.substr(1)) % 4);
+      }
+      EXPECT_GT(3.f, res[i].second);
+    }
+    for (size_t i = 1; i < res.size(); ++i) {
+      EXPECT_LE(res[i - 1].second, res[i].second);
+    }
+  }
+
+  // reconstructed vectors are close to the original ones
+  vector<float> v;
+  EXPECT_TRUE(s.get_row("r1", v));
+  ASSERT_EQ(8u, v.size());
+  EXPECT_NEAR(10, v[1], 1);
+  EXPECT_NEAR(0, v[2], 1);
+}
+
+TEST(pq_index_storage, remove_and_update_row) {
+  pq_index_storage s(8, 4, 16, 10, 1);
+  add_rows(s, "r", 20, 0);
+  s.remove_row("r3");
+  s.remove_row("unknown");
+  EXPECT_EQ(19u, s.size());
+  vector<string> ids;
+  s.get_all_row_ids(ids);
+  EXPECT_EQ(19u, ids.size());
+  EXPECT_TRUE(std::find(ids.begin(), ids.end(), "r3") == ids.end());
+
+  // the last row moved to the removed slot is still found
+  vector<float> v;
+  EXPECT_TRUE(s.get_row("r19", v));
+  EXPECT_EQ("r19", similar_row_ids(s, v, 1)[0]);
+
+  vector<float> w(8, 100);
+  s.set_row("r0", w);
+  EXPECT_EQ("r0", similar_row_ids(s, w, 1)[0]);
+  EXPECT_EQ(19u, s.size());
+
+  s.clear();
+  EXPECT_EQ(0u, s.size());
+  EXPECT_FALSE(s.is_trained());
+}
+
+TEST(pq_index_storage, mix_codebook) {
+  pq_index_storage s1(8, 4, 16, 50, 1), s2(8, 4, 16, 50, 1);
+  pq_index_storage s3(8, 4, 16, 50, 1);
+  add_rows(s1, "a", 60, 0);
+  add_rows(s2, "b", 60, 1);
+  add_rows(s3, "c", 10, 2);
+  EXPECT_TRUE(s1.is_trained());
+  EXPECT_TRUE(s2.is_trained());
+  EXPECT_FALSE(s3.is_trained());
+
+  string d1, d2, d3;
+  s1.get_diff(d1);
+  s2.get_diff(d2);
+  s3.get_diff(d3);
+  s1.mix(d1, d2);
+  s1.mix(d2, d3);
+  s1.set_mixed_and_clear_diff(d3);
+  s2.set_mixed_and_clear_diff(d3);
+  s3.set_mixed_and_clear_diff(d3);
+
+  // all servers have the same rows encoded by the merged codebook
+  mtrand rand(3);
+  vector<float> query = make_vector(rand, 2);
+  pq_index_storage* ss[] = {&s1, &s2, &s3};
+  vector<pair<string, float> > expected;
+  s1.similar_row(query, 130, expected);
+  EXPECT_EQ(130u, expected.size());
+  for (size_t i = 0; i < 3; ++i) {
+    EXPECT_TRUE(ss[i]->is_trained());
+    EXPECT_EQ(130u, ss[i]->size());
+    vector<pair<string, float> > res;
+    ss[i]->similar_row(query, 130, res);
+    ASSERT_EQ(expected.size(), res.size());
+    for (size_t j = 0; j < res.size(); ++j) {
+      EXPECT_FLOAT_EQ(expected[j].second, res[j].second);
+    }
+  }
+}
+
+TEST(pq_index_storage, late_codebook) {
+  pq_index_storage s1(8, 4, 16, 50, 1), s2(8, 4, 16, 50, 1);
+  add_rows(s1, "a", 60, 0);
+  add_rows(s2, "b", 10, 1);
+  string d1, d2;
+  s1.get_diff(d1);
+  s2.get_diff(d2);
+  s1.mix(d1, d2);
+  s1.set_mixed_and_clear_diff(d2);
+  s2.set_mixed_and_clear_diff(d2);
+  EXPECT_TRUE(s2.is_trained());
+
+  // a server which trains its codebook later gets the mixed one
+  pq_index_storage s3(8, 4, 16, 50, 1);
+  add_rows(s3, "c", 60, 2);
+  EXPECT_TRUE(s3.is_trained());
+  vector<float> before;
+  s1.get_row("a1", before);
+
+  string d3;
+  s1.get_diff(d1);
+  s2.get_diff(d2);
+  s3.get_diff(d3);
+  s1.mix(d3, d1);
+  s1.mix(d1, d2);
+  s1.set_mixed_and_clear_diff(d2);
+  s2.set_mixed_and_clear_diff(d2);
+  s3.set_mixed_and_clear_diff(d2);
+
+  vector<float> v;
+  s1.get_row("a1", v);
+  EXPECT_TRUE(before == v);
+  s2.get_row("a1", v);
+  EXPECT_TRUE(before == v);
+  vector<float> c1;
+  s1.get_row("c1", c1);
+  s3.get_row("c1", v);
+  EXPECT_TRUE(c1 == v);
+  EXPECT_EQ(130u, s1.size());
+  EXPECT_EQ(60u, s3.size());
+}
+
+TEST(pq_index_storage, encode_exact_vectors) {
+  // s1 encodes rows again by the codebook of s2
+  pq_index_storage s1(8, 4, 16, 50, 1), s2(8, 4, 16, 50, 1);
+  vector_map exact;
+  s1.set_vector_source(&exact);
+  exact.add_rows(s1, "a", 60, 0);
+  add_rows(s2, "b", 60, 1);
+  string d2;
+  s2.get_diff(d2);
+  s1.set_mixed_and_clear_diff(d2);
+
+  // s3 encodes rows by the codebook of s2 at first
+  pq_index_storage s3(8, 4, 16, 1000, 1);
+  s3.set_mixed_and_clear_diff(d2);
+  EXPECT_TRUE(s3.is_trained());
+  add_rows(s3, "a", 60, 0);
+
+  for (size_t i = 0; i < 60; ++i) {
+    const string row = "a" + lexical_cast<string>(i);
+    vector<float> v1, v3;
+    s1.get_row(row, v1);
+    s3.get_row(row, v3);
+    EXPECT_TRUE(v1 == v3);
+  }
+}
+
+TEST(pq_index_storage, save_and_load) {
+  pq_index_storage s(8, 4, 16, 50, 1);
+  add_rows(s, "r", 60, 0);
+  s.remove_row("r0");
+
+  stringstream ss;
+  s.save(ss);
+  pq_index_storage s2;
+  s2.load(ss);
+  EXPECT_EQ(8u, s2.dimension());
+  EXPECT_EQ(59u, s2.size());
+
+  mtrand rand(1);
+  vector<float> query = make_vector(rand, 1);
+  vector<pair<string, float> > res1, res2;
+  s.similar_row(query, 10, res1);
+  s2.similar_row(query, 10, res2);
+  EXPECT_TRUE(res1 == res2);
+
+  s2.set_row("x", query);
+  EXPECT_EQ("x", similar_row_ids(s2, query, 1)[0]);
+}
+
+}  // namespace storage
+}  // namespace jubatus
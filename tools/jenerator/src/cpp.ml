@@ -416,6 +416,20 @@ let gen_keeper_register m ret_type =
     let call = gen_call func [method_name_str; gen_aggregator_function ret_type agg] in
     [ (0, call) ]
 
+  | Cht_batch ->
+    (* the first argument is a list of ids and the result is a list of
+       results for each of them *)
+    let elem_type = match ret_type with
+      | List t -> t
+      | _ ->
+        let msg = Printf.sprintf
+          "cht_batch method must return list: %s" m.method_name in
+        raise (Invalid_argument msg) in
+    let args = List.tl arg_types in
+    let func = gen_template "k.register_cht_batch" (elem_type::args) in
+    let call = gen_call func [method_name_str] in
+    [ (0, call) ]
+
   | Broadcast ->
     let func = gen_template "k.register_async_broadcast" (ret_type::arg_types) in
     let call = gen_call func [method_name_str; gen_aggregator_function ret_type agg] in
@@ -530,7 +544,7 @@ let gen_impl_method m =
 let is_cht_method m =
   let routing, _, _ = get_decorator m in
   match routing with
-  | Cht _ -> true
+  | Cht _ | Cht_batch -> true
   | _ -> false
 ;;
 
@@ -37,7 +37,7 @@ type field_type = {
   field_name: string;
 };;
 
-type routing_type = | Random | Cht of int | Broadcast | Internal;;
+type routing_type = | Random | Cht of int | Cht_batch | Broadcast | Internal;;
 
 type reqtype = | Update | Analysis | Nolock;;
 
@@ -113,6 +113,7 @@ let make_decorator = function
   | "#@broadcast" -> Routing(Broadcast)
   | "#@internal"  -> Routing(Internal)
   | "#@cht"       -> Routing(Cht(2))
+  | "#@cht_batch" -> Routing(Cht_batch)
 
   | "#@all_and"   -> Aggtype(All_and)
   | "#@all_or"    -> Aggtype(All_or)
@@ -134,6 +135,7 @@ let make_decorator_with_int d i =
 let routing_to_string = function
   | Random -> "random";
   | Cht(i) -> "cht(" ^ string_of_int i ^ ")";
+  | Cht_batch -> "cht_batch";
   | Broadcast -> "broadcast";
   | Internal -> ""
 ;;
@@ -29,7 +29,7 @@ type decl_type = Void | Object | Bool
 
 type field_type = Field of int * decl_type * string * string list
 
-type routing_type = Random | Cht of int | Broadcast | Internal
+type routing_type = Random | Cht of int | Cht_batch | Broadcast | Internal
 type reqtype = Update | Analysis | Nolock
 
 (* known_aggregators =
@@ -72,6 +72,7 @@ let make_decorator = function
   | "#@broadcast" -> Routing(Broadcast);
   | "#@internal"  -> Routing(Internal);
   | "#@cht"       -> Routing(Cht(2));
+  | "#@cht_batch" -> Routing(Cht_batch);
 
   | "#@all_and"   -> Aggtype(All_and);
   | "#@all_or"   -> Aggtype(All_or);
@@ -90,6 +91,7 @@ let make_decorator_with_int d i =
 let routing_to_string = function
   | Random -> "random";
   | Cht(i) -> "cht("^(string_of_int i)^")";
+  | Cht_batch -> "cht_batch";
   | Broadcast -> "broadcast";
   | Internal -> "";;
 